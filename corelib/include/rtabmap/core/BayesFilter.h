@@ -67,6 +67,8 @@ private:
 			const std::vector<int> & oldIds,
 			const std::vector<int> & newIds);
 	void updatePosterior(const Memory * memory, const std::vector<int> & likelihoodIds);
+	void updateNeighborsIndex(const Memory * memory, const std::vector<int> & ids);
+	cv::Mat computeSparsePrior(const Memory * memory, const std::vector<int> & ids, const cv::Mat & posterior);
 	void normalize(cv::Mat & prediction, unsigned int index, float addedProbabilitiesSum, bool virtualPlaceUsed) const;
 
 private:
@@ -75,6 +77,7 @@ private:
 	float _virtualPlacePrior;
 	std::vector<double> _predictionLC; // {Vp, Lc, l1, l2, l3, l4...}
 	bool _fullPredictionUpdate;
+	bool _sparsePrediction;
 	float _totalPredictionLCValues;
 	std::map<int, std::map<int, int> > _neighborsIndex;
 };
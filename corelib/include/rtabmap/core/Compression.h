@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
 
 #include <rtabmap/utilite/UThread.h>
+#include <rtabmap/utilite/USemaphore.h>
 #include <opencv2/opencv.hpp>
 
 namespace rtabmap {
@@ -55,7 +56,7 @@ namespace rtabmap {
 class RTABMAP_EXP CompressionThread : public UThread
 {
 public:
-	// format : ".png" ".jpg" "" (empty is general)
+	// format : ".png" ".jpg" ".rvl" (16UC1 depth only) "" (empty is general)
 	CompressionThread(const cv::Mat & mat, const std::string & format = "");
 	CompressionThread(const cv::Mat & bytes, bool isImage);
 	const cv::Mat & getCompressedData() const {return compressedData_;}
@@ -70,6 +71,49 @@ private:
 	bool compressMode_;
 };
 
+/**
+ * Same as CompressionThread, but the job is executed by a
+ * persistent pool of worker threads shared by all jobs instead
+ * of creating a new thread for each compression. start() queues
+ * the job, join() waits until it is done. The job is joined
+ * on destruction if it is still queued or running.
+ *
+ * Example compression:
+ *   cv::Mat image;// an image
+ *   CompressionJob job(image, ".jpg");
+ *   job.start();
+ *   job.join();
+ *   cv::Mat bytes = job.getCompressedData();
+ */
+class RTABMAP_EXP CompressionJob
+{
+public:
+	// format : ".png" ".jpg" ".rvl" (16UC1 depth only) "" (empty is general)
+	CompressionJob(const cv::Mat & mat, const std::string & format = "");
+	CompressionJob(const cv::Mat & bytes, bool isImage);
+	~CompressionJob();
+	void start();
+	void join();
+	bool isStarted() const {return started_;}
+	const cv::Mat & getCompressedData() const {return compressedData_;}
+	cv::Mat & getUncompressedData() {return uncompressedData_;}
+
+private:
+	friend class CompressionWorker;
+	void process();
+
+private:
+	cv::Mat compressedData_;
+	cv::Mat uncompressedData_;
+	std::string format_;
+	bool image_;
+	bool compressMode_;
+	bool started_;
+	USemaphore done_;
+};
+
+// format : ".png", ".jpg" or ".rvl" (lossless, 16UC1 depth images only).
+// uncompressImage() detects the format automatically.
 std::vector<unsigned char> RTABMAP_EXP compressImage(const cv::Mat & image, const std::string & format = ".png");
 cv::Mat RTABMAP_EXP compressImage2(const cv::Mat & image, const std::string & format = ".png");
 
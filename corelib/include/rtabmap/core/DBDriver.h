@@ -49,6 +49,7 @@ namespace rtabmap {
 class Signature;
 class VWDictionary;
 class VisualWord;
+class DBDriverPrefetchThread;
 
 // Todo This class needs a refactoring, the _dbSafeAccessMutex problem when the trash is emptying (transaction)
 // "Of course, it has always been the case and probably always will be
@@ -77,6 +78,10 @@ public:
 	void asyncSave(Signature * s); //ownership transferred
 	void asyncSave(VisualWord * vw); //ownership transferred
 	void emptyTrashes(bool async = false);
+	// Load in background the signatures that will likely be requested by the next loadSignatures() call.
+	// Previously prefetched signatures not in ids are released. Ignored if a prefetch is still running.
+	void prefetchSignatures(const std::list<int> & ids);
+	int getPrefetchedSignaturesSize() const;
 	double getEmptyTrashesTime() const {return _emptyTrashesTime;}
 	void setTimestampUpdateEnabled(bool enabled) {_timestampUpdate = enabled;} // used on Update Signature and Word queries
 
@@ -106,6 +111,8 @@ public:
 	std::map<int, Transform> loadOptimizedPoses(Transform * lastlocalizationPose) const;
 	void save2DMap(const cv::Mat & map, float xMin, float yMin, float cellSize) const;
 	cv::Mat load2DMap(float & xMin, float & yMin, float & cellSize) const;
+	void saveDictionaryIndex(const cv::Mat & index) const;
+	cv::Mat loadDictionaryIndex() const;
 	void saveOptimizedMesh(
 			const cv::Mat & cloud,
 			const std::vector<std::vector<std::vector<unsigned int> > > & polygons = std::vector<std::vector<std::vector<unsigned int> > >(),      // Textures -> polygons -> vertices
@@ -235,6 +242,8 @@ protected:
 	virtual std::map<int, Transform> loadOptimizedPosesQuery(Transform * lastlocalizationPose) const = 0;
 	virtual void save2DMapQuery(const cv::Mat & map, float xMin, float yMin, float cellSize) const = 0;
 	virtual cv::Mat load2DMapQuery(float & xMin, float & yMin, float & cellSize) const = 0;
+	virtual void saveDictionaryIndexQuery(const cv::Mat & index) const = 0;
+	virtual cv::Mat loadDictionaryIndexQuery() const = 0;
 	virtual void saveOptimizedMeshQuery(
 				const cv::Mat & cloud,
 				const std::vector<std::vector<std::vector<unsigned int> > > & polygons,
@@ -271,6 +280,12 @@ protected:
 	virtual void getNodeIdByLabelQuery(const std::string & label, int & id) const = 0;
 	virtual void getAllLabelsQuery(std::map<int, std::string> & labels) const = 0;
 
+	// Optional driver opened read-only on the same database, used to load data
+	// without waiting for the trash to be emptied (0 if not available).
+	// The reader must be used, created and deleted only while _readerMutex is locked.
+	virtual const DBDriver * getReaderQuery() const {return 0;}
+	UMutex _readerMutex;
+
 private:
 	//non-abstract methods
 	void saveOrUpdate(const std::vector<Signature *> & signatures);
@@ -279,16 +294,28 @@ private:
 	//thread stuff
 	virtual void mainLoop();
 
+	void prefetch(const std::list<int> & ids); // called from the prefetch thread
+	void invalidatePrefetched(int id);
+	void clearPrefetched();
+	friend class DBDriverPrefetchThread;
+
 private:
 	UMutex _transactionMutex;
 	std::map<int, Signature *> _trashSignatures;//<id, Signature*>
 	std::map<int, VisualWord *> _trashVisualWords; //<id, VisualWord*>
+	std::multiset<int> _emptyingSignatures; // ids being saved by emptyTrashes()
+	std::multiset<int> _emptyingVisualWords;
 	UMutex _trashesMutex;
 	UMutex _dbSafeAccessMutex;
 	USemaphore _addSem;
 	double _emptyTrashesTime;
 	std::string _url;
 	bool _timestampUpdate;
+
+	DBDriverPrefetchThread * _prefetchThread;
+	std::map<int, Signature *> _prefetchedSignatures;
+	std::set<int> _prefetchInvalidated; // ids modified since the prefetch started
+	UMutex _prefetchMutex;
 };
 
 }
@@ -49,6 +49,7 @@ public:
 	void setCacheSize(unsigned int cacheSize);
 	void setSynchronous(int synchronous);
 	void setTempStore(int tempStore);
+	void setCacheStatements(bool cacheStatements);
 
 protected:
 	virtual bool connectDatabaseQuery(const std::string & url, bool overwritten = false);
@@ -107,6 +108,8 @@ protected:
 	virtual std::map<int, Transform> loadOptimizedPosesQuery(Transform * lastlocalizationPose) const;
 	virtual void save2DMapQuery(const cv::Mat & map, float xMin, float yMin, float cellSize) const;
 	virtual cv::Mat load2DMapQuery(float & xMin, float & yMin, float & cellSize) const;
+	virtual void saveDictionaryIndexQuery(const cv::Mat & index) const;
+	virtual cv::Mat loadDictionaryIndexQuery() const;
 	virtual void saveOptimizedMeshQuery(
 			const cv::Mat & cloud,
 			const std::vector<std::vector<std::vector<unsigned int> > > & polygons,
@@ -143,6 +146,8 @@ protected:
 	virtual void getNodeIdByLabelQuery(const std::string & label, int & id) const;
 	virtual void getAllLabelsQuery(std::map<int, std::string> & labels) const;
 
+	virtual const DBDriver * getReaderQuery() const {return _reader;}
+
 private:
 	std::string queryStepNode() const;
 	std::string queryStepImage() const;
@@ -152,7 +157,7 @@ private:
 	std::string queryStepLinkUpdate() const;
 	std::string queryStepLink() const;
 	std::string queryStepWordsChanged() const;
-	std::string queryStepKeypoint() const;
+	std::string queryStepKeypoint(int rows = 1) const;
 	std::string queryStepOccupancyGridUpdate() const;
 	void stepNode(sqlite3_stmt * ppStmt, const Signature * s) const;
 	void stepImage(
@@ -165,6 +170,7 @@ private:
 	void stepLink(sqlite3_stmt * ppStmt, const Link & link) const;
 	void stepWordsChanged(sqlite3_stmt * ppStmt, int signatureId, int oldWordId, int newWordId) const;
 	void stepKeypoint(sqlite3_stmt * ppStmt, int signatureId, int wordId, const cv::KeyPoint & kp, const cv::Point3f & pt, const cv::Mat & descriptor) const;
+	int bindKeypoint(sqlite3_stmt * ppStmt, int index, int signatureId, int wordId, const cv::KeyPoint & kp, const cv::Point3f & pt, const cv::Mat & descriptor) const;
 	void stepOccupancyGridUpdate(sqlite3_stmt * ppStmt,
 			int nodeId,
 			const cv::Mat & ground,
@@ -173,9 +179,14 @@ private:
 			float cellSize,
 			const cv::Point3f & viewpoint) const;
 
+	sqlite3_stmt * prepareStatement(const std::string & query) const;
+	void releaseStatement(sqlite3_stmt * ppStmt) const;
+
 private:
 	void loadLinksQuery(std::list<Signature *> & signatures) const;
 	int loadOrSaveDb(sqlite3 *pInMemory, const std::string & fileName, int isSave) const;
+	void connectReader();
+	void disconnectReader();
 
 protected:
 	sqlite3 * _ppDb;
@@ -188,6 +199,9 @@ private:
 	int _journalMode;
 	int _synchronous;
 	int _tempStore;
+	bool _cacheStatements;
+	mutable std::map<std::string, sqlite3_stmt *> _cachedStatements;
+	DBDriverSqlite3 * _reader; // read-only connection (WAL journal mode)
 };
 
 }
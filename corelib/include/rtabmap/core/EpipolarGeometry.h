@@ -107,6 +107,15 @@ public:
 			std::list<std::pair<int, std::pair<cv::KeyPoint, cv::KeyPoint> > > & pairs,
 			bool ignoreNegativeIds = true);
 
+	/**
+	 * Same count than findPairs() without creating the pairs, ids must be sorted.
+	 * if a=[1 2 3 4 6 6], b=[1 1 2 4 5 6 6], realPairsCount = 5
+	 */
+	static int countPairs(
+			const std::vector<int> & wordIdsA,
+			const std::vector<int> & wordIdsB,
+			bool ignoreNegativeIds = true);
+
 	/**
 	 * if a=[1 2 3 4 6 6], b=[1 1 2 4 5 6 6], results= [(2,2) (4,4)]
 	 * realPairsCount = 5
@@ -164,6 +164,15 @@ public:
 protected:
 	Feature2D(const ParametersMap & parameters = ParametersMap());
 
+	// If generateKeypointsImpl() can be called from multiple
+	// threads at the same time (see Kp/Threads).
+	virtual bool isKeypointsThreadSafe() const {return false;}
+	// Rows around a keypoint used to compute its descriptor (descriptor
+	// support and image border filtering of the extractor). If >= 0,
+	// generateDescriptorsImpl() can be called on horizontal bands of the
+	// image from multiple threads at the same time (see Kp/Threads).
+	virtual int getDescriptorsMargin() const {return -1;}
+
 private:
 	virtual std::vector<cv::KeyPoint> generateKeypointsImpl(const cv::Mat & image, const cv::Rect & roi, const cv::Mat & mask = cv::Mat()) const = 0;
 	virtual cv::Mat generateDescriptorsImpl(const cv::Mat & image, std::vector<cv::KeyPoint> & keypoints) const = 0;
@@ -179,6 +188,7 @@ private:
 	double _subPixEps;
 	int gridRows_;
 	int gridCols_;
+	int threads_;
 	// Stereo stuff
 	Stereo * _stereo;
 };
@@ -246,6 +256,8 @@ public:
 private:
 	virtual std::vector<cv::KeyPoint> generateKeypointsImpl(const cv::Mat & image, const cv::Rect & roi, const cv::Mat & mask = cv::Mat()) const;
 	virtual cv::Mat generateDescriptorsImpl(const cv::Mat & image, std::vector<cv::KeyPoint> & keypoints) const;
+	virtual bool isKeypointsThreadSafe() const {return !gpu_;}
+	virtual int getDescriptorsMargin() const;
 
 private:
 	float scaleFactor_;
@@ -277,6 +289,7 @@ public:
 private:
 	virtual std::vector<cv::KeyPoint> generateKeypointsImpl(const cv::Mat & image, const cv::Rect & roi, const cv::Mat & mask = cv::Mat()) const;
 	virtual cv::Mat generateDescriptorsImpl(const cv::Mat & image, std::vector<cv::KeyPoint> & keypoints) const {return cv::Mat();}
+	virtual bool isKeypointsThreadSafe() const {return !gpu_;}
 
 private:
 	int threshold_;
@@ -304,6 +317,7 @@ public:
 
 private:
 	virtual cv::Mat generateDescriptorsImpl(const cv::Mat & image, std::vector<cv::KeyPoint> & keypoints) const;
+	virtual int getDescriptorsMargin() const {return 28;} // PATCH_SIZE/2 + KERNEL_SIZE/2 of OpenCV's BRIEF
 
 private:
 	int bytes_;
@@ -344,6 +358,7 @@ public:
 
 private:
 	virtual std::vector<cv::KeyPoint> generateKeypointsImpl(const cv::Mat & image, const cv::Rect & roi, const cv::Mat & mask = cv::Mat()) const;
+	virtual bool isKeypointsThreadSafe() const {return true;}
 
 private:
 	double _qualityLevel;
@@ -367,6 +382,7 @@ public:
 
 private:
 	virtual cv::Mat generateDescriptorsImpl(const cv::Mat & image, std::vector<cv::KeyPoint> & keypoints) const;
+	virtual int getDescriptorsMargin() const {return 28;} // PATCH_SIZE/2 + KERNEL_SIZE/2 of OpenCV's BRIEF
 
 private:
 	int bytes_;
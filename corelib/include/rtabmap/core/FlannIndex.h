@@ -71,6 +71,18 @@ public:
 
 	bool isBuilt();
 
+	// Set before building the index: the features are saved
+	// with the index only if it is built to be serialized.
+	void setSerializable(bool enabled) {serializable_ = enabled;}
+	bool isSerializable() const {return serializable_;}
+
+	// Serialize the index with its data, so that it can be
+	// restored without the original features. Return an empty
+	// matrix if the index was not built to be serialized.
+	cv::Mat serialize() const;
+	// return false if the index cannot be restored (the index is released)
+	bool deserialize(const cv::Mat & data);
+
 	int featuresType() const {return featuresType_;}
 	int featuresDim() const {return featuresDim_;}
 
@@ -100,6 +112,8 @@ public:
 			bool sorted = true) const;
 
 private:
+	static const int kSerializationVersion = 1;
+
 	void * index_;
 	unsigned int nextIndex_;
 	int featuresType_;
@@ -107,6 +121,8 @@ private:
 	bool isLSH_;
 	bool useDistanceL1_; // true=EUCLEDIAN_L2 false=MANHATTAN_L1
 	float rebalancingFactor_;
+	bool serializable_;
+	bool datasetSaved_; // the index has been built to be serialized
 
 	// keep feature in memory until the tree is rebuilt
 	// (in case the word is deleted when removed from the VWDictionary)
@@ -0,0 +1,79 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CORELIB_SRC_HAMMINGMATCHER_H_
+#define CORELIB_SRC_HAMMINGMATCHER_H_
+
+#include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+#include <string>
+#include <vector>
+
+namespace rtabmap {
+
+/**
+ * Brute force k-nearest neighbors search for binary descriptors (ORB, BRIEF,
+ * FREAK, BRISK...). The Hamming distance kernel is selected at runtime
+ * depending on the CPU: AVX-512 VPOPCNTDQ, AVX2 or SSSE3 nibble lookup,
+ * hardware popcnt or a portable version. The search is done by blocks of train
+ * descriptors so that they stay in cache for all queries, and a distance
+ * computation is stopped as soon as it cannot be in the k best anymore.
+ */
+class RTABMAP_EXP HammingMatcher
+{
+public:
+	enum Implementation {
+		kScalar,
+		kPopcnt,
+		kSSSE3,
+		kAVX2,
+		kAVX512};
+
+public:
+	// Implementation used on this CPU
+	static Implementation implementation();
+	static std::string implementationName();
+
+	static int distance(const unsigned char * a, const unsigned char * b, int bytes);
+
+	/**
+	 * Same results than cv::BFMatcher(cv::NORM_HAMMING).knnMatch(query, train, matches, k):
+	 * for each query, up to k matches sorted by distance (ties sorted by train index).
+	 * @param query CV_8UC1 descriptors
+	 * @param train CV_8UC1 descriptors, same number of columns than query
+	 */
+	static void knnMatch(
+			const cv::Mat & query,
+			const cv::Mat & train,
+			std::vector<std::vector<cv::DMatch> > & matches,
+			int k);
+};
+
+} /* namespace rtabmap */
+
+#endif /* CORELIB_SRC_HAMMINGMATCHER_H_ */
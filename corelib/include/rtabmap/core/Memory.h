@@ -90,6 +90,7 @@ public:
 
 	std::list<int> forget(const std::set<int> & ignoredIds = std::set<int>());
 	std::set<int> reactivateSignatures(const std::list<int> & ids, unsigned int maxLoaded, double & timeDbAccess);
+	void prefetchSignatures(const std::list<int> & ids);
 
 	int cleanup();
 	void saveStatistics(const Statistics & statistics);
@@ -263,6 +264,9 @@ private:
 	void cleanUnusedWords();
 	int getNi(int signatureId) const;
 
+private:
+	std::vector<float> computeLikelihoodValues(const Signature * signature, const std::vector<int> & ids) const;
+
 protected:
 	DBDriver * _dbDriver;
 
@@ -273,6 +277,8 @@ private:
 	bool _binDataKept;
 	bool _rawDescriptorsKept;
 	bool _saveDepth16Format;
+	std::string _depthCompressionFormat;
+	bool _saveDictionaryIndex;
 	bool _notLinkedNodesKeptInDb;
 	bool _saveIntermediateNodeData;
 	bool _incrementalMemory;
@@ -303,6 +309,7 @@ private:
 	int _visCorType;
 	bool _imagesAlreadyRectified;
 	bool _covOffDiagonalIgnored;
+	int _likelihoodThreads;
 
 	int _idCount;
 	int _idMapCount;
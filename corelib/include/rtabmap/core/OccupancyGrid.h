@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl/pcl_base.h>
 #include <rtabmap/core/Parameters.h>
 #include <rtabmap/core/Signature.h>
+#include <set>
 
 namespace rtabmap {
 
@@ -61,6 +62,7 @@ public:
 	bool isGridFromDepth() const {return occupancyFromDepth_;}
 	bool isFullUpdate() const {return fullUpdate_;}
 	float getUpdateError() const {return updateError_;}
+	int getTileSize() const {return tileSize_;}
 	bool isMapFrameProjection() const {return projMapFrame_;}
 	const std::map<int, Transform> & addedNodes() const {return addedNodes_;}
 	int cacheSize() const {return (int)cache_.size();}
@@ -104,6 +106,43 @@ public:
 	const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & getMapObstacles() const {return assembledObstacles_;}
 	const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & getMapEmptyCells() const {return assembledEmptyCells_;}
 
+private:
+	// The global map is divided in square tiles of tileSize_ x tileSize_ cells,
+	// indexed by absolute cell coordinates (cell (0,0) starts at the map origin).
+	struct Tile
+	{
+		cv::Mat map;         // CV_8SC1: -1=unknown, 0=empty, 100=occupied (-2=footprint while updating)
+		cv::Mat info;        // CV_32FC4: <node id, x, y, log-odds>
+		std::set<int> nodes; // nodes having set cells in this tile
+	};
+
+	cv::Point2i cellIndex(float x, float y) const;
+	std::pair<int, int> tileKey(const cv::Point2i & cell) const;
+	Tile & getTile(const std::pair<int, int> & key, std::set<std::pair<int, int> > & updatedTiles);
+	bool getCell(int x, int y, char *& value, float *& info);
+	void addNodeToTile(int nodeId, Tile & tile, const std::pair<int, int> & key);
+	void growBounds(const cv::Point2i & cell);
+	void addLocalMapTiles(const cv::Mat & cells, std::set<std::pair<int, int> > & tiles) const;
+	void localMapsFromCache(
+			int nodeId,
+			const Transform & pose,
+			std::map<int, cv::Mat> & emptyLocalMaps,
+			std::map<int, cv::Mat> & occupiedLocalMaps) const;
+	void extractCells(
+			const std::set<std::pair<int, int> > & tiles,
+			const std::map<int, Transform> & nodes,
+			std::map<int, cv::Mat> & emptyLocalMaps,
+			std::map<int, cv::Mat> & occupiedLocalMaps) const;
+	void addLocalMap(
+			int nodeId,
+			const Transform & pose,
+			const cv::Mat & emptyCells,
+			const cv::Mat & occupiedCells,
+			bool incrementalGraphUpdate,
+			const std::set<std::pair<int, int> > * tilesFilter,
+			std::set<std::pair<int, int> > & updatedTiles);
+	cv::Mat assembleTiles(float & xMin, float & yMin, int format) const;
+
 private:
 	ParametersMap parameters_;
 	int cloudDecimation_;
@@ -143,13 +182,15 @@ private:
 	float probMiss_;
 	float probClampingMin_;
 	float probClampingMax_;
+	int tileSize_;
 
 	std::map<int, std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> > cache_; //<node id, < <ground, obstacles>, empty> >
-	cv::Mat map_;
-	cv::Mat mapInfo_;
-	std::map<int, std::pair<int, int> > cellCount_; //<node Id, cells>
-	float xMin_;
-	float yMin_;
+	std::map<std::pair<int, int>, Tile> tiles_;
+	std::map<int, std::set<std::pair<int, int> > > nodeTiles_; //<node Id, tiles>
+	cv::Point2i cellMin_; // bounds of the set cells and poses (absolute cell coordinates)
+	cv::Point2i cellMax_;
+	Tile * lastTile_;
+	std::pair<int, int> lastTileKey_;
 	std::map<int, Transform> addedNodes_;
 
 	bool cloudAssembling_;
@@ -223,10 +223,10 @@ private:
 	std::map<int, cv::Point3f> cacheViewPoints_;
 	RtabmapColorOcTree * octree_;
 	std::map<int, Transform> addedNodes_;
-	octomap::KeyRay keyRay_;
 	bool hasColor_;
 	bool fullUpdate_;
 	float updateError_;
+	bool updateMovedOnly_;
 	float rangeMax_;
 	bool rayTracing_;
 	double minValues_[3];
@@ -39,6 +39,8 @@ namespace rtabmap {
 class Signature;
 class Registration;
 class Optimizer;
+class VoxelHashMap;
+class VWDictionary;
 
 class RTABMAP_EXP OdometryF2M : public Odometry
 {
@@ -65,14 +67,18 @@ private:
 	int scanMaximumMapSize_;
 	float scanSubtractRadius_;
 	float scanSubtractAngle_;
+	float scanMapVoxelSize_;
+	float scanMapRange_;
 	int bundleAdjustment_;
 	int bundleMaxFrames_;
 
 	Registration * regPipeline_;
 	Signature * map_;
+	VWDictionary * mapDictionary_; // words of the local map, for visual registration
 	Signature * lastFrame_;
 	int lastFrameOldestNewId_;
 	std::vector<std::pair<pcl::PointCloud<pcl::PointNormal>::Ptr, pcl::IndicesPtr> > scansBuffer_;
+	VoxelHashMap * scanVoxelMap_;
 
 	std::map<int, std::map<int, cv::Point3f> > bundleWordReferences_; //<WordId, <FrameId, pt2D+depth>>
 	std::map<int, Transform> bundlePoses_;
@@ -49,6 +49,7 @@ public:
 		localBundleOutliers(0),
 		localBundleConstraints(0),
 		localBundleTime(0),
+		localBundleSolverTime(0),
 		keyFrameAdded(false),
 		timeEstimation(0.0f),
 		timeParticleFiltering(0.0f),
@@ -71,6 +72,7 @@ public:
 		output.localBundleOutliers = localBundleOutliers;
 		output.localBundleConstraints = localBundleConstraints;
 		output.localBundleTime = localBundleTime;
+		output.localBundleSolverTime = localBundleSolverTime;
 		output.localBundlePoses = localBundlePoses;
 		output.localBundleModels = localBundleModels;
 		output.keyFrameAdded = keyFrameAdded;
@@ -96,6 +98,7 @@ public:
 	int localBundleOutliers;
 	int localBundleConstraints;
 	float localBundleTime;
+	float localBundleSolverTime;
 	std::map<int, Transform> localBundlePoses;
 	std::map<int, CameraModel> localBundleModels;
 	bool keyFrameAdded;
@@ -112,6 +112,23 @@ public:
 				std::list<std::map<int, Transform> > * intermediateGraphes = 0,
 				double * finalError = 0,
 				int * iterationsDone = 0);
+
+	// Optimize the same graph as the previous call with nodes and links
+	// added or removed. Inherited classes keeping their solver state between
+	// calls only apply the changes, otherwise the whole graph is optimized.
+	// Only OptimizerGTSAM keeps a session (GTSAM/Incremental).
+	virtual std::map<int, Transform> optimizeSession(
+				int rootId,
+				const std::map<int, Transform> & poses,
+				const std::multimap<int, Link> & constraints,
+				cv::Mat & outputCovariance,
+				double * finalError = 0,
+				int * iterationsDone = 0);
+	virtual void resetSession() {}
+
+	// Time (s) spent in the linear solver during the last optimization, 0 if not available
+	double lastSolverTime() const {return lastSolverTime_;}
+
 	virtual std::map<int, Transform> optimizeBA(
 			int rootId, // if negative, all other poses are fixed
 			const std::map<int, Transform> & poses,
@@ -151,6 +168,8 @@ protected:
 			bool priorsIgnored     = Parameters::defaultOptimizerPriorsIgnored());
 	Optimizer(const ParametersMap & parameters);
 
+	void setLastSolverTime(double time) {lastSolverTime_ = time;}
+
 private:
 	int iterations_;
 	bool slam2d_;
@@ -158,6 +177,7 @@ private:
 	double epsilon_;
 	bool robust_;
 	bool priorsIgnored_;
+	double lastSolverTime_;
 };
 
 } /* namespace rtabmap */
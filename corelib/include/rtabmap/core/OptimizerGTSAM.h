@@ -32,6 +32,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <rtabmap/core/Optimizer.h>
 
+namespace gtsam {
+class ISAM2;
+}
+
 namespace rtabmap {
 
 class RTABMAP_EXP OptimizerGTSAM : public Optimizer
@@ -42,11 +46,15 @@ public:
 public:
 	OptimizerGTSAM(const ParametersMap & parameters = ParametersMap()) :
 		Optimizer(parameters),
-		optimizer_(Parameters::defaultGTSAMOptimizer())
+		optimizer_(Parameters::defaultGTSAMOptimizer()),
+		incremental_(Parameters::defaultGTSAMIncremental()),
+		isam2_(0),
+		isam2RootId_(0),
+		isam2RootFactor_(0)
 	{
 		parseParameters(parameters);
 	}
-	virtual ~OptimizerGTSAM() {}
+	virtual ~OptimizerGTSAM();
 
 	virtual Type type() const {return kTypeGTSAM;}
 
@@ -61,8 +69,26 @@ public:
 			double * finalError = 0,
 			int * iterationsDone = 0);
 
+	virtual std::map<int, Transform> optimizeSession(
+			int rootId,
+			const std::map<int, Transform> & poses,
+			const std::multimap<int, Link> & edgeConstraints,
+			cv::Mat & outputCovariance,
+			double * finalError = 0,
+			int * iterationsDone = 0);
+	virtual void resetSession();
+
 private:
 	int optimizer_;
+	bool incremental_;
+
+	// iSAM2 session
+	gtsam::ISAM2 * isam2_;
+	std::set<int> isam2Nodes_;
+	std::set<int> isam2RemovedNodes_; // anchored, see optimizeSession()
+	std::multimap<int, std::pair<Link, size_t> > isam2Links_; // <from, <link, factor index> >
+	int isam2RootId_;
+	size_t isam2RootFactor_;
 };
 
 } /* namespace rtabmap */
@@ -69,6 +69,7 @@ public:
 
 	// take ownership!
 	void setChildRegistration(Registration * child);
+	Registration * childRegistration() const {return child_;}
 
 	Transform computeTransformation(
 			const Signature & from,
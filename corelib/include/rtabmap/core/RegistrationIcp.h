@@ -32,9 +32,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <rtabmap/core/Registration.h>
 #include <rtabmap/core/Signature.h>
+#include <rtabmap/utilite/UMutex.h>
 
 namespace rtabmap {
 
+class RegistrationIcpCache;
+class VoxelHashMap;
+
 // Geometrical registration
 class RTABMAP_EXP RegistrationIcp : public Registration
 {
@@ -45,6 +49,11 @@ public:
 
 	virtual void parseParameters(const ParametersMap & parameters);
 
+	// Voxel map the "from" scan is created from (e.g., the local scan map of
+	// OdometryF2M), its voxels are then searched for the correspondences
+	// instead of building a kd-tree on each new "from" scan. Not owned.
+	void setFromVoxelMap(const VoxelHashMap * voxelMap) {_fromVoxelMap = voxelMap;}
+
 protected:
 	virtual Transform computeTransformationImpl(
 			Signature & from,
@@ -74,6 +83,13 @@ private:
 	float _libpointmatcherEpsilon;
 	float _libpointmatcherOutlierRatio;
 	void * _libpointmatcherICP;
+
+	// "from" scan processed by the last registration (filtered cloud,
+	// normals, complexity, search tree), reused if the same scan is
+	// registered again (e.g., the local scan map of OdometryF2M).
+	RegistrationIcpCache * _fromCache;
+	UMutex _fromCacheMutex;
+	const VoxelHashMap * _fromVoxelMap;
 };
 
 }
@@ -36,6 +36,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace rtabmap {
 
 class Feature2D;
+class VWDictionary;
 
 // Visual registration
 class RTABMAP_EXP RegistrationVis : public Registration
@@ -52,6 +53,13 @@ public:
 	int getMinInliers() const {return _minInliers;}
 
 	Feature2D * createFeatureDetector() const; // for convenience
+	VWDictionary * createDictionary() const; // for convenience
+
+	// Dictionary of the words of the "from" signature (same IDs and descriptors),
+	// kept up to date by the caller between registrations (not owned). When all
+	// descriptors are matched, it is used instead of a temporary dictionary if
+	// it contains exactly the words of the "from" signature.
+	void setFromDictionary(const VWDictionary * dictionary) {_fromDictionary = dictionary;}
 
 protected:
 	virtual Transform computeTransformationImpl(
@@ -88,6 +96,8 @@ private:
 
 	ParametersMap _featureParameters;
 	ParametersMap _bundleParameters;
+
+	const VWDictionary * _fromDictionary;
 };
 
 }
@@ -203,7 +203,8 @@ private:
 			cv::Mat & covariance,
 			std::multimap<int, Link> * constraints = 0,
 			double * error = 0,
-			int * iterationsDone = 0) const;
+			int * iterationsDone = 0,
+			bool optimizerSession = false) const;
 	void updateGoalIndex();
 	bool computePath(int targetNode, std::map<int, Transform> nodes, const std::multimap<int, rtabmap::Link> & constraints);
 
@@ -225,6 +226,7 @@ private:
 	float _loopRatio;
 	bool _verifyLoopClosureHypothesis;
 	unsigned int _maxRetrieved;
+	unsigned int _maxPrefetched;
 	unsigned int _maxLocalRetrieved;
 	bool _rawDataKept;
 	bool _statisticLogsBufferedInRAM;
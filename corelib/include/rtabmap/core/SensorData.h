@@ -38,6 +38,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <opencv2/features2d/features2d.hpp>
 #include <rtabmap/core/LaserScan.h>
 #include <rtabmap/core/IMU.h>
+#include <rtabmap/utilite/UMutex.h>
+#include <map>
+#include <vector>
 
 namespace rtabmap
 {
@@ -161,8 +164,8 @@ public:
 	const cv::Mat & imageRaw() const {return _imageRaw;}
 	const cv::Mat & depthOrRightRaw() const {return _depthOrRightRaw;}
 	const LaserScan & laserScanRaw() const {return _laserScanRaw;}
-	void setImageRaw(const cv::Mat & imageRaw) {_imageRaw = imageRaw;}
-	void setDepthOrRightRaw(const cv::Mat & depthOrImageRaw) {_depthOrRightRaw =depthOrImageRaw;}
+	void setImageRaw(const cv::Mat & imageRaw);
+	void setDepthOrRightRaw(const cv::Mat & depthOrImageRaw);
 	void setLaserScanRaw(const LaserScan & laserScanRaw) {_laserScanRaw =laserScanRaw;}
 	void setCameraModel(const CameraModel & model) {_cameraModels.clear(); _cameraModels.push_back(model);}
 	void setCameraModels(const std::vector<CameraModel> & models) {_cameraModels = models;}
@@ -172,6 +175,25 @@ public:
 	cv::Mat depthRaw() const {return _depthOrRightRaw.type()!=CV_8UC1?_depthOrRightRaw:cv::Mat();}
 	cv::Mat rightRaw() const {return _depthOrRightRaw.type()==CV_8UC1?_depthOrRightRaw:cv::Mat();}
 
+	/**
+	 * Images derived from the raw images. They are computed on the first call,
+	 * then shared by all copies of this SensorData, so that odometry, memory and
+	 * registration processing the same frame don't compute them again.
+	 * Setting a decimated image returned by imageRawDecimated() or
+	 * depthOrRightRawDecimated() with setImageRaw() or setDepthOrRightRaw()
+	 * keeps the derived images already computed for that decimated image.
+	 */
+	cv::Mat imageRawGray() const; // CV_8UC1
+	cv::Mat imageRawDecimated(int decimation) const; // see util2d::decimate()
+	cv::Mat depthOrRightRawDecimated(int decimation) const; // see util2d::decimate()
+	// Gray image pyramid with derivatives, see cv::buildOpticalFlowPyramid()
+	std::vector<cv::Mat> imageRawPyramid(const cv::Size & winSize, int maxLevel) const;
+	// Right image pyramid without derivatives, see cv::buildOpticalFlowPyramid()
+	std::vector<cv::Mat> rightRawPyramid(const cv::Size & winSize, int maxLevel) const;
+	void clearImageCache();
+	// Release the pyramids of this copy (other copies keep them), gray and decimated images are kept.
+	void clearImagePyramids();
+
 	void uncompressData();
 	void uncompressData(
 			cv::Mat * imageRaw,
@@ -252,6 +274,32 @@ public:
 
 	bool isPointVisibleFromCameras(const cv::Point3f & pt) const; // assuming point is in robot frame
 
+private:
+	class ImageCache
+	{
+	public:
+		cv::Mat gray(const cv::Mat & image);
+		cv::Mat decimated(const cv::Mat & image, int decimation);
+		std::vector<cv::Mat> pyramid(const cv::Mat & image, const cv::Size & winSize, int maxLevel, bool withDerivatives);
+		// Cache of a decimated image previously returned by decimated(), null otherwise
+		cv::Ptr<ImageCache> cacheOf(const cv::Mat & image);
+		// New cache sharing the gray and decimated images, without the pyramids
+		cv::Ptr<ImageCache> withoutPyramids();
+
+	private:
+		struct Pyramid
+		{
+			cv::Size winSize;
+			int maxLevel;
+			bool withDerivatives;
+			std::vector<cv::Mat> levels;
+		};
+		UMutex mutex_;
+		cv::Mat gray_;
+		std::vector<Pyramid> pyramids_;
+		std::map<int, std::pair<cv::Mat, cv::Ptr<ImageCache> > > decimated_;
+	};
+
 private:
 	int _id;
 	double _stamp;
@@ -264,6 +312,10 @@ private:
 	cv::Mat _depthOrRightRaw;   // depth CV_16UC1 or CV_32FC1, right image CV_8UC1
 	LaserScan _laserScanRaw;
 
+	// derived images, shared between copies
+	cv::Ptr<ImageCache> _imageRawCache;
+	cv::Ptr<ImageCache> _depthOrRightRawCache;
+
 	std::vector<CameraModel> _cameraModels;
 	StereoCameraModel _stereoCameraModel;
 
@@ -62,7 +62,7 @@ public:
 	virtual ~Signature();
 
 	/**
-	 * Must return a value between >=0 and <=1 (1 means 100% similarity).
+	 * Must return a value between >=0 and <=1 (1 means 100% similarity).
 	 */
 	float compareTo(const Signature & signature) const;
 	bool isBadSignature() const;
@@ -102,17 +102,40 @@ public:
 	void removeAllWords();
 	void removeWord(int wordId);
 	void changeWordsRef(int oldWordId, int activeWordId);
+	void changeWordsRef(const std::map<int, int> & refsToChange); // <oldWordId, activeWordId>
 	void setWords(const std::multimap<int, cv::KeyPoint> & words);
+	// Set all words at once, ids don't need to be sorted. Keypoints, points and
+	// descriptors should be empty or have the same size than ids.
+	void setWords(
+			const std::vector<int> & ids,
+			const std::vector<cv::KeyPoint> & keypoints,
+			const std::vector<cv::Point3f> & points,
+			const cv::Mat & descriptors);
+	// Exchange words, 3D words and descriptors with the ones in arguments
+	void swapWords(
+			std::multimap<int, cv::KeyPoint> & words,
+			std::multimap<int, cv::Point3f> & words3,
+			std::multimap<int, cv::Mat> & descriptors);
 	bool isEnabled() const {return _enabled;}
 	void setEnabled(bool enabled) {_enabled = enabled;}
-	const std::multimap<int, cv::KeyPoint> & getWords() const {return _words;}
+	// The multimaps returned by getWords(), getWords3() and getWordsDescriptors()
+	// are built from the arrays below on first access, then kept up to date
+	// with the signature. Prefer the arrays in loops over many signatures.
+	const std::multimap<int, cv::KeyPoint> & getWords() const {if(!_wordsView.valid) buildWordsView(); return _wordsView.map;}
 	int getInvalidWordsCount() const {return _invalidWordsCount;}
 	const std::map<int, int> & getWordsChanged() const {return _wordsChanged;}
-	const std::multimap<int, cv::Mat> & getWordsDescriptors() const {return _wordsDescriptors;}
-	void setWordsDescriptors(const std::multimap<int, cv::Mat> & descriptors) {_wordsDescriptors = descriptors;}
+	const std::multimap<int, cv::Mat> & getWordsDescriptors() const {if(!_wordsDescriptorsView.valid) buildWordsDescriptorsView(); return _wordsDescriptorsView.map;}
+	void setWordsDescriptors(const std::multimap<int, cv::Mat> & descriptors);
+
+	// Words sorted by id, keypoints, points and descriptors are empty or
+	// at the same index than their word id.
+	const std::vector<int> & getWordIds() const {return _wordIds;}
+	const std::vector<cv::KeyPoint> & getWordKeypoints() const {return _wordsKpts;}
+	const std::vector<cv::Point3f> & getWordPoints3() const {return _words3;}
+	const cv::Mat & getWordDescriptorsMat() const {return _wordsDescriptors;} // one row per word
 
 	//metric stuff
-	void setWords3(const std::multimap<int, cv::Point3f> & words3) {_words3 = words3;}
+	void setWords3(const std::multimap<int, cv::Point3f> & words3);
 	void setPose(const Transform & pose) {_pose = pose;}
 	void setGroundTruthPose(const Transform & pose) {_groundTruthPose = pose;}
 	void setVelocity(float vx, float vy, float vz, float vroll, float vpitch, float vyaw) {
@@ -125,7 +148,7 @@ public:
 		_velocity[5]=vyaw;
 	}
 
-	const std::multimap<int, cv::Point3f> & getWords3() const {return _words3;}
+	const std::multimap<int, cv::Point3f> & getWords3() const {if(!_words3View.valid) buildWords3View(); return _words3View.map;}
 	const Transform & getPose() const {return _pose;}
 	cv::Mat getPoseCovariance() const;
 	const Transform & getGroundTruthPose() const {return _groundTruthPose;}
@@ -136,6 +159,29 @@ public:
 
 	long getMemoryUsed(bool withSensorData=true) const; // Return memory usage in Bytes
 
+private:
+	// Multimap built on demand for the compatibility accessors. It is not
+	// copied with the signature, it will be rebuilt from the arrays if needed.
+	template<typename V>
+	class MultimapView
+	{
+	public:
+		MultimapView() : valid(false) {}
+		MultimapView(const MultimapView &) : valid(false) {}
+		MultimapView & operator=(const MultimapView &) {map.clear(); valid = false; return *this;}
+		std::multimap<int, V> map;
+		bool valid;
+	};
+
+	void resetWordIds(const std::vector<int> & ids);
+	void clearWordIdsIfUnused();
+	void sortWords();
+	void updateInvalidWordsCount();
+	void updateViews();
+	void buildWordsView() const;
+	void buildWords3View() const;
+	void buildWordsDescriptorsView() const;
+
 private:
 	int _id;
 	int _mapId;
@@ -147,12 +193,17 @@ private:
 	bool _modified;
 	bool _linksModified; // Optimization when updating signatures in database
 
-	// Contains all words (Some can be duplicates -> if a word appears 2
-	// times in the signature, it will be 2 times in this list)
-	// Words match with the CvSeq keypoints and descriptors
-	std::multimap<int, cv::KeyPoint> _words; // word <id, keypoint>
-	std::multimap<int, cv::Point3f> _words3; // word <id, point> // in base_link frame (localTransform applied))
-	std::multimap<int, cv::Mat> _wordsDescriptors;
+	// Contains all words sorted by id (Some can be duplicates -> if a word
+	// appears 2 times in the signature, it will be 2 times in this list).
+	// Keypoints, points and descriptors are parallel arrays, each one is
+	// either empty or has the same size than _wordIds.
+	std::vector<int> _wordIds;
+	std::vector<cv::KeyPoint> _wordsKpts;
+	std::vector<cv::Point3f> _words3; // in base_link frame (localTransform applied))
+	cv::Mat _wordsDescriptors; // one row per word
+	mutable MultimapView<cv::KeyPoint> _wordsView;
+	mutable MultimapView<cv::Point3f> _words3View;
+	mutable MultimapView<cv::Mat> _wordsDescriptorsView;
 	std::map<int, int> _wordsChanged; // <oldId, newId>
 	bool _enabled;
 	int _invalidWordsCount;
@@ -117,6 +117,7 @@ class RTABMAP_EXP Statistics
 	RTABMAP_STATS(Timing, Reactivation, ms);
 	RTABMAP_STATS(Timing, Add_loop_closure_link, ms);
 	RTABMAP_STATS(Timing, Map_optimization, ms);
+	RTABMAP_STATS(Timing, Map_optimization_solver, ms);
 	RTABMAP_STATS(Timing, Likelihood_computation, ms);
 	RTABMAP_STATS(Timing, Posterior_computation, ms);
 	RTABMAP_STATS(Timing, Hypotheses_creation, ms);
@@ -127,6 +128,7 @@ class RTABMAP_EXP Statistics
 	RTABMAP_STATS(Timing, Forgetting, ms);
 	RTABMAP_STATS(Timing, Joining_trash, ms);
 	RTABMAP_STATS(Timing, Emptying_trash, ms);
+	RTABMAP_STATS(Timing, Prefetch_search, ms);
 
 	RTABMAP_STATS(TimingMem, Pre_update, ms);
 	RTABMAP_STATS(TimingMem, Signature_creation, ms);
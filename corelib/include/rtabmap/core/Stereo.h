@@ -35,6 +35,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace rtabmap {
 
+class SensorData;
+
 class RTABMAP_EXP Stereo {
 public:
 	static Stereo * create(const ParametersMap & parameters = ParametersMap());
@@ -49,6 +51,11 @@ public:
 			const cv::Mat & rightImage,
 			const std::vector<cv::Point2f> & leftCorners,
 			std::vector<unsigned char> & status) const;
+	// Same as above with left and right images of the data, using its cached gray images.
+	virtual std::vector<cv::Point2f> computeCorrespondences(
+			const SensorData & data,
+			const std::vector<cv::Point2f> & leftCorners,
+			std::vector<unsigned char> & status) const;
 
 	cv::Size winSize() const {return cv::Size(winWidth_, winHeight_);}
 	int iterations() const   {return iterations_;}
@@ -78,9 +85,21 @@ public:
 			const cv::Mat & rightImage,
 			const std::vector<cv::Point2f> & leftCorners,
 			std::vector<unsigned char> & status) const;
+	// Same as above, using the cached image pyramids of the data.
+	virtual std::vector<cv::Point2f> computeCorrespondences(
+			const SensorData & data,
+			const std::vector<cv::Point2f> & leftCorners,
+			std::vector<unsigned char> & status) const;
 
 	float epsilon() const {return epsilon_;}
 
+private:
+	std::vector<cv::Point2f> computeCorrespondencesImpl(
+			cv::InputArray leftImage,
+			cv::InputArray rightImage,
+			const std::vector<cv::Point2f> & leftCorners,
+			std::vector<unsigned char> & status) const;
+
 private:
 	float epsilon_;
 };
@@ -42,6 +42,7 @@ namespace rtabmap
 class DBDriver;
 class VisualWord;
 class FlannIndex;
+class FlannIndexThread;
 
 class RTABMAP_EXP VWDictionary
 {
@@ -52,6 +53,7 @@ public:
 		kNNFlannLSH,
 		kNNBruteForce,
 		kNNBruteForceGPU,
+		kNNBruteForceHamming, // in-tree SIMD kernel for binary descriptors, see HammingMatcher
 		kNNUndef};
 	static const int ID_START;
 	static const int ID_INVALID;
@@ -74,12 +76,27 @@ public:
 
 	void addWordRef(int wordId, int signatureId);
 	void removeAllWordRef(int wordId, int signatureId);
+
+	// Inverted index, signatureIds must be sorted. Scores are accumulated
+	// in the output vectors at the same index than the signature id.
+	void computeTfIdfScores(
+			const std::list<int> & wordIds,
+			const std::vector<int> & signatureIds,
+			const std::vector<float> & signatureWordsCount,
+			float totalSignatures,
+			std::vector<float> & scores) const;
+	void computeSharedWords(
+			const std::map<int, int> & wordsCount, // <word id, occurrences>
+			const std::vector<int> & signatureIds,
+			std::vector<int> & sharedWords) const;
+	const std::vector<std::pair<int, int> > & getPostings(int wordId) const;
 	const VisualWord * getWord(int id) const;
 	VisualWord * getUnusedWord(int id) const;
 	void setLastWordId(int id) {_lastWordId = id;}
 	const std::map<int, VisualWord *> & getVisualWords() const {return _visualWords;}
 	float getNndrRatio() const {return _nndrRatio;}
 	unsigned int getNotIndexedWordsCount() const {return (int)_notIndexedWords.size();}
+	unsigned int getRemovedIndexedWordsCount() const {return (int)_removedIndexedWords.size();}
 	int getLastIndexedWordId() const;
 	int getTotalActiveReferences() const {return _totalActiveReferences;}
 	unsigned int getIndexedWordsCount() const;
@@ -87,11 +104,23 @@ public:
 	void setNNStrategy(NNStrategy strategy);
 	bool isIncremental() const {return _incrementalDictionary;}
 	bool isIncrementalFlann() const {return _incrementalFlann;}
+	bool isFlannRebuiltInBackground() const {return _backgroundRebuild;}
 	void setIncrementalDictionary();
 	void setFixedDictionary(const std::string & dictionaryPath);
 
 	void exportDictionary(const char * fileNameReferences, const char * fileNameDescriptors) const;
 
+	// The FLANN index keeps its data for serialization only if
+	// this is set before the index is built (default false).
+	void setIndexSerializable(bool enabled);
+	// FLANN index with the ids of the words it contains. Empty if the index
+	// doesn't contain exactly all words of the dictionary (call update() before)
+	// or if it has not been built to be serialized.
+	cv::Mat serializeIndex() const;
+	// Should be called after loading the words, instead of rebuilding the index in
+	// update(). Return false if the index doesn't match the words or the strategy.
+	bool deserializeIndex(const cv::Mat & data);
+
 	void clear(bool printWarningsIfNotEmpty = true);
 	std::vector<VisualWord *> getUnusedWords() const;
 	std::vector<int> getUnusedWordIds() const;
@@ -102,6 +131,13 @@ public:
 protected:
 	int getNextId();
 
+private:
+	void addPosting(int wordId, int signatureId);
+	void removePostings(int wordId, int signatureId);
+	void updateInBackground();
+	void releaseBackgroundRebuild();
+	void updateNotIndexedData(int type, int cols);
+
 protected:
 	std::map<int, VisualWord *> _visualWords; //<id,VisualWord*>
 	int _totalActiveReferences; // keep track of all references for updating the common signature
@@ -110,12 +146,19 @@ private:
 	bool _incrementalDictionary;
 	bool _incrementalFlann;
 	float _rebalancingFactor;
+	bool _backgroundRebuild;
+	bool _indexSerializable;
 	float _nndrRatio;
 	std::string _dictionaryPath; // a pre-computed dictionary (.txt)
 	bool _newWordsComparedTogether;
 	int _lastWordId;
 	bool useDistanceL1_;
 	FlannIndex * _flannIndex;
+	FlannIndexThread * _flannIndexThread; // index being rebuilt in background
+	unsigned int _indexSizeAtBuild; // background rebuild: words in the index when it was built
+	unsigned int _indexAddedSinceBuild; // background rebuild: words added incrementally to the index since
+	std::vector<int> _addedDuringRebuild; // words added to the current index but not in the snapshot being indexed
+	std::vector<int> _removedDuringRebuild; // words removed while the snapshot is indexed
 	cv::Mat _dataTree;
 	NNStrategy _strategy;
 	std::map<int ,int> _mapIndexId;
@@ -123,6 +166,9 @@ private:
 	std::map<int, VisualWord*> _unusedWords; //<id,VisualWord*>, note that these words stay in _visualWords
 	std::set<int> _notIndexedWords; // Words that are not indexed in the dictionary
 	std::set<int> _removedIndexedWords; // Words not anymore in the dictionary but still indexed in the dictionary
+	cv::Mat _notIndexedData; // descriptors of _notIndexedWords searched by brute force during a background rebuild
+	std::vector<int> _notIndexedDataIds; // word ids of _notIndexedData rows
+	std::map<int, std::vector<std::pair<int, int> > > _invertedIndex; // <word id, <signature id, occurrences> sorted by signature id>
 };
 
 } // namespace rtabmap
@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CORELIB_SRC_VOXELHASHMAP_H_
+#define CORELIB_SRC_VOXELHASHMAP_H_
+
+#include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <vector>
+
+namespace rtabmap {
+
+/**
+ * Fixed-capacity hash map of voxels, each voxel keeping a single representative
+ * point (with its normal). Insertion and lookup are O(1), and memory is bounded
+ * by the capacity whatever the number of points inserted.
+ */
+class RTABMAP_EXP VoxelHashMap
+{
+public:
+	VoxelHashMap(float voxelSize = 0.05f, int capacity = 2000);
+
+	void clear();
+	int size() const {return size_;}
+	int capacity() const {return capacity_;}
+	float voxelSize() const {return voxelSize_;}
+
+	/**
+	 * Add points falling in empty voxels (the first point added in a voxel
+	 * stays its representative). Points are not added anymore when
+	 * the map is full.
+	 * @return the number of points added
+	 */
+	int insert(const pcl::PointCloud<pcl::PointNormal> & cloud);
+
+	/**
+	 * Remove voxels farther than "range" from "center" (if range > 0),
+	 * then the oldest voxels until the empty voxels that "incoming" would
+	 * fill can be inserted.
+	 * @return the number of voxels removed
+	 */
+	int evict(
+			const Eigen::Vector3f & center,
+			float range,
+			const pcl::PointCloud<pcl::PointNormal> & incoming = pcl::PointCloud<pcl::PointNormal>());
+
+	/**
+	 * Representative points of the voxels. The voxels are indexed in the
+	 * order of this cloud until the next call (see nearest()).
+	 */
+	pcl::PointCloud<pcl::PointNormal>::Ptr getCloud();
+
+	/**
+	 * Nearest representative point, searched in the voxels around "point",
+	 * of the cloud returned by the last call to getCloud(). Voxels added
+	 * since are ignored. If "remap" is set, the index returned is remapped
+	 * (e.g., to a filtered copy of the cloud) and voxels mapped to -1 are
+	 * ignored. Read only, it can be called from multiple threads.
+	 * @return the index of the nearest point, or -1 if there is none
+	 * closer than maxDistance
+	 */
+	int nearest(
+			const pcl::PointNormal & point,
+			float maxDistance,
+			float * distanceSqr = 0,
+			const std::vector<int> * remap = 0) const;
+
+private:
+	struct Voxel
+	{
+		Voxel() : key(0), stamp(0), used(false), index(-1) {}
+		unsigned long long key;
+		unsigned int stamp;
+		bool used;
+		int index; // in the last cloud returned by getCloud()
+		pcl::PointNormal point;
+	};
+
+	long long coordinate(float value) const;
+	unsigned long long key(long long x, long long y, long long z) const;
+	unsigned long long key(const pcl::PointNormal & point) const;
+	unsigned int slot(unsigned long long key) const;
+	int find(unsigned long long key) const;
+	bool add(unsigned long long key, const pcl::PointNormal & point, unsigned int stamp);
+	void erase(unsigned int i);
+
+private:
+	float voxelSize_;
+	int capacity_;
+	int size_;
+	unsigned int stamp_;
+	std::vector<Voxel> table_; // open addressing, linear probing
+	// buffers reused by evict()
+	std::vector<unsigned long long> incomingKeys_;
+	std::vector<unsigned int> stamps_;
+};
+
+} /* namespace rtabmap */
+
+#endif /* CORELIB_SRC_VOXELHASHMAP_H_ */
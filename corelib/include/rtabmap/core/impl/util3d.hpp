@@ -0,0 +1,87 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef UTIL3D_HPP_
+#define UTIL3D_HPP_
+
+#include <rtabmap/utilite/ULogger.h>
+
+namespace rtabmap{
+namespace util3d{
+
+// Fields of PointT not in the scan are left to their default value
+template<typename PointT> inline void laserScanSetNormal(PointT &, const float *) {}
+inline void laserScanSetNormal(pcl::PointNormal & pt, const float * ptr) {pt.normal_x = ptr[0]; pt.normal_y = ptr[1]; pt.normal_z = ptr[2];}
+inline void laserScanSetNormal(pcl::PointXYZRGBNormal & pt, const float * ptr) {pt.normal_x = ptr[0]; pt.normal_y = ptr[1]; pt.normal_z = ptr[2];}
+inline void laserScanSetNormal(pcl::PointXYZINormal & pt, const float * ptr) {pt.normal_x = ptr[0]; pt.normal_y = ptr[1]; pt.normal_z = ptr[2];}
+template<typename PointT> inline void laserScanSetRGB(PointT &, const float *) {}
+inline void laserScanSetRGB(pcl::PointXYZRGB & pt, const float * ptr) {int rgb = *(const int*)ptr; pt.b = (unsigned char)(rgb & 0xFF); pt.g = (unsigned char)((rgb >> 8) & 0xFF); pt.r = (unsigned char)((rgb >> 16) & 0xFF);}
+inline void laserScanSetRGB(pcl::PointXYZRGBNormal & pt, const float * ptr) {int rgb = *(const int*)ptr; pt.b = (unsigned char)(rgb & 0xFF); pt.g = (unsigned char)((rgb >> 8) & 0xFF); pt.r = (unsigned char)((rgb >> 16) & 0xFF);}
+template<typename PointT> inline void laserScanSetIntensity(PointT &, const float *) {}
+inline void laserScanSetIntensity(pcl::PointXYZI & pt, const float * ptr) {pt.intensity = *ptr;}
+inline void laserScanSetIntensity(pcl::PointXYZINormal & pt, const float * ptr) {pt.intensity = *ptr;}
+
+template<typename PointT>
+LaserScanPointView<PointT>::LaserScanPointView(const LaserScan & scan, const PointT & defaultPoint) :
+	data_(scan.data()),
+	defaultPoint_(defaultPoint),
+	is2d_(scan.is2d()),
+	normalsOffset_(scan.getNormalsOffset()),
+	rgbOffset_(scan.getRGBOffset()),
+	intensityOffset_(scan.getIntensityOffset())
+{
+	UASSERT(!scan.isCompressed());
+}
+
+template<typename PointT>
+PointT LaserScanPointView<PointT>::at(int index) const
+{
+	const float * ptr = data_.ptr<float>(0, index);
+	PointT pt = defaultPoint_;
+	pt.x = ptr[0];
+	pt.y = ptr[1];
+	pt.z = is2d_?0.0f:ptr[2];
+	if(normalsOffset_ >= 0)
+	{
+		laserScanSetNormal(pt, ptr+normalsOffset_);
+	}
+	if(rgbOffset_ >= 0)
+	{
+		laserScanSetRGB(pt, ptr+rgbOffset_);
+	}
+	if(intensityOffset_ >= 0)
+	{
+		laserScanSetIntensity(pt, ptr+intensityOffset_);
+	}
+	return pt;
+}
+
+}
+}
+
+#endif /* UTIL3D_HPP_ */
@@ -244,6 +244,15 @@ pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr RTABMAP_EXP laserScanToPointCloudRG
 // For laserScan without normals, normals are set to null.
 pcl::PointCloud<pcl::PointXYZINormal>::Ptr RTABMAP_EXP laserScanToPointCloudINormal(const LaserScan & laserScan, const Transform & transform = Transform(), float intensity = 0.0f);
 
+// Same as above, but the points are appended to "output" (avoiding the
+// intermediate cloud when assembling scans, or to reuse a cloud's memory).
+void RTABMAP_EXP laserScanToPointCloud(const LaserScan & laserScan, pcl::PointCloud<pcl::PointXYZ> & output, const Transform & transform = Transform());
+void RTABMAP_EXP laserScanToPointCloudNormal(const LaserScan & laserScan, pcl::PointCloud<pcl::PointNormal> & output, const Transform & transform = Transform());
+void RTABMAP_EXP laserScanToPointCloudRGB(const LaserScan & laserScan, pcl::PointCloud<pcl::PointXYZRGB> & output, const Transform & transform = Transform(), unsigned char r = 255, unsigned char g = 255, unsigned char b = 255);
+void RTABMAP_EXP laserScanToPointCloudI(const LaserScan & laserScan, pcl::PointCloud<pcl::PointXYZI> & output, const Transform & transform = Transform(), float intensity = 0.0f);
+void RTABMAP_EXP laserScanToPointCloudRGBNormal(const LaserScan & laserScan, pcl::PointCloud<pcl::PointXYZRGBNormal> & output, const Transform & transform = Transform(), unsigned char r = 255, unsigned char g = 255, unsigned char b = 255);
+void RTABMAP_EXP laserScanToPointCloudINormal(const LaserScan & laserScan, pcl::PointCloud<pcl::PointXYZINormal> & output, const Transform & transform = Transform(), float intensity = 0.0f);
+
 // For 2d laserScan, z is set to null.
 pcl::PointXYZ RTABMAP_EXP laserScanToPoint(const LaserScan & laserScan, int index);
 // For laserScan without normals, normals are set to null.
@@ -259,6 +268,31 @@ pcl::PointXYZRGBNormal RTABMAP_EXP laserScanToPointRGBNormal(const LaserScan & l
 // For laserScan without normals, normals are set to null.
 pcl::PointXYZINormal RTABMAP_EXP laserScanToPointINormal(const LaserScan & laserScan, int index, float intensity);
 
+/**
+ * Read-only view of the points of a laser scan as PCL points, without
+ * converting the scan to a point cloud. The field offsets are resolved
+ * once, then each point is read directly from the scan data (shared, not
+ * copied). Fields of PointT not in the scan are set from "defaultPoint"
+ * (e.g., the color of a scan without rgb). Unlike the laserScanToPoint*()
+ * functions, the index is not checked.
+ */
+template<typename PointT>
+class LaserScanPointView
+{
+public:
+	LaserScanPointView(const LaserScan & scan, const PointT & defaultPoint = PointT());
+	int size() const {return data_.cols;}
+	PointT at(int index) const;
+
+private:
+	cv::Mat data_;
+	PointT defaultPoint_;
+	bool is2d_;
+	int normalsOffset_;
+	int rgbOffset_;
+	int intensityOffset_;
+};
+
 void RTABMAP_EXP getMinMax3D(const cv::Mat & laserScan, cv::Point3f & min, cv::Point3f & max);
 void RTABMAP_EXP getMinMax3D(const cv::Mat & laserScan, pcl::PointXYZ & min, pcl::PointXYZ & max);
 
@@ -362,4 +396,6 @@ RTABMAP_DEPRECATED(pcl::PointCloud<pcl::PointXYZ>::Ptr RTABMAP_EXP loadCloud(
 } // namespace util3d
 } // namespace rtabmap
 
+#include "rtabmap/core/impl/util3d.hpp"
+
 #endif /* UTIL3D_H_ */
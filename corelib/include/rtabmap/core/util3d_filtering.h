@@ -79,6 +79,14 @@ pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr RTABMAP_EXP downsample(
 		const pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr & cloud,
 		int step);
 
+/**
+ * Voxel filtering done directly on the scan data (without PCL conversion), for
+ * all scan formats. Like pcl::VoxelGrid, points falling in the same voxel are
+ * averaged (normals are re-normalized, RGB is averaged per channel).
+ */
+LaserScan RTABMAP_EXP voxelize(
+		const LaserScan & scan,
+		float voxelSize);
 pcl::PointCloud<pcl::PointXYZ>::Ptr RTABMAP_EXP voxelize(
 		const pcl::PointCloud<pcl::PointXYZ>::Ptr & cloud,
 		const pcl::IndicesPtr & indices,
@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
+#include <pcl/search/kdtree.h>
 #include <rtabmap/core/Transform.h>
 #include <opencv2/core/core.hpp>
 
@@ -65,7 +66,9 @@ void RTABMAP_EXP computeVarianceAndCorrespondences(
 		double maxCorrespondenceDistance,
 		double maxCorrespondenceAngle, // <=0 means that we don't care about normal angle difference
 		double & variance,
-		int & correspondencesOut);
+		int & correspondencesOut,
+		// optional search tree already built on cloudA, used if cloudA is the largest cloud
+		const pcl::search::KdTree<pcl::PointNormal>::Ptr & treeA = pcl::search::KdTree<pcl::PointNormal>::Ptr());
 void RTABMAP_EXP computeVarianceAndCorrespondences(
 		const pcl::PointCloud<pcl::PointXYZ>::ConstPtr & cloudA,
 		const pcl::PointCloud<pcl::PointXYZ>::ConstPtr & cloudB,
@@ -81,7 +84,9 @@ Transform RTABMAP_EXP icp(
 		bool & hasConverged,
 		pcl::PointCloud<pcl::PointXYZ> & cloud_source_registered,
 		float epsilon = 0.0f,
-		bool icp2D = false);
+		bool icp2D = false,
+		// optional search tree already built on cloud_target, not rebuilt by ICP
+		const pcl::search::KdTree<pcl::PointXYZ>::Ptr & treeTarget = pcl::search::KdTree<pcl::PointXYZ>::Ptr());
 
 Transform RTABMAP_EXP icpPointToPlane(
 		const pcl::PointCloud<pcl::PointNormal>::ConstPtr & cloud_source,
@@ -91,7 +96,9 @@ Transform RTABMAP_EXP icpPointToPlane(
 		bool & hasConverged,
 		pcl::PointCloud<pcl::PointNormal> & cloud_source_registered,
 		float epsilon = 0.0f,
-		bool icp2D = false);
+		bool icp2D = false,
+		// optional search tree already built on cloud_target, not rebuilt by ICP
+		const pcl::search::KdTree<pcl::PointNormal>::Ptr & treeTarget = pcl::search::KdTree<pcl::PointNormal>::Ptr());
 
 } // namespace util3d
 } // namespace rtabmap
@@ -43,6 +43,7 @@ namespace rtabmap {
 BayesFilter::BayesFilter(const ParametersMap & parameters) :
 	_virtualPlacePrior(Parameters::defaultBayesVirtualPlacePriorThr()),
 	_fullPredictionUpdate(Parameters::defaultBayesFullPredictionUpdate()),
+	_sparsePrediction(Parameters::defaultBayesSparsePrediction()),
 	_totalPredictionLCValues(0.0f)
 {
 	this->setPredictionLC(Parameters::defaultBayesPredictionLC());
@@ -61,6 +62,16 @@ void BayesFilter::parseParameters(const ParametersMap & parameters)
 	}
 	Parameters::parse(parameters, Parameters::kBayesVirtualPlacePriorThr(), _virtualPlacePrior);
 	Parameters::parse(parameters, Parameters::kBayesFullPredictionUpdate(), _fullPredictionUpdate);
+	bool sparsePrediction = _sparsePrediction;
+	Parameters::parse(parameters, Parameters::kBayesSparsePrediction(), sparsePrediction);
+	if(sparsePrediction != _sparsePrediction)
+	{
+		// The dense matrix and the neighbors index are not
+		// compatible between the two modes, start over
+		_sparsePrediction = sparsePrediction;
+		_prediction = cv::Mat();
+		_neighborsIndex.clear();
+	}
 
 	UASSERT(_virtualPlacePrior >= 0 && _virtualPlacePrior <= 1.0f);
 }
@@ -165,9 +176,11 @@ const std::map<int, float> & BayesFilter::computePosterior(const Memory * memory
 	int j=0;
 	// Recursive Bayes estimation...
 	// STEP 1 - Prediction : Prior*lastPosterior
-	_prediction = this->generatePrediction(memory, uKeys(likelihood));
-
-	UDEBUG("STEP1-generate prior=%fs, rows=%d, cols=%d", timer.ticks(), _prediction.rows, _prediction.cols);
+	if(!_sparsePrediction)
+	{
+		_prediction = this->generatePrediction(memory, uKeys(likelihood));
+		UDEBUG("STEP1-generate prior=%fs, rows=%d, cols=%d", timer.ticks(), _prediction.rows, _prediction.cols);
+	}
 	//std::cout << "Prediction=" << _prediction << std::endl;
 
 	// Adjust the last posterior if some images were
@@ -182,10 +195,19 @@ const std::map<int, float> & BayesFilter::computePosterior(const Memory * memory
 	ULOGGER_DEBUG("STEP1-update posterior=%fs, posterior=%d, _posterior size=%d", posterior.rows, _posterior.size());
 	//std::cout << "LastPosterior=" << posterior << std::endl;
 
-	// Multiply prediction matrix with the last posterior
-	// (m,m) X (m,1) = (m,1)
-	prior = _prediction * posterior;
-	ULOGGER_DEBUG("STEP1-matrix mult time=%fs", timer.ticks());
+	if(_sparsePrediction)
+	{
+		// Multiply the sparse prediction with the last posterior,
+		// without creating the (m,m) matrix
+		prior = this->computeSparsePrior(memory, uKeys(likelihood), posterior);
+		ULOGGER_DEBUG("STEP1-sparse prior time=%fs (neighbors index=%d)", timer.ticks(), (int)_neighborsIndex.size());
+	}
+	else
+	{
+		// Multiply prediction matrix with the last posterior
+		// (m,m) X (m,1) = (m,1)
+		prior = _prediction * posterior;
+	}
 	//std::cout << "ResultingPrior=" << prior << std::endl;
 
 	ULOGGER_DEBUG("STEP1-matrix mult time=%fs", timer.ticks());
@@ -664,6 +686,269 @@ cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
 	return prediction;
 }
 
+void BayesFilter::updateNeighborsIndex(const Memory * memory, const std::vector<int> & ids)
+{
+	UASSERT(memory && _predictionLC.size() >= 2);
+
+	if(_fullPredictionUpdate)
+	{
+		_neighborsIndex.clear();
+	}
+	// Same rules as generatePrediction() when the index is created
+	// from scratch, otherwise same rules as updatePrediction()
+	bool generate = _neighborsIndex.empty();
+
+	// Remove ids that are not in WM anymore
+	std::set<int> idsSet(ids.begin(), ids.end());
+	int removed = 0;
+	for(std::map<int, std::map<int, int> >::iterator iter=_neighborsIndex.begin(); iter!=_neighborsIndex.end();)
+	{
+		if(idsSet.find(iter->first) == idsSet.end())
+		{
+			_neighborsIndex.erase(iter++);
+			++removed;
+		}
+		else
+		{
+			++iter;
+		}
+	}
+
+	// Add new ids (retrieved from LTM or new locations transferred from STM)
+	int added = 0;
+	for(unsigned int i=0; i<ids.size(); ++i)
+	{
+		if(ids[i] > 0 && _neighborsIndex.find(ids[i]) == _neighborsIndex.end())
+		{
+			std::map<int, int> neighbors = memory->getNeighborsId(ids[i], _predictionLC.size()-1, 0, false, false, true, true);
+
+			if(generate)
+			{
+				std::list<int> idsLoopMargin;
+				//filter neighbors in STM
+				for(std::map<int, int>::iterator iter=neighbors.begin(); iter!=neighbors.end();)
+				{
+					if(memory->isInSTM(iter->first))
+					{
+						neighbors.erase(iter++);
+					}
+					else
+					{
+						if(iter->second == 0 && idsSet.find(iter->first)!=idsSet.end())
+						{
+							idsLoopMargin.push_back(iter->first);
+						}
+						++iter;
+					}
+				}
+
+				// should at least have 1 id in idsMarginLoop
+				if(idsLoopMargin.size() == 0)
+				{
+					UFATAL("No 0 margin neighbor for signature %d !?!?", ids[i]);
+				}
+
+				// same neighbor tree for loop signatures (margin = 0)
+				for(std::list<int>::iterator iter = idsLoopMargin.begin(); iter!=idsLoopMargin.end(); ++iter)
+				{
+					uInsert(_neighborsIndex, std::make_pair(*iter, neighbors));
+					++added;
+				}
+				continue;
+			}
+
+			if(!_fullPredictionUpdate)
+			{
+				// make the new id visible to its neighbors already indexed
+				for(std::map<int, int>::iterator iter=neighbors.begin(); iter!=neighbors.end(); ++iter)
+				{
+					std::map<int, std::map<int, int> >::iterator jter = _neighborsIndex.find(iter->first);
+					if(jter != _neighborsIndex.end())
+					{
+						uInsert(jter->second, std::make_pair(ids[i], iter->second));
+					}
+				}
+			}
+			_neighborsIndex.insert(std::make_pair(ids[i], neighbors));
+			++added;
+		}
+	}
+	UDEBUG("Neighbors index: added=%d removed=%d size=%d", added, removed, (int)_neighborsIndex.size());
+}
+
+// Same model as generatePrediction() and normalize(), but each column of
+// the prediction is represented by its non-default values and a default
+// value shared by all other rows. The prior is accumulated column by column:
+//   prior(r) = sum_c(default_c * post_c) + sum_c((value_rc - default_c) * post_c)
+cv::Mat BayesFilter::computeSparsePrior(const Memory * memory, const std::vector<int> & ids, const cv::Mat & posterior)
+{
+	UASSERT(memory &&
+		   _predictionLC.size() >= 2 &&
+		   ids.size() &&
+		   posterior.type() == CV_32FC1 &&
+		   posterior.rows == (int)ids.size());
+
+	UTimer timer;
+	this->updateNeighborsIndex(memory, ids);
+	UDEBUG("time updating neighbors index = %fs", timer.ticks());
+
+#if __cplusplus >= 201103L
+	std::unordered_map<int,int> idToIndexMap;
+	idToIndexMap.reserve(ids.size());
+#else
+	std::map<int,int> idToIndexMap;
+#endif
+	for(unsigned int i=0; i<ids.size(); ++i)
+	{
+		if(ids[i]>0)
+		{
+			idToIndexMap[ids[i]] = i;
+		}
+	}
+
+	int cols = (int)ids.size();
+	bool virtualPlaceUsed = ids[0]<0;
+	int startRow = virtualPlaceUsed?1:0;
+	float allOtherPlacesValue = _totalPredictionLCValues < 1?1.0f - _totalPredictionLCValues:0.0f;
+	float maxNorm = 1 - (virtualPlaceUsed?_predictionLC[0]:0); // 1 - virtual place probability
+
+	cv::Mat prior = cv::Mat::zeros(cols, 1, CV_32FC1);
+	float * priorPtr = (float*)prior.data;
+	const float * posteriorPtr = (const float*)posterior.data;
+	float defaultSum = 0.0f;
+	int nonZeros = 0;
+	std::vector<std::pair<int, float> > values; // <row, value>
+	for(int c=0; c<cols; ++c)
+	{
+		values.clear();
+		float defaultValue = 0.0f;
+		if(ids[c] > 0)
+		{
+			std::map<int, std::map<int, int> >::const_iterator kter = _neighborsIndex.find(ids[c]);
+			UASSERT_MSG(kter != _neighborsIndex.end(), uFormat("Did not find %d (current index size=%d)", ids[c], (int)_neighborsIndex.size()).c_str());
+			const std::map<int, int> & neighbors = kter->second;
+
+			// ADD prob for each neighbors
+			float sum = 0.0f;
+			int selfIndex = -1;
+			for(std::map<int, int>::const_iterator iter=neighbors.begin(); iter!=neighbors.end(); ++iter)
+			{
+				if(iter->first>=0)
+				{
+#if __cplusplus >= 201103L
+					std::unordered_map<int, int>::const_iterator jter = idToIndexMap.find(iter->first);
+#else
+					std::map<int, int>::const_iterator jter = idToIndexMap.find(iter->first);
+#endif
+					if(jter != idToIndexMap.end())
+					{
+						UASSERT((iter->second+1) < (int)_predictionLC.size());
+						if(jter->second == c)
+						{
+							selfIndex = (int)values.size();
+						}
+						values.push_back(std::make_pair(jter->second, (float)_predictionLC[iter->second+1]));
+						sum += values.back().second;
+					}
+				}
+			}
+
+			// ADD values of not found neighbors to loop closure
+			if(sum < _totalPredictionLCValues-_predictionLC[0])
+			{
+				float delta = _totalPredictionLCValues-_predictionLC[0]-sum;
+				if(selfIndex < 0)
+				{
+					values.push_back(std::make_pair(c, 0.0f));
+					selfIndex = (int)values.size()-1;
+				}
+				values[selfIndex].second += delta;
+				sum += delta;
+			}
+
+			// Set all loop events to small values according to the model
+			if(allOtherPlacesValue > 0 && cols>1)
+			{
+				defaultValue = allOtherPlacesValue / float(cols - 1);
+				for(unsigned int j=0; j<values.size(); ++j)
+				{
+					if(values[j].second == 0)
+					{
+						values[j].second = defaultValue;
+						sum += defaultValue;
+					}
+				}
+				sum += defaultValue * float(cols - startRow - (int)values.size());
+			}
+
+			//normalize this column
+			if(sum<maxNorm-0.0001 || sum>maxNorm+0.0001)
+			{
+				float scale = maxNorm / sum;
+				for(unsigned int j=0; j<values.size(); ++j)
+				{
+					values[j].second *= scale;
+				}
+				defaultValue *= scale;
+				sum = maxNorm;
+			}
+
+			// ADD virtual place prob
+			if(virtualPlaceUsed)
+			{
+				values.push_back(std::make_pair(0, (float)_predictionLC[0]));
+				sum += _predictionLC[0];
+			}
+
+			if(sum<0.99 || sum > 1.01)
+			{
+				UWARN("Prediction is not normalized sum=%f", sum);
+			}
+		}
+		else if(_virtualPlacePrior > 0)
+		{
+			// Set the virtual place prior
+			if(cols>1) // The first must be the virtual place
+			{
+				values.push_back(std::make_pair(0, _virtualPlacePrior));
+				defaultValue = (1.0-_virtualPlacePrior)/(cols-1);
+			}
+			else
+			{
+				values.push_back(std::make_pair(0, 1.0f));
+			}
+		}
+		else
+		{
+			// Only for some tests...
+			// when _virtualPlacePrior=0, set all priors to the same value
+			defaultValue = 1.0f/cols;
+		}
+
+		float p = posteriorPtr[c];
+		if(p != 0.0f)
+		{
+			defaultSum += defaultValue * p;
+			for(unsigned int j=0; j<values.size(); ++j)
+			{
+				priorPtr[values[j].first] += (values[j].second - defaultValue) * p;
+			}
+		}
+		nonZeros += (int)values.size();
+	}
+
+	if(defaultSum != 0.0f)
+	{
+		for(int r=0; r<cols; ++r)
+		{
+			priorPtr[r] += defaultSum;
+		}
+	}
+
+	UDEBUG("time computing sparse prior (cols=%d, non-default values=%d) = %fs", cols, nonZeros, timer.ticks());
+	return prior;
+}
+
 void BayesFilter::updatePosterior(const Memory * memory, const std::vector<int> & likelihoodIds)
 {
 	ULOGGER_DEBUG("");
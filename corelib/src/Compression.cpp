@@ -28,7 +28,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/Compression.h"
 #include <rtabmap/utilite/ULogger.h>
 #include <rtabmap/utilite/UConversion.h>
+#include <rtabmap/utilite/UMutex.h>
+#include <rtabmap/utilite/UDestroyer.h>
 #include <opencv2/opencv.hpp>
+#include <list>
 
 #include <zlib.h>
 
@@ -41,7 +44,7 @@ CompressionThread::CompressionThread(const cv::Mat & mat, const std::string & fo
 	image_(!format.empty()),
 	compressMode_(true)
 {
-	UASSERT(format.empty() || format.compare(".png") == 0 || format.compare(".jpg") == 0);
+	UASSERT(format.empty() || format.compare(".png") == 0 || format.compare(".jpg") == 0 || format.compare(".rvl") == 0);
 }
 // assume image
 CompressionThread::CompressionThread(const cv::Mat & bytes, bool isImage) :
@@ -49,60 +52,428 @@ CompressionThread::CompressionThread(const cv::Mat & bytes, bool isImage) :
 	image_(isImage),
 	compressMode_(false)
 {}
-void CompressionThread::mainLoop()
+static void compressOrUncompress(
+		bool compressMode,
+		bool image,
+		const std::string & format,
+		cv::Mat & compressedData,
+		cv::Mat & uncompressedData)
 {
 	try
 	{
-		if(compressMode_)
+		if(compressMode)
 		{
-			if(!uncompressedData_.empty())
+			if(!uncompressedData.empty())
 			{
-				if(image_)
+				if(image)
 				{
-					compressedData_ = compressImage2(uncompressedData_, format_);
+					compressedData = compressImage2(uncompressedData, format);
 				}
 				else
 				{
-					compressedData_ = compressData2(uncompressedData_);
+					compressedData = compressData2(uncompressedData);
 				}
 			}
 		}
 		else // uncompress
 		{
-			if(!compressedData_.empty())
+			if(!compressedData.empty())
 			{
-				if(image_)
+				if(image)
 				{
-					uncompressedData_ = uncompressImage(compressedData_);
+					uncompressedData = uncompressImage(compressedData);
 				}
 				else
 				{
-					uncompressedData_ = uncompressData(compressedData_);
+					uncompressedData = uncompressData(compressedData);
 				}
 			}
 		}
 	}
 	catch (cv::Exception & e) {
 		UERROR("Exception while compressing/uncompressing data: %s", e.what());
-		if(compressMode_)
+		if(compressMode)
 		{
-			compressedData_ = cv::Mat();
+			compressedData = cv::Mat();
 		}
 		else
 		{
-			uncompressedData_ = cv::Mat();
+			uncompressedData = cv::Mat();
 		}
 	}
+}
+
+void CompressionThread::mainLoop()
+{
+	compressOrUncompress(compressMode_, image_, format_, compressedData_, uncompressedData_);
 	this->kill();
 }
 
-// ".png" or ".jpg"
+// Pool of workers shared by all CompressionJob, created on first use
+// and stopped when the application exits.
+class CompressionPool
+{
+public:
+	static CompressionPool * getInstance();
+	virtual ~CompressionPool();
+
+	void post(CompressionJob * job);
+	// Block until a job is available, return 0 if woken up without job.
+	CompressionJob * take();
+
+private:
+	CompressionPool();
+
+private:
+	std::list<CompressionJob*> jobs_;
+	UMutex jobsMutex_;
+	USemaphore jobsSemaphore_;
+	std::vector<UThread*> workers_;
+
+	static CompressionPool * instance_;
+	static UDestroyer<CompressionPool> destroyer_;
+	static UMutex instanceMutex_;
+};
+
+class CompressionWorker : public UThread
+{
+public:
+	CompressionWorker(CompressionPool * pool) : pool_(pool) {}
+	virtual ~CompressionWorker() {this->join(true);}
+protected:
+	virtual void mainLoop()
+	{
+		CompressionJob * job = pool_->take();
+		if(job)
+		{
+			job->process();
+		}
+	}
+private:
+	CompressionPool * pool_;
+};
+
+CompressionPool * CompressionPool::instance_ = 0;
+UDestroyer<CompressionPool> CompressionPool::destroyer_;
+UMutex CompressionPool::instanceMutex_;
+
+CompressionPool * CompressionPool::getInstance()
+{
+	UScopeMutex lock(instanceMutex_);
+	if(!instance_)
+	{
+		instance_ = new CompressionPool();
+		destroyer_.setDoomed(instance_);
+	}
+	return instance_;
+}
+
+// Upper bound of the number of workers, compression of a single
+// node doesn't have more jobs than that.
+static const int kMaxPoolSize = 8;
+
+CompressionPool::CompressionPool()
+{
+	int poolSize = std::max(1, std::min(cv::getNumberOfCPUs(), kMaxPoolSize));
+	UDEBUG("Starting %d compression workers", poolSize);
+	for(int i=0; i<poolSize; ++i)
+	{
+		workers_.push_back(new CompressionWorker(this));
+		workers_.back()->start();
+	}
+}
+
+CompressionPool::~CompressionPool()
+{
+	for(unsigned int i=0; i<workers_.size(); ++i)
+	{
+		workers_[i]->kill();
+	}
+	// wake up all workers waiting for a job
+	jobsSemaphore_.release((int)workers_.size());
+	for(unsigned int i=0; i<workers_.size(); ++i)
+	{
+		delete workers_[i];
+	}
+	workers_.clear();
+	if(!jobs_.empty())
+	{
+		UWARN("%d compression jobs were not processed!", (int)jobs_.size());
+	}
+	instance_ = 0;
+}
+
+void CompressionPool::post(CompressionJob * job)
+{
+	jobsMutex_.lock();
+	jobs_.push_back(job);
+	jobsMutex_.unlock();
+	jobsSemaphore_.release();
+}
+
+CompressionJob * CompressionPool::take()
+{
+	jobsSemaphore_.acquire();
+	CompressionJob * job = 0;
+	jobsMutex_.lock();
+	if(!jobs_.empty())
+	{
+		job = jobs_.front();
+		jobs_.pop_front();
+	}
+	jobsMutex_.unlock();
+	return job;
+}
+
+CompressionJob::CompressionJob(const cv::Mat & mat, const std::string & format) :
+	uncompressedData_(mat),
+	format_(format),
+	image_(!format.empty()),
+	compressMode_(true),
+	started_(false)
+{
+	UASSERT(format.empty() || format.compare(".png") == 0 || format.compare(".jpg") == 0 || format.compare(".rvl") == 0);
+}
+CompressionJob::CompressionJob(const cv::Mat & bytes, bool isImage) :
+	compressedData_(bytes),
+	image_(isImage),
+	compressMode_(false),
+	started_(false)
+{}
+CompressionJob::~CompressionJob()
+{
+	join();
+}
+void CompressionJob::start()
+{
+	UASSERT_MSG(!started_, "Compression job already started!");
+	started_ = true;
+	CompressionPool::getInstance()->post(this);
+}
+void CompressionJob::join()
+{
+	if(started_)
+	{
+		done_.acquire();
+		started_ = false;
+	}
+}
+void CompressionJob::process()
+{
+	compressOrUncompress(compressMode_, image_, format_, compressedData_, uncompressedData_);
+	done_.release();
+}
+
+// RVL depth codec: zero runs and zig-zag deltas of non-zero pixels are
+// written with a variable-length encoding of 3-bit nibbles (+1 continuation
+// bit), packed in 32-bit words. Based on:
+//   A. D. Wilson, "Fast Lossless Depth Image Compression", ISS 2017.
+static const unsigned char RVL_MAGIC[4] = {'R', 'V', 'L', 'D'};
+static const int RVL_HEADER_SIZE = 4 + 2*sizeof(int); // magic, rows, cols
+
+class RVLEncoder
+{
+public:
+	RVLEncoder(unsigned char * buffer) : buffer_(buffer), start_(buffer), word_(0), nibbles_(0) {}
+	void encode(unsigned int value)
+	{
+		do
+		{
+			unsigned int nibble = value & 0x7;
+			if((value >>= 3))
+			{
+				nibble |= 0x8;
+			}
+			word_ <<= 4;
+			word_ |= nibble;
+			if(++nibbles_ == 8)
+			{
+				flushWord();
+			}
+		}
+		while(value);
+	}
+	size_t finish()
+	{
+		if(nibbles_)
+		{
+			word_ <<= 4 * (8 - nibbles_);
+			flushWord();
+		}
+		return buffer_ - start_;
+	}
+private:
+	void flushWord()
+	{
+		memcpy(buffer_, &word_, sizeof(unsigned int));
+		buffer_ += sizeof(unsigned int);
+		nibbles_ = 0;
+		word_ = 0;
+	}
+private:
+	unsigned char * buffer_;
+	unsigned char * start_;
+	unsigned int word_;
+	int nibbles_;
+};
+
+class RVLDecoder
+{
+public:
+	RVLDecoder(const unsigned char * buffer, size_t size) : buffer_(buffer), end_(buffer+size), word_(0), nibbles_(0) {}
+	// return false if the buffer is too short
+	bool decode(unsigned int & value)
+	{
+		unsigned int nibble;
+		value = 0;
+		int bits = 29;
+		do
+		{
+			if(bits < 0)
+			{
+				return false; // more than 32 bits, corrupted
+			}
+			if(!nibbles_)
+			{
+				if(buffer_ + sizeof(unsigned int) > end_)
+				{
+					return false;
+				}
+				memcpy(&word_, buffer_, sizeof(unsigned int));
+				buffer_ += sizeof(unsigned int);
+				nibbles_ = 8;
+			}
+			nibble = word_ & 0xf0000000;
+			value |= (nibble << 1) >> bits;
+			word_ <<= 4;
+			--nibbles_;
+			bits -= 3;
+		}
+		while(nibble & 0x80000000);
+		return true;
+	}
+private:
+	const unsigned char * buffer_;
+	const unsigned char * end_;
+	unsigned int word_;
+	int nibbles_;
+};
+
+static std::vector<unsigned char> compressRVL(const cv::Mat & depth)
+{
+	UASSERT(depth.type() == CV_16UC1);
+	cv::Mat input = depth.isContinuous()?depth:depth.clone();
+	int numPixels = (int)input.total();
+	// worst case: 6 nibbles per non-zero pixel (17 bits zig-zag delta) + run lengths
+	std::vector<unsigned char> bytes(RVL_HEADER_SIZE + numPixels*3 + 16*sizeof(unsigned int));
+	memcpy(bytes.data(), RVL_MAGIC, 4);
+	memcpy(bytes.data()+4, &input.rows, sizeof(int));
+	memcpy(bytes.data()+4+sizeof(int), &input.cols, sizeof(int));
+
+	RVLEncoder encoder(bytes.data() + RVL_HEADER_SIZE);
+	const unsigned short * in = input.ptr<unsigned short>();
+	const unsigned short * end = in + numPixels;
+	int previous = 0;
+	while(in != end)
+	{
+		unsigned int zeros = 0;
+		for(; in != end && !*in; ++in, ++zeros);
+		encoder.encode(zeros);
+		unsigned int nonzeros = 0;
+		for(const unsigned short * p = in; p != end && *p; ++p, ++nonzeros);
+		encoder.encode(nonzeros);
+		for(unsigned int i=0; i<nonzeros; ++i)
+		{
+			int current = *in++;
+			int delta = current - previous;
+			encoder.encode(((unsigned int)delta << 1) ^ (unsigned int)(delta >> 31)); // zig-zag
+			previous = current;
+		}
+	}
+	bytes.resize(RVL_HEADER_SIZE + encoder.finish());
+	return bytes;
+}
+
+static bool isRVL(const unsigned char * bytes, size_t size)
+{
+	return size >= (size_t)RVL_HEADER_SIZE && memcmp(bytes, RVL_MAGIC, 4) == 0;
+}
+
+static cv::Mat uncompressRVL(const unsigned char * bytes, size_t size)
+{
+	UASSERT(isRVL(bytes, size));
+	int rows, cols;
+	memcpy(&rows, bytes+4, sizeof(int));
+	memcpy(&cols, bytes+4+sizeof(int), sizeof(int));
+	if(rows <= 0 || cols <= 0)
+	{
+		UERROR("Invalid RVL depth size (%dx%d)", cols, rows);
+		return cv::Mat();
+	}
+	cv::Mat depth(rows, cols, CV_16UC1);
+	RVLDecoder decoder(bytes + RVL_HEADER_SIZE, size - RVL_HEADER_SIZE);
+	unsigned short * out = depth.ptr<unsigned short>();
+	unsigned int remaining = (unsigned int)depth.total();
+	int previous = 0;
+	unsigned int zeros, nonzeros, positive;
+	bool corrupted = false;
+	while(remaining && !corrupted)
+	{
+		if(!decoder.decode(zeros) || zeros > remaining)
+		{
+			corrupted = true;
+			break;
+		}
+		memset(out, 0, zeros*sizeof(unsigned short));
+		out += zeros;
+		remaining -= zeros;
+		if(!decoder.decode(nonzeros) || nonzeros > remaining)
+		{
+			corrupted = true;
+			break;
+		}
+		remaining -= nonzeros;
+		for(; nonzeros && !corrupted; --nonzeros)
+		{
+			if(decoder.decode(positive))
+			{
+				int delta = (int)(positive >> 1) ^ -(int)(positive & 1);
+				previous += delta;
+				*out++ = (unsigned short)previous;
+			}
+			else
+			{
+				corrupted = true;
+			}
+		}
+	}
+	if(corrupted)
+	{
+		UERROR("RVL depth data is corrupted (size=%d bytes, %dx%d)", (int)size, cols, rows);
+		return cv::Mat();
+	}
+	return depth;
+}
+
+// ".png", ".jpg" or ".rvl" (CV_16UC1 only)
 std::vector<unsigned char> compressImage(const cv::Mat & image, const std::string & format)
 {
 	std::vector<unsigned char> bytes;
 	if(!image.empty())
 	{
-		if(image.type() == CV_32FC1)
+		if(format.compare(".rvl") == 0)
+		{
+			if(image.type() == CV_16UC1)
+			{
+				bytes = compressRVL(image);
+			}
+			else
+			{
+				UWARN("\".rvl\" format is only for CV_16UC1 images (type=%d), using \".png\" format.", image.type());
+				return compressImage(image, ".png");
+			}
+		}
+		else if(image.type() == CV_32FC1)
 		{
 			//save in 8bits-4channel
 			cv::Mat bgra(image.size(), CV_8UC4, image.data);
@@ -116,7 +487,7 @@ std::vector<unsigned char> compressImage(const cv::Mat & image, const std::strin
 	return bytes;
 }
 
-// ".png" or ".jpg"
+// ".png", ".jpg" or ".rvl" (CV_16UC1 only)
 cv::Mat compressImage2(const cv::Mat & image, const std::string & format)
 {
 	std::vector<unsigned char> bytes = compressImage(image, format);
@@ -130,7 +501,11 @@ cv::Mat compressImage2(const cv::Mat & image, const std::string & format)
 cv::Mat uncompressImage(const cv::Mat & bytes)
 {
 	 cv::Mat image;
-	if(!bytes.empty())
+	if(!bytes.empty() && isRVL(bytes.data, bytes.total()*bytes.elemSize()))
+	{
+		image = uncompressRVL(bytes.data, bytes.total()*bytes.elemSize());
+	}
+	else if(!bytes.empty())
 	{
 #if CV_MAJOR_VERSION>2 || (CV_MAJOR_VERSION >=2 && CV_MINOR_VERSION >=4)
 		image = cv::imdecode(bytes, cv::IMREAD_UNCHANGED);
@@ -152,7 +527,11 @@ cv::Mat uncompressImage(const cv::Mat & bytes)
 cv::Mat uncompressImage(const std::vector<unsigned char> & bytes)
 {
 	 cv::Mat image;
-	if(bytes.size())
+	if(bytes.size() && isRVL(bytes.data(), bytes.size()))
+	{
+		image = uncompressRVL(bytes.data(), bytes.size());
+	}
+	else if(bytes.size())
 	{
 #if CV_MAJOR_VERSION>2 || (CV_MAJOR_VERSION >=2 && CV_MINOR_VERSION >=4)
 		image = cv::imdecode(bytes, cv::IMREAD_UNCHANGED);
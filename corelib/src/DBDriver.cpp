@@ -38,6 +38,47 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace rtabmap {
 
+// Return true if one of the ids is currently written by emptyTrashes()
+template<typename T>
+static bool isEmptying(const std::multiset<int> & emptying, const T & ids)
+{
+	if(emptying.size())
+	{
+		for(typename T::const_iterator iter=ids.begin(); iter!=ids.end(); ++iter)
+		{
+			if(emptying.find(*iter) != emptying.end())
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+class DBDriverPrefetchThread : public UThread
+{
+public:
+	DBDriverPrefetchThread(DBDriver * driver) :
+		driver_(driver)
+	{
+		UASSERT(driver_ != 0);
+	}
+	virtual ~DBDriverPrefetchThread() {this->join(true);}
+	void setIds(const std::list<int> & ids) {ids_ = ids;}
+
+private:
+	virtual void mainLoop()
+	{
+		driver_->prefetch(ids_);
+		ids_.clear();
+		this->kill(); // Do it only once
+	}
+
+private:
+	DBDriver * driver_;
+	std::list<int> ids_;
+};
+
 DBDriver * DBDriver::create(const ParametersMap & parameters)
 {
 	// well, we only have Sqlite3 database type for now :P
@@ -46,7 +87,8 @@ DBDriver * DBDriver::create(const ParametersMap & parameters)
 
 DBDriver::DBDriver(const ParametersMap & parameters) :
 	_emptyTrashesTime(0),
-	_timestampUpdate(true)
+	_timestampUpdate(true),
+	_prefetchThread(0) // created on first prefetch, drivers used as readers never start any thread
 {
 	this->parseParameters(parameters);
 }
@@ -54,6 +96,8 @@ DBDriver::DBDriver(const ParametersMap & parameters) :
 DBDriver::~DBDriver()
 {
 	join(true);
+	delete _prefetchThread;
+	clearPrefetched();
 	this->emptyTrashes();
 }
 
@@ -65,6 +109,11 @@ void DBDriver::closeConnection(bool save, const std::string & outputUrl)
 {
 	UDEBUG("isRunning=%d", this->isRunning());
 	this->join(true);
+	if(_prefetchThread)
+	{
+		_prefetchThread->join();
+	}
+	clearPrefetched();
 	UDEBUG("");
 	if(save)
 	{
@@ -322,6 +371,8 @@ void DBDriver::emptyTrashes(bool async)
 
 	std::map<int, Signature*> signatures;
 	std::map<int, VisualWord*> visualWords;
+	std::vector<int> signatureIds;
+	std::vector<int> visualWordIds;
 	_trashesMutex.lock();
 	{
 		ULOGGER_DEBUG("signatures=%d, visualWords=%d", _trashSignatures.size(), _trashVisualWords.size());
@@ -330,6 +381,12 @@ void DBDriver::emptyTrashes(bool async)
 		_trashSignatures.clear();
 		_trashVisualWords.clear();
 
+		// Until committed, these cannot be loaded from the read-only connection
+		signatureIds = uKeys(signatures);
+		visualWordIds = uKeys(visualWords);
+		_emptyingSignatures.insert(signatureIds.begin(), signatureIds.end());
+		_emptyingVisualWords.insert(visualWordIds.begin(), visualWordIds.end());
+
 		_dbSafeAccessMutex.lock();
 	}
 	_trashesMutex.unlock();
@@ -377,6 +434,20 @@ void DBDriver::emptyTrashes(bool async)
 	ULOGGER_DEBUG("Total time emptying trashes = %fs...", _emptyTrashesTime);
 
 	_dbSafeAccessMutex.unlock();
+
+	if(signatureIds.size() || visualWordIds.size())
+	{
+		_trashesMutex.lock();
+		for(unsigned int i=0; i<signatureIds.size(); ++i)
+		{
+			_emptyingSignatures.erase(_emptyingSignatures.find(signatureIds[i]));
+		}
+		for(unsigned int i=0; i<visualWordIds.size(); ++i)
+		{
+			_emptyingVisualWords.erase(_emptyingVisualWords.find(visualWordIds[i]));
+		}
+		_trashesMutex.unlock();
+	}
 }
 
 void DBDriver::asyncSave(Signature * s)
@@ -384,6 +455,7 @@ void DBDriver::asyncSave(Signature * s)
 	if(s)
 	{
 		UDEBUG("s=%d", s->id());
+		invalidatePrefetched(s->id());
 		_trashesMutex.lock();
 		{
 			_trashSignatures.insert(std::pair<int, Signature*>(s->id(), s));
@@ -466,16 +538,19 @@ void DBDriver::saveOrUpdate(const std::vector<VisualWord *> & words) const
 
 void DBDriver::addLink(const Link & link)
 {
+	invalidatePrefetched(link.from());
 	_dbSafeAccessMutex.lock();
 	this->addLinkQuery(link);
 	_dbSafeAccessMutex.unlock();
 }
 void DBDriver::removeLink(int from, int to)
 {
+	invalidatePrefetched(from);
 	this->executeNoResult(uFormat("DELETE FROM Link WHERE from_id=%d and to_id=%d", from, to).c_str());
 }
 void DBDriver::updateLink(const Link & link)
 {
+	invalidatePrefetched(link.from());
 	_dbSafeAccessMutex.lock();
 	this->updateLinkQuery(link);
 	_dbSafeAccessMutex.unlock();
@@ -488,6 +563,7 @@ void DBDriver::updateOccupancyGrid(
 		float cellSize,
 		const cv::Point3f & viewpoint)
 {
+	invalidatePrefetched(nodeId);
 	_dbSafeAccessMutex.lock();
 	//just to make sure the occupancy grids are compressed for convenience
 	SensorData data;
@@ -504,6 +580,7 @@ void DBDriver::updateOccupancyGrid(
 
 void DBDriver::updateDepthImage(int nodeId, const cv::Mat & image)
 {
+	invalidatePrefetched(nodeId);
 	_dbSafeAccessMutex.lock();
 	this->updateDepthImageQuery(
 			nodeId,
@@ -530,9 +607,17 @@ void DBDriver::loadSignatures(const std::list<int> & signIds,
 		std::set<int> * loadedFromTrash)
 {
 	UDEBUG("");
+	if(_prefetchThread && _prefetchThread->isRunning())
+	{
+		// don't load twice the same signatures
+		UDEBUG("Waiting prefetch thread...");
+		_prefetchThread->join();
+	}
+
 	// look up in the trash before the database
 	std::list<int> ids = signIds;
 	bool valueFound = false;
+	bool useReader = false;
 	_trashesMutex.lock();
 	{
 		for(std::list<int>::iterator iter = ids.begin(); iter != ids.end();)
@@ -566,23 +651,207 @@ void DBDriver::loadSignatures(const std::list<int> & signIds,
 				++iter;
 			}
 		}
+		useReader = !isEmptying(_emptyingSignatures, ids);
 	}
 	_trashesMutex.unlock();
+
+	// then in the prefetched signatures
+	_prefetchMutex.lock();
+	if(_prefetchedSignatures.size())
+	{
+		int hits = 0;
+		for(std::list<int>::iterator iter = ids.begin(); iter != ids.end();)
+		{
+			std::map<int, Signature*>::iterator sIter = _prefetchedSignatures.find(*iter);
+			if(sIter != _prefetchedSignatures.end())
+			{
+				signatures.push_back(sIter->second);
+				_prefetchedSignatures.erase(sIter);
+				iter = ids.erase(iter);
+				++hits;
+			}
+			else
+			{
+				++iter;
+			}
+		}
+		UDEBUG("Prefetched signatures used=%d, remaining=%d", hits, (int)_prefetchedSignatures.size());
+	}
+	_prefetchMutex.unlock();
+
 	UDEBUG("");
 	if(ids.size())
 	{
-		_dbSafeAccessMutex.lock();
-		this->loadSignaturesQuery(ids, signatures);
-		_dbSafeAccessMutex.unlock();
+		bool loaded = false;
+		if(useReader)
+		{
+			_readerMutex.lock();
+			if(this->getReaderQuery())
+			{
+				this->getReaderQuery()->loadSignaturesQuery(ids, signatures);
+				loaded = true;
+			}
+			_readerMutex.unlock();
+		}
+		if(!loaded)
+		{
+			_dbSafeAccessMutex.lock();
+			this->loadSignaturesQuery(ids, signatures);
+			_dbSafeAccessMutex.unlock();
+		}
 	}
 }
 
+void DBDriver::prefetchSignatures(const std::list<int> & ids)
+{
+	if(_prefetchThread == 0)
+	{
+		_prefetchThread = new DBDriverPrefetchThread(this);
+	}
+	else if(_prefetchThread->isRunning())
+	{
+		UDEBUG("Previous prefetch is not finished, ignoring %d ids.", (int)ids.size());
+		return;
+	}
+
+	std::set<int> idsSet(ids.begin(), ids.end());
+	std::list<int> idsToLoad;
+	_prefetchMutex.lock();
+	{
+		// release signatures not requested anymore, keeping the cache bounded
+		for(std::map<int, Signature*>::iterator iter=_prefetchedSignatures.begin(); iter!=_prefetchedSignatures.end();)
+		{
+			if(idsSet.find(iter->first) == idsSet.end())
+			{
+				delete iter->second;
+				_prefetchedSignatures.erase(iter++);
+			}
+			else
+			{
+				++iter;
+			}
+		}
+		for(std::set<int>::iterator iter=idsSet.begin(); iter!=idsSet.end(); ++iter)
+		{
+			if(_prefetchedSignatures.find(*iter) == _prefetchedSignatures.end())
+			{
+				idsToLoad.push_back(*iter);
+			}
+		}
+		_prefetchInvalidated.clear();
+	}
+	_prefetchMutex.unlock();
+
+	// don't check isConnected() here, it would wait for the trash thread
+	if(idsToLoad.size())
+	{
+		UDEBUG("Prefetching %d signatures", (int)idsToLoad.size());
+		_prefetchThread->setIds(idsToLoad);
+		_prefetchThread->start();
+	}
+}
+
+int DBDriver::getPrefetchedSignaturesSize() const
+{
+	int size;
+	_prefetchMutex.lock();
+	size = (int)_prefetchedSignatures.size();
+	_prefetchMutex.unlock();
+	return size;
+}
+
+void DBDriver::prefetch(const std::list<int> & ids)
+{
+	UTimer timer;
+	// Signatures in the trash or being saved are more recent than the ones in the database
+	std::list<int> idsToLoad;
+	_trashesMutex.lock();
+	{
+		for(std::list<int>::const_iterator iter=ids.begin(); iter!=ids.end(); ++iter)
+		{
+			if(_trashSignatures.find(*iter) == _trashSignatures.end() &&
+			   _emptyingSignatures.find(*iter) == _emptyingSignatures.end())
+			{
+				idsToLoad.push_back(*iter);
+			}
+		}
+	}
+	_trashesMutex.unlock();
+
+	std::list<Signature *> signatures;
+	if(idsToLoad.size())
+	{
+		bool loaded = false;
+		_readerMutex.lock();
+		if(this->getReaderQuery())
+		{
+			this->getReaderQuery()->loadSignaturesQuery(idsToLoad, signatures);
+			loaded = true;
+		}
+		_readerMutex.unlock();
+		if(!loaded)
+		{
+			_dbSafeAccessMutex.lock();
+			this->loadSignaturesQuery(idsToLoad, signatures);
+			_dbSafeAccessMutex.unlock();
+		}
+	}
+
+	int added = 0;
+	_prefetchMutex.lock();
+	for(std::list<Signature *>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+	{
+		// modified while we were loading it?
+		if(_prefetchInvalidated.find((*iter)->id()) == _prefetchInvalidated.end() &&
+		   _prefetchedSignatures.find((*iter)->id()) == _prefetchedSignatures.end())
+		{
+			_prefetchedSignatures.insert(std::make_pair((*iter)->id(), *iter));
+			++added;
+		}
+		else
+		{
+			delete *iter;
+		}
+	}
+	_prefetchMutex.unlock();
+	UDEBUG("Prefetched %d/%d signatures (%fs)", added, (int)ids.size(), timer.ticks());
+}
+
+void DBDriver::invalidatePrefetched(int id)
+{
+	_prefetchMutex.lock();
+	std::map<int, Signature*>::iterator iter = _prefetchedSignatures.find(id);
+	if(iter != _prefetchedSignatures.end())
+	{
+		delete iter->second;
+		_prefetchedSignatures.erase(iter);
+	}
+	if(_prefetchThread && _prefetchThread->isRunning())
+	{
+		_prefetchInvalidated.insert(id);
+	}
+	_prefetchMutex.unlock();
+}
+
+void DBDriver::clearPrefetched()
+{
+	_prefetchMutex.lock();
+	for(std::map<int, Signature*>::iterator iter=_prefetchedSignatures.begin(); iter!=_prefetchedSignatures.end(); ++iter)
+	{
+		delete iter->second;
+	}
+	_prefetchedSignatures.clear();
+	_prefetchInvalidated.clear();
+	_prefetchMutex.unlock();
+}
+
 void DBDriver::loadWords(const std::set<int> & wordIds, std::list<VisualWord *> & vws)
 {
 	// look up in the trash before the database
 	std::set<int> ids = wordIds;
 	std::map<int, VisualWord*>::iterator wIter;
 	std::list<VisualWord *> puttedBack;
+	bool useReader = false;
 	_trashesMutex.lock();
 	{
 		if(_trashVisualWords.size())
@@ -604,13 +873,28 @@ void DBDriver::loadWords(const std::set<int> & wordIds, std::list<VisualWord *>
 				}
 			}
 		}
+		useReader = !isEmptying(_emptyingVisualWords, ids);
 	}
 	_trashesMutex.unlock();
 	if(ids.size())
 	{
-		_dbSafeAccessMutex.lock();
-		this->loadWordsQuery(ids, vws);
-		_dbSafeAccessMutex.unlock();
+		bool loaded = false;
+		if(useReader)
+		{
+			_readerMutex.lock();
+			if(this->getReaderQuery())
+			{
+				this->getReaderQuery()->loadWordsQuery(ids, vws);
+				loaded = true;
+			}
+			_readerMutex.unlock();
+		}
+		if(!loaded)
+		{
+			_dbSafeAccessMutex.lock();
+			this->loadWordsQuery(ids, vws);
+			_dbSafeAccessMutex.unlock();
+		}
 		uAppend(vws, puttedBack);
 	}
 	else if(puttedBack.size())
@@ -623,6 +907,7 @@ void DBDriver::loadNodeData(std::list<Signature *> & signatures, bool images, bo
 {
 	// Don't look in the trash, we assume that if we want to load
 	// data of a signature, it is not in thrash! Print an error if so.
+	bool useReader = true;
 	_trashesMutex.lock();
 	if(_trashSignatures.size())
 	{
@@ -632,11 +917,32 @@ void DBDriver::loadNodeData(std::list<Signature *> & signatures, bool images, bo
 			UASSERT_MSG(!uContains(_trashSignatures, (*iter)->id()), uFormat("Signature %d should not be used when transferred to trash!!!!", (*iter)->id()).c_str());
 		}
 	}
+	if(_emptyingSignatures.size())
+	{
+		for(std::list<Signature *>::iterator iter=signatures.begin(); useReader && iter!=signatures.end(); ++iter)
+		{
+			useReader = _emptyingSignatures.find((*iter)->id()) == _emptyingSignatures.end();
+		}
+	}
 	_trashesMutex.unlock();
 
-	_dbSafeAccessMutex.lock();
-	this->loadNodeDataQuery(signatures, images, scan, userData, occupancyGrid);
-	_dbSafeAccessMutex.unlock();
+	bool loaded = false;
+	if(useReader)
+	{
+		_readerMutex.lock();
+		if(this->getReaderQuery())
+		{
+			this->getReaderQuery()->loadNodeDataQuery(signatures, images, scan, userData, occupancyGrid);
+			loaded = true;
+		}
+		_readerMutex.unlock();
+	}
+	if(!loaded)
+	{
+		_dbSafeAccessMutex.lock();
+		this->loadNodeDataQuery(signatures, images, scan, userData, occupancyGrid);
+		_dbSafeAccessMutex.unlock();
+	}
 }
 
 void DBDriver::getNodeData(
@@ -645,6 +951,7 @@ void DBDriver::getNodeData(
 		bool images, bool scan, bool userData, bool occupancyGrid) const
 {
 	bool found = false;
+	bool useReader = false;
 	// look in the trash
 	_trashesMutex.lock();
 	if(uContains(_trashSignatures, signatureId))
@@ -660,17 +967,32 @@ void DBDriver::getNodeData(
 			found = true;
 		}
 	}
+	useReader = !found && _emptyingSignatures.find(signatureId) == _emptyingSignatures.end();
 	_trashesMutex.unlock();
 
 	if(!found)
 	{
-		_dbSafeAccessMutex.lock();
 		std::list<Signature *> signatures;
 		Signature tmp(signatureId);
 		signatures.push_back(&tmp);
-		loadNodeDataQuery(signatures, images, scan, userData, occupancyGrid);
+		bool loaded = false;
+		if(useReader)
+		{
+			_readerMutex.lock();
+			if(this->getReaderQuery())
+			{
+				this->getReaderQuery()->loadNodeDataQuery(signatures, images, scan, userData, occupancyGrid);
+				loaded = true;
+			}
+			_readerMutex.unlock();
+		}
+		if(!loaded)
+		{
+			_dbSafeAccessMutex.lock();
+			loadNodeDataQuery(signatures, images, scan, userData, occupancyGrid);
+			_dbSafeAccessMutex.unlock();
+		}
 		data = signatures.front()->sensorData();
-		_dbSafeAccessMutex.unlock();
 	}
 }
 
@@ -922,7 +1244,7 @@ void DBDriver::getInvertedIndexNi(int signatureId, int & ni) const
 	_trashesMutex.lock();
 	if(uContains(_trashSignatures, signatureId))
 	{
-		ni = _trashSignatures.at(signatureId)->getWords().size();
+		ni = (int)_trashSignatures.at(signatureId)->getWordIds().size();
 		found = true;
 	}
 	_trashesMutex.unlock();
@@ -1090,6 +1412,21 @@ cv::Mat DBDriver::load2DMap(float & xMin, float & yMin, float & cellSize) const
 	return map;
 }
 
+void DBDriver::saveDictionaryIndex(const cv::Mat & index) const
+{
+	_dbSafeAccessMutex.lock();
+	saveDictionaryIndexQuery(index);
+	_dbSafeAccessMutex.unlock();
+}
+
+cv::Mat DBDriver::loadDictionaryIndex() const
+{
+	_dbSafeAccessMutex.lock();
+	cv::Mat index = loadDictionaryIndexQuery();
+	_dbSafeAccessMutex.unlock();
+	return index;
+}
+
 void DBDriver::saveOptimizedMesh(
 			const cv::Mat & cloud,
 			const std::vector<std::vector<std::vector<unsigned int> > > & polygons,
@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/Compression.h"
 #include "DatabaseSchema_sql.h"
 #include <set>
+#include <algorithm>
 
 #include "rtabmap/utilite/UtiLite.h"
 
@@ -49,7 +50,9 @@ DBDriverSqlite3::DBDriverSqlite3(const ParametersMap & parameters) :
 	_cacheSize(Parameters::defaultDbSqlite3CacheSize()),
 	_journalMode(Parameters::defaultDbSqlite3JournalMode()),
 	_synchronous(Parameters::defaultDbSqlite3Synchronous()),
-	_tempStore(Parameters::defaultDbSqlite3TempStore())
+	_tempStore(Parameters::defaultDbSqlite3TempStore()),
+	_cacheStatements(Parameters::defaultDbSqlite3CacheStatements()),
+	_reader(0)
 {
 	ULOGGER_DEBUG("treadSafe=%d", sqlite3_threadsafe());
 	this->parseParameters(parameters);
@@ -83,9 +86,26 @@ void DBDriverSqlite3::parseParameters(const ParametersMap & parameters)
 	{
 		this->setDbInMemory(uStr2Bool((*iter).second.c_str()));
 	}
+	if((iter=parameters.find(Parameters::kDbSqlite3CacheStatements())) != parameters.end())
+	{
+		this->setCacheStatements(uStr2Bool((*iter).second.c_str()));
+	}
 	DBDriver::parseParameters(parameters);
 }
 
+void DBDriverSqlite3::setCacheStatements(bool cacheStatements)
+{
+	if(_cacheStatements && !cacheStatements)
+	{
+		for(std::map<std::string, sqlite3_stmt *>::iterator iter=_cachedStatements.begin(); iter!=_cachedStatements.end(); ++iter)
+		{
+			sqlite3_finalize(iter->second);
+		}
+		_cachedStatements.clear();
+	}
+	_cacheStatements = cacheStatements;
+}
+
 void DBDriverSqlite3::setCacheSize(unsigned int cacheSize)
 {
 	if(this->isConnected())
@@ -99,13 +119,17 @@ void DBDriverSqlite3::setCacheSize(unsigned int cacheSize)
 
 void DBDriverSqlite3::setJournalMode(int journalMode)
 {
-	if(journalMode >= 0 && journalMode < 5)
+	if(journalMode >= 0 && journalMode < 6)
 	{
+		bool changed = _journalMode != journalMode;
 		_journalMode = journalMode;
 		if(this->isConnected())
 		{
 			switch(_journalMode)
 			{
+			case 5:
+				this->executeNoResultQuery("PRAGMA journal_mode = WAL;");
+				break;
 			case 4:
 				this->executeNoResultQuery("PRAGMA journal_mode = OFF;");
 				break;
@@ -123,6 +147,11 @@ void DBDriverSqlite3::setJournalMode(int journalMode)
 				this->executeNoResultQuery("PRAGMA journal_mode = DELETE;");
 				break;
 			}
+			if(changed)
+			{
+				// the reader is opened in connectDatabaseQuery(), reopen it only if the mode changed
+				this->connectReader();
+			}
 		}
 	}
 	else
@@ -406,6 +435,8 @@ bool DBDriverSqlite3::connectDatabaseQuery(const std::string & url, bool overwri
 	this->setSynchronous(_synchronous); // this will call the SQL
 	this->setTempStore(_tempStore); // this will call the SQL
 
+	this->connectReader();
+
 	return true;
 }
 void DBDriverSqlite3::disconnectDatabaseQuery(bool save, const std::string & outputUrl)
@@ -413,8 +444,10 @@ void DBDriverSqlite3::disconnectDatabaseQuery(bool save, const std::string & out
 	UDEBUG("");
 	if(_ppDb)
 	{
+		this->disconnectReader();
+
 		int rc = SQLITE_OK;
-		// make sure that all statements are finalized
+		// make sure that all statements are finalized (including the cached ones)
 		sqlite3_stmt * pStmt;
 		while( (pStmt = sqlite3_next_stmt(_ppDb, 0))!=0 )
 		{
@@ -424,6 +457,7 @@ void DBDriverSqlite3::disconnectDatabaseQuery(bool save, const std::string & out
 				UERROR("");
 			}
 		}
+		_cachedStatements.clear();
 
 		if(save && (_dbInMemory || this->getUrl().empty()))
 		{
@@ -467,6 +501,55 @@ void DBDriverSqlite3::disconnectDatabaseQuery(bool save, const std::string & out
 	}
 }
 
+void DBDriverSqlite3::connectReader()
+{
+	this->disconnectReader();
+	if(_ppDb && _journalMode == 5 && !this->isInMemory())
+	{
+		// In WAL mode, readers don't block the writer and the writer doesn't
+		// block readers, so data can be loaded while the trash is emptied.
+		sqlite3 * ppDb = 0;
+		int rc = sqlite3_open_v2(this->getUrl().c_str(), &ppDb, SQLITE_OPEN_READONLY, 0);
+		if(rc == SQLITE_OK)
+		{
+			// The reader only runs queries: it is never started
+			// and it doesn't create a prefetch thread.
+			DBDriverSqlite3 * reader = new DBDriverSqlite3();
+			reader->_ppDb = ppDb;
+			reader->_version = _version;
+			reader->setCacheSize(_cacheSize);
+			_readerMutex.lock();
+			_reader = reader;
+			_readerMutex.unlock();
+			UINFO("Opened read-only connection to \"%s\".", this->getUrl().c_str());
+		}
+		else
+		{
+			UWARN("Could not open a read-only connection to \"%s\" (%s), all "
+				  "queries will use the same connection.", this->getUrl().c_str(), sqlite3_errmsg(ppDb));
+			sqlite3_close(ppDb);
+		}
+	}
+	else if(_journalMode == 5 && _ppDb)
+	{
+		UWARN("WAL journal mode is not supported for databases in memory.");
+	}
+}
+
+void DBDriverSqlite3::disconnectReader()
+{
+	// wait for the queries using the reader
+	_readerMutex.lock();
+	DBDriverSqlite3 * reader = _reader;
+	_reader = 0;
+	_readerMutex.unlock();
+	if(reader)
+	{
+		reader->closeConnection(false);
+		delete reader;
+	}
+}
+
 bool DBDriverSqlite3::isConnectedQuery() const
 {
 	return _ppDb != 0;
@@ -2761,9 +2844,10 @@ void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<
 			const void * descriptor = 0;
 			int dRealSize = 0;
 			cv::KeyPoint kpt;
-			std::multimap<int, cv::KeyPoint> visualWords;
-			std::multimap<int, cv::Point3f> visualWords3;
-			std::multimap<int, cv::Mat> descriptors;
+			std::vector<int> visualWordIds;
+			std::vector<cv::KeyPoint> visualWords;
+			std::vector<cv::Point3f> visualWords3;
+			cv::Mat descriptors;
 			cv::Point3f depth(0,0,0);
 
 			// Process the result if one
@@ -2812,8 +2896,9 @@ void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<
 					depth.z = sqlite3_column_double(ppStmt, index++);
 				}
 
-				visualWords.insert(visualWords.end(), std::make_pair(visualWordId, kpt));
-				visualWords3.insert(visualWords3.end(), std::make_pair(visualWordId, depth));
+				visualWordIds.push_back(visualWordId);
+				visualWords.push_back(kpt);
+				visualWords3.push_back(depth);
 
 				if(uStrNumCmp(_version, "0.11.2") >= 0)
 				{
@@ -2841,7 +2926,7 @@ void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<
 
 						memcpy(d.data, descriptor, dRealSize);
 
-						descriptors.insert(descriptors.end(), std::make_pair(visualWordId, d));
+						descriptors.push_back(d);
 					}
 				}
 
@@ -2855,10 +2940,13 @@ void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<
 			}
 			else
 			{
-				(*iter)->setWords(visualWords);
-				(*iter)->setWords3(visualWords3);
-				(*iter)->setWordsDescriptors(descriptors);
-				ULOGGER_DEBUG("Add %d keypoints, %d 3d points and %d descriptors to node %d", (int)visualWords.size(), (int)visualWords3.size(), (int)descriptors.size(), (*iter)->id());
+				if(!descriptors.empty() && descriptors.rows != (int)visualWordIds.size())
+				{
+					UWARN("Node %d has %d descriptors for %d words, descriptors are ignored.", (*iter)->id(), descriptors.rows, (int)visualWordIds.size());
+					descriptors = cv::Mat();
+				}
+				(*iter)->setWords(visualWordIds, visualWords, visualWords3, descriptors);
+				ULOGGER_DEBUG("Add %d keypoints, %d 3d points and %d descriptors to node %d", (int)visualWords.size(), (int)visualWords3.size(), descriptors.rows, (*iter)->id());
 			}
 
 			//reset
@@ -3607,8 +3695,7 @@ void DBDriverSqlite3::updateQuery(const std::list<Signature *> & nodes, bool upd
 				query = "UPDATE Node SET weight=? WHERE id=?;";
 			}
 		}
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareStatement(query);
 
 		for(std::list<Signature *>::const_iterator i=nodes.begin(); i!=nodes.end(); ++i)
 		{
@@ -3644,16 +3731,14 @@ void DBDriverSqlite3::updateQuery(const std::list<Signature *> & nodes, bool upd
 				UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 			}
 		}
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		// Reset the statement for the next batch (finalized if not cached)
+		releaseStatement(ppStmt);
 
 		ULOGGER_DEBUG("Update Node table, Time=%fs", timer.ticks());
 
 		// Update links part1
 		query = "DELETE FROM Link WHERE from_id=?;";
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareStatement(query);
 		for(std::list<Signature *>::const_iterator j=nodes.begin(); j!=nodes.end(); ++j)
 		{
 			if((*j)->isLinksModified())
@@ -3668,14 +3753,12 @@ void DBDriverSqlite3::updateQuery(const std::list<Signature *> & nodes, bool upd
 				UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 			}
 		}
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		// Reset the statement for the next batch (finalized if not cached)
+		releaseStatement(ppStmt);
 
 		// Update links part2
 		query = queryStepLink();
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareStatement(query);
 		for(std::list<Signature *>::const_iterator j=nodes.begin(); j!=nodes.end(); ++j)
 		{
 			if((*j)->isLinksModified())
@@ -3688,15 +3771,13 @@ void DBDriverSqlite3::updateQuery(const std::list<Signature *> & nodes, bool upd
 				}
 			}
 		}
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		// Reset the statement for the next batch (finalized if not cached)
+		releaseStatement(ppStmt);
 		ULOGGER_DEBUG("Update Neighbors Time=%fs", timer.ticks());
 
 		// Update word references
 		query = queryStepWordsChanged();
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareStatement(query);
 		for(std::list<Signature *>::const_iterator j=nodes.begin(); j!=nodes.end(); ++j)
 		{
 			if((*j)->getWordsChanged().size())
@@ -3708,9 +3789,8 @@ void DBDriverSqlite3::updateQuery(const std::list<Signature *> & nodes, bool upd
 				}
 			}
 		}
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		// Reset the statement for the next batch (finalized if not cached)
+		releaseStatement(ppStmt);
 
 		ULOGGER_DEBUG("signatures update=%fs", timer.ticks());
 	}
@@ -3728,8 +3808,7 @@ void DBDriverSqlite3::updateQuery(const std::list<VisualWord *> & words, bool up
 		VisualWord * w = 0;
 
 		std::string query = "UPDATE Word SET time_enter = DATETIME('NOW') WHERE id=?;";
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareStatement(query);
 
 		for(std::list<VisualWord *>::const_iterator i=words.begin(); i!=words.end(); ++i)
 		{
@@ -3748,9 +3827,8 @@ void DBDriverSqlite3::updateQuery(const std::list<VisualWord *> & words, bool up
 			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
 		}
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		// Reset the statement for the next batch (finalized if not cached)
+		releaseStatement(ppStmt);
 
 		ULOGGER_DEBUG("Update Word table, Time=%fs", timer.ticks());
 	}
@@ -3764,13 +3842,11 @@ void DBDriverSqlite3::saveQuery(const std::list<Signature *> & signatures)
 		std::string type;
 		UTimer timer;
 		timer.start();
-		int rc = SQLITE_OK;
 		sqlite3_stmt * ppStmt = 0;
 
 		// Signature table
 		std::string query = queryStepNode();
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareStatement(query);
 
 		for(std::list<Signature *>::const_iterator i=signatures.begin(); i!=signatures.end(); ++i)
 		{
@@ -3782,16 +3858,14 @@ void DBDriverSqlite3::saveQuery(const std::list<Signature *> & signatures)
 
 			stepNode(ppStmt, *i);
 		}
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		// Reset the statement for the next batch (finalized if not cached)
+		releaseStatement(ppStmt);
 
 		UDEBUG("Time=%fs", timer.ticks());
 
 		// Create new entries in table Link
 		query = queryStepLink();
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareStatement(query);
 		for(std::list<Signature *>::const_iterator jter=signatures.begin(); jter!=signatures.end(); ++jter)
 		{
 			// Save links
@@ -3801,56 +3875,81 @@ void DBDriverSqlite3::saveQuery(const std::list<Signature *> & signatures)
 				stepLink(ppStmt, i->second);
 			}
 		}
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		// Reset the statement for the next batch (finalized if not cached)
+		releaseStatement(ppStmt);
 
 		UDEBUG("Time=%fs", timer.ticks());
 
 
-		// Create new entries in table Feature
+		// Create new entries in table Feature. Most rows are inserted by
+		// groups of "batchRows" rows with the same statement, the
+		// remaining ones are inserted one by one.
 		query = queryStepKeypoint();
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareStatement(query);
+		int columns = (int)std::count(query.begin(), query.end(), '?');
+		int batchRows = sqlite3_limit(_ppDb, SQLITE_LIMIT_VARIABLE_NUMBER, -1) / columns;
+		batchRows = batchRows < 100?batchRows:100; // under the default compound select limit (500)
+		int totalRows = 0;
 		for(std::list<Signature *>::const_iterator i=signatures.begin(); i!=signatures.end(); ++i)
 		{
-			UASSERT((*i)->getWords3().empty() || (*i)->getWords().size() == (*i)->getWords3().size());
-			UASSERT((*i)->getWordsDescriptors().empty() || (*i)->getWords().size() == (*i)->getWordsDescriptors().size());
-
-			std::multimap<int, cv::Point3f>::const_iterator p=(*i)->getWords3().begin();
-			std::multimap<int, cv::Mat>::const_iterator d=(*i)->getWordsDescriptors().begin();
-			for(std::multimap<int, cv::KeyPoint>::const_iterator w=(*i)->getWords().begin(); w!=(*i)->getWords().end(); ++w)
+			totalRows += (int)(*i)->getWordKeypoints().size();
+		}
+		int batchedRows = batchRows>1?(totalRows/batchRows)*batchRows:0;
+		sqlite3_stmt * ppStmtBatch = batchedRows?prepareStatement(queryStepKeypoint(batchRows)):0;
+		int row = 0;
+		for(std::list<Signature *>::const_iterator i=signatures.begin(); i!=signatures.end(); ++i)
+		{
+			// keypoints, points and descriptors are parallel arrays with the same ids
+			const std::vector<int> & ids = (*i)->getWordIds();
+			const std::vector<cv::KeyPoint> & kpts = (*i)->getWordKeypoints();
+			const std::vector<cv::Point3f> & points = (*i)->getWordPoints3();
+			const cv::Mat & descriptors = (*i)->getWordDescriptorsMat();
+			for(unsigned int w=0; w<kpts.size(); ++w)
 			{
 				cv::Point3f pt(0,0,0);
-				if(p!=(*i)->getWords3().end())
+				if(!points.empty())
 				{
-					UASSERT(w->first == p->first); // must be same id!
-					pt = p->second;
-					++p;
+					pt = points[w];
 				}
 
 				cv::Mat descriptor;
-				if(d!=(*i)->getWordsDescriptors().end())
+				if(!descriptors.empty())
 				{
-					UASSERT(w->first == d->first); // must be same id!
-					descriptor = d->second;
-					++d;
+					descriptor = descriptors.row(w);
 				}
 
-				stepKeypoint(ppStmt, (*i)->id(), w->first, w->second, pt, descriptor);
+				if(row < batchedRows)
+				{
+					// descriptors are bound as SQLITE_STATIC, their data stay in the signatures
+					bindKeypoint(ppStmtBatch, (row%batchRows)*columns+1, (*i)->id(), ids[w], kpts[w], pt, descriptor);
+					if((row+1)%batchRows == 0)
+					{
+						int rc = sqlite3_step(ppStmtBatch);
+						UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+						rc = sqlite3_reset(ppStmtBatch);
+						UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+					}
+				}
+				else
+				{
+					stepKeypoint(ppStmt, (*i)->id(), ids[w], kpts[w], pt, descriptor);
+				}
+				++row;
 			}
 		}
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		// Reset the statements for the next batch (finalized if not cached)
+		if(ppStmtBatch)
+		{
+			releaseStatement(ppStmtBatch);
+		}
+		releaseStatement(ppStmt);
 		UDEBUG("Time=%fs", timer.ticks());
 
 		if(uStrNumCmp(_version, "0.10.0") >= 0)
 		{
 			// Add SensorData
 			query = queryStepSensorData();
-			rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			ppStmt = prepareStatement(query);
 			UDEBUG("Saving %d images", signatures.size());
 
 			for(std::list<Signature *>::const_iterator i=signatures.begin(); i!=signatures.end(); ++i)
@@ -3867,17 +3966,15 @@ void DBDriverSqlite3::saveQuery(const std::list<Signature *> & signatures)
 				}
 			}
 
-			// Finalize (delete) the statement
-			rc = sqlite3_finalize(ppStmt);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			// Reset the statement for the next batch (finalized if not cached)
+			releaseStatement(ppStmt);
 			UDEBUG("Time=%fs", timer.ticks());
 		}
 		else
 		{
 			// Add images
 			query = queryStepImage();
-			rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			ppStmt = prepareStatement(query);
 			UDEBUG("Saving %d images", signatures.size());
 
 			for(std::list<Signature *>::const_iterator i=signatures.begin(); i!=signatures.end(); ++i)
@@ -3888,15 +3985,13 @@ void DBDriverSqlite3::saveQuery(const std::list<Signature *> & signatures)
 				}
 			}
 
-			// Finalize (delete) the statement
-			rc = sqlite3_finalize(ppStmt);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			// Reset the statement for the next batch (finalized if not cached)
+			releaseStatement(ppStmt);
 			UDEBUG("Time=%fs", timer.ticks());
 
 			// Add depths
 			query = queryStepDepth();
-			rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			ppStmt = prepareStatement(query);
 			for(std::list<Signature *>::const_iterator i=signatures.begin(); i!=signatures.end(); ++i)
 			{
 				//metric
@@ -3906,9 +4001,8 @@ void DBDriverSqlite3::saveQuery(const std::list<Signature *> & signatures)
 					stepDepth(ppStmt, (*i)->sensorData());
 				}
 			}
-			// Finalize (delete) the statement
-			rc = sqlite3_finalize(ppStmt);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			// Reset the statement for the next batch (finalized if not cached)
+			releaseStatement(ppStmt);
 		}
 
 		UDEBUG("Time=%fs", timer.ticks());
@@ -3931,8 +4025,7 @@ void DBDriverSqlite3::saveQuery(const std::list<VisualWord *> & words) const
 		if(words.size()>0)
 		{
 			query = std::string("INSERT INTO Word(id, descriptor_size, descriptor) VALUES(?,?,?);");
-			rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			ppStmt = prepareStatement(query);
 			for(std::list<VisualWord *>::const_iterator iter=words.begin(); iter!=words.end(); ++iter)
 			{
 				const VisualWord * w = *iter;
@@ -3964,9 +4057,8 @@ void DBDriverSqlite3::saveQuery(const std::list<VisualWord *> & words) const
 					UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 				}
 			}
-			// Finalize (delete) the statement
-			rc = sqlite3_finalize(ppStmt);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			// Reset the statement for the next batch (finalized if not cached)
+			releaseStatement(ppStmt);
 		}
 
 		UDEBUG("Time=%fs", timer.ticks());
@@ -4546,6 +4638,93 @@ cv::Mat DBDriverSqlite3::load2DMapQuery(float & xMin, float & yMin, float & cell
 	return map;
 }
 
+void DBDriverSqlite3::saveDictionaryIndexQuery(const cv::Mat & dictionaryIndex) const
+{
+	UDEBUG("");
+	if(_ppDb && uStrNumCmp(_version, "0.17.6") >= 0)
+	{
+		UTimer timer;
+		timer.start();
+		int rc = SQLITE_OK;
+		sqlite3_stmt * ppStmt = 0;
+		std::string query;
+
+		// Update table Admin
+		query = uFormat("UPDATE Admin SET dictionary_index=?, time_enter = DATETIME('NOW') WHERE version='%s';", _version.c_str());
+		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+		int index = 1;
+
+		// the FLANN index is already compressed (lz4)
+		if(dictionaryIndex.empty())
+		{
+			rc = sqlite3_bind_null(ppStmt, index++);
+			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		}
+		else
+		{
+			UASSERT(dictionaryIndex.type() == CV_8UC1 && dictionaryIndex.rows == 1);
+			rc = sqlite3_bind_blob(ppStmt, index++, dictionaryIndex.data, dictionaryIndex.cols, SQLITE_STATIC);
+			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		}
+
+		//execute query
+		rc=sqlite3_step(ppStmt);
+		UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+		// Finalize (delete) the statement
+		rc = sqlite3_finalize(ppStmt);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+		UDEBUG("Time=%fs (%d bytes)", timer.ticks(), dictionaryIndex.cols);
+	}
+}
+
+cv::Mat DBDriverSqlite3::loadDictionaryIndexQuery() const
+{
+	UDEBUG("");
+	cv::Mat index;
+	if(_ppDb && uStrNumCmp(_version, "0.17.6") >= 0)
+	{
+		UTimer timer;
+		timer.start();
+		int rc = SQLITE_OK;
+		sqlite3_stmt * ppStmt = 0;
+		std::stringstream query;
+
+		query << "SELECT dictionary_index "
+			  << "FROM Admin "
+			  << "WHERE version='" << _version.c_str()
+			  <<"';";
+
+		rc = sqlite3_prepare_v2(_ppDb, query.str().c_str(), -1, &ppStmt, 0);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+		// Process the result if one
+		rc = sqlite3_step(ppStmt);
+		UASSERT_MSG(rc == SQLITE_ROW, uFormat("DB error (%s): Not found first Admin row: query=\"%s\"", _version.c_str(), query.str().c_str()).c_str());
+		if(rc == SQLITE_ROW)
+		{
+			//dictionary_index
+			const void * data = sqlite3_column_blob(ppStmt, 0);
+			int dataSize = sqlite3_column_bytes(ppStmt, 0);
+			if(dataSize>0 && data)
+			{
+				index = cv::Mat(1, dataSize, CV_8UC1, (void *)data).clone();
+			}
+			rc = sqlite3_step(ppStmt); // next result...
+		}
+		UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+		// Finalize (delete) the statement
+		rc = sqlite3_finalize(ppStmt);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ULOGGER_DEBUG("Time=%fs (%d bytes)", timer.ticks(), index.cols);
+	}
+	return index;
+}
+
 void DBDriverSqlite3::saveOptimizedMeshQuery(
 			const cv::Mat & cloud,
 			const std::vector<std::vector<std::vector<unsigned int> > > & polygons,
@@ -4879,6 +5058,46 @@ cv::Mat DBDriverSqlite3::loadOptimizedMeshQuery(
 	return cloud;
 }
 
+sqlite3_stmt * DBDriverSqlite3::prepareStatement(const std::string & query) const
+{
+	UASSERT(_ppDb);
+	if(_cacheStatements)
+	{
+		std::map<std::string, sqlite3_stmt *>::iterator iter = _cachedStatements.find(query);
+		if(iter != _cachedStatements.end())
+		{
+			return iter->second;
+		}
+	}
+
+	sqlite3_stmt * ppStmt = 0;
+	int rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+	if(_cacheStatements)
+	{
+		_cachedStatements.insert(std::make_pair(query, ppStmt));
+	}
+	return ppStmt;
+}
+
+void DBDriverSqlite3::releaseStatement(sqlite3_stmt * ppStmt) const
+{
+	int rc = SQLITE_OK;
+	if(_cacheStatements)
+	{
+		// Keep it for the next batch, bound blobs are SQLITE_STATIC so
+		// make sure they don't point on released data.
+		rc = sqlite3_reset(ppStmt);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		rc = sqlite3_clear_bindings(ppStmt);
+	}
+	else
+	{
+		rc = sqlite3_finalize(ppStmt);
+	}
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+}
+
 std::string DBDriverSqlite3::queryStepNode() const
 {
 	if(uStrNumCmp(_version, "0.14.0") >= 0)
@@ -5632,21 +5851,36 @@ void DBDriverSqlite3::stepWordsChanged(sqlite3_stmt * ppStmt, int nodeId, int ol
 	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 }
 
-std::string DBDriverSqlite3::queryStepKeypoint() const
+std::string DBDriverSqlite3::queryStepKeypoint(int rows) const
 {
+	std::string query;
+	std::string values;
 	if(uStrNumCmp(_version, "0.13.0") >= 0)
 	{
-		return "INSERT INTO Feature(node_id, word_id, pos_x, pos_y, size, dir, response, octave, depth_x, depth_y, depth_z, descriptor_size, descriptor) VALUES(?,?,?,?,?,?,?,?,?,?,?,?,?);";
+		query = "INSERT INTO Feature(node_id, word_id, pos_x, pos_y, size, dir, response, octave, depth_x, depth_y, depth_z, descriptor_size, descriptor) VALUES";
+		values = "(?,?,?,?,?,?,?,?,?,?,?,?,?)";
 	}
 	else if(uStrNumCmp(_version, "0.12.0") >= 0)
 	{
-		return "INSERT INTO Map_Node_Word(node_id, word_id, pos_x, pos_y, size, dir, response, octave, depth_x, depth_y, depth_z, descriptor_size, descriptor) VALUES(?,?,?,?,?,?,?,?,?,?,?,?,?);";
+		query = "INSERT INTO Map_Node_Word(node_id, word_id, pos_x, pos_y, size, dir, response, octave, depth_x, depth_y, depth_z, descriptor_size, descriptor) VALUES";
+		values = "(?,?,?,?,?,?,?,?,?,?,?,?,?)";
 	}
 	else if(uStrNumCmp(_version, "0.11.2") >= 0)
 	{
-		return "INSERT INTO Map_Node_Word(node_id, word_id, pos_x, pos_y, size, dir, response, depth_x, depth_y, depth_z, descriptor_size, descriptor) VALUES(?,?,?,?,?,?,?,?,?,?,?,?);";
+		query = "INSERT INTO Map_Node_Word(node_id, word_id, pos_x, pos_y, size, dir, response, depth_x, depth_y, depth_z, descriptor_size, descriptor) VALUES";
+		values = "(?,?,?,?,?,?,?,?,?,?,?,?)";
+	}
+	else
+	{
+		query = "INSERT INTO Map_Node_Word(node_id, word_id, pos_x, pos_y, size, dir, response, depth_x, depth_y, depth_z) VALUES";
+		values = "(?,?,?,?,?,?,?,?,?,?)";
 	}
-	return "INSERT INTO Map_Node_Word(node_id, word_id, pos_x, pos_y, size, dir, response, depth_x, depth_y, depth_z) VALUES(?,?,?,?,?,?,?,?,?,?);";
+	// multi-row insert
+	for(int i=0; i<rows; ++i)
+	{
+		query += i==0?values:","+values;
+	}
+	return query + ";";
 }
 void DBDriverSqlite3::stepKeypoint(sqlite3_stmt * ppStmt,
 		int nodeId,
@@ -5654,13 +5888,29 @@ void DBDriverSqlite3::stepKeypoint(sqlite3_stmt * ppStmt,
 		const cv::KeyPoint & kp,
 		const cv::Point3f & pt,
 		const cv::Mat & descriptor) const
+{
+	bindKeypoint(ppStmt, 1, nodeId, wordId, kp, pt, descriptor);
+
+	int rc=sqlite3_step(ppStmt);
+	UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+	rc = sqlite3_reset(ppStmt);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+}
+// Bind the values of a keypoint starting at parameter "index", return the next parameter index
+int DBDriverSqlite3::bindKeypoint(sqlite3_stmt * ppStmt,
+		int index,
+		int nodeId,
+		int wordId,
+		const cv::KeyPoint & kp,
+		const cv::Point3f & pt,
+		const cv::Mat & descriptor) const
 {
 	if(!ppStmt)
 	{
 		UFATAL("");
 	}
 	int rc = SQLITE_OK;
-	int index = 1;
 	rc = sqlite3_bind_int(ppStmt, index++, nodeId);
 	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 	rc = sqlite3_bind_int(ppStmt, index++, wordId);
@@ -5739,12 +5989,7 @@ void DBDriverSqlite3::stepKeypoint(sqlite3_stmt * ppStmt,
 		}
 		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 	}
-
-	rc=sqlite3_step(ppStmt);
-	UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
-
-	rc = sqlite3_reset(ppStmt);
-	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+	return index;
 }
 
 std::string DBDriverSqlite3::queryStepOccupancyGridUpdate() const
@@ -36,6 +36,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <opencv2/core/core_c.h>
 #include <opencv2/calib3d/calib3d.hpp>
 #include <iostream>
+#include <algorithm>
 
 namespace rtabmap
 {
@@ -442,24 +443,54 @@ int EpipolarGeometry::findPairs(const std::multimap<int, cv::KeyPoint> & wordsA,
 		std::list<std::pair<int, std::pair<cv::KeyPoint, cv::KeyPoint> > > & pairs,
 		bool ignoreInvalidIds)
 {
-	const std::list<int> & ids = uUniqueKeys(wordsA);
-	std::multimap<int, cv::KeyPoint>::const_iterator iterA;
-	std::multimap<int, cv::KeyPoint>::const_iterator iterB;
+	// Both maps are sorted by id, merge them linearly
+	std::multimap<int, cv::KeyPoint>::const_iterator iterA = ignoreInvalidIds?wordsA.lower_bound(0):wordsA.begin();
+	std::multimap<int, cv::KeyPoint>::const_iterator iterB = ignoreInvalidIds?wordsB.lower_bound(0):wordsB.begin();
 	pairs.clear();
 	int realPairsCount = 0;
-	for(std::list<int>::const_iterator i=ids.begin(); i!=ids.end(); ++i)
+	while(iterA != wordsA.end() && iterB != wordsB.end())
 	{
-		if(!ignoreInvalidIds || (ignoreInvalidIds && *i >= 0))
+		if(iterA->first < iterB->first)
 		{
-			iterA = wordsA.find(*i);
-			iterB = wordsB.find(*i);
-			while(iterA != wordsA.end() && iterB != wordsB.end() && (*iterA).first == (*iterB).first && (*iterA).first == *i)
-			{
-				pairs.push_back(std::pair<int, std::pair<cv::KeyPoint, cv::KeyPoint> >(*i, std::pair<cv::KeyPoint, cv::KeyPoint>((*iterA).second, (*iterB).second)));
-				++iterA;
-				++iterB;
-				++realPairsCount;
-			}
+			++iterA;
+		}
+		else if(iterB->first < iterA->first)
+		{
+			++iterB;
+		}
+		else
+		{
+			pairs.push_back(std::pair<int, std::pair<cv::KeyPoint, cv::KeyPoint> >(iterA->first, std::pair<cv::KeyPoint, cv::KeyPoint>(iterA->second, iterB->second)));
+			++iterA;
+			++iterB;
+			++realPairsCount;
+		}
+	}
+	return realPairsCount;
+}
+
+int EpipolarGeometry::countPairs(const std::vector<int> & wordIdsA,
+		const std::vector<int> & wordIdsB,
+		bool ignoreInvalidIds)
+{
+	std::vector<int>::const_iterator iterA = ignoreInvalidIds?std::lower_bound(wordIdsA.begin(), wordIdsA.end(), 0):wordIdsA.begin();
+	std::vector<int>::const_iterator iterB = ignoreInvalidIds?std::lower_bound(wordIdsB.begin(), wordIdsB.end(), 0):wordIdsB.begin();
+	int realPairsCount = 0;
+	while(iterA != wordIdsA.end() && iterB != wordIdsB.end())
+	{
+		if(*iterA < *iterB)
+		{
+			++iterA;
+		}
+		else if(*iterB < *iterA)
+		{
+			++iterB;
+		}
+		else
+		{
+			++iterA;
+			++iterB;
+			++realPairsCount;
 		}
 	}
 	return realPairsCount;
@@ -475,24 +506,38 @@ int EpipolarGeometry::findPairsUnique(
 		std::list<std::pair<int, std::pair<cv::KeyPoint, cv::KeyPoint> > > & pairs,
 		bool ignoreInvalidIds)
 {
-	const std::list<int> & ids = uUniqueKeys(wordsA);
+	std::multimap<int, cv::KeyPoint>::const_iterator iterA = ignoreInvalidIds?wordsA.lower_bound(0):wordsA.begin();
+	std::multimap<int, cv::KeyPoint>::const_iterator iterB = ignoreInvalidIds?wordsB.lower_bound(0):wordsB.begin();
 	int realPairsCount = 0;
 	pairs.clear();
-	for(std::list<int>::const_iterator i=ids.begin(); i!=ids.end(); ++i)
+	while(iterA != wordsA.end() && iterB != wordsB.end())
 	{
-		if(!ignoreInvalidIds || (ignoreInvalidIds && *i>=0))
+		if(iterA->first < iterB->first)
+		{
+			++iterA;
+		}
+		else if(iterB->first < iterA->first)
+		{
+			++iterB;
+		}
+		else
 		{
-			std::list<cv::KeyPoint> ptsA = uValues(wordsA, *i);
-			std::list<cv::KeyPoint> ptsB = uValues(wordsB, *i);
-			if(ptsA.size() == 1 && ptsB.size() == 1)
+			int id = iterA->first;
+			std::multimap<int, cv::KeyPoint>::const_iterator firstA = iterA;
+			std::multimap<int, cv::KeyPoint>::const_iterator firstB = iterB;
+			int countA = 0;
+			int countB = 0;
+			for(; iterA != wordsA.end() && iterA->first == id; ++iterA, ++countA);
+			for(; iterB != wordsB.end() && iterB->first == id; ++iterB, ++countB);
+			if(countA == 1 && countB == 1)
 			{
-				pairs.push_back(std::pair<int, std::pair<cv::KeyPoint, cv::KeyPoint> >(*i, std::pair<cv::KeyPoint, cv::KeyPoint>(ptsA.front(), ptsB.front())));
+				pairs.push_back(std::pair<int, std::pair<cv::KeyPoint, cv::KeyPoint> >(id, std::pair<cv::KeyPoint, cv::KeyPoint>(firstA->second, firstB->second)));
 				++realPairsCount;
 			}
-			else if(ptsA.size()>1 && ptsB.size()>1)
+			else if(countA>1 && countB>1)
 			{
 				// just update the count
-				realPairsCount += ptsA.size() > ptsB.size() ? ptsB.size() : ptsA.size();
+				realPairsCount += countA > countB ? countB : countA;
 			}
 		}
 	}
@@ -510,25 +555,36 @@ int EpipolarGeometry::findPairsAll(const std::multimap<int, cv::KeyPoint> & word
 {
 	UTimer timer;
 	timer.start();
-	const std::list<int> & ids = uUniqueKeys(wordsA);
+	std::multimap<int, cv::KeyPoint>::const_iterator iterA = ignoreInvalidIds?wordsA.lower_bound(0):wordsA.begin();
+	std::multimap<int, cv::KeyPoint>::const_iterator iterB = ignoreInvalidIds?wordsB.lower_bound(0):wordsB.begin();
 	pairs.clear();
-	int realPairsCount = 0;;
-	for(std::list<int>::const_iterator iter=ids.begin(); iter!=ids.end(); ++iter)
+	int realPairsCount = 0;
+	while(iterA != wordsA.end() && iterB != wordsB.end())
 	{
-		if(!ignoreInvalidIds || (ignoreInvalidIds && *iter>=0))
+		if(iterA->first < iterB->first)
 		{
-			std::list<cv::KeyPoint> ptsA = uValues(wordsA, *iter);
-			std::list<cv::KeyPoint> ptsB = uValues(wordsB, *iter);
-
-			realPairsCount += ptsA.size() > ptsB.size() ? ptsB.size() : ptsA.size();
-
-			for(std::list<cv::KeyPoint>::iterator jter=ptsA.begin(); jter!=ptsA.end(); ++jter)
+			++iterA;
+		}
+		else if(iterB->first < iterA->first)
+		{
+			++iterB;
+		}
+		else
+		{
+			int id = iterA->first;
+			std::multimap<int, cv::KeyPoint>::const_iterator firstB = iterB;
+			std::multimap<int, cv::KeyPoint>::const_iterator jter;
+			int countA = 0;
+			int countB = 0;
+			for(; iterB != wordsB.end() && iterB->first == id; ++iterB, ++countB);
+			for(; iterA != wordsA.end() && iterA->first == id; ++iterA, ++countA)
 			{
-				for(std::list<cv::KeyPoint>::iterator kter=ptsB.begin(); kter!=ptsB.end(); ++kter)
+				for(jter=firstB; jter!=iterB; ++jter)
 				{
-					pairs.push_back(std::pair<int, std::pair<cv::KeyPoint, cv::KeyPoint> >(*iter, std::pair<cv::KeyPoint, cv::KeyPoint>(*jter, *kter)));
+					pairs.push_back(std::pair<int, std::pair<cv::KeyPoint, cv::KeyPoint> >(id, std::pair<cv::KeyPoint, cv::KeyPoint>(iterA->second, jter->second)));
 				}
 			}
+			realPairsCount += countA > countB ? countB : countA;
 		}
 	}
 	ULOGGER_DEBUG("time = %f", timer.ticks());
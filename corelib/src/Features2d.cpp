@@ -37,6 +37,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/utilite/ULogger.h"
 #include "rtabmap/utilite/UTimer.h"
 #include <opencv2/imgproc/imgproc_c.h>
+#include <algorithm>
 #include <opencv2/core/version.hpp>
 #include <opencv2/opencv_modules.hpp>
 
@@ -329,7 +330,8 @@ Feature2D::Feature2D(const ParametersMap & parameters) :
 		_subPixIterations(Parameters::defaultKpSubPixIterations()),
 		_subPixEps(Parameters::defaultKpSubPixEps()),
 		gridRows_(Parameters::defaultKpGridRows()),
-		gridCols_(Parameters::defaultKpGridCols())
+		gridCols_(Parameters::defaultKpGridCols()),
+		threads_(Parameters::defaultKpThreads())
 {
 	_stereo = new Stereo(parameters);
 	this->parseParameters(parameters);
@@ -350,8 +352,10 @@ void Feature2D::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(parameters, Parameters::kKpSubPixEps(), _subPixEps);
 	Parameters::parse(parameters, Parameters::kKpGridRows(), gridRows_);
 	Parameters::parse(parameters, Parameters::kKpGridCols(), gridCols_);
+	Parameters::parse(parameters, Parameters::kKpThreads(), threads_);
 
 	UASSERT(gridRows_ >= 1 && gridCols_>=1);
+	UASSERT(threads_ >= 1);
 	if(maxFeatures_ > 0)
 	{
 		maxFeatures_ =	maxFeatures_ / (gridRows_ * gridCols_);
@@ -552,27 +556,34 @@ std::vector<cv::KeyPoint> Feature2D::generateKeypoints(const cv::Mat & image, co
 	// Get keypoints
 	int rowSize = globalRoi.height / gridRows_;
 	int colSize = globalRoi.width / gridCols_;
-	for (int i = 0; i<gridRows_; ++i)
+	int cells = gridRows_ * gridCols_;
+	int threads = !this->isKeypointsThreadSafe()?1:threads_ < cells?threads_:cells;
+	std::vector<std::vector<cv::KeyPoint> > cellKeypoints(cells);
+	#pragma omp parallel for num_threads(threads) if(threads > 1)
+	for (int k = 0; k<cells; ++k)
 	{
-		for (int j = 0; j<gridCols_; ++j)
+		int i = k / gridCols_;
+		int j = k % gridCols_;
+		cv::Rect roi(globalRoi.x + j*colSize, globalRoi.y + i*rowSize, colSize, rowSize);
+		std::vector<cv::KeyPoint> & sub_keypoints = cellKeypoints[k];
+		sub_keypoints = this->generateKeypointsImpl(image, roi, mask);
+		limitKeypoints(sub_keypoints, maxFeatures_);
+		if(roi.x || roi.y)
 		{
-			cv::Rect roi(globalRoi.x + j*colSize, globalRoi.y + i*rowSize, colSize, rowSize);
-			std::vector<cv::KeyPoint> sub_keypoints;
-			sub_keypoints = this->generateKeypointsImpl(image, roi, mask);
-			limitKeypoints(sub_keypoints, maxFeatures_);
-			if(roi.x || roi.y)
+			// Adjust keypoint position to raw image
+			for(std::vector<cv::KeyPoint>::iterator iter=sub_keypoints.begin(); iter!=sub_keypoints.end(); ++iter)
 			{
-				// Adjust keypoint position to raw image
-				for(std::vector<cv::KeyPoint>::iterator iter=sub_keypoints.begin(); iter!=sub_keypoints.end(); ++iter)
-				{
-					iter->pt.x += roi.x;
-					iter->pt.y += roi.y;
-				}
+				iter->pt.x += roi.x;
+				iter->pt.y += roi.y;
 			}
-			keypoints.insert( keypoints.end(), sub_keypoints.begin(), sub_keypoints.end() );
 		}
 	}
-	UDEBUG("Keypoints extraction time = %f s, keypoints extracted = %d (mask empty=%d)", timer.ticks(), keypoints.size(), mask.empty()?1:0);
+	// merged in the same cell order as the sequential extraction
+	for (int k = 0; k<cells; ++k)
+	{
+		keypoints.insert( keypoints.end(), cellKeypoints[k].begin(), cellKeypoints[k].end() );
+	}
+	UDEBUG("Keypoints extraction time = %f s, keypoints extracted = %d (mask empty=%d, threads=%d)", timer.ticks(), keypoints.size(), mask.empty()?1:0, threads);
 
 	if(keypoints.size() && _subPixWinSize > 0 && _subPixIterations > 0)
 	{
@@ -602,7 +613,83 @@ cv::Mat Feature2D::generateDescriptors(
 	{
 		UASSERT(!image.empty());
 		UASSERT(image.type() == CV_8UC1);
-		descriptors = generateDescriptorsImpl(image, keypoints);
+		int margin = this->getDescriptorsMargin();
+		int threads = margin < 0?1:threads_;
+		// bands thinner than their margins would mostly process the same rows
+		if(threads > 1 && margin > 0 && image.rows / threads < 2*margin)
+		{
+			threads = image.rows / (2*margin);
+		}
+		if(threads > (int)keypoints.size())
+		{
+			threads = (int)keypoints.size();
+		}
+		if(threads > 1)
+		{
+			// The extractor is called on each band extended by the margin, so that
+			// its per-image processing (e.g., the integral image of BRIEF) is done
+			// once on each part of the image instead of on the full image for each
+			// thread. Keypoints removed by the extractor (e.g., too close to image
+			// border) are the same, the remaining ones are merged back in their
+			// input order (class_id is used to keep the input index).
+			int bandSize = (image.rows + threads - 1) / threads;
+			std::vector<std::vector<cv::KeyPoint> > bandKeypoints(threads);
+			for(unsigned int i=0; i<keypoints.size(); ++i)
+			{
+				int band = int(keypoints[i].pt.y) / bandSize;
+				band = band < 0?0:band >= threads?threads-1:band;
+				bandKeypoints[band].push_back(keypoints[i]);
+				bandKeypoints[band].back().class_id = i;
+			}
+			std::vector<cv::Mat> bandDescriptors(threads);
+			#pragma omp parallel for num_threads(threads)
+			for(int k=0; k<threads; ++k)
+			{
+				if(bandKeypoints[k].size())
+				{
+					int start = k*bandSize - margin < 0?0:k*bandSize - margin;
+					int end = (k+1)*bandSize + margin > image.rows?image.rows:(k+1)*bandSize + margin;
+					for(unsigned int i=0; i<bandKeypoints[k].size(); ++i)
+					{
+						bandKeypoints[k][i].pt.y -= start;
+					}
+					bandDescriptors[k] = generateDescriptorsImpl(image.rowRange(start, end), bandKeypoints[k]);
+					for(unsigned int i=0; i<bandKeypoints[k].size(); ++i)
+					{
+						bandKeypoints[k][i].pt.y += start;
+					}
+				}
+			}
+
+			std::vector<std::pair<int, std::pair<int, int> > > order; // input index, band, row
+			for(int k=0; k<threads; ++k)
+			{
+				UASSERT_MSG(bandDescriptors[k].rows == (int)bandKeypoints[k].size(), uFormat("descriptors=%d, keypoints=%d", bandDescriptors[k].rows, (int)bandKeypoints[k].size()).c_str());
+				for(unsigned int i=0; i<bandKeypoints[k].size(); ++i)
+				{
+					order.push_back(std::make_pair(bandKeypoints[k][i].class_id, std::make_pair(k, (int)i)));
+				}
+			}
+			std::sort(order.begin(), order.end());
+			std::vector<cv::KeyPoint> merged(order.size());
+			for(unsigned int i=0; i<order.size(); ++i)
+			{
+				const cv::Mat & bandDescriptor = bandDescriptors[order[i].second.first];
+				if(descriptors.empty())
+				{
+					descriptors = cv::Mat((int)order.size(), bandDescriptor.cols, bandDescriptor.type());
+				}
+				bandDescriptor.row(order[i].second.second).copyTo(descriptors.row(i));
+				merged[i] = bandKeypoints[order[i].second.first][order[i].second.second];
+				merged[i].class_id = keypoints[order[i].first].class_id;
+			}
+			keypoints = merged;
+			UDEBUG("Descriptors computed in %d bands", threads);
+		}
+		else
+		{
+			descriptors = generateDescriptorsImpl(image, keypoints);
+		}
 		UASSERT_MSG(descriptors.rows == (int)keypoints.size(), uFormat("descriptors=%d, keypoints=%d", descriptors.rows, (int)keypoints.size()).c_str());
 		UDEBUG("Descriptors extracted = %d, remaining kpts=%d", descriptors.rows, (int)keypoints.size());
 	}
@@ -619,25 +706,13 @@ std::vector<cv::Point3f> Feature2D::generateKeypoints3D(
 		if(!data.rightRaw().empty() && !data.imageRaw().empty() && data.stereoCameraModel().isValidForProjection())
 		{
 			//stereo
-			cv::Mat imageMono;
-			// convert to grayscale
-			if(data.imageRaw().channels() > 1)
-			{
-				cv::cvtColor(data.imageRaw(), imageMono, cv::COLOR_BGR2GRAY);
-			}
-			else
-			{
-				imageMono = data.imageRaw();
-			}
-
 			std::vector<cv::Point2f> leftCorners;
 			cv::KeyPoint::convert(keypoints, leftCorners);
 			std::vector<unsigned char> status;
 
 			std::vector<cv::Point2f> rightCorners;
 			rightCorners = _stereo->computeCorrespondences(
-					imageMono,
-					data.rightRaw(),
+					data,
 					leftCorners,
 					status);
 
@@ -996,6 +1071,12 @@ std::vector<cv::KeyPoint> ORB::generateKeypointsImpl(const cv::Mat & image, cons
 	return keypoints;
 }
 
+int ORB::getDescriptorsMargin() const
+{
+	// edge threshold and patch, at the scale of the highest pyramid level
+	return gpu_?-1:(int)std::ceil(float(edgeThreshold_ + patchSize_) * std::pow(scaleFactor_, float(nLevels_-1)));
+}
+
 cv::Mat ORB::generateDescriptorsImpl(const cv::Mat & image, std::vector<cv::KeyPoint> & keypoints) const
 {
 	UASSERT(!image.empty() && image.channels() == 1 && image.depth() == CV_8U);
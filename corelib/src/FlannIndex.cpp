@@ -30,6 +30,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "rtflann/flann.hpp"
 
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
 namespace rtabmap {
 
 FlannIndex::FlannIndex():
@@ -39,7 +43,9 @@ FlannIndex::FlannIndex():
 		featuresDim_(0),
 		isLSH_(false),
 		useDistanceL1_(false),
-		rebalancingFactor_(2.0f)
+		rebalancingFactor_(2.0f),
+		serializable_(false),
+		datasetSaved_(false)
 {
 }
 FlannIndex::~FlannIndex()
@@ -74,6 +80,7 @@ void FlannIndex::release()
 	}
 	nextIndex_ = 0;
 	isLSH_ = false;
+	datasetSaved_ = false;
 	addedDescriptors_.clear();
 	removedIndexes_.clear();
 }
@@ -147,6 +154,8 @@ void FlannIndex::buildLinearIndex(
 	rebalancingFactor_ = rebalancingFactor;
 
 	rtflann::LinearIndexParams params;
+	params["save_dataset"] = serializable_; // see serialize()
+	datasetSaved_ = serializable_;
 
 	if(featuresType_ == CV_8UC1)
 	{
@@ -195,6 +204,8 @@ void FlannIndex::buildKDTreeIndex(
 	rebalancingFactor_ = rebalancingFactor;
 
 	rtflann::KDTreeIndexParams params(trees);
+	params["save_dataset"] = serializable_; // see serialize()
+	datasetSaved_ = serializable_;
 
 	if(featuresType_ == CV_8UC1)
 	{
@@ -244,6 +255,8 @@ void FlannIndex::buildKDTreeSingleIndex(
 	rebalancingFactor_ = rebalancingFactor;
 
 	rtflann::KDTreeSingleIndexParams params(leafMaxSize, reorder);
+	params["save_dataset"] = serializable_; // see serialize()
+	datasetSaved_ = serializable_;
 
 	if(featuresType_ == CV_8UC1)
 	{
@@ -292,8 +305,12 @@ void FlannIndex::buildLSHIndex(
 	useDistanceL1_ = true;
 	rebalancingFactor_ = rebalancingFactor;
 
+	rtflann::LshIndexParams params(12, 20, 2);
+	params["save_dataset"] = serializable_; // see serialize()
+	datasetSaved_ = serializable_;
+
 	rtflann::Matrix<unsigned char> dataset(features.data, features.rows, features.cols);
-	index_ = new rtflann::Index<rtflann::Hamming<unsigned char> >(dataset, rtflann::LshIndexParams(12, 20, 2));
+	index_ = new rtflann::Index<rtflann::Hamming<unsigned char> >(dataset, params);
 	((rtflann::Index<rtflann::Hamming<unsigned char> >*)index_)->buildIndex();
 
 	// incremental FLANN
@@ -307,6 +324,201 @@ bool FlannIndex::isBuilt()
 	return index_!=0;
 }
 
+cv::Mat FlannIndex::serialize() const
+{
+	cv::Mat output;
+	if(!index_)
+	{
+		return output;
+	}
+	if(!datasetSaved_)
+	{
+		UDEBUG("The index has not been built to be serialized.");
+		return output;
+	}
+
+	// rtflann archives only work on FILE streams, write in a memory
+	// stream (a temporary file on Windows, which doesn't have them)
+#ifdef _WIN32
+	FILE * stream = tmpfile();
+#else
+	char * buffer = 0;
+	size_t bufferSize = 0;
+	FILE * stream = open_memstream(&buffer, &bufferSize);
+#endif
+	if(stream == 0)
+	{
+		UERROR("Cannot create a stream to serialize the FLANN index!");
+		return output;
+	}
+
+	int header[7];
+	header[0] = kSerializationVersion;
+	header[1] = featuresType_;
+	header[2] = featuresDim_;
+	header[3] = isLSH_?1:0;
+	header[4] = useDistanceL1_?1:0;
+	header[5] = (int)nextIndex_;
+	header[6] = (int)removedIndexes_.size();
+	bool ok = fwrite(header, sizeof(int), 7, stream) == 7 &&
+			fwrite(&rebalancingFactor_, sizeof(float), 1, stream) == 1;
+	for(std::list<int>::const_iterator iter=removedIndexes_.begin(); ok && iter!=removedIndexes_.end(); ++iter)
+	{
+		ok = fwrite(&(*iter), sizeof(int), 1, stream) == 1;
+	}
+
+	try
+	{
+		if(ok && featuresType_ == CV_8UC1)
+		{
+			((rtflann::Index<rtflann::Hamming<unsigned char> >*)index_)->saveIndex(stream);
+		}
+		else if(ok && useDistanceL1_)
+		{
+			((rtflann::Index<rtflann::L1<float> >*)index_)->saveIndex(stream);
+		}
+		else if(ok && featuresDim_ <= 3)
+		{
+			((rtflann::Index<rtflann::L2_Simple<float> >*)index_)->saveIndex(stream);
+		}
+		else if(ok)
+		{
+			((rtflann::Index<rtflann::L2<float> >*)index_)->saveIndex(stream);
+		}
+	}
+	catch(const std::exception & e)
+	{
+		UERROR("Failed to serialize FLANN index: %s", e.what());
+		ok = false;
+	}
+
+#ifdef _WIN32
+	long size = ok?ftell(stream):0;
+	if(size > 0)
+	{
+		output = cv::Mat(1, (int)size, CV_8UC1);
+		rewind(stream);
+		if(fread(output.data, 1, size, stream) != (size_t)size)
+		{
+			UERROR("Failed to read back serialized FLANN index (%ld bytes)", size);
+			output = cv::Mat();
+		}
+	}
+	fclose(stream);
+#else
+	// buffer and bufferSize are updated on close
+	ok = fclose(stream) == 0 && ok;
+	if(ok && bufferSize > 0)
+	{
+		output = cv::Mat(1, (int)bufferSize, CV_8UC1);
+		memcpy(output.data, buffer, bufferSize);
+	}
+	free(buffer);
+#endif
+	return output;
+}
+
+bool FlannIndex::deserialize(const cv::Mat & data)
+{
+	this->release();
+	if(data.empty())
+	{
+		return false;
+	}
+	UASSERT(data.type() == CV_8UC1 && data.isContinuous());
+
+	// read the data in place (a temporary file on Windows, see serialize())
+#ifdef _WIN32
+	FILE * stream = tmpfile();
+	bool ok = stream != 0 && fwrite(data.data, 1, data.total(), stream) == data.total();
+	if(ok)
+	{
+		rewind(stream);
+	}
+#else
+	FILE * stream = fmemopen((void*)data.data, data.total(), "rb");
+	bool ok = stream != 0;
+#endif
+	if(stream == 0)
+	{
+		UERROR("Cannot create a stream to deserialize the FLANN index!");
+		return false;
+	}
+
+	int header[7];
+	float rebalancingFactor = 0.0f;
+	ok = ok && fread(header, sizeof(int), 7, stream) == 7 &&
+			fread(&rebalancingFactor, sizeof(float), 1, stream) == 1;
+	if(ok && header[0] != kSerializationVersion)
+	{
+		UWARN("Serialized FLANN index version (%d) is not the same as the current one (%d), ignoring it.", header[0], kSerializationVersion);
+		ok = false;
+	}
+	std::list<int> removedIndexes;
+	for(int i=0; ok && i<header[6]; ++i)
+	{
+		int index;
+		ok = fread(&index, sizeof(int), 1, stream) == 1;
+		removedIndexes.push_back(index);
+	}
+
+	if(ok)
+	{
+		featuresType_ = header[1];
+		featuresDim_ = header[2];
+		isLSH_ = header[3] != 0;
+		useDistanceL1_ = header[4] != 0;
+		nextIndex_ = header[5];
+		rebalancingFactor_ = rebalancingFactor;
+		UASSERT(featuresType_ == CV_32FC1 || featuresType_ == CV_8UC1);
+		try
+		{
+			// Create an empty index of the saved type, the data are in the archive
+			long start = ftell(stream);
+			rtflann::IndexHeader flannHeader = rtflann::load_header(stream);
+			fseek(stream, start, SEEK_SET);
+			rtflann::IndexParams params;
+			params["algorithm"] = flannHeader.h.index_type;
+			params["save_dataset"] = true;
+			datasetSaved_ = true;
+
+			if(featuresType_ == CV_8UC1)
+			{
+				index_ = new rtflann::Index<rtflann::Hamming<unsigned char> >(params);
+				((rtflann::Index<rtflann::Hamming<unsigned char> >*)index_)->loadIndex(stream);
+			}
+			else if(useDistanceL1_)
+			{
+				index_ = new rtflann::Index<rtflann::L1<float> >(params);
+				((rtflann::Index<rtflann::L1<float> >*)index_)->loadIndex(stream);
+			}
+			else if(featuresDim_ <= 3)
+			{
+				index_ = new rtflann::Index<rtflann::L2_Simple<float> >(params);
+				((rtflann::Index<rtflann::L2_Simple<float> >*)index_)->loadIndex(stream);
+			}
+			else
+			{
+				index_ = new rtflann::Index<rtflann::L2<float> >(params);
+				((rtflann::Index<rtflann::L2<float> >*)index_)->loadIndex(stream);
+			}
+			removedIndexes_ = removedIndexes;
+		}
+		catch(const std::exception & e)
+		{
+			UERROR("Failed to deserialize FLANN index: %s", e.what());
+			ok = false;
+		}
+	}
+	fclose(stream);
+
+	if(!ok)
+	{
+		this->release();
+	}
+	return ok;
+}
+
 unsigned int FlannIndex::addPoints(const cv::Mat & features)
 {
 	if(!index_)
@@ -0,0 +1,366 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap/core/HammingMatcher.h"
+#include <rtabmap/utilite/ULogger.h>
+
+#include <climits>
+#include <stdint.h>
+#include <cstring>
+#include <algorithm>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RTABMAP_HAMMING_X86
+#include <immintrin.h>
+#if (defined(__clang__) && __clang_major__ >= 6) || (!defined(__clang__) && __GNUC__ >= 8)
+#define RTABMAP_HAMMING_AVX512
+#endif
+#endif
+
+// Early termination is checked after each block of this size (bytes), so
+// that 32 bytes descriptors (ORB, BRIEF) can be rejected after half of them
+#define HAMMING_BLOCK 16
+// Size of the block of train descriptors kept in cache for all queries (bytes)
+#define HAMMING_TRAIN_CACHE (32*1024)
+
+namespace rtabmap {
+
+namespace {
+
+typedef int (*HammingFunc)(const unsigned char * a, const unsigned char * b, int n, int maxDist);
+
+inline uint64_t load64(const unsigned char * p)
+{
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+inline int popcountPortable(uint64_t v)
+{
+	v = v - ((v >> 1) & 0x5555555555555555ULL);
+	v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+	v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int)((v * 0x0101010101010101ULL) >> 56);
+}
+
+int hammingScalar(const unsigned char * a, const unsigned char * b, int n, int maxDist)
+{
+	int d = 0;
+	int i = 0;
+	for(; i+HAMMING_BLOCK <= n; i+=HAMMING_BLOCK)
+	{
+		d += popcountPortable(load64(a+i) ^ load64(b+i));
+		d += popcountPortable(load64(a+i+8) ^ load64(b+i+8));
+		if(d >= maxDist)
+		{
+			return d;
+		}
+	}
+	for(; i+8 <= n; i+=8)
+	{
+		d += popcountPortable(load64(a+i) ^ load64(b+i));
+	}
+	for(; i < n; ++i)
+	{
+		d += popcountPortable((uint64_t)(a[i] ^ b[i]));
+	}
+	return d;
+}
+
+#ifdef RTABMAP_HAMMING_X86
+
+__attribute__((target("popcnt")))
+inline int hammingPopcntTail(const unsigned char * a, const unsigned char * b, int i, int n)
+{
+	int d = 0;
+	for(; i+8 <= n; i+=8)
+	{
+		d += (int)__builtin_popcountll(load64(a+i) ^ load64(b+i));
+	}
+	for(; i < n; ++i)
+	{
+		d += (int)__builtin_popcount(a[i] ^ b[i]);
+	}
+	return d;
+}
+
+__attribute__((target("popcnt")))
+int hammingPopcnt(const unsigned char * a, const unsigned char * b, int n, int maxDist)
+{
+	int d = 0;
+	int i = 0;
+	for(; i+HAMMING_BLOCK <= n; i+=HAMMING_BLOCK)
+	{
+		d += (int)__builtin_popcountll(load64(a+i) ^ load64(b+i));
+		d += (int)__builtin_popcountll(load64(a+i+8) ^ load64(b+i+8));
+		if(d >= maxDist)
+		{
+			return d;
+		}
+	}
+	return d + hammingPopcntTail(a, b, i, n);
+}
+
+__attribute__((target("ssse3")))
+int hammingSSSE3(const unsigned char * a, const unsigned char * b, int n, int maxDist)
+{
+	const __m128i lookup = _mm_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+	const __m128i lowMask = _mm_set1_epi8(0x0f);
+	int d = 0;
+	int i = 0;
+	for(; i+HAMMING_BLOCK <= n; i+=HAMMING_BLOCK)
+	{
+		__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a+i)), _mm_loadu_si128((const __m128i*)(b+i)));
+		__m128i c = _mm_add_epi8(
+				_mm_shuffle_epi8(lookup, _mm_and_si128(x, lowMask)),
+				_mm_shuffle_epi8(lookup, _mm_and_si128(_mm_srli_epi16(x, 4), lowMask)));
+		__m128i sad = _mm_sad_epu8(c, _mm_setzero_si128());
+		d += _mm_cvtsi128_si32(sad) + _mm_extract_epi16(sad, 4);
+		if(d >= maxDist)
+		{
+			return d;
+		}
+	}
+	// SSSE3 CPUs don't all have popcnt
+	for(; i+8 <= n; i+=8)
+	{
+		d += popcountPortable(load64(a+i) ^ load64(b+i));
+	}
+	for(; i < n; ++i)
+	{
+		d += popcountPortable((uint64_t)(a[i] ^ b[i]));
+	}
+	return d;
+}
+
+__attribute__((target("avx2,popcnt")))
+int hammingAVX2(const unsigned char * a, const unsigned char * b, int n, int maxDist)
+{
+	const __m256i lookup = _mm256_setr_epi8(
+			0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+			0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+	const __m256i lowMask = _mm256_set1_epi8(0x0f);
+	if(n < 64)
+	{
+		// A single 256 bits block could not be rejected early,
+		// use the smaller blocks of popcnt instead.
+		return hammingPopcnt(a, b, n, maxDist);
+	}
+	int d = 0;
+	int i = 0;
+	for(; i+32 <= n; i+=32)
+	{
+		__m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a+i)), _mm256_loadu_si256((const __m256i*)(b+i)));
+		__m256i c = _mm256_add_epi8(
+				_mm256_shuffle_epi8(lookup, _mm256_and_si256(x, lowMask)),
+				_mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowMask)));
+		__m256i sad = _mm256_sad_epu8(c, _mm256_setzero_si256());
+		__m128i s = _mm_add_epi64(_mm256_castsi256_si128(sad), _mm256_extracti128_si256(sad, 1));
+		d += _mm_cvtsi128_si32(s) + _mm_extract_epi16(s, 4);
+		if(d >= maxDist)
+		{
+			return d;
+		}
+	}
+	return d + hammingPopcnt(a+i, b+i, n-i, maxDist-d);
+}
+
+#ifdef RTABMAP_HAMMING_AVX512
+__attribute__((target("avx512f,avx512vpopcntdq,popcnt")))
+int hammingAVX512(const unsigned char * a, const unsigned char * b, int n, int maxDist)
+{
+	int d = 0;
+	int i = 0;
+	for(; i+64 <= n; i+=64)
+	{
+		__m512i x = _mm512_xor_si512(_mm512_loadu_si512((const void*)(a+i)), _mm512_loadu_si512((const void*)(b+i)));
+		d += (int)_mm512_reduce_add_epi64(_mm512_popcnt_epi64(x));
+		if(d >= maxDist)
+		{
+			return d;
+		}
+	}
+	// 32 bytes descriptors (ORB, BRIEF) end up here, popcnt is faster
+	// than a 512 bits masked load for them and can reject them early.
+	return d + hammingPopcnt(a+i, b+i, n-i, maxDist-d);
+}
+#endif
+
+#endif // RTABMAP_HAMMING_X86
+
+HammingMatcher::Implementation detectImplementation()
+{
+#ifdef RTABMAP_HAMMING_X86
+	__builtin_cpu_init();
+#ifdef RTABMAP_HAMMING_AVX512
+	if(__builtin_cpu_supports("avx512vpopcntdq") && __builtin_cpu_supports("popcnt"))
+	{
+		return HammingMatcher::kAVX512;
+	}
+#endif
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+	{
+		return HammingMatcher::kAVX2;
+	}
+	if(__builtin_cpu_supports("popcnt"))
+	{
+		return HammingMatcher::kPopcnt;
+	}
+	if(__builtin_cpu_supports("ssse3"))
+	{
+		return HammingMatcher::kSSSE3;
+	}
+#endif
+	return HammingMatcher::kScalar;
+}
+
+HammingFunc hammingFunction(HammingMatcher::Implementation implementation)
+{
+	switch(implementation)
+	{
+#ifdef RTABMAP_HAMMING_X86
+#ifdef RTABMAP_HAMMING_AVX512
+	case HammingMatcher::kAVX512:
+		return hammingAVX512;
+#endif
+	case HammingMatcher::kAVX2:
+		return hammingAVX2;
+	case HammingMatcher::kSSSE3:
+		return hammingSSSE3;
+	case HammingMatcher::kPopcnt:
+		return hammingPopcnt;
+#endif
+	default:
+		break;
+	}
+	return hammingScalar;
+}
+
+HammingFunc selectedFunction()
+{
+	static const HammingFunc func = hammingFunction(HammingMatcher::implementation());
+	return func;
+}
+
+} // namespace
+
+HammingMatcher::Implementation HammingMatcher::implementation()
+{
+	static const Implementation implementation = detectImplementation();
+	return implementation;
+}
+
+std::string HammingMatcher::implementationName()
+{
+	switch(implementation())
+	{
+	case kAVX512:
+		return "AVX-512 VPOPCNTDQ";
+	case kAVX2:
+		return "AVX2";
+	case kSSSE3:
+		return "SSSE3";
+	case kPopcnt:
+		return "POPCNT";
+	default:
+		break;
+	}
+	return "Scalar";
+}
+
+int HammingMatcher::distance(const unsigned char * a, const unsigned char * b, int bytes)
+{
+	return selectedFunction()(a, b, bytes, INT_MAX);
+}
+
+void HammingMatcher::knnMatch(
+		const cv::Mat & query,
+		const cv::Mat & train,
+		std::vector<std::vector<cv::DMatch> > & matches,
+		int k)
+{
+	UASSERT(k > 0);
+	UASSERT(query.empty() || query.type() == CV_8UC1);
+	UASSERT(train.empty() || train.type() == CV_8UC1);
+	UASSERT(query.empty() || train.empty() || query.cols == train.cols);
+
+	matches.clear();
+	matches.resize(query.rows);
+	if(query.empty() || train.empty())
+	{
+		return;
+	}
+
+	const HammingFunc func = selectedFunction();
+	const int n = query.cols;
+	const int kk = std::min(k, train.rows);
+	std::vector<int> bestDist(query.rows*kk, INT_MAX);
+	std::vector<int> bestIdx(query.rows*kk, -1);
+
+	// Compare all queries with a block of train descriptors before
+	// going to the next block, so that the block stays in cache.
+	const int trainBlock = std::max(1, HAMMING_TRAIN_CACHE / n);
+	for(int t0=0; t0<train.rows; t0+=trainBlock)
+	{
+		const int t1 = std::min(t0+trainBlock, train.rows);
+		for(int q=0; q<query.rows; ++q)
+		{
+			const unsigned char * queryPtr = query.ptr<unsigned char>(q);
+			int * dist = &bestDist[q*kk];
+			int * idx = &bestIdx[q*kk];
+			for(int t=t0; t<t1; ++t)
+			{
+				// the distance is not completely computed if it is
+				// already larger than the worst of the k best
+				int d = func(queryPtr, train.ptr<unsigned char>(t), n, dist[kk-1]);
+				if(d < dist[kk-1])
+				{
+					int j = kk-1;
+					for(; j>0 && dist[j-1] > d; --j)
+					{
+						dist[j] = dist[j-1];
+						idx[j] = idx[j-1];
+					}
+					dist[j] = d;
+					idx[j] = t;
+				}
+			}
+		}
+	}
+
+	for(int q=0; q<query.rows; ++q)
+	{
+		matches[q].reserve(kk);
+		for(int j=0; j<kk && bestIdx[q*kk+j] >= 0; ++j)
+		{
+			matches[q].push_back(cv::DMatch(q, bestIdx[q*kk+j], (float)bestDist[q*kk+j]));
+		}
+	}
+}
+
+} /* namespace rtabmap */
@@ -68,12 +68,29 @@ const int Memory::kIdStart = 0;
 const int Memory::kIdVirtual = -1;
 const int Memory::kIdInvalid = 0;
 
+// Word ids of the signature without duplicates (sorted)
+static std::list<int> uniqueWordIds(const Signature * s)
+{
+	const std::vector<int> & ids = s->getWordIds();
+	std::list<int> uniqueIds;
+	for(unsigned int i=0; i<ids.size(); ++i)
+	{
+		if(i==0 || ids[i] != ids[i-1])
+		{
+			uniqueIds.push_back(ids[i]);
+		}
+	}
+	return uniqueIds;
+}
+
 Memory::Memory(const ParametersMap & parameters) :
 	_dbDriver(0),
 	_similarityThreshold(Parameters::defaultMemRehearsalSimilarity()),
 	_binDataKept(Parameters::defaultMemBinDataKept()),
 	_rawDescriptorsKept(Parameters::defaultMemRawDescriptorsKept()),
 	_saveDepth16Format(Parameters::defaultMemSaveDepth16Format()),
+	_depthCompressionFormat(Parameters::defaultMemDepthCompressionFormat()),
+	_saveDictionaryIndex(Parameters::defaultMemSaveDictionaryIndex()),
 	_notLinkedNodesKeptInDb(Parameters::defaultMemNotLinkedNodesKept()),
 	_saveIntermediateNodeData(Parameters::defaultMemIntermediateNodeDataKept()),
 	_incrementalMemory(Parameters::defaultMemIncrementalMemory()),
@@ -104,6 +121,7 @@ Memory::Memory(const ParametersMap & parameters) :
 	_visCorType(Parameters::defaultVisCorType()),
 	_imagesAlreadyRectified(Parameters::defaultRtabmapImagesAlreadyRectified()),
 	_covOffDiagonalIgnored(Parameters::defaultMemCovOffDiagIgnored()),
+	_likelihoodThreads(Parameters::defaultMemLikelihoodThreads()),
 	_idCount(kIdStart),
 	_idMapCount(kIdStart),
 	_lastSignature(0),
@@ -270,8 +288,7 @@ void Memory::loadDataFromDb(bool postInitClosingEvents)
 			const std::map<int, Signature *> & signatures = this->getSignatures();
 			for(std::map<int, Signature *>::const_iterator i=signatures.begin(); i!=signatures.end(); ++i)
 			{
-				const std::multimap<int, cv::KeyPoint> & words = i->second->getWords();
-				std::list<int> keys = uUniqueKeys(words);
+				std::list<int> keys = uniqueWordIds(i->second);
 				for(std::list<int>::iterator iter=keys.begin(); iter!=keys.end(); ++iter)
 				{
 					if(*iter > 0)
@@ -310,6 +327,11 @@ void Memory::loadDataFromDb(bool postInitClosingEvents)
 			_dbDriver->load(_vwd, _vwd->isIncremental());
 		}
 		UDEBUG("%d words loaded!", _vwd->getUnusedWordsSize());
+		if(_saveDictionaryIndex && _vwd->getUnusedWordsSize())
+		{
+			// restore the index instead of rebuilding it
+			_vwd->deserializeIndex(_dbDriver->loadDictionaryIndex());
+		}
 		_vwd->update();
 		if(postInitClosingEvents) UEventsManager::post(new RtabmapEventInit(uFormat("Loading dictionary, done! (%d words)", (int)_vwd->getUnusedWordsSize())));
 
@@ -321,15 +343,15 @@ void Memory::loadDataFromDb(bool postInitClosingEvents)
 			Signature * s = this->_getSignature(i->first);
 			UASSERT(s != 0);
 
-			const std::multimap<int, cv::KeyPoint> & words = s->getWords();
-			if(words.size())
+			const std::vector<int> & wordIds = s->getWordIds();
+			if(wordIds.size())
 			{
-				UDEBUG("node=%d, word references=%d", s->id(), words.size());
-				for(std::multimap<int, cv::KeyPoint>::const_iterator iter = words.begin(); iter!=words.end(); ++iter)
+				UDEBUG("node=%d, word references=%d", s->id(), (int)wordIds.size());
+				for(unsigned int j=0; j<wordIds.size(); ++j)
 				{
-					if(iter->first > 0)
+					if(wordIds[j] > 0)
 					{
-						_vwd->addWordRef(iter->first, i->first);
+						_vwd->addWordRef(wordIds[j], i->first);
 					}
 				}
 				s->setEnabled(true);
@@ -448,6 +470,14 @@ void Memory::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(params, Parameters::kMemBinDataKept(), _binDataKept);
 	Parameters::parse(params, Parameters::kMemRawDescriptorsKept(), _rawDescriptorsKept);
 	Parameters::parse(params, Parameters::kMemSaveDepth16Format(), _saveDepth16Format);
+	Parameters::parse(params, Parameters::kMemDepthCompressionFormat(), _depthCompressionFormat);
+	if(_depthCompressionFormat.compare(".png") != 0 && _depthCompressionFormat.compare(".rvl") != 0)
+	{
+		UWARN("Parameter %s should be \".png\" or \".rvl\" (was \"%s\"), using \".png\".",
+				Parameters::kMemDepthCompressionFormat().c_str(), _depthCompressionFormat.c_str());
+		_depthCompressionFormat = ".png";
+	}
+	Parameters::parse(params, Parameters::kMemSaveDictionaryIndex(), _saveDictionaryIndex);
 	Parameters::parse(params, Parameters::kMemReduceGraph(), _reduceGraph);
 	Parameters::parse(params, Parameters::kMemNotLinkedNodesKept(), _notLinkedNodesKeptInDb);
 	Parameters::parse(params, Parameters::kMemIntermediateNodeDataKept(), _saveIntermediateNodeData);
@@ -486,6 +516,7 @@ void Memory::parseParameters(const ParametersMap & parameters)
 	}
 	Parameters::parse(params, Parameters::kRtabmapImagesAlreadyRectified(), _imagesAlreadyRectified);
 	Parameters::parse(params, Parameters::kMemCovOffDiagIgnored(), _covOffDiagonalIgnored);
+	Parameters::parse(params, Parameters::kMemLikelihoodThreads(), _likelihoodThreads);
 
 
 	UASSERT_MSG(_maxStMemSize >= 0, uFormat("value=%d", _maxStMemSize).c_str());
@@ -511,6 +542,7 @@ void Memory::parseParameters(const ParametersMap & parameters)
 	if(_vwd)
 	{
 		_vwd->parseParameters(params);
+		_vwd->setIndexSerializable(_saveDictionaryIndex);
 	}
 
 	Parameters::parse(params, Parameters::kKpTfIdfLikelihoodUsed(), _tfIdfLikelihoodUsed);
@@ -863,9 +895,9 @@ void Memory::addSignatureToStm(Signature * signature, const cv::Mat & covariance
 
 		if(_vwd)
 		{
-			UDEBUG("%d words ref for the signature %d", signature->getWords().size(), signature->id());
+			UDEBUG("%d words ref for the signature %d", (int)signature->getWordIds().size(), signature->id());
 		}
-		if(signature->getWords().size())
+		if(signature->getWordIds().size())
 		{
 			signature->setEnabled(true);
 		}
@@ -1462,6 +1494,17 @@ void Memory::clear()
 					_dbDriver->getMemoryUsed(),
 					(int)_vwd->getVisualWords().size(),
 					parameters);
+
+			if(_saveDictionaryIndex)
+			{
+				// words of the last state are the same we will load on next
+				// initialization, update the index only if some words are pending
+				if(_vwd->getNotIndexedWordsCount() || _vwd->getRemovedIndexedWordsCount())
+				{
+					_vwd->update();
+				}
+				_dbDriver->saveDictionaryIndex(_vwd->serializeIndex());
+			}
 		}
 	}
 	UDEBUG("");
@@ -1527,119 +1570,140 @@ void Memory::clear()
  */
 std::map<int, float> Memory::computeLikelihood(const Signature * signature, const std::list<int> & ids)
 {
-	if(!_tfIdfLikelihoodUsed)
+	UTimer timer;
+	timer.start();
+	std::map<int, float> likelihood;
+
+	if(!signature)
+	{
+		ULOGGER_ERROR("The signature is null");
+		return likelihood;
+	}
+	else if(ids.empty())
 	{
-		UTimer timer;
-		timer.start();
-		std::map<int, float> likelihood;
+		UWARN("ids list is empty");
+		return likelihood;
+	}
 
-		if(!signature)
-		{
-			ULOGGER_ERROR("The signature is null");
-			return likelihood;
-		}
-		else if(ids.empty())
-		{
-			UWARN("ids list is empty");
-			return likelihood;
-		}
+	std::vector<int> sortedIds(ids.begin(), ids.end());
+	std::sort(sortedIds.begin(), sortedIds.end());
 
-		for(std::list<int>::const_iterator iter = ids.begin(); iter!=ids.end(); ++iter)
+	std::vector<float> values;
+	int threads = _likelihoodThreads < (int)sortedIds.size()?_likelihoodThreads:(int)sortedIds.size();
+	if(threads > 1)
+	{
+		// Each thread computes the likelihood of a contiguous
+		// block of ids, values are the same than with one thread
+		std::vector<std::vector<float> > blockValues(threads);
+		int blockSize = ((int)sortedIds.size() + threads - 1) / threads;
+		#pragma omp parallel for num_threads(threads)
+		for(int i=0; i<threads; ++i)
 		{
-			float sim = 0.0f;
-			if(*iter > 0)
+			int begin = i*blockSize<(int)sortedIds.size()?i*blockSize:(int)sortedIds.size();
+			int end = begin+blockSize<(int)sortedIds.size()?begin+blockSize:(int)sortedIds.size();
+			if(begin < end)
 			{
-				const Signature * sB = this->getSignature(*iter);
-				if(!sB)
-				{
-					UFATAL("Signature %d not found in WM ?!?", *iter);
-				}
-				sim = signature->compareTo(*sB);
+				blockValues[i] = this->computeLikelihoodValues(signature, std::vector<int>(sortedIds.begin()+begin, sortedIds.begin()+end));
 			}
-
-			likelihood.insert(likelihood.end(), std::pair<int, float>(*iter, sim));
 		}
-
-		UDEBUG("compute likelihood (similarity)... %f s", timer.ticks());
-		return likelihood;
+		values.reserve(sortedIds.size());
+		for(int i=0; i<threads; ++i)
+		{
+			values.insert(values.end(), blockValues[i].begin(), blockValues[i].end());
+		}
 	}
 	else
 	{
-		UTimer timer;
-		timer.start();
-		std::map<int, float> likelihood;
-		std::map<int, float> calculatedWordsRatio;
+		values = this->computeLikelihoodValues(signature, sortedIds);
+	}
+	UASSERT(values.size() == sortedIds.size());
+
+	for(unsigned int i=0; i<sortedIds.size(); ++i)
+	{
+		likelihood.insert(likelihood.end(), std::pair<int, float>(sortedIds[i], values[i]));
+	}
+
+	UDEBUG("compute likelihood (%s, threads=%d) %f s", _tfIdfLikelihoodUsed?"tf-idf":"similarity", threads>1?threads:1, timer.ticks());
+	return likelihood;
+}
 
-		if(!signature)
+// ids must be sorted
+std::vector<float> Memory::computeLikelihoodValues(const Signature * signature, const std::vector<int> & ids) const
+{
+	std::vector<float> values(ids.size(), 0.0f);
+	if(!_tfIdfLikelihoodUsed)
+	{
+		// Count the words shared with each signature using the
+		// inverted index of the dictionary, this gives the same number
+		// of pairs than Signature::compareTo() without comparing each signature
+		std::map<int, int> wordsCount;
+		const std::vector<int> & wordIds = signature->getWordIds();
+		for(unsigned int i=0; i<wordIds.size(); ++i)
 		{
-			ULOGGER_ERROR("The signature is null");
-			return likelihood;
+			if(wordIds[i] >= 0)
+			{
+				++wordsCount[wordIds[i]];
+			}
 		}
-		else if(ids.empty())
+		std::vector<int> sharedWords;
+		if(!signature->isBadSignature())
 		{
-			UWARN("ids list is empty");
-			return likelihood;
+			_vwd->computeSharedWords(wordsCount, ids, sharedWords);
 		}
+		int zeroWordsCount = uValue(wordsCount, 0, 0); // word id 0 is not in the dictionary
+		int validWordsA = (int)signature->getWordKeypoints().size()-signature->getInvalidWordsCount();
 
-		for(std::list<int>::const_iterator iter = ids.begin(); iter!=ids.end(); ++iter)
+		for(unsigned int i=0; i<ids.size(); ++i)
 		{
-			likelihood.insert(likelihood.end(), std::pair<int, float>(*iter, 0.0f));
+			if(ids[i] > 0)
+			{
+				const Signature * sB = this->getSignature(ids[i]);
+				if(!sB)
+				{
+					UFATAL("Signature %d not found in WM ?!?", ids[i]);
+				}
+				if(!sB->isEnabled())
+				{
+					// words of this signature are not referenced in the dictionary
+					values[i] = signature->compareTo(*sB);
+				}
+				else if(!sB->isBadSignature() && !signature->isBadSignature())
+				{
+					int pairs = sharedWords[i];
+					if(zeroWordsCount)
+					{
+						std::pair<std::vector<int>::const_iterator, std::vector<int>::const_iterator> zeros =
+								std::equal_range(sB->getWordIds().begin(), sB->getWordIds().end(), 0);
+						int count = int(zeros.second - zeros.first);
+						pairs += count<zeroWordsCount?count:zeroWordsCount;
+					}
+					int validWordsB = (int)sB->getWordKeypoints().size()-sB->getInvalidWordsCount();
+					int totalWords = validWordsA>validWordsB?validWordsA:validWordsB;
+					UASSERT(totalWords > 0);
+					values[i] = float(pairs) / float(totalWords);
+				}
+			}
 		}
-
-		const std::list<int> & wordIds = uUniqueKeys(signature->getWords());
-
-		float nwi; // nwi is the number of a specific word referenced by a place
-		float ni; // ni is the total of words referenced by a place
-		float nw; // nw is the number of places referenced by a specific word
-		float N; // N is the total number of places
-
-		float logNnw;
-		const VisualWord * vw;
-
-		N = this->getSignatures().size();
-
+	}
+	else
+	{
+		float N = this->getSignatures().size(); // N is the total number of places
 		if(N)
 		{
-			UDEBUG("processing... ");
-			// Pour chaque mot dans la signature SURF
-			for(std::list<int>::const_iterator i=wordIds.begin(); i!=wordIds.end(); ++i)
+			// Scores are accumulated in a dense vector indexed
+			// like the sorted ids, using the inverted index of the dictionary
+			std::vector<float> signatureWordsCount(ids.size(), 0.0f);
+			for(unsigned int i=0; i<ids.size(); ++i)
 			{
-				if(*i>0)
+				if(ids[i] > 0)
 				{
-					// "Inverted index" - Pour chaque endroit contenu dans chaque mot
-					vw = _vwd->getWord(*i);
-					UASSERT_MSG(vw!=0, uFormat("Word %d not found in dictionary!?", *i).c_str());
-
-					const std::map<int, int> & refs = vw->getReferences();
-					nw = refs.size();
-					if(nw)
-					{
-						logNnw = log10(N/nw);
-						if(logNnw)
-						{
-							for(std::map<int, int>::const_iterator j=refs.begin(); j!=refs.end(); ++j)
-							{
-								std::map<int, float>::iterator iter = likelihood.find(j->first);
-								if(iter != likelihood.end())
-								{
-									nwi = j->second;
-									ni = this->getNi(j->first);
-									if(ni != 0)
-									{
-										//UDEBUG("%d, %f %f %f %f", vw->id(), logNnw, nwi, ni, ( nwi  * logNnw ) / ni);
-										iter->second += ( nwi  * logNnw ) / ni;
-									}
-								}
-							}
-						}
-					}
+					signatureWordsCount[i] = this->getNi(ids[i]);
 				}
 			}
+			_vwd->computeTfIdfScores(uniqueWordIds(signature), ids, signatureWordsCount, N, values);
 		}
-
-		UDEBUG("compute likelihood (tf-idf) %f s", timer.ticks());
-		return likelihood;
 	}
+	return values;
 }
 
 // Weights of the signatures in the working memory <signature id, weight>
@@ -2081,7 +2145,7 @@ void Memory::moveToTrash(Signature * s, bool keepLinkedToGraph, std::list<int> *
 		this->disableWordsRef(s->id());
 		if(!keepLinkedToGraph && _vwd->isIncremental())
 		{
-			std::list<int> keys = uUniqueKeys(s->getWords());
+			std::list<int> keys = uniqueWordIds(s);
 			for(std::list<int>::const_iterator i=keys.begin(); i!=keys.end(); ++i)
 			{
 				// assume just removed word doesn't have any other references
@@ -2764,12 +2828,12 @@ Transform Memory::computeIcpTransformMulti(
 						{
 							if(scan.hasNormals())
 							{
-								*assembledToNormalIClouds += *util3d::laserScanToPointCloudINormal(scan,
+								util3d::laserScanToPointCloudINormal(scan, *assembledToNormalIClouds,
 										toPoseInv * iter->second * scan.localTransform());
 							}
 							else
 							{
-								*assembledToIClouds += *util3d::laserScanToPointCloudI(scan,
+								util3d::laserScanToPointCloudI(scan, *assembledToIClouds,
 										toPoseInv * iter->second * scan.localTransform());
 							}
 						}
@@ -2777,12 +2841,12 @@ Transform Memory::computeIcpTransformMulti(
 						{
 							if(scan.hasNormals())
 							{
-								*assembledToNormalClouds += *util3d::laserScanToPointCloudNormal(scan,
+								util3d::laserScanToPointCloudNormal(scan, *assembledToNormalClouds,
 										toPoseInv * iter->second * scan.localTransform());
 							}
 							else
 							{
-								*assembledToClouds += *util3d::laserScanToPointCloud(scan,
+								util3d::laserScanToPointCloud(scan, *assembledToClouds,
 										toPoseInv * iter->second * scan.localTransform());
 							}
 						}
@@ -3549,7 +3613,7 @@ int Memory::getNi(int signatureId) const
 	const Signature * s = this->getSignature(signatureId);
 	if(s)
 	{
-		ni = (int)((Signature *)s)->getWords().size();
+		ni = (int)s->getWordIds().size();
 	}
 	else
 	{
@@ -3567,7 +3631,7 @@ void Memory::copyData(const Signature * from, Signature * to)
 	{
 		// words 2d
 		this->disableWordsRef(to->id());
-		to->setWords(from->getWords());
+		to->setWords(from->getWordIds(), from->getWordKeypoints(), from->getWordPoints3(), from->getWordDescriptorsMat());
 		std::list<int> id;
 		id.push_back(to->id());
 		this->enableWordsRef(id);
@@ -3584,8 +3648,6 @@ void Memory::copyData(const Signature * from, Signature * to)
 		to->sensorData().setId(to->id());
 
 		to->setPose(from->getPose());
-		to->setWords3(from->getWords3());
-		to->setWordsDescriptors(from->getWordsDescriptors());
 	}
 	else
 	{
@@ -3755,9 +3817,9 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 				if(!decimatedData.rightRaw().empty() ||
 					(decimatedData.depthRaw().rows == decimatedData.imageRaw().rows && decimatedData.depthRaw().cols == decimatedData.imageRaw().cols))
 				{
-					decimatedData.setDepthOrRightRaw(util2d::decimate(decimatedData.depthOrRightRaw(), _imagePreDecimation));
+					decimatedData.setDepthOrRightRaw(decimatedData.depthOrRightRawDecimated(_imagePreDecimation));
 				}
-				decimatedData.setImageRaw(util2d::decimate(decimatedData.imageRaw(), _imagePreDecimation));
+				decimatedData.setImageRaw(decimatedData.imageRawDecimated(_imagePreDecimation));
 				std::vector<CameraModel> cameraModels = decimatedData.cameraModels();
 				for(unsigned int i=0; i<cameraModels.size(); ++i)
 				{
@@ -3773,15 +3835,7 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 			}
 
 			UINFO("Extract features");
-			cv::Mat imageMono;
-			if(decimatedData.imageRaw().channels() == 3)
-			{
-				cv::cvtColor(decimatedData.imageRaw(), imageMono, CV_BGR2GRAY);
-			}
-			else
-			{
-				imageMono = decimatedData.imageRaw();
-			}
+			cv::Mat imageMono = decimatedData.imageRawGray();
 
 			cv::Mat depthMask;
 			if(!decimatedData.depthRaw().empty() && _depthAsMask)
@@ -3876,17 +3930,7 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 
 		if(descriptors.empty())
 		{
-			cv::Mat imageMono;
-			if(data.imageRaw().channels() == 3)
-			{
-				cv::cvtColor(data.imageRaw(), imageMono, CV_BGR2GRAY);
-			}
-			else
-			{
-				imageMono = data.imageRaw();
-			}
-
-			descriptors = _feature2D->generateDescriptors(imageMono, keypoints);
+			descriptors = _feature2D->generateDescriptors(data.imageRawGray(), keypoints);
 		}
 		t = timer.ticks();
 		if(stats) stats->addStatistic(Statistics::kTimingMemDescriptors_extraction(), t*1000.0f);
@@ -4150,9 +4194,9 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 		if(!data.rightRaw().empty() ||
 			(data.depthRaw().rows == image.rows && data.depthRaw().cols == image.cols))
 		{
-			depthOrRightImage = util2d::decimate(depthOrRightImage, _imagePostDecimation);
+			depthOrRightImage = data.depthOrRightRawDecimated(_imagePostDecimation);
 		}
-		image = util2d::decimate(image, _imagePostDecimation);
+		image = data.imageRawDecimated(_imagePostDecimation);
 		for(unsigned int i=0; i<cameraModels.size(); ++i)
 		{
 			cameraModels[i] = cameraModels[i].scaled(1.0/double(_imagePostDecimation));
@@ -4234,10 +4278,10 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 		cv::Mat compressedUserData;
 		if(_compressionParallelized)
 		{
-			rtabmap::CompressionThread ctImage(image, std::string(".jpg"));
-			rtabmap::CompressionThread ctDepth(depthOrRightImage, std::string(".png"));
-			rtabmap::CompressionThread ctLaserScan(laserScan.data());
-			rtabmap::CompressionThread ctUserData(data.userDataRaw());
+			rtabmap::CompressionJob ctImage(image, std::string(".jpg"));
+			rtabmap::CompressionJob ctDepth(depthOrRightImage, depthOrRightImage.type() == CV_16UC1?_depthCompressionFormat:std::string(".png"));
+			rtabmap::CompressionJob ctLaserScan(laserScan.data());
+			rtabmap::CompressionJob ctUserData(data.userDataRaw());
 			if(!image.empty())
 			{
 				ctImage.start();
@@ -4267,7 +4311,9 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 		else
 		{
 			compressedImage = compressImage2(image, std::string(".jpg"));
-			compressedDepth = compressImage2(depthOrRightImage, depthOrRightImage.type() == CV_32FC1 || depthOrRightImage.type() == CV_16UC1?std::string(".png"):std::string(".jpg"));
+			compressedDepth = compressImage2(depthOrRightImage,
+					depthOrRightImage.type() == CV_16UC1?_depthCompressionFormat:
+					depthOrRightImage.type() == CV_32FC1?std::string(".png"):std::string(".jpg"));
 			compressedScan = compressData2(laserScan.data());
 			compressedUserData = compressData2(data.userDataRaw());
 		}
@@ -4308,8 +4354,8 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 		cv::Mat compressedUserData;
 		if(_compressionParallelized)
 		{
-			rtabmap::CompressionThread ctUserData(data.userDataRaw());
-			rtabmap::CompressionThread ctLaserScan(laserScan.data());
+			rtabmap::CompressionJob ctUserData(data.userDataRaw());
+			rtabmap::CompressionJob ctLaserScan(laserScan.data());
 			if(!data.userDataRaw().empty() && !isIntermediateNode)
 			{
 				ctUserData.start();
@@ -4438,8 +4484,7 @@ void Memory::disableWordsRef(int signatureId)
 	Signature * ss = this->_getSignature(signatureId);
 	if(ss && ss->isEnabled())
 	{
-		const std::multimap<int, cv::KeyPoint> & words = ss->getWords();
-		const std::list<int> & keys = uUniqueKeys(words);
+		const std::list<int> & keys = uniqueWordIds(ss);
 		int count = _vwd->getTotalActiveReferences();
 		// First remove all references
 		for(std::list<int>::const_iterator i=keys.begin(); i!=keys.end(); ++i)
@@ -4492,7 +4537,7 @@ void Memory::enableWordsRef(const std::list<int> & signatureIds)
 		if(ss && !ss->isEnabled())
 		{
 			surfSigns.push_back(ss);
-			std::list<int> uniqueKeys = uUniqueKeys(ss->getWords());
+			std::list<int> uniqueKeys = uniqueWordIds(ss);
 
 			//Find words in the signature which they are not in the current dictionary
 			for(std::list<int>::const_iterator k=uniqueKeys.begin(); k!=uniqueKeys.end(); ++k)
@@ -4552,14 +4597,10 @@ void Memory::enableWordsRef(const std::list<int> & signatureIds)
 		}
 		UDEBUG("Added %d to dictionary, time=%fs", vws.size()-refsToChange.size(), timer.ticks());
 
-		//update the global references map and update the signatures reactivated
-		for(std::map<int, int>::const_iterator iter=refsToChange.begin(); iter != refsToChange.end(); ++iter)
+		//update the signatures reactivated
+		for(std::list<Signature *>::iterator j=surfSigns.begin(); j!=surfSigns.end(); ++j)
 		{
-			//uInsert(_wordRefsToChange, (const std::pair<int, int>)*iter); // This will be used to change references in the database
-			for(std::list<Signature *>::iterator j=surfSigns.begin(); j!=surfSigns.end(); ++j)
-			{
-				(*j)->changeWordsRef(iter->first, iter->second);
-			}
+			(*j)->changeWordsRef(refsToChange);
 		}
 		UDEBUG("changing ref, total=%d, time=%fs", refsToChange.size(), timer.ticks());
 	}
@@ -4569,7 +4610,7 @@ void Memory::enableWordsRef(const std::list<int> & signatureIds)
 	// Reactivate references and signatures
 	for(std::list<Signature *>::iterator j=surfSigns.begin(); j!=surfSigns.end(); ++j)
 	{
-		const std::vector<int> & keys = uKeys((*j)->getWords());
+		const std::vector<int> & keys = (*j)->getWordIds();
 		if(keys.size())
 		{
 			// Add all references
@@ -4630,6 +4671,16 @@ std::set<int> Memory::reactivateSignatures(const std::list<int> & ids, unsigned
 	return std::set<int>(idsToLoad.begin(), idsToLoad.end());
 }
 
+void Memory::prefetchSignatures(const std::list<int> & ids)
+{
+	// Loaded in background, reactivateSignatures() will get
+	// them without accessing the database
+	if(_dbDriver)
+	{
+		_dbDriver->prefetchSignatures(ids);
+	}
+}
+
 // return all non-null poses
 // return unique links between nodes (for neighbors: old->new, for loops: parent->child)
 void Memory::getMetricConstraints(
@@ -79,8 +79,10 @@ OccupancyGrid::OccupancyGrid(const ParametersMap & parameters) :
 	probMiss_(logodds(Parameters::defaultGridGlobalProbMiss())),
 	probClampingMin_(logodds(Parameters::defaultGridGlobalProbClampingMin())),
 	probClampingMax_(logodds(Parameters::defaultGridGlobalProbClampingMax())),
-	xMin_(0.0f),
-	yMin_(0.0f),
+	tileSize_(Parameters::defaultGridGlobalTileSize()),
+	cellMin_(0,0),
+	cellMax_(-1,-1),
+	lastTile_(0),
 	cloudAssembling_(false),
 	assembledGround_(new pcl::PointCloud<pcl::PointXYZRGB>),
 	assembledObstacles_(new pcl::PointCloud<pcl::PointXYZRGB>),
@@ -156,6 +158,17 @@ void OccupancyGrid::parseParameters(const ParametersMap & parameters)
 		probClampingMax_ = logodds(probClampingMax_);
 	}
 	UASSERT(probClampingMax_ > probClampingMin_);
+	int tileSize = tileSize_;
+	if(Parameters::parse(parameters, Parameters::kGridGlobalTileSize(), tileSize) && tileSize != tileSize_)
+	{
+		UASSERT_MSG(tileSize > 0, uFormat("Param name is \"%s\"", Parameters::kGridGlobalTileSize().c_str()).c_str());
+		if(!tiles_.empty())
+		{
+			UWARN("Grid tile size has changed, the map is cleared!");
+		}
+		this->clear();
+		tileSize_ = tileSize;
+	}
 
 	UASSERT(minMapSize_ >= 0.0f);
 
@@ -230,27 +243,28 @@ void OccupancyGrid::setMap(const cv::Mat & map, float xMin, float yMin, float ce
 	{
 		UASSERT(cellSize > 0.0f);
 		UASSERT(map.type() == CV_8SC1);
-		map_ = map.clone();
-		mapInfo_ = cv::Mat::zeros(map.size(), CV_32FC4);
-		for(int i=0; i<map_.rows; ++i)
+		cellSize_ = cellSize;
+		cv::Point2i origin(cvRound(xMin/cellSize_), cvRound(yMin/cellSize_));
+		std::set<std::pair<int, int> > updatedTiles;
+		for(int i=0; i<map.rows; ++i)
 		{
-			for(int j=0; j<map_.cols; ++j)
+			for(int j=0; j<map.cols; ++j)
 			{
-				const char value = map_.at<char>(i,j);
-				float * info = mapInfo_.ptr<float>(i,j);
-				if(value == 0)
+				const char value = map.at<char>(i,j);
+				if(value == 0 || value == 100)
 				{
-					info[3] = probClampingMin_;
-				}
-				else if(value == 100)
-				{
-					info[3] = probClampingMax_;
+					cv::Point2i cell(origin.x+j, origin.y+i);
+					std::pair<int, int> key = tileKey(cell);
+					Tile & tile = getTile(key, updatedTiles);
+					int x = cell.x - key.first*tileSize_;
+					int y = cell.y - key.second*tileSize_;
+					tile.map.at<char>(y, x) = value;
+					tile.info.ptr<float>(y, x)[3] = value == 0?probClampingMin_:probClampingMax_;
 				}
 			}
 		}
-		xMin_ = xMin;
-		yMin_ = yMin;
-		cellSize_ = cellSize;
+		growBounds(origin);
+		growBounds(cv::Point2i(origin.x+map.cols-1, origin.y+map.rows-1));
 		addedNodes_ = poses;
 	}
 }
@@ -260,7 +274,7 @@ void OccupancyGrid::setCellSize(float cellSize)
 	UASSERT_MSG(cellSize > 0.0f, uFormat("Param name is \"%s\"", Parameters::kGridCellSize().c_str()).c_str());
 	if(cellSize_ != cellSize)
 	{
-		if(!map_.empty())
+		if(!tiles_.empty())
 		{
 			UWARN("Grid cell size has changed, the map is cleared!");
 		}
@@ -591,11 +605,11 @@ void OccupancyGrid::createLocalMap(
 void OccupancyGrid::clear()
 {
 	cache_.clear();
-	map_ = cv::Mat();
-	mapInfo_ = cv::Mat();
-	cellCount_.clear();
-	xMin_ = 0.0f;
-	yMin_ = 0.0f;
+	tiles_.clear();
+	nodeTiles_.clear();
+	cellMin_ = cv::Point2i(0,0);
+	cellMax_ = cv::Point2i(-1,-1);
+	lastTile_ = 0;
 	addedNodes_.clear();
 	assembledGround_->clear();
 	assembledObstacles_->clear();
@@ -603,104 +617,455 @@ void OccupancyGrid::clear()
 
 cv::Mat OccupancyGrid::getMap(float & xMin, float & yMin) const
 {
-	xMin = xMin_;
-	yMin = yMin_;
+	UTimer t;
+	cv::Mat map = assembleTiles(xMin, yMin, occupancyThr_ != 0.0f?1:0);
+	UDEBUG("Assembling %d tiles (thr=%f) = %fs", (int)tiles_.size(), occupancyThr_, t.ticks());
 
-	cv::Mat map = map_;
+	if(erode_ && !map.empty())
+	{
+		map = util3d::erodeMap(map);
+		UDEBUG("Eroding map = %fs", t.ticks());
+	}
+	return map;
+}
 
-	UTimer t;
-	if(occupancyThr_ != 0.0f && !map.empty())
+cv::Mat OccupancyGrid::getProbMap(float & xMin, float & yMin) const
+{
+	return assembleTiles(xMin, yMin, 2);
+}
+
+void OccupancyGrid::addToCache(
+		int nodeId,
+		const cv::Mat & ground,
+		const cv::Mat & obstacles,
+		const cv::Mat & empty)
+{
+	UDEBUG("nodeId=%d", nodeId);
+	uInsert(cache_, std::make_pair(nodeId, std::make_pair(std::make_pair(ground, obstacles), empty)));
+}
+
+cv::Point2i OccupancyGrid::cellIndex(float x, float y) const
+{
+	return cv::Point2i(cvFloor(x/cellSize_), cvFloor(y/cellSize_));
+}
+
+std::pair<int, int> OccupancyGrid::tileKey(const cv::Point2i & cell) const
+{
+	// floor division
+	return std::make_pair(
+			cell.x>=0?cell.x/tileSize_:(cell.x+1)/tileSize_-1,
+			cell.y>=0?cell.y/tileSize_:(cell.y+1)/tileSize_-1);
+}
+
+OccupancyGrid::Tile & OccupancyGrid::getTile(const std::pair<int, int> & key, std::set<std::pair<int, int> > & updatedTiles)
+{
+	if(lastTile_ == 0 || lastTileKey_ != key)
 	{
-		float occThr = logodds(occupancyThr_);
-		map = cv::Mat(map.size(), map.type());
-		UASSERT(mapInfo_.cols == map.cols && mapInfo_.rows == map.rows);
-		for(int i=0; i<map.rows; ++i)
+		std::map<std::pair<int, int>, Tile>::iterator iter = tiles_.find(key);
+		if(iter == tiles_.end())
 		{
-			for(int j=0; j<map.cols; ++j)
+			iter = tiles_.insert(std::make_pair(key, Tile())).first;
+			iter->second.map = cv::Mat(tileSize_, tileSize_, CV_8SC1, cv::Scalar(-1));
+			iter->second.info = cv::Mat::zeros(tileSize_, tileSize_, CV_32FC4);
+		}
+		lastTile_ = &iter->second;
+		lastTileKey_ = key;
+		updatedTiles.insert(key);
+	}
+	return *lastTile_;
+}
+
+bool OccupancyGrid::getCell(int x, int y, char *& value, float *& info)
+{
+	std::pair<int, int> key = tileKey(cv::Point2i(x,y));
+	std::map<std::pair<int, int>, Tile>::iterator iter = tiles_.find(key);
+	if(iter == tiles_.end())
+	{
+		return false;
+	}
+	x -= key.first*tileSize_;
+	y -= key.second*tileSize_;
+	value = &iter->second.map.at<char>(y, x);
+	info = iter->second.info.ptr<float>(y, x);
+	return true;
+}
+
+void OccupancyGrid::addNodeToTile(int nodeId, Tile & tile, const std::pair<int, int> & key)
+{
+	if(nodeId > 0 && tile.nodes.insert(nodeId).second)
+	{
+		nodeTiles_[nodeId].insert(key);
+	}
+}
+
+void OccupancyGrid::growBounds(const cv::Point2i & cell)
+{
+	if(cellMin_.x > cellMax_.x)
+	{
+		cellMin_ = cellMax_ = cell;
+	}
+	else
+	{
+		cellMin_.x = std::min(cellMin_.x, cell.x);
+		cellMin_.y = std::min(cellMin_.y, cell.y);
+		cellMax_.x = std::max(cellMax_.x, cell.x);
+		cellMax_.y = std::max(cellMax_.y, cell.y);
+	}
+}
+
+void OccupancyGrid::addLocalMapTiles(const cv::Mat & cells, std::set<std::pair<int, int> > & tiles) const
+{
+	for(int i=0; i<cells.cols; ++i)
+	{
+		const float * ptf = cells.ptr<float>(0,i);
+		tiles.insert(tileKey(cellIndex(ptf[0], ptf[1])));
+	}
+}
+
+// Transform local cells in map frame, only x and y are kept
+static cv::Mat transformLocalCells(const cv::Mat & cells, const Transform & pose)
+{
+	if(cells.rows > 1 && cells.cols == 1)
+	{
+		UFATAL("Occupancy local maps should be 1 row and X cols! (rows=%d cols=%d)", cells.rows, cells.cols);
+	}
+	cv::Mat output(1, cells.cols, CV_32FC2);
+	for(int i=0; i<output.cols; ++i)
+	{
+		const float * vi = cells.ptr<float>(0,i);
+		float * vo = output.ptr<float>(0,i);
+		cv::Point3f vt;
+		if(cells.channels() != 2 && cells.channels() != 5)
+		{
+			vt = util3d::transformPoint(cv::Point3f(vi[0], vi[1], vi[2]), pose);
+		}
+		else
+		{
+			vt = util3d::transformPoint(cv::Point3f(vi[0], vi[1], 0), pose);
+		}
+		vo[0] = vt.x;
+		vo[1] = vt.y;
+	}
+	return output;
+}
+
+void OccupancyGrid::localMapsFromCache(
+		int nodeId,
+		const Transform & pose,
+		std::map<int, cv::Mat> & emptyLocalMaps,
+		std::map<int, cv::Mat> & occupiedLocalMaps) const
+{
+	const std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> & pair = cache_.at(nodeId);
+
+	UDEBUG("Adding grid %d: ground=%d obstacles=%d empty=%d", nodeId, pair.first.first.cols, pair.first.second.cols, pair.second.cols);
+
+	//ground
+	if(pair.first.first.cols)
+	{
+		uInsert(emptyLocalMaps, std::make_pair(nodeId, transformLocalCells(pair.first.first, pose)));
+	}
+
+	//empty
+	if(pair.second.cols)
+	{
+		uInsert(emptyLocalMaps, std::make_pair(nodeId, transformLocalCells(pair.second, pose)));
+	}
+
+	//obstacles
+	if(pair.first.second.cols)
+	{
+		uInsert(occupiedLocalMaps, std::make_pair(nodeId, transformLocalCells(pair.first.second, pose)));
+	}
+}
+
+void OccupancyGrid::extractCells(
+		const std::set<std::pair<int, int> > & tiles,
+		const std::map<int, Transform> & nodes,
+		std::map<int, cv::Mat> & emptyLocalMaps,
+		std::map<int, cv::Mat> & occupiedLocalMaps) const
+{
+	std::map<int, std::vector<cv::Vec2f> > emptyCells;
+	std::map<int, std::vector<cv::Vec2f> > occupiedCells;
+	for(std::set<std::pair<int, int> >::const_iterator iter=tiles.begin(); iter!=tiles.end(); ++iter)
+	{
+		std::map<std::pair<int, int>, Tile>::const_iterator jter = tiles_.find(*iter);
+		if(jter == tiles_.end())
+		{
+			continue;
+		}
+		const Tile & tile = jter->second;
+		for(int y=0; y<tile.map.rows; ++y)
+		{
+			for(int x=0; x<tile.map.cols; ++x)
 			{
-				const float * info = mapInfo_.ptr<float>(i, j);
-				if(info[3] == 0.0f)
+				const float * info = tile.info.ptr<float>(y,x);
+				int nodeId = (int)info[0];
+				char value = tile.map.at<char>(y,x);
+				if(nodeId > 0 && value >= 0)
 				{
-					map.at<char>(i, j) = -1; // unknown
+					std::map<int, Transform>::const_iterator tter = nodes.find(nodeId);
+					if(tter != nodes.end())
+					{
+						cv::Point3f pt = util3d::transformPoint(cv::Point3f(info[1], info[2], 0.0f), tter->second);
+						(value == 0?emptyCells:occupiedCells)[nodeId].push_back(cv::Vec2f(pt.x, pt.y));
+					}
 				}
-				else if(info[3] >= occThr)
+			}
+		}
+	}
+	for(std::map<int, std::vector<cv::Vec2f> >::iterator iter=emptyCells.begin(); iter!=emptyCells.end(); ++iter)
+	{
+		uInsert(emptyLocalMaps, std::make_pair(iter->first, cv::Mat(iter->second, true).reshape(2, 1)));
+	}
+	for(std::map<int, std::vector<cv::Vec2f> >::iterator iter=occupiedCells.begin(); iter!=occupiedCells.end(); ++iter)
+	{
+		uInsert(occupiedLocalMaps, std::make_pair(iter->first, cv::Mat(iter->second, true).reshape(2, 1)));
+	}
+}
+
+void OccupancyGrid::addLocalMap(
+		int nodeId,
+		const Transform & pose,
+		const cv::Mat & emptyCells,
+		const cv::Mat & occupiedCells,
+		bool incrementalGraphUpdate,
+		const std::set<std::pair<int, int> > * tilesFilter,
+		std::set<std::pair<int, int> > & updatedTiles)
+{
+	for(int i=0; i<emptyCells.cols; ++i)
+	{
+		const float * ptf = emptyCells.ptr<float>(0,i);
+		cv::Point2i cell = cellIndex(ptf[0], ptf[1]);
+		std::pair<int, int> key = tileKey(cell);
+		if(tilesFilter && tilesFilter->find(key) == tilesFilter->end())
+		{
+			continue;
+		}
+		Tile & tile = getTile(key, updatedTiles);
+		int x = cell.x - key.first*tileSize_;
+		int y = cell.y - key.second*tileSize_;
+		char & value = tile.map.at<char>(y, x);
+		if(value != -2 && (!incrementalGraphUpdate || value==-1))
+		{
+			float * info = tile.info.ptr<float>(y, x);
+			int cellNodeId = (int)info[0];
+			if(value != -1 && nodeId > 0 && (nodeId < cellNodeId || cellNodeId < 0))
+			{
+				// cannot rewrite on cells referred by more recent nodes
+				continue;
+			}
+			if(nodeId > 0)
+			{
+				info[0] = (float)nodeId;
+				info[1] = ptf[0];
+				info[2] = ptf[1];
+				addNodeToTile(nodeId, tile, key);
+			}
+			value = 0; // free space
+			growBounds(cell);
+
+			// update odds
+			if(cellNodeId != nodeId)
+			{
+				info[3] += probMiss_;
+				if (info[3] < probClampingMin_)
 				{
-					map.at<char>(i, j) = 100; // unknown
+					info[3] = probClampingMin_;
 				}
-				else
+				if (info[3] > probClampingMax_)
 				{
-					map.at<char>(i, j) = 0; // empty
+					info[3] = probClampingMax_;
 				}
 			}
 		}
-		UDEBUG("Converting map from probabilities (thr=%f) = %fs", occupancyThr_, t.ticks());
 	}
 
-	if(erode_ && !map.empty())
+	if(footprintRadius_ >= cellSize_*1.5f)
 	{
-		map = util3d::erodeMap(map);
-		UDEBUG("Eroding map = %fs", t.ticks());
+		// place free space under the footprint of the robot
+		cv::Point2i ptBegin = cellIndex(pose.x()-footprintRadius_, pose.y()-footprintRadius_);
+		cv::Point2i ptEnd = cellIndex(pose.x()+footprintRadius_, pose.y()+footprintRadius_);
+		for(int i=ptBegin.x; i<ptEnd.x; ++i)
+		{
+			for(int j=ptBegin.y; j<ptEnd.y; ++j)
+			{
+				cv::Point2i cell(i,j);
+				std::pair<int, int> key = tileKey(cell);
+				if(tilesFilter && tilesFilter->find(key) == tilesFilter->end())
+				{
+					continue;
+				}
+				Tile & tile = getTile(key, updatedTiles);
+				int x = cell.x - key.first*tileSize_;
+				int y = cell.y - key.second*tileSize_;
+				char & value = tile.map.at<char>(y, x);
+				float * info = tile.info.ptr<float>(y, x);
+				int cellNodeId = (int)info[0];
+				if(value != -1 && nodeId > 0 && (nodeId < cellNodeId || cellNodeId < 0))
+				{
+					// cannot rewrite on cells referred by more recent nodes
+					continue;
+				}
+				if(nodeId > 0)
+				{
+					info[0] = (float)nodeId;
+					info[1] = (float(i)+0.5f) * cellSize_;
+					info[2] = (float(j)+0.5f) * cellSize_;
+					addNodeToTile(nodeId, tile, key);
+				}
+				value = -2; // free space (footprint)
+				growBounds(cell);
+			}
+		}
 	}
-	return map;
-}
-
-cv::Mat OccupancyGrid::getProbMap(float & xMin, float & yMin) const
-{
-	xMin = xMin_;
-	yMin = yMin_;
 
-	cv::Mat map;
-	if(!mapInfo_.empty())
+	for(int i=0; i<occupiedCells.cols; ++i)
 	{
-		map = cv::Mat(mapInfo_.size(), map_.type());
-		for(int i=0; i<map.rows; ++i)
+		const float * ptf = occupiedCells.ptr<float>(0,i);
+		cv::Point2i cell = cellIndex(ptf[0], ptf[1]);
+		std::pair<int, int> key = tileKey(cell);
+		if(tilesFilter && tilesFilter->find(key) == tilesFilter->end())
 		{
-			for(int j=0; j<map.cols; ++j)
+			continue;
+		}
+		Tile & tile = getTile(key, updatedTiles);
+		int x = cell.x - key.first*tileSize_;
+		int y = cell.y - key.second*tileSize_;
+		char & value = tile.map.at<char>(y, x);
+		if(value != -2)
+		{
+			float * info = tile.info.ptr<float>(y, x);
+			int cellNodeId = (int)info[0];
+			if(value != -1 && nodeId > 0 && (nodeId < cellNodeId || cellNodeId < 0))
 			{
-				const float * info = mapInfo_.ptr<float>(i, j);
-				if(info[3] == 0.0f)
+				// cannot rewrite on cells referred by more recent nodes
+				continue;
+			}
+			if(nodeId > 0)
+			{
+				info[0] = (float)nodeId;
+				info[1] = ptf[0];
+				info[2] = ptf[1];
+				addNodeToTile(nodeId, tile, key);
+			}
+			value = 100; // obstacles
+			growBounds(cell);
+
+			// update odds
+			if(cellNodeId != nodeId)
+			{
+				info[3] += probHit_;
+				if (info[3] < probClampingMin_)
 				{
-					map.at<char>(i, j) = -1; // unknown
+					info[3] = probClampingMin_;
 				}
-				else
+				if (info[3] > probClampingMax_)
 				{
-					map.at<char>(i, j) = char(probability(info[3])*100.0f); // empty
+					info[3] = probClampingMax_;
 				}
 			}
 		}
 	}
-	return map;
 }
 
-void OccupancyGrid::addToCache(
-		int nodeId,
-		const cv::Mat & ground,
-		const cv::Mat & obstacles,
-		const cv::Mat & empty)
+cv::Mat OccupancyGrid::assembleTiles(float & xMin, float & yMin, int format) const
 {
-	UDEBUG("nodeId=%d", nodeId);
-	uInsert(cache_, std::make_pair(nodeId, std::make_pair(std::make_pair(ground, obstacles), empty)));
+	// format: 0=raw values, 1=occupancy threshold, 2=probabilities
+	xMin = 0.0f;
+	yMin = 0.0f;
+	cv::Mat map;
+	if(cellMin_.x > cellMax_.x)
+	{
+		return map;
+	}
+
+	int margin = 10+(footprintRadius_>cellSize_*1.5f?int(footprintRadius_/cellSize_)+1:0);
+	cv::Point2i cellMin = cellMin_ - cv::Point2i(margin, margin);
+	cv::Point2i cellMax = cellMax_ + cv::Point2i(margin, margin);
+	if(minMapSize_ > 0.0f)
+	{
+		cv::Point2i minSizeMin = cellIndex(-minMapSize_/2.0f, -minMapSize_/2.0f);
+		cv::Point2i minSizeMax = cellIndex(minMapSize_/2.0f, minMapSize_/2.0f);
+		cellMin.x = std::min(cellMin.x, minSizeMin.x);
+		cellMin.y = std::min(cellMin.y, minSizeMin.y);
+		cellMax.x = std::max(cellMax.x, minSizeMax.x);
+		cellMax.y = std::max(cellMax.y, minSizeMax.y);
+	}
+	cv::Size mapSize(cellMax.x - cellMin.x + 1, cellMax.y - cellMin.y + 1);
+	if(mapSize.width > 99999 || mapSize.height > 99999)
+	{
+		UERROR("Large map size!! map min=(%f, %f) max=(%f,%f). "
+				"There's maybe an error with the poses provided! The map will not be created!",
+				float(cellMin.x)*cellSize_, float(cellMin.y)*cellSize_, float(cellMax.x+1)*cellSize_, float(cellMax.y+1)*cellSize_);
+		return map;
+	}
+	xMin = float(cellMin.x)*cellSize_;
+	yMin = float(cellMin.y)*cellSize_;
+	map = cv::Mat(mapSize, CV_8SC1, cv::Scalar(-1));
+
+	std::vector<const std::pair<const std::pair<int, int>, Tile> *> tiles;
+	tiles.reserve(tiles_.size());
+	for(std::map<std::pair<int, int>, Tile>::const_iterator iter=tiles_.begin(); iter!=tiles_.end(); ++iter)
+	{
+		tiles.push_back(&(*iter));
+	}
+
+	float occThr = logodds(occupancyThr_);
+	#pragma omp parallel for
+	for(int k=0; k<(int)tiles.size(); ++k)
+	{
+		const std::pair<int, int> & key = tiles[k]->first;
+		const Tile & tile = tiles[k]->second;
+		cv::Rect tileRect(key.first*tileSize_ - cellMin.x, key.second*tileSize_ - cellMin.y, tileSize_, tileSize_);
+		cv::Rect roi = tileRect & cv::Rect(0, 0, map.cols, map.rows);
+		if(roi.area() == 0)
+		{
+			continue;
+		}
+		cv::Rect tileRoi(roi.x - tileRect.x, roi.y - tileRect.y, roi.width, roi.height);
+		if(format == 0)
+		{
+			cv::Mat dst = map(roi);
+			tile.map(tileRoi).copyTo(dst);
+		}
+		else
+		{
+			for(int y=0; y<roi.height; ++y)
+			{
+				const float * info = tile.info.ptr<float>(tileRoi.y+y, tileRoi.x);
+				char * value = map.ptr<char>(roi.y+y, roi.x);
+				for(int x=0; x<roi.width; ++x, info+=4, ++value)
+				{
+					if(info[3] == 0.0f)
+					{
+						*value = -1; // unknown
+					}
+					else if(format == 1)
+					{
+						*value = info[3] >= occThr?100:0; // occupied or empty
+					}
+					else
+					{
+						*value = char(probability(info[3])*100.0f);
+					}
+				}
+			}
+		}
+	}
+	return map;
 }
 
 void OccupancyGrid::update(const std::map<int, Transform> & posesIn)
 {
 	UTimer timer;
-	UDEBUG("Update (poses=%d addedNodes_=%d)", (int)posesIn.size(), (int)addedNodes_.size());
-
-	float margin = cellSize_*10.0f+(footprintRadius_>cellSize_*1.5f?float(int(footprintRadius_/cellSize_)+1):0.0f)*cellSize_;
-
-	float minX=-minMapSize_/2.0f;
-	float minY=-minMapSize_/2.0f;
-	float maxX=minMapSize_/2.0f;
-	float maxY=minMapSize_/2.0f;
-	bool undefinedSize = minMapSize_ == 0.0f;
-	std::map<int, cv::Mat> emptyLocalMaps;
-	std::map<int, cv::Mat> occupiedLocalMaps;
+	UDEBUG("Update (poses=%d addedNodes_=%d tiles=%d)", (int)posesIn.size(), (int)addedNodes_.size(), (int)tiles_.size());
 
-	// First, check of the graph has changed. If so, re-create the map by moving all occupied nodes (fullUpdate==false).
+	// First, check of the graph has changed. If so, only tiles touched by nodes that
+	// moved are updated. The whole map is re-created only if none of the previous nodes are in the graph.
 	bool graphOptimized = false; // If a loop closure happened (e.g., poses are modified)
 	bool graphChanged = addedNodes_.size()>0; // If the new map doesn't have any node from the previous map
-	std::map<int, Transform> transforms;
+	std::map<int, Transform> transforms; // <moved node, correction>
+	std::set<int> removedNodes;
 	float updateErrorSqrd = updateError_*updateError_;
 	for(std::map<int, Transform>::iterator iter=addedNodes_.begin(); iter!=addedNodes_.end(); ++iter)
 	{
@@ -710,38 +1075,16 @@ void OccupancyGrid::update(const std::map<int, Transform> & posesIn)
 			graphChanged = false;
 
 			UASSERT(!iter->second.isNull() && !jter->second.isNull());
-			Transform t = Transform::getIdentity();
 			if(iter->second.getDistanceSquared(jter->second) > updateErrorSqrd)
 			{
-				t = jter->second * iter->second.inverse();
+				transforms.insert(std::make_pair(jter->first, jter->second * iter->second.inverse()));
 				graphOptimized = true;
 			}
-			transforms.insert(std::make_pair(jter->first, t));
-
-			float x = jter->second.x();
-			float y  =jter->second.y();
-			if(undefinedSize)
-			{
-				minX = maxX = x;
-				minY = maxY = y;
-				undefinedSize = false;
-			}
-			else
-			{
-				if(minX > x)
-					minX = x;
-				else if(maxX < x)
-					maxX = x;
-
-				if(minY > y)
-					minY = y;
-				else if(maxY < y)
-					maxY = y;
-			}
 		}
 		else
 		{
 			UDEBUG("Updated pose for node %d is not found, some points may not be copied if graph has changed.", iter->first);
+			removedNodes.insert(iter->first);
 		}
 	}
 
@@ -749,146 +1092,198 @@ void OccupancyGrid::update(const std::map<int, Transform> & posesIn)
 	bool assembledObstaclesUpdated = false;
 	bool assembledEmptyCellsUpdated = false;
 
-	if(graphOptimized || graphChanged)
+	lastTile_ = 0;
+	std::set<std::pair<int, int> > updatedTiles;
+	std::set<std::pair<int, int> > dirtyTiles; // tiles touched by moved or removed nodes
+	std::map<int, cv::Mat> emptyLocalMaps;
+	std::map<int, cv::Mat> occupiedLocalMaps;
+	std::set<int> redrawnNodes; // nodes not moved but added again in dirty tiles
+
+	if(graphChanged)
 	{
-		if(graphChanged)
+		UWARN("Graph has changed! The whole map should be rebuilt.");
+		tiles_.clear();
+		nodeTiles_.clear();
+		cellMin_ = cv::Point2i(0,0);
+		cellMax_ = cv::Point2i(-1,-1);
+		addedNodes_.clear();
+	}
+	else if(graphOptimized)
+	{
+		std::set<int> nodesToClear = removedNodes;
+		for(std::map<int, Transform>::iterator iter=transforms.begin(); iter!=transforms.end(); ++iter)
 		{
-			UWARN("Graph has changed! The whole map should be rebuilt.");
+			nodesToClear.insert(iter->first);
 		}
-		else
+		for(std::set<int>::iterator iter=nodesToClear.begin(); iter!=nodesToClear.end(); ++iter)
 		{
-			UINFO("Graph optimized!");
+			std::map<int, std::set<std::pair<int, int> > >::iterator jter = nodeTiles_.find(*iter);
+			if(jter != nodeTiles_.end())
+			{
+				dirtyTiles.insert(jter->second.begin(), jter->second.end());
+			}
 		}
 
-		if(cloudAssembling_)
+		// Local maps of the moved nodes at their new position. If not in cache,
+		// their cells are moved.
+		std::map<int, Transform> nodesToExtract;
+		for(std::map<int, Transform>::iterator iter=transforms.begin(); iter!=transforms.end(); ++iter)
 		{
-			assembledGround_->clear();
-			assembledObstacles_->clear();
+			if(uContains(cache_, iter->first))
+			{
+				localMapsFromCache(iter->first, posesIn.at(iter->first), emptyLocalMaps, occupiedLocalMaps);
+			}
+			else
+			{
+				nodesToExtract.insert(*iter);
+			}
+		}
+		if(nodesToExtract.size())
+		{
+			extractCells(dirtyTiles, nodesToExtract, emptyLocalMaps, occupiedLocalMaps);
 		}
 
-		if(!fullUpdate_ && !graphChanged && !map_.empty()) // incremental, just move cells
+		if(fullUpdate_)
 		{
-			// 1) recreate all local maps
-			UASSERT(map_.cols == mapInfo_.cols &&
-					map_.rows == mapInfo_.rows);
-			std::map<int, std::pair<int, int> > tmpIndices;
-			for(std::map<int, std::pair<int, int> >::iterator iter=cellCount_.begin(); iter!=cellCount_.end(); ++iter)
+			// Dirty tiles are re-created from scratch: add tiles at the new
+			// position of the moved nodes, then all nodes having cells in
+			// these tiles are added again in the same order as a full rebuild.
+			for(std::map<int, Transform>::iterator iter=transforms.begin(); iter!=transforms.end(); ++iter)
 			{
-				if(!uContains(cache_, iter->first) && transforms.find(iter->first) != transforms.end())
+				std::map<int, cv::Mat>::iterator jter = emptyLocalMaps.find(iter->first);
+				if(jter != emptyLocalMaps.end())
 				{
-					if(iter->second.first)
+					addLocalMapTiles(jter->second, dirtyTiles);
+				}
+				jter = occupiedLocalMaps.find(iter->first);
+				if(jter != occupiedLocalMaps.end())
+				{
+					addLocalMapTiles(jter->second, dirtyTiles);
+				}
+				if(footprintRadius_ >= cellSize_*1.5f)
+				{
+					const Transform & pose = posesIn.at(iter->first);
+					std::pair<int, int> keyBegin = tileKey(cellIndex(pose.x()-footprintRadius_, pose.y()-footprintRadius_));
+					std::pair<int, int> keyEnd = tileKey(cellIndex(pose.x()+footprintRadius_, pose.y()+footprintRadius_));
+					for(int i=keyBegin.first; i<=keyEnd.first; ++i)
 					{
-						emptyLocalMaps.insert(std::make_pair( iter->first, cv::Mat(1, iter->second.first, CV_32FC2)));
+						for(int j=keyBegin.second; j<=keyEnd.second; ++j)
+						{
+							dirtyTiles.insert(std::make_pair(i,j));
+						}
 					}
-					if(iter->second.second)
+				}
+			}
+
+			std::map<int, Transform> nodesToRedraw; // not in cache
+			for(std::set<std::pair<int, int> >::iterator iter=dirtyTiles.begin(); iter!=dirtyTiles.end(); ++iter)
+			{
+				std::map<std::pair<int, int>, Tile>::iterator jter = tiles_.find(*iter);
+				if(jter != tiles_.end())
+				{
+					for(std::set<int>::iterator kter=jter->second.nodes.begin(); kter!=jter->second.nodes.end(); ++kter)
 					{
-						occupiedLocalMaps.insert(std::make_pair( iter->first, cv::Mat(1, iter->second.second, CV_32FC2)));
+						std::map<int, Transform>::const_iterator pter = posesIn.find(*kter);
+						if(pter != posesIn.end() && transforms.find(*kter) == transforms.end() && redrawnNodes.insert(*kter).second)
+						{
+							if(uContains(cache_, *kter))
+							{
+								localMapsFromCache(*kter, pter->second, emptyLocalMaps, occupiedLocalMaps);
+							}
+							else
+							{
+								nodesToRedraw.insert(std::make_pair(*kter, Transform::getIdentity()));
+							}
+						}
 					}
-					tmpIndices.insert(std::make_pair(iter->first, std::make_pair(0,0)));
 				}
 			}
-			for(int y=0; y<map_.rows; ++y)
+			if(nodesToRedraw.size())
 			{
-				for(int x=0; x<map_.cols; ++x)
+				extractCells(dirtyTiles, nodesToRedraw, emptyLocalMaps, occupiedLocalMaps);
+			}
+
+			for(std::set<std::pair<int, int> >::iterator iter=dirtyTiles.begin(); iter!=dirtyTiles.end(); ++iter)
+			{
+				std::map<std::pair<int, int>, Tile>::iterator jter = tiles_.find(*iter);
+				if(jter != tiles_.end())
 				{
-					float * info = mapInfo_.ptr<float>(y,x);
-					int nodeId = (int)info[0];
-					if(nodeId > 0 && map_.at<char>(y,x) >= 0)
+					for(std::set<int>::iterator kter=jter->second.nodes.begin(); kter!=jter->second.nodes.end(); ++kter)
 					{
-						if(tmpIndices.find(nodeId)!=tmpIndices.end())
+						std::map<int, std::set<std::pair<int, int> > >::iterator nter = nodeTiles_.find(*kter);
+						if(nter != nodeTiles_.end())
 						{
-							std::map<int, Transform>::iterator tter = transforms.find(nodeId);
-							UASSERT(tter != transforms.end());
-
-							cv::Point3f pt(info[1], info[2], 0.0f);
-							pt = util3d::transformPoint(pt, tter->second);
-
-							if(minX > pt.x)
-								minX = pt.x;
-							else if(maxX < pt.x)
-								maxX = pt.x;
-
-							if(minY > pt.y)
-								minY = pt.y;
-							else if(maxY < pt.y)
-								maxY = pt.y;
-
-							std::map<int, std::pair<int, int> >::iterator jter = tmpIndices.find(nodeId);
-							if(map_.at<char>(y, x) == 0)
+							nter->second.erase(*iter);
+							if(nter->second.empty())
 							{
-								// ground
-								std::map<int, cv::Mat>::iterator iter = emptyLocalMaps.find(nodeId);
-								UASSERT(iter != emptyLocalMaps.end());
-								UASSERT(jter->second.first < iter->second.cols);
-								float * ptf = iter->second.ptr<float>(0,jter->second.first++);
-								ptf[0] = pt.x;
-								ptf[1] = pt.y;
+								nodeTiles_.erase(nter);
 							}
-							else
+						}
+					}
+					tiles_.erase(jter);
+				}
+			}
+		}
+		else
+		{
+			// Only cells of the moved and removed nodes are cleared
+			for(std::set<std::pair<int, int> >::iterator iter=dirtyTiles.begin(); iter!=dirtyTiles.end(); ++iter)
+			{
+				std::map<std::pair<int, int>, Tile>::iterator jter = tiles_.find(*iter);
+				if(jter != tiles_.end())
+				{
+					Tile & tile = jter->second;
+					for(int y=0; y<tile.map.rows; ++y)
+					{
+						for(int x=0; x<tile.map.cols; ++x)
+						{
+							float * info = tile.info.ptr<float>(y,x);
+							if(nodesToClear.find((int)info[0]) != nodesToClear.end())
 							{
-								// obstacle
-								std::map<int, cv::Mat>::iterator iter = occupiedLocalMaps.find(nodeId);
-								UASSERT(iter != occupiedLocalMaps.end());
-								UASSERT(iter!=occupiedLocalMaps.end());
-								UASSERT(jter->second.second < iter->second.cols);
-								float * ptf = iter->second.ptr<float>(0,jter->second.second++);
-								ptf[0] = pt.x;
-								ptf[1] = pt.y;
+								tile.map.at<char>(y,x) = -1;
+								info[0] = info[1] = info[2] = info[3] = 0.0f;
 							}
 						}
 					}
-					else if(nodeId > 0)
+					for(std::set<int>::iterator kter=nodesToClear.begin(); kter!=nodesToClear.end(); ++kter)
 					{
-						UERROR("Cell referred b node %d is unknown!?", nodeId);
+						tile.nodes.erase(*kter);
 					}
 				}
 			}
-
-			//verify if all cells were added
-			for(std::map<int, std::pair<int, int> >::iterator iter=tmpIndices.begin(); iter!=tmpIndices.end(); ++iter)
+			for(std::set<int>::iterator iter=nodesToClear.begin(); iter!=nodesToClear.end(); ++iter)
 			{
-				std::map<int, cv::Mat>::iterator jter = emptyLocalMaps.find(iter->first);
-				UASSERT_MSG((iter->second.first == 0 && (jter==emptyLocalMaps.end() || jter->second.empty())) ||
-						(iter->second.first != 0 && jter!=emptyLocalMaps.end() && jter->second.cols == iter->second.first),
-						uFormat("iter->second.first=%d jter->second.cols=%d", iter->second.first, jter!=emptyLocalMaps.end()?jter->second.cols:-1).c_str());
-				jter = occupiedLocalMaps.find(iter->first);
-				UASSERT_MSG((iter->second.second == 0 && (jter==occupiedLocalMaps.end() || jter->second.empty())) ||
-						(iter->second.second != 0 && jter!=occupiedLocalMaps.end() && jter->second.cols == iter->second.second),
-						uFormat("iter->second.first=%d jter->second.cols=%d", iter->second.first, jter!=emptyLocalMaps.end()?jter->second.cols:-1).c_str());
+				nodeTiles_.erase(*iter);
 			}
+		}
 
-			UDEBUG("min (%f,%f) max(%f,%f)", minX, minY, maxX, maxY);
+		for(std::set<int>::iterator iter=removedNodes.begin(); iter!=removedNodes.end(); ++iter)
+		{
+			addedNodes_.erase(*iter);
 		}
 
-		addedNodes_.clear();
-		map_ = cv::Mat();
-		mapInfo_ = cv::Mat();
-		cellCount_.clear();
-		xMin_ = 0.0f;
-		yMin_ = 0.0f;
-	}
-	else if(!map_.empty())
-	{
-		// update
-		minX=xMin_+margin+cellSize_/2.0f;
-		minY=yMin_+margin+cellSize_/2.0f;
-		maxX=xMin_+float(map_.cols)*cellSize_ - margin;
-		maxY=yMin_+float(map_.rows)*cellSize_ - margin;
-		undefinedSize = false;
+		UINFO("Graph optimized! (%d nodes moved, %d removed, %d redrawn, %d tiles updated)",
+				(int)transforms.size(), (int)removedNodes.size(), (int)redrawnNodes.size(), (int)dirtyTiles.size());
 	}
 
-	bool incrementalGraphUpdate = graphOptimized && !fullUpdate_ && !graphChanged;
+	bool incrementalGraphUpdate = graphOptimized && !fullUpdate_;
 
 	std::list<std::pair<int, Transform> > poses;
-	int lastId = addedNodes_.size()?addedNodes_.rbegin()->first:0;
-	UDEBUG("Last id = %d", lastId);
+	std::set<int> newNodes;
 
-	// add old poses that were not in the current map (they were just retrieved from LTM)
+	// add old poses that were not in the current map (they were just retrieved from LTM),
+	// with the moved and redrawn nodes
 	for(std::map<int, Transform>::const_iterator iter=posesIn.upper_bound(0); iter!=posesIn.end(); ++iter)
 	{
 		if(addedNodes_.find(iter->first) == addedNodes_.end())
 		{
 			UDEBUG("Pose %d not found in current added poses, it will be added to map", iter->first);
+			newNodes.insert(iter->first);
+			poses.push_back(*iter);
+		}
+		else if(transforms.find(iter->first) != transforms.end() ||
+				redrawnNodes.find(iter->first) != redrawnNodes.end())
+		{
 			poses.push_back(*iter);
 		}
 	}
@@ -898,6 +1293,7 @@ void OccupancyGrid::update(const std::map<int, Transform> & posesIn)
 	{
 		if(iter->first < 0)
 		{
+			newNodes.insert(iter->first);
 			poses.push_back(*iter);
 		}
 		else
@@ -906,591 +1302,165 @@ void OccupancyGrid::update(const std::map<int, Transform> & posesIn)
 		}
 	}
 
-	for(std::list<std::pair<int, Transform> >::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
+	if(poses.size())
 	{
-		UASSERT(!iter->second.isNull());
-
-		float x = iter->second.x();
-		float y  =iter->second.y();
-		if(undefinedSize)
+		UDEBUG("first pose= %d last pose=%d", poses.begin()->first, poses.rbegin()->first);
+	}
+	for(std::list<std::pair<int, Transform> >::const_iterator kter = poses.begin(); kter!=poses.end(); ++kter)
+	{
+		UASSERT(!kter->second.isNull());
+		if(kter->first > 0)
 		{
-			minX = maxX = x;
-			minY = maxY = y;
-			undefinedSize = false;
+			uInsert(addedNodes_, *kter);
 		}
-		else
+		if(newNodes.find(kter->first) != newNodes.end() && uContains(cache_, kter->first))
 		{
-			if(minX > x)
-				minX = x;
-			else if(maxX < x)
-				maxX = x;
-
-			if(minY > y)
-				minY = y;
-			else if(maxY < y)
-				maxY = y;
+			localMapsFromCache(kter->first, kter->second, emptyLocalMaps, occupiedLocalMaps);
 		}
+		growBounds(cellIndex(kter->second.x(), kter->second.y()));
+
+		std::map<int, cv::Mat >::iterator iter = emptyLocalMaps.find(kter->first);
+		std::map<int, cv::Mat >::iterator jter = occupiedLocalMaps.find(kter->first);
+		addLocalMap(
+				kter->first,
+				kter->second,
+				iter!=emptyLocalMaps.end()?iter->second:cv::Mat(),
+				jter!=occupiedLocalMaps.end()?jter->second:cv::Mat(),
+				incrementalGraphUpdate,
+				redrawnNodes.find(kter->first) != redrawnNodes.end()?&dirtyTiles:0,
+				updatedTiles);
 	}
 
-	if(!cache_.empty())
+	if(footprintRadius_ >= cellSize_*1.5f || incrementalGraphUpdate)
 	{
-		for(std::list<std::pair<int, Transform> >::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
+		if(incrementalGraphUpdate)
 		{
-			if(uContains(cache_, iter->first))
+			// fill holes left by the cells moved
+			for(std::set<std::pair<int, int> >::iterator iter=dirtyTiles.begin(); iter!=dirtyTiles.end(); ++iter)
 			{
-				const std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> & pair = cache_.at(iter->first);
-
-				UDEBUG("Adding grid %d: ground=%d obstacles=%d empty=%d", iter->first, pair.first.first.cols, pair.first.second.cols, pair.second.cols);
-
-				//ground
-				if(pair.first.first.cols)
+				if(tiles_.find(*iter) != tiles_.end())
 				{
-					if(pair.first.first.rows > 1 && pair.first.first.cols == 1)
-					{
-						UFATAL("Occupancy local maps should be 1 row and X cols! (rows=%d cols=%d)", pair.first.first.rows, pair.first.first.cols);
-					}
-					cv::Mat ground(1, pair.first.first.cols, CV_32FC2);
-					for(int i=0; i<ground.cols; ++i)
-					{
-						const float * vi = pair.first.first.ptr<float>(0,i);
-						float * vo = ground.ptr<float>(0,i);
-						cv::Point3f vt;
-						if(pair.first.first.channels() != 2 && pair.first.first.channels() != 5)
-						{
-							vt = util3d::transformPoint(cv::Point3f(vi[0], vi[1], vi[2]), iter->second);
-						}
-						else
-						{
-							vt = util3d::transformPoint(cv::Point3f(vi[0], vi[1], 0), iter->second);
-						}
-						vo[0] = vt.x;
-						vo[1] = vt.y;
-						if(minX > vo[0])
-							minX = vo[0];
-						else if(maxX < vo[0])
-							maxX = vo[0];
-
-						if(minY > vo[1])
-							minY = vo[1];
-						else if(maxY < vo[1])
-							maxY = vo[1];
-					}
-					uInsert(emptyLocalMaps, std::make_pair(iter->first, ground));
-
-					if(cloudAssembling_)
-					{
-						*assembledGround_ += *util3d::laserScanToPointCloudRGB(LaserScan::backwardCompatibility(pair.first.first), iter->second, 0, 255, 0);
-						assembledGroundUpdated = true;
-					}
-				}
-
-				//empty
-				if(pair.second.cols)
-				{
-					if(pair.second.rows > 1 && pair.second.cols == 1)
-					{
-						UFATAL("Occupancy local maps should be 1 row and X cols! (rows=%d cols=%d)", pair.second.rows, pair.second.cols);
-					}
-					cv::Mat ground(1, pair.second.cols, CV_32FC2);
-					for(int i=0; i<ground.cols; ++i)
-					{
-						const float * vi = pair.second.ptr<float>(0,i);
-						float * vo = ground.ptr<float>(0,i);
-						cv::Point3f vt;
-						if(pair.second.channels() != 2 && pair.second.channels() != 5)
-						{
-							vt = util3d::transformPoint(cv::Point3f(vi[0], vi[1], vi[2]), iter->second);
-						}
-						else
-						{
-							vt = util3d::transformPoint(cv::Point3f(vi[0], vi[1], 0), iter->second);
-						}
-						vo[0] = vt.x;
-						vo[1] = vt.y;
-						if(minX > vo[0])
-							minX = vo[0];
-						else if(maxX < vo[0])
-							maxX = vo[0];
-
-						if(minY > vo[1])
-							minY = vo[1];
-						else if(maxY < vo[1])
-							maxY = vo[1];
-					}
-					uInsert(emptyLocalMaps, std::make_pair(iter->first, ground));
-
-					if(cloudAssembling_)
-					{
-						*assembledEmptyCells_ += *util3d::laserScanToPointCloudRGB(LaserScan::backwardCompatibility(pair.second), iter->second, 0, 255, 0);
-						assembledEmptyCellsUpdated = true;
-					}
-				}
-
-				//obstacles
-				if(pair.first.second.cols)
-				{
-					if(pair.first.second.rows > 1 && pair.first.second.cols == 1)
-					{
-						UFATAL("Occupancy local maps should be 1 row and X cols! (rows=%d cols=%d)", pair.first.second.rows, pair.first.second.cols);
-					}
-					cv::Mat obstacles(1, pair.first.second.cols, CV_32FC2);
-					for(int i=0; i<obstacles.cols; ++i)
-					{
-						const float * vi = pair.first.second.ptr<float>(0,i);
-						float * vo = obstacles.ptr<float>(0,i);
-						cv::Point3f vt;
-						if(pair.first.second.channels() != 2 && pair.first.second.channels() != 5)
-						{
-							vt = util3d::transformPoint(cv::Point3f(vi[0], vi[1], vi[2]), iter->second);
-						}
-						else
-						{
-							vt = util3d::transformPoint(cv::Point3f(vi[0], vi[1], 0), iter->second);
-						}
-						vo[0] = vt.x;
-						vo[1] = vt.y;
-						if(minX > vo[0])
-							minX = vo[0];
-						else if(maxX < vo[0])
-							maxX = vo[0];
-
-						if(minY > vo[1])
-							minY = vo[1];
-						else if(maxY < vo[1])
-							maxY = vo[1];
-					}
-					uInsert(occupiedLocalMaps, std::make_pair(iter->first, obstacles));
-
-					if(cloudAssembling_)
-					{
-						*assembledObstacles_ += *util3d::laserScanToPointCloudRGB(LaserScan::backwardCompatibility(pair.first.second), iter->second, 255, 0, 0);
-						assembledObstaclesUpdated = true;
-					}
+					updatedTiles.insert(*iter);
 				}
 			}
 		}
-	}
 
-	cv::Mat map;
-	cv::Mat mapInfo;
-	if(minX != maxX && minY != maxY)
-	{
-		//Get map size
-		float xMin = minX-margin;
-		xMin -= cellSize_/2.0f;
-		float yMin = minY-margin;
-		yMin -= cellSize_/2.0f;
-		float xMax = maxX+margin;
-		float yMax = maxY+margin;
-
-		if(fabs((yMax - yMin) / cellSize_) > 99999 ||
-		   fabs((xMax - xMin) / cellSize_) > 99999)
+		for(std::set<std::pair<int, int> >::iterator iter=updatedTiles.begin(); iter!=updatedTiles.end(); ++iter)
 		{
-			UERROR("Large map size!! map min=(%f, %f) max=(%f,%f). "
-					"There's maybe an error with the poses provided! The map will not be created!",
-					xMin, yMin, xMax, yMax);
-		}
-		else
-		{
-			UDEBUG("map min=(%f, %f) odlMin(%f,%f) max=(%f,%f)", xMin, yMin, xMin_, yMin_, xMax, yMax);
-			cv::Size newMapSize((xMax - xMin) / cellSize_+0.5f, (yMax - yMin) / cellSize_+0.5f);
-			if(map_.empty())
-			{
-				UDEBUG("Map empty!");
-				map = cv::Mat::ones(newMapSize, CV_8S)*-1;
-				mapInfo = cv::Mat::zeros(newMapSize, CV_32FC4);
-			}
-			else
+			Tile & tile = tiles_.at(*iter);
+			for(int i=0; i<tile.map.rows; ++i)
 			{
-				if(xMin == xMin_ && yMin == yMin_ &&
-						newMapSize.width == map_.cols &&
-						newMapSize.height == map_.rows)
+				for(int j=0; j<tile.map.cols; ++j)
 				{
-					// same map size and origin, don't do anything
-					UDEBUG("Map same size!");
-					map = map_;
-					mapInfo = mapInfo_;
-				}
-				else
-				{
-					UASSERT_MSG(xMin <= xMin_+cellSize_/2, uFormat("xMin=%f, xMin_=%f, cellSize_=%f", xMin, xMin_, cellSize_).c_str());
-					UASSERT_MSG(yMin <= yMin_+cellSize_/2, uFormat("yMin=%f, yMin_=%f, cellSize_=%f", yMin, yMin_, cellSize_).c_str());
-					UASSERT_MSG(xMax >= xMin_+float(map_.cols)*cellSize_ - cellSize_/2, uFormat("xMin=%f, xMin_=%f, cols=%d cellSize_=%f", xMin, xMin_, map_.cols, cellSize_).c_str());
-					UASSERT_MSG(yMax >= yMin_+float(map_.rows)*cellSize_ - cellSize_/2, uFormat("yMin=%f, yMin_=%f, cols=%d cellSize_=%f", yMin, yMin_, map_.rows, cellSize_).c_str());
-
-					UDEBUG("Copy map");
-					// copy the old map in the new map
-					// make sure the translation is cellSize
-					int deltaX = 0;
-					if(xMin < xMin_)
-					{
-						deltaX = (xMin_ - xMin) / cellSize_ + 1.0f;
-						xMin = xMin_-float(deltaX)*cellSize_;
-					}
-					int deltaY = 0;
-					if(yMin < yMin_)
-					{
-						deltaY = (yMin_ - yMin) / cellSize_ + 1.0f;
-						yMin = yMin_-float(deltaY)*cellSize_;
-					}
-					UDEBUG("deltaX=%d, deltaY=%d", deltaX, deltaY);
-					newMapSize.width = (xMax - xMin) / cellSize_+0.5f;
-					newMapSize.height = (yMax - yMin) / cellSize_+0.5f;
-					UDEBUG("%d/%d -> %d/%d", map_.cols, map_.rows, newMapSize.width, newMapSize.height);
-					UASSERT(newMapSize.width >= map_.cols && newMapSize.height >= map_.rows);
-					UASSERT(newMapSize.width >= map_.cols+deltaX && newMapSize.height >= map_.rows+deltaY);
-					UASSERT(deltaX>=0 && deltaY>=0);
-					map = cv::Mat::ones(newMapSize, CV_8S)*-1;
-					mapInfo = cv::Mat::zeros(newMapSize, mapInfo_.type());
-					map_.copyTo(map(cv::Rect(deltaX, deltaY, map_.cols, map_.rows)));
-					mapInfo_.copyTo(mapInfo(cv::Rect(deltaX, deltaY, map_.cols, map_.rows)));
-				}
-			}
-			UASSERT(map.cols == mapInfo.cols && map.rows == mapInfo.rows);
-			UDEBUG("map %d %d", map.cols, map.rows);
-			if(poses.size())
-			{
-				UDEBUG("first pose= %d last pose=%d", poses.begin()->first, poses.rbegin()->first);
-			}
-			for(std::list<std::pair<int, Transform> >::const_iterator kter = poses.begin(); kter!=poses.end(); ++kter)
-			{
-				if(kter->first > 0)
-				{
-					uInsert(addedNodes_, *kter);
-				}
-				std::map<int, cv::Mat >::iterator iter = emptyLocalMaps.find(kter->first);
-				std::map<int, cv::Mat >::iterator jter = occupiedLocalMaps.find(kter->first);
-				std::map<int, std::pair<int, int> >::iterator cter = cellCount_.find(kter->first);
-				if(cter == cellCount_.end() && kter->first > 0)
-				{
-					cter = cellCount_.insert(std::make_pair(kter->first, std::pair<int,int>(0,0))).first;
-				}
-				if(iter!=emptyLocalMaps.end())
-				{
-					for(int i=0; i<iter->second.cols; ++i)
+					char & value = tile.map.at<char>(i, j);
+					if(value == -2)
 					{
-						float * ptf = iter->second.ptr<float>(0,i);
-						cv::Point2i pt((ptf[0]-xMin)/cellSize_, (ptf[1]-yMin)/cellSize_);
-						UASSERT_MSG(pt.y >=0 && pt.y < map.rows && pt.x >= 0 && pt.x < map.cols,
-								uFormat("%d: pt=(%d,%d) map=%dx%d rawPt=(%f,%f) xMin=%f yMin=%f channels=%dvs%d (graph modified=%d)",
-										kter->first, pt.x, pt.y, map.cols, map.rows, ptf[0], ptf[1], xMin, yMin, iter->second.channels(), mapInfo.channels()-1, (graphOptimized || graphChanged)?1:0).c_str());
-						char & value = map.at<char>(pt.y, pt.x);
-						if(value != -2 && (!incrementalGraphUpdate || value==-1))
-						{
-							float * info = mapInfo.ptr<float>(pt.y, pt.x);
-							int nodeId = (int)info[0];
-							if(value != -1)
-							{
-								if(kter->first > 0 && (kter->first <  nodeId || nodeId < 0))
-								{
-									// cannot rewrite on cells referred by more recent nodes
-									continue;
-								}
-								if(nodeId > 0)
-								{
-									std::map<int, std::pair<int, int> >::iterator eter = cellCount_.find(nodeId);
-									UASSERT_MSG(eter != cellCount_.end(), uFormat("current pose=%d nodeId=%d", kter->first, nodeId).c_str());
-									if(value == 0)
-									{
-										eter->second.first -= 1;
-									}
-									else if(value == 100)
-									{
-										eter->second.second -= 1;
-									}
-									if(kter->first < 0)
-									{
-										eter->second.first += 1;
-									}
-								}
-							}
-							if(kter->first > 0)
-							{
-								info[0] = (float)kter->first;
-								info[1] = ptf[0];
-								info[2] = ptf[1];
-								cter->second.first+=1;
-							}
-							value = 0; // free space
-
-							// update odds
-							if(nodeId != kter->first)
-							{
-								info[3] += probMiss_;
-								if (info[3] < probClampingMin_)
-								{
-									info[3] = probClampingMin_;
-								}
-								if (info[3] > probClampingMax_)
-								{
-									info[3] = probClampingMax_;
-								}
-							}
-						}
+						value = 0;
 					}
-				}
 
-				if(footprintRadius_ >= cellSize_*1.5f)
-				{
-					// place free space under the footprint of the robot
-					cv::Point2i ptBegin((kter->second.x()-footprintRadius_-xMin)/cellSize_, (kter->second.y()-footprintRadius_-yMin)/cellSize_);
-					cv::Point2i ptEnd((kter->second.x()+footprintRadius_-xMin)/cellSize_, (kter->second.y()+footprintRadius_-yMin)/cellSize_);
-					if(ptBegin.x < 0)
-						ptBegin.x = 0;
-					if(ptEnd.x >= map.cols)
-						ptEnd.x = map.cols-1;
-
-					if(ptBegin.y < 0)
-						ptBegin.y = 0;
-					if(ptEnd.y >= map.rows)
-						ptEnd.y = map.rows-1;
-					for(int i=ptBegin.x; i<ptEnd.x; ++i)
+					if(incrementalGraphUpdate && value == -1)
 					{
-						for(int j=ptBegin.y; j<ptEnd.y; ++j)
+						int x = iter->first*tileSize_ + j;
+						int y = iter->second*tileSize_ + i;
+						float * info = tile.info.ptr<float>(i, j);
+						// neighbors (i+1,j), (i-1,j), (i,j+1), (i,j-1), can be in other tiles
+						static const int offsets[4][2] = {{1,0}, {-1,0}, {0,1}, {0,-1}};
+						char * neighbors[4] = {0};
+						float * neighborsInfo[4] = {0};
+						bool border = false;
+						for(int n=0; n<4 && !border; ++n)
 						{
-							UASSERT(j < map.rows && i < map.cols);
-							char & value = map.at<char>(j, i);
-							float * info = mapInfo.ptr<float>(j, i);
-							int nodeId = (int)info[0];
-							if(value != -1)
+							int ni = i+offsets[n][0];
+							int nj = j+offsets[n][1];
+							if(ni>=0 && ni<tile.map.rows && nj>=0 && nj<tile.map.cols)
 							{
-								if(kter->first > 0 && (kter->first <  nodeId || nodeId < 0))
-								{
-									// cannot rewrite on cells referred by more recent nodes
-									continue;
-								}
-								if(nodeId>0)
-								{
-									std::map<int, std::pair<int, int> >::iterator eter = cellCount_.find(nodeId);
-									UASSERT_MSG(eter != cellCount_.end(), uFormat("current pose=%d nodeId=%d", kter->first, nodeId).c_str());
-									if(value == 0)
-									{
-										eter->second.first -= 1;
-									}
-									else if(value == 100)
-									{
-										eter->second.second -= 1;
-									}
-									if(kter->first < 0)
-									{
-										eter->second.first += 1;
-									}
-								}
+								neighbors[n] = &tile.map.at<char>(ni, nj);
+								neighborsInfo[n] = tile.info.ptr<float>(ni, nj);
 							}
-							if(kter->first > 0)
+							else if(!getCell(x+offsets[n][1], y+offsets[n][0], neighbors[n], neighborsInfo[n]))
 							{
-								info[0] = (float)kter->first;
-								info[1] = float(i) * cellSize_ + xMin;
-								info[2] = float(j) * cellSize_ + yMin;
-								cter->second.first+=1;
+								// at the border of the known space
+								border = true;
 							}
-							value = -2; // free space (footprint)
 						}
-					}
-				}
-
-				if(jter!=occupiedLocalMaps.end())
-				{
-					for(int i=0; i<jter->second.cols; ++i)
-					{
-						float * ptf = jter->second.ptr<float>(0,i);
-						cv::Point2i pt((ptf[0]-xMin)/cellSize_, (ptf[1]-yMin)/cellSize_);
-						UASSERT_MSG(pt.y>=0 && pt.y < map.rows && pt.x>=0 && pt.x < map.cols,
-									uFormat("%d: pt=(%d,%d) map=%dx%d rawPt=(%f,%f) xMin=%f yMin=%f channels=%dvs%d (graph modified=%d)",
-											kter->first, pt.x, pt.y, map.cols, map.rows, ptf[0], ptf[1], xMin, yMin, jter->second.channels(), mapInfo.channels()-1, (graphOptimized || graphChanged)?1:0).c_str());
-						char & value = map.at<char>(pt.y, pt.x);
-						if(value != -2)
+						if(border)
 						{
-							float * info = mapInfo.ptr<float>(pt.y, pt.x);
-							int nodeId = (int)info[0];
-							if(value != -1)
-							{
-								if(kter->first > 0 && (kter->first <  nodeId || nodeId < 0))
-								{
-									// cannot rewrite on cells referred by more recent nodes
-									continue;
-								}
-								if(nodeId>0)
-								{
-									std::map<int, std::pair<int, int> >::iterator eter = cellCount_.find(nodeId);
-									UASSERT_MSG(eter != cellCount_.end(), uFormat("current pose=%d nodeId=%d", kter->first, nodeId).c_str());
-									if(value == 0)
-									{
-										eter->second.first -= 1;
-									}
-									else if(value == 100)
-									{
-										eter->second.second -= 1;
-									}
-									if(kter->first < 0)
-									{
-										eter->second.second += 1;
-									}
-								}
-							}
-							if(kter->first > 0)
-							{
-								info[0] = (float)kter->first;
-								info[1] = ptf[0];
-								info[2] = ptf[1];
-								cter->second.second+=1;
-							}
-							value = 100; // obstacles
-
-							// update odds
-							if(nodeId != kter->first)
-							{
-								info[3] += probHit_;
-								if (info[3] < probClampingMin_)
-								{
-									info[3] = probClampingMin_;
-								}
-								if (info[3] > probClampingMax_)
-								{
-									info[3] = probClampingMax_;
-								}
-							}
+							continue;
 						}
-					}
-				}
-			}
 
-			if(footprintRadius_ >= cellSize_*1.5f || incrementalGraphUpdate)
-			{
-				for(int i=1; i<map.rows-1; ++i)
-				{
-					for(int j=1; j<map.cols-1; ++j)
-					{
-						char & value = map.at<char>(i, j);
-						if(value == -2)
+						int nearest = -1;
+						if(*neighbors[0] == 100 && *neighbors[1] == 100)
 						{
-							value = 0;
+							// fill obstacle
+							value = 100;
+							// associate with the nearest pose
+							nearest = neighborsInfo[0][0]>0.0f?0:neighborsInfo[1][0]>0.0f?1:-1;
 						}
-
-						if(incrementalGraphUpdate && value == -1)
+						else if(*neighbors[2] == 100 && *neighbors[3] == 100)
 						{
-							float * info = mapInfo.ptr<float>(i, j);
-
 							// fill obstacle
-							if(map.at<char>(i+1, j) == 100 && map.at<char>(i-1, j) == 100)
-							{
-								value = 100;
-								// associate with the nearest pose
-								if(mapInfo.ptr<float>(i+1, j)[0]>0.0f)
-								{
-									info[0] = mapInfo.ptr<float>(i+1, j)[0];
-									info[1] = float(j) * cellSize_ + xMin;
-									info[2] = float(i) * cellSize_ + yMin;
-									std::map<int, std::pair<int, int> >::iterator cter = cellCount_.find(int(info[0]));
-									UASSERT(cter!=cellCount_.end());
-									cter->second.second+=1;
-								}
-								else if(mapInfo.ptr<float>(i-1, j)[0]>0.0f)
-								{
-									info[0] = mapInfo.ptr<float>(i-1, j)[0];
-									info[1] = float(j) * cellSize_ + xMin;
-									info[2] = float(i) * cellSize_ + yMin;
-									std::map<int, std::pair<int, int> >::iterator cter = cellCount_.find(int(info[0]));
-									UASSERT(cter!=cellCount_.end());
-									cter->second.second+=1;
-								}
-							}
-							else if(map.at<char>(i, j+1) == 100 && map.at<char>(i, j-1) == 100)
-							{
-								value = 100;
-								// associate with the nearest pose
-								if(mapInfo.ptr<float>(i, j+1)[0]>0.0f)
-								{
-									info[0] = mapInfo.ptr<float>(i, j+1)[0];
-									info[1] = float(j) * cellSize_ + xMin;
-									info[2] = float(i) * cellSize_ + yMin;
-									std::map<int, std::pair<int, int> >::iterator cter = cellCount_.find(int(info[0]));
-									UASSERT(cter!=cellCount_.end());
-									cter->second.second+=1;
-								}
-								else if(mapInfo.ptr<float>(i, j-1)[0]>0.0f)
-								{
-									info[0] = mapInfo.ptr<float>(i, j-1)[0];
-									info[1] = float(j) * cellSize_ + xMin;
-									info[2] = float(i) * cellSize_ + yMin;
-									std::map<int, std::pair<int, int> >::iterator cter = cellCount_.find(int(info[0]));
-									UASSERT(cter!=cellCount_.end());
-									cter->second.second+=1;
-								}
-							}
-							else
+							value = 100;
+							// associate with the nearest pose
+							nearest = neighborsInfo[2][0]>0.0f?2:neighborsInfo[3][0]>0.0f?3:-1;
+						}
+						else
+						{
+							// fill empty
+							char sum =  (*neighbors[0] == 0?1:0) +
+										(*neighbors[1] == 0?1:0) +
+										(*neighbors[2] == 0?1:0) +
+										(*neighbors[3] == 0?1:0);
+							if(sum >=3)
 							{
-								// fill empty
-								char sum =  (map.at<char>(i+1, j) == 0?1:0) +
-											(map.at<char>(i-1, j) == 0?1:0) +
-											(map.at<char>(i, j+1) == 0?1:0) +
-											(map.at<char>(i, j-1) == 0?1:0);
-								if(sum >=3)
-								{
-									value = 0;
-									// associate with the nearest pose, only check two cases (as 3 are required)
-									if(map.at<char>(i+1, j) != -1 && mapInfo.ptr<float>(i+1, j)[0]>0.0f)
-									{
-										info[0] = mapInfo.ptr<float>(i+1, j)[0];
-										info[1] = float(j) * cellSize_ + xMin;
-										info[2] = float(i) * cellSize_ + yMin;
-										std::map<int, std::pair<int, int> >::iterator cter = cellCount_.find(int(info[0]));
-										UASSERT(cter!=cellCount_.end());
-										cter->second.first+=1;
-									}
-									else if(map.at<char>(i-1, j) != -1 && mapInfo.ptr<float>(i-1, j)[0]>0.0f)
-									{
-										info[0] = mapInfo.ptr<float>(i-1, j)[0];
-										info[1] = float(j) * cellSize_ + xMin;
-										info[2] = float(i) * cellSize_ + yMin;
-										std::map<int, std::pair<int, int> >::iterator cter = cellCount_.find(int(info[0]));
-										UASSERT(cter!=cellCount_.end());
-										cter->second.first+=1;
-									}
-								}
+								value = 0;
+								// associate with the nearest pose, only check two cases (as 3 are required)
+								nearest = *neighbors[0] != -1 && neighborsInfo[0][0]>0.0f?0:*neighbors[1] != -1 && neighborsInfo[1][0]>0.0f?1:-1;
 							}
 						}
-
-						//float * info = mapInfo.ptr<float>(i,j);
-						//if(info[0] > 0)
-						//{
-						//	cloud->at(oi).x = info[1];
-						//	cloud->at(oi).y = info[2];
-						//	oi++;
-						//}
+						if(nearest >= 0)
+						{
+							info[0] = neighborsInfo[nearest][0];
+							info[1] = (float(x)+0.5f) * cellSize_;
+							info[2] = (float(y)+0.5f) * cellSize_;
+							addNodeToTile((int)info[0], tile, *iter);
+						}
 					}
 				}
 			}
-			//if(graphChanged)
-			//{
-			//	cloud->resize(oi);
-			//	pcl::io::savePCDFileBinary("mapInfo.pcd", *cloud);
-			//	UWARN("Saved mapInfo.pcd");
-			//}
-
-			map_ = map;
-			mapInfo_ = mapInfo;
-			xMin_ = xMin;
-			yMin_ = yMin;
-
-			// clean cellCount_
-			for(std::map<int, std::pair<int, int> >::iterator iter= cellCount_.begin(); iter!=cellCount_.end();)
+		}
+	}
+
+	if(cloudAssembling_)
+	{
+		if(graphOptimized || graphChanged)
+		{
+			assembledGround_->clear();
+			assembledObstacles_->clear();
+			assembledEmptyCells_->clear();
+		}
+		for(std::map<int, Transform>::const_iterator iter=posesIn.begin(); iter!=posesIn.end(); ++iter)
+		{
+			if((graphOptimized || newNodes.find(iter->first) != newNodes.end()) && uContains(cache_, iter->first))
 			{
-				UASSERT(iter->second.first >= 0 && iter->second.second >= 0);
-				if(iter->second.first == 0 && iter->second.second == 0)
+				const std::pair<std::pair<cv::Mat, cv::Mat>, cv::Mat> & pair = cache_.at(iter->first);
+				if(pair.first.first.cols)
 				{
-					cellCount_.erase(iter++);
+					*assembledGround_ += *util3d::laserScanToPointCloudRGB(LaserScan::backwardCompatibility(pair.first.first), iter->second, 0, 255, 0);
+					assembledGroundUpdated = true;
 				}
-				else
+				if(pair.second.cols)
 				{
-					++iter;
+					*assembledEmptyCells_ += *util3d::laserScanToPointCloudRGB(LaserScan::backwardCompatibility(pair.second), iter->second, 0, 255, 0);
+					assembledEmptyCellsUpdated = true;
+				}
+				if(pair.first.second.cols)
+				{
+					*assembledObstacles_ += *util3d::laserScanToPointCloudRGB(LaserScan::backwardCompatibility(pair.first.second), iter->second, 255, 0, 0);
+					assembledObstaclesUpdated = true;
 				}
 			}
 		}
-	}
 
-	if(cloudAssembling_)
-	{
 		if(assembledGroundUpdated && assembledGround_->size() > 1)
 		{
 			assembledGround_ = util3d::voxelize(assembledGround_, cellSize_);
@@ -1525,7 +1495,7 @@ void OccupancyGrid::update(const std::map<int, Transform> & posesIn)
 		}
 	}
 
-	UDEBUG("Occupancy Grid update time = %f s", timer.ticks());
+	UDEBUG("Occupancy Grid update time = %f s (%d tiles updated, %d tiles)", timer.ticks(), (int)updatedTiles.size(), (int)tiles_.size());
 }
 
 }
@@ -33,6 +33,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/util3d_filtering.h>
 #include <rtabmap/core/util3d_mapping.h>
 #include <pcl/common/transforms.h>
+#include <algorithm>
+#include <set>
 
 namespace rtabmap {
 
@@ -266,6 +268,7 @@ OctoMap::OctoMap(const ParametersMap & parameters) :
 		hasColor_(false),
 		fullUpdate_(Parameters::defaultGridGlobalFullUpdate()),
 		updateError_(Parameters::defaultGridGlobalUpdateError()),
+		updateMovedOnly_(Parameters::defaultGridGlobalUpdateMovedOnly()),
 		rangeMax_(Parameters::defaultGridRangeMax()),
 		rayTracing_(Parameters::defaultGridRayTracing())
 {
@@ -302,6 +305,7 @@ OctoMap::OctoMap(const ParametersMap & parameters) :
 	octree_->setClampingThresMax(clampingMax);
 	Parameters::parse(parameters, Parameters::kGridGlobalFullUpdate(), fullUpdate_);
 	Parameters::parse(parameters, Parameters::kGridGlobalUpdateError(), updateError_);
+	Parameters::parse(parameters, Parameters::kGridGlobalUpdateMovedOnly(), updateMovedOnly_);
 	Parameters::parse(parameters, Parameters::kGridRangeMax(), rangeMax_);
 	Parameters::parse(parameters, Parameters::kGridRayTracing(), rayTracing_);
 }
@@ -311,6 +315,7 @@ OctoMap::OctoMap(float cellSize, float occupancyThr, bool fullUpdate, float upda
 		hasColor_(false),
 		fullUpdate_(fullUpdate),
 		updateError_(updateError),
+		updateMovedOnly_(Parameters::defaultGridGlobalUpdateMovedOnly()),
 		rangeMax_(0.0f),
 		rayTracing_(true)
 {
@@ -334,7 +339,6 @@ void OctoMap::clear()
 	cacheClouds_.clear();
 	cacheViewPoints_.clear();
 	addedNodes_.clear();
-	keyRay_ = octomap::KeyRay();
 	hasColor_ = false;
 	minValues_[0] = minValues_[1] = minValues_[2] = 0.0;
 	maxValues_[0] = maxValues_[1] = maxValues_[2] = 0.0;
@@ -364,6 +368,33 @@ void OctoMap::addToCache(int nodeId,
 	uInsert(cacheViewPoints_, std::make_pair(nodeId, viewPoint));
 }
 
+namespace {
+// Occupied endpoint computed before being inserted in the tree. Sorted
+// by key, then by point index to keep insertion order inside a cell.
+struct OccupiedPoint
+{
+	octomap::OcTreeKey key;
+	octomap::point3d point;
+	unsigned char r;
+	unsigned char g;
+	unsigned char b;
+	bool obstacle;
+	int index;
+
+	bool operator<(const OccupiedPoint & other) const
+	{
+		for(unsigned int i=0; i<3; ++i)
+		{
+			if(key[i] != other.key[i])
+			{
+				return key[i] < other.key[i];
+			}
+		}
+		return index < other.index;
+	}
+};
+}
+
 void OctoMap::update(const std::map<int, Transform> & poses)
 {
 	UDEBUG("Update (poses=%d addedNodes_=%d)", (int)poses.size(), (int)addedNodes_.size());
@@ -373,6 +404,7 @@ void OctoMap::update(const std::map<int, Transform> & poses)
 	bool graphChanged = addedNodes_.size()>0; // If the new map doesn't have any node from the previous map
 	std::map<int, Transform> transforms;
 	std::map<int, Transform> updatedAddedNodes;
+	std::set<int> movedNodes;
 	float updateErrorSqrd = updateError_*updateError_;
 	for(std::map<int, Transform>::iterator iter=addedNodes_.begin(); iter!=addedNodes_.end(); ++iter)
 	{
@@ -386,6 +418,7 @@ void OctoMap::update(const std::map<int, Transform> & poses)
 			{
 				t = jter->second * iter->second.inverse();
 				graphOptimized = true;
+				movedNodes.insert(jter->first);
 			}
 			transforms.insert(std::make_pair(jter->first, t));
 			updatedAddedNodes.insert(std::make_pair(jter->first, jter->second));
@@ -395,6 +428,7 @@ void OctoMap::update(const std::map<int, Transform> & poses)
 			UDEBUG("Updated pose for node %d is not found, some points may not be copied. Use negative ids to just update cell values without adding new ones.", jter->first);
 		}
 	}
+	std::set<int> reinsertedNodes;
 	if(graphOptimized || graphChanged)
 	{
 		if(graphChanged)
@@ -409,16 +443,28 @@ void OctoMap::update(const std::map<int, Transform> & poses)
 		minValues_[0] = minValues_[1] = minValues_[2] = 0.0;
 		maxValues_[0] = maxValues_[1] = maxValues_[2] = 0.0;
 
-		if(fullUpdate_ || graphChanged)
+		if((fullUpdate_ && !updateMovedOnly_) || graphChanged)
 		{
 			// clear all but keep cache
 			octree_->clear();
 			addedNodes_.clear();
-			keyRay_ = octomap::KeyRay();
 			hasColor_ = false;
 		}
 		else
 		{
+			if(fullUpdate_)
+			{
+				// GridGlobal/UpdateMovedOnly: only nodes that moved more than updateError are
+				// re-inserted from the cache (with ray tracing), cells of the other nodes are kept.
+				for(std::set<int>::iterator iter=movedNodes.begin(); iter!=movedNodes.end(); ++iter)
+				{
+					transforms.erase(*iter);
+					updatedAddedNodes.erase(*iter);
+				}
+				reinsertedNodes = movedNodes;
+				UINFO("Graph optimized, re-inserting %d/%d nodes", (int)movedNodes.size(), (int)addedNodes_.size());
+			}
+
 			RtabmapColorOcTree * newOcTree = new RtabmapColorOcTree(octree_->getResolution());
 			int copied=0;
 			int count=0;
@@ -563,181 +609,236 @@ void OctoMap::update(const std::map<int, Transform> & poses)
 				UERROR("Could not generate Key for origin ", sensorOrigin.x(), sensorOrigin.y(), sensorOrigin.z());
 			}
 
-			bool computeRays = rayTracing_ && (occupancyIter == cache_.end() || occupancyIter->second.second.empty());
+			bool computeRays = rayTracing_ &&
+					(occupancyIter == cache_.end() || occupancyIter->second.second.empty()) &&
+					(iter->first < 0 || iter->first>lastId || reinsertedNodes.find(iter->first) != reinsertedNodes.end());
+			bool checkRecentNodes = iter->first >0 && iter->first<lastId;
 
-			// instead of direct scan insertion, compute update to filter ground:
-			octomap::KeySet free_cells;
-			// insert ground points only as free:
-			unsigned int maxGroundPts = occupancyIter != cache_.end()?occupancyIter->second.first.first.cols:cloudIter->second.first->size();
-			UDEBUG("%d: compute free cells (from %d ground points)", iter->first, (int)maxGroundPts);
 			Eigen::Affine3f t = iter->second.toEigen3f();
 			LaserScan tmpGround;
+			LaserScan tmpObstacle;
+			LaserScan tmpEmpty;
+			int maxGroundPts = 0;
+			int maxObstaclePts = 0;
+			int maxEmptyPts = 0;
 			if(occupancyIter != cache_.end())
 			{
 				tmpGround = LaserScan::backwardCompatibility(occupancyIter->second.first.first);
-				UASSERT(tmpGround.size() == (int)maxGroundPts);
+				tmpObstacle = LaserScan::backwardCompatibility(occupancyIter->second.first.second);
+				tmpEmpty = LaserScan::backwardCompatibility(occupancyIter->second.second);
+				maxGroundPts = occupancyIter->second.first.first.cols;
+				maxObstaclePts = occupancyIter->second.first.second.cols;
+				maxEmptyPts = occupancyIter->second.second.cols;
+				UASSERT(tmpGround.size() == maxGroundPts);
+				UASSERT(tmpObstacle.size() == maxObstaclePts);
+				UASSERT(tmpEmpty.size() == maxEmptyPts);
 			}
-			for (unsigned int i=0; i<maxGroundPts; ++i)
+			else
 			{
-				pcl::PointXYZRGB pt;
-				if(occupancyIter != cache_.end())
-				{
-					pt = util3d::laserScanToPointRGB(tmpGround, i);
-					pt = pcl::transformPoint(pt, t);
-				}
-				else
-				{
-					pt = pcl::transformPoint(cloudIter->second.first->at(i), t);
-				}
-				octomap::point3d point(pt.x, pt.y, pt.z);
-				bool ignoreOccupiedCell = false;
-				if(rangeMaxSqrd > 0.0f)
+				maxGroundPts = (int)cloudIter->second.first->size();
+				maxObstaclePts = (int)cloudIter->second.second->size();
+			}
+			const int totalPts = maxGroundPts + maxObstaclePts + maxEmptyPts;
+			// cached cells are read directly from their data
+			pcl::PointXYZRGB white;
+			white.r = white.g = white.b = 255;
+			const util3d::LaserScanPointView<pcl::PointXYZRGB> groundPoints(tmpGround, white);
+			const util3d::LaserScanPointView<pcl::PointXYZRGB> obstaclePoints(tmpObstacle, white);
+			const util3d::LaserScanPointView<pcl::PointXYZ> emptyPoints(tmpEmpty);
+			UDEBUG("%d: compute cells (from %d ground, %d obstacle and %d empty points)", iter->first, maxGroundPts, maxObstaclePts, maxEmptyPts);
+
+			// Compute occupied and free keys of all points in parallel, the tree
+			// is only read here. Ground points are occupied and clear space,
+			// obstacle points are occupied and clear space, empty points are free.
+			std::vector<OccupiedPoint> occupiedPoints;
+			octomap::KeySet free_cells;
+			#pragma omp parallel
+			{
+				std::vector<OccupiedPoint> localOccupied;
+				octomap::KeySet localFree;
+				octomap::KeyRay keyRay;
+				octomap::point3d localMin, localMax;
+				bool localMinMaxSet = false;
+				bool localHasColor = false;
+
+				#pragma omp for schedule(dynamic, 256)
+				for(int i=0; i<totalPts; ++i)
 				{
-					octomap::point3d v(pt.x - cellSize - sensorOrigin.x(), pt.y - cellSize - sensorOrigin.y(), pt.z - cellSize - sensorOrigin.z());
-					if(v.norm_sq() > rangeMaxSqrd)
+					pcl::PointXYZRGB pt;
+					bool emptyPoint = false;
+					if(i < maxGroundPts)
 					{
-						// compute new point to max range
-						v.normalize();
-						v*=rangeMax_;
-						point = sensorOrigin + v;
-						ignoreOccupiedCell=true;
+						if(occupancyIter != cache_.end())
+						{
+							pt = pcl::transformPoint(groundPoints.at(i), t);
+						}
+						else
+						{
+							pt = pcl::transformPoint(cloudIter->second.first->at(i), t);
+						}
+					}
+					else if(i < maxGroundPts + maxObstaclePts)
+					{
+						if(occupancyIter != cache_.end())
+						{
+							pt = pcl::transformPoint(obstaclePoints.at(i-maxGroundPts), t);
+						}
+						else
+						{
+							pt = pcl::transformPoint(cloudIter->second.second->at(i-maxGroundPts), t);
+						}
+					}
+					else
+					{
+						pcl::PointXYZ ptEmpty = pcl::transformPoint(emptyPoints.at(i-maxGroundPts-maxObstaclePts), t);
+						pt.x = ptEmpty.x;
+						pt.y = ptEmpty.y;
+						pt.z = ptEmpty.z;
+						emptyPoint = true;
 					}
-				}
 
-				if(!ignoreOccupiedCell)
-				{
-					// occupied endpoint
+					octomap::point3d point(pt.x, pt.y, pt.z);
 					octomap::OcTreeKey key;
-					if (octree_->coordToKeyChecked(point, key))
+					if(emptyPoint)
 					{
-						if(iter->first >0 && iter->first<lastId)
+						if(rangeMaxSqrd > 0.0f)
 						{
-							RtabmapColorOcTreeNode * n = octree_->search(key);
-							if(n && n->getNodeRefId() > 0 && n->getNodeRefId() > iter->first)
+							octomap::point3d v(pt.x - sensorOrigin.x(), pt.y - sensorOrigin.y(), pt.z - sensorOrigin.z());
+							if(v.norm_sq() > rangeMaxSqrd)
 							{
-								// The cell has been updated from more recent node, don't update the cell
 								continue;
 							}
 						}
-
-						updateMinMax(point);
-						RtabmapColorOcTreeNode * n = octree_->updateNode(key, true);
-
-						if(n)
+						if(octree_->coordToKeyChecked(point, key))
 						{
-							if(!hasColor_ && !(pt.r ==0 && pt.g == 0 && pt.b == 0) && !(pt.r ==255 && pt.g == 255 && pt.b == 255))
-							{
-								hasColor_ = true;
-							}
-							octree_->averageNodeColor(key, pt.r, pt.g, pt.b);
 							if(iter->first > 0)
 							{
-								n->setNodeRefId(iter->first);
-								n->setPointRef(point);
+								RtabmapColorOcTreeNode * n = octree_->search(key);
+								if(n && n->getNodeRefId() > 0 && n->getNodeRefId() >= iter->first)
+								{
+									// The cell has been updated from current node or more recent node, don't update the cell
+									continue;
+								}
 							}
-							n->setOccupancyType(RtabmapColorOcTreeNode::kTypeGround);
+							localFree.insert(key);
+							localMin = localMinMaxSet?octomap::point3d(std::min(localMin.x(), point.x()), std::min(localMin.y(), point.y()), std::min(localMin.z(), point.z())):point;
+							localMax = localMinMaxSet?octomap::point3d(std::max(localMax.x(), point.x()), std::max(localMax.y(), point.y()), std::max(localMax.z(), point.z())):point;
+							localMinMaxSet = true;
 						}
+						continue;
 					}
-				}
 
-				// only clear space (ground points)
-				if (computeRays &&
-					(iter->first < 0 || iter->first>lastId) &&
-					octree_->computeRayKeys(sensorOrigin, point, keyRay_))
-				{
-					free_cells.insert(keyRay_.begin(), keyRay_.end());
-				}
-			}
-			UDEBUG("%d: ground cells=%d free cells=%d", iter->first, (int)maxGroundPts, (int)free_cells.size());
-
-			// all other points: free on ray, occupied on endpoint:
-			unsigned int maxObstaclePts = occupancyIter != cache_.end()?occupancyIter->second.first.second.cols:cloudIter->second.second->size();
-			UDEBUG("%d: compute occupied cells (from %d obstacle points)", iter->first, (int)maxObstaclePts);
-			LaserScan tmpObstacle;
-			if(occupancyIter != cache_.end())
-			{
-				tmpObstacle = LaserScan::backwardCompatibility(occupancyIter->second.first.second);
-				UASSERT(tmpObstacle.size() == (int)maxObstaclePts);
-			}
-			for (unsigned int i=0; i<maxObstaclePts; ++i)
-			{
-				pcl::PointXYZRGB pt;
-				if(occupancyIter != cache_.end())
-				{
-					pt = util3d::laserScanToPointRGB(tmpObstacle, i);
-					pt = pcl::transformPoint(pt, t);
-				}
-				else
-				{
-					pt = pcl::transformPoint(cloudIter->second.second->at(i), t);
-				}
-
-				octomap::point3d point(pt.x, pt.y, pt.z);
-
-				bool ignoreOccupiedCell = false;
-				if(rangeMaxSqrd > 0.0f)
-				{
-					octomap::point3d v(pt.x - cellSize - sensorOrigin.x(), pt.y - cellSize - sensorOrigin.y(), pt.z - cellSize - sensorOrigin.z());
-					if(v.norm_sq() > rangeMaxSqrd)
+					bool ignoreOccupiedCell = false;
+					if(rangeMaxSqrd > 0.0f)
 					{
-						// compute new point to max range
-						v.normalize();
-						v*=rangeMax_;
-						point = sensorOrigin + v;
-						ignoreOccupiedCell=true;
+						octomap::point3d v(pt.x - cellSize - sensorOrigin.x(), pt.y - cellSize - sensorOrigin.y(), pt.z - cellSize - sensorOrigin.z());
+						if(v.norm_sq() > rangeMaxSqrd)
+						{
+							// compute new point to max range
+							v.normalize();
+							v*=rangeMax_;
+							point = sensorOrigin + v;
+							ignoreOccupiedCell=true;
+						}
 					}
-				}
 
-				if(!ignoreOccupiedCell)
-				{
-					// occupied endpoint
-					octomap::OcTreeKey key;
-					if (octree_->coordToKeyChecked(point, key))
+					if(!ignoreOccupiedCell)
 					{
-						if(iter->first >0 && iter->first<lastId)
+						// occupied endpoint
+						if (octree_->coordToKeyChecked(point, key))
 						{
-							RtabmapColorOcTreeNode * n = octree_->search(key);
-							if(n && n->getNodeRefId() > 0 && n->getNodeRefId() > iter->first)
+							if(checkRecentNodes)
 							{
-								// The cell has been updated from more recent node, don't update the cell
-								continue;
+								RtabmapColorOcTreeNode * n = octree_->search(key);
+								if(n && n->getNodeRefId() > 0 && n->getNodeRefId() > iter->first)
+								{
+									// The cell has been updated from more recent node, don't update the cell
+									continue;
+								}
 							}
-						}
-
-						updateMinMax(point);
 
-						RtabmapColorOcTreeNode * n = octree_->updateNode(key, true);
-						if(n)
-						{
-							if(!hasColor_ && !(pt.r ==0 && pt.g == 0 && pt.b == 0) && !(pt.r ==255 && pt.g == 255 && pt.b == 255))
-							{
-								hasColor_ = true;
-							}
-							octree_->averageNodeColor(key, pt.r, pt.g, pt.b);
-							if(iter->first > 0)
+							OccupiedPoint occupied;
+							occupied.key = key;
+							occupied.point = point;
+							occupied.r = pt.r;
+							occupied.g = pt.g;
+							occupied.b = pt.b;
+							occupied.obstacle = i >= maxGroundPts;
+							occupied.index = i;
+							localOccupied.push_back(occupied);
+
+							if(!localHasColor && !(pt.r ==0 && pt.g == 0 && pt.b == 0) && !(pt.r ==255 && pt.g == 255 && pt.b == 255))
 							{
-								n->setNodeRefId(iter->first);
-								n->setPointRef(point);
+								localHasColor = true;
 							}
-							n->setOccupancyType(RtabmapColorOcTreeNode::kTypeObstacle);
+							localMin = localMinMaxSet?octomap::point3d(std::min(localMin.x(), point.x()), std::min(localMin.y(), point.y()), std::min(localMin.z(), point.z())):point;
+							localMax = localMinMaxSet?octomap::point3d(std::max(localMax.x(), point.x()), std::max(localMax.y(), point.y()), std::max(localMax.z(), point.z())):point;
+							localMinMaxSet = true;
 						}
 					}
+
+					// free cells
+					if (computeRays && octree_->computeRayKeys(sensorOrigin, point, keyRay))
+					{
+						localFree.insert(keyRay.begin(), keyRay.end());
+					}
 				}
 
-				// free cells
-				if (computeRays &&
-					(iter->first < 0 || iter->first>lastId) &&
-					octree_->computeRayKeys(sensorOrigin, point, keyRay_))
+				#pragma omp critical
 				{
-					free_cells.insert(keyRay_.begin(), keyRay_.end());
+					occupiedPoints.insert(occupiedPoints.end(), localOccupied.begin(), localOccupied.end());
+					free_cells.insert(localFree.begin(), localFree.end());
+					if(localMinMaxSet)
+					{
+						updateMinMax(localMin);
+						updateMinMax(localMax);
+					}
+					hasColor_ = hasColor_ || localHasColor;
 				}
 			}
-			UDEBUG("%d: occupied cells=%d free cells=%d", iter->first, (int)maxObstaclePts, (int)free_cells.size());
 
+			// Deduplicate occupied keys: each cell is updated once, with the
+			// mean color of its points and the last point as reference.
+			std::sort(occupiedPoints.begin(), occupiedPoints.end());
+			octomap::KeySet occupied_cells;
+			for(size_t i=0; i<occupiedPoints.size();)
+			{
+				size_t j = i;
+				int r=0, g=0, b=0;
+				bool obstacle = false;
+				for(; j<occupiedPoints.size() && occupiedPoints[j].key == occupiedPoints[i].key; ++j)
+				{
+					r += occupiedPoints[j].r;
+					g += occupiedPoints[j].g;
+					b += occupiedPoints[j].b;
+					obstacle = obstacle || occupiedPoints[j].obstacle;
+				}
+				const OccupiedPoint & last = occupiedPoints[j-1];
+				int count = int(j-i);
+				i = j;
+
+				occupied_cells.insert(last.key);
+				RtabmapColorOcTreeNode * n = octree_->updateNode(last.key, true);
+				if(n)
+				{
+					octree_->averageNodeColor(last.key, r/count, g/count, b/count);
+					if(iter->first > 0)
+					{
+						n->setNodeRefId(iter->first);
+						n->setPointRef(last.point);
+					}
+					n->setOccupancyType(obstacle?RtabmapColorOcTreeNode::kTypeObstacle:RtabmapColorOcTreeNode::kTypeGround);
+				}
+			}
+			UDEBUG("%d: occupied cells=%d free cells=%d", iter->first, (int)occupied_cells.size(), (int)free_cells.size());
 
 			// mark free cells only if not seen occupied in this cloud
 			for(octomap::KeySet::iterator it = free_cells.begin(), end=free_cells.end(); it!= end; ++it)
 			{
+				if(occupied_cells.find(*it) != occupied_cells.end())
+				{
+					continue;
+				}
 				if(iter->first > 0)
 				{
 					RtabmapColorOcTreeNode * n = octree_->search(*it);
@@ -759,63 +860,6 @@ void OctoMap::update(const std::map<int, Transform> & poses)
 				}
 			}
 
-			// all empty cells
-			if(occupancyIter != cache_.end() && occupancyIter->second.second.cols)
-			{
-				unsigned int maxEmptyPts = occupancyIter->second.second.cols;
-				UDEBUG("%d: compute free cells (from %d empty points)", iter->first, (int)maxEmptyPts);
-				LaserScan tmpEmpty = LaserScan::backwardCompatibility(occupancyIter->second.second);
-				UASSERT(tmpEmpty.size() == (int)maxEmptyPts);
-				for (unsigned int i=0; i<maxEmptyPts; ++i)
-				{
-					pcl::PointXYZ pt;
-					pt = util3d::laserScanToPoint(tmpEmpty, i);
-					pt = pcl::transformPoint(pt, t);
-
-					octomap::point3d point(pt.x, pt.y, pt.z);
-
-					bool ignoreCell = false;
-					if(rangeMaxSqrd > 0.0f)
-					{
-						octomap::point3d v(pt.x - sensorOrigin.x(), pt.y - sensorOrigin.y(), pt.z - sensorOrigin.z());
-						if(v.norm_sq() > rangeMaxSqrd)
-						{
-							ignoreCell=true;
-						}
-					}
-
-					if(!ignoreCell)
-					{
-						octomap::OcTreeKey key;
-						if (octree_->coordToKeyChecked(point, key))
-						{
-
-							if(iter->first >0)
-							{
-								RtabmapColorOcTreeNode * n = octree_->search(key);
-								if(n && n->getNodeRefId() > 0 && n->getNodeRefId() >= iter->first)
-								{
-									// The cell has been updated from current node or more recent node, don't update the cell
-									continue;
-								}
-							}
-
-							updateMinMax(point);
-
-							RtabmapColorOcTreeNode * n = octree_->updateNode(key, false);
-							if(n && n->getOccupancyType() == RtabmapColorOcTreeNode::kTypeUnknown)
-							{
-								n->setOccupancyType(RtabmapColorOcTreeNode::kTypeEmpty);
-								if(iter->first > 0)
-								{
-									n->setNodeRefId(iter->first);
-								}
-							}
-						}
-					}
-				}
-			}
-
 			// compress map
 			//octree_->prune();
 
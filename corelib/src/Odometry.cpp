@@ -362,8 +362,8 @@ Transform Odometry::process(SensorData & data, const Transform & guessIn, Odomet
 	{
 		// Decimation of images with calibrations
 		SensorData decimatedData = data;
-		decimatedData.setImageRaw(util2d::decimate(decimatedData.imageRaw(), _imageDecimation));
-		decimatedData.setDepthOrRightRaw(util2d::decimate(decimatedData.depthOrRightRaw(), _imageDecimation));
+		decimatedData.setImageRaw(decimatedData.imageRawDecimated(_imageDecimation));
+		decimatedData.setDepthOrRightRaw(decimatedData.depthOrRightRawDecimated(_imageDecimation));
 		std::vector<CameraModel> cameraModels = decimatedData.cameraModels();
 		for(unsigned int i=0; i<cameraModels.size(); ++i)
 		{
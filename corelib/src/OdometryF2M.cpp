@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/VisualWord.h"
 #include "rtabmap/core/Signature.h"
 #include "rtabmap/core/RegistrationVis.h"
+#include "rtabmap/core/RegistrationIcp.h"
 #include "rtabmap/core/util3d_transforms.h"
 #include "rtabmap/core/util3d_registration.h"
 #include "rtabmap/core/util3d_correspondences.h"
@@ -39,6 +40,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/VWDictionary.h"
 #include "rtabmap/core/util3d.h"
 #include "rtabmap/core/Graph.h"
+#include "rtabmap/core/VoxelHashMap.h"
 #include "rtflann/flann.hpp"
 #include "rtabmap/utilite/ULogger.h"
 #include "rtabmap/utilite/UTimer.h"
@@ -66,11 +68,15 @@ OdometryF2M::OdometryF2M(const ParametersMap & parameters) :
 	scanMaximumMapSize_(Parameters::defaultOdomF2MScanMaxSize()),
 	scanSubtractRadius_(Parameters::defaultOdomF2MScanSubtractRadius()),
 	scanSubtractAngle_(Parameters::defaultOdomF2MScanSubtractAngle()),
+	scanMapVoxelSize_(Parameters::defaultOdomF2MScanMapVoxelSize()),
+	scanMapRange_(Parameters::defaultOdomF2MScanMapRange()),
 	bundleAdjustment_(Parameters::defaultOdomF2MBundleAdjustment()),
 	bundleMaxFrames_(Parameters::defaultOdomF2MBundleAdjustmentMaxFrames()),
 	map_(new Signature(-1)),
+	mapDictionary_(0),
 	lastFrame_(new Signature(1)),
 	lastFrameOldestNewId_(0),
+	scanVoxelMap_(0),
 	bundleSeq_(0),
 	sba_(0)
 {
@@ -86,6 +92,8 @@ OdometryF2M::OdometryF2M(const ParametersMap & parameters) :
 	{
 		scanSubtractAngle_ *= M_PI/180.0f;
 	}
+	Parameters::parse(parameters, Parameters::kOdomF2MScanMapVoxelSize(), scanMapVoxelSize_);
+	Parameters::parse(parameters, Parameters::kOdomF2MScanMapRange(), scanMapRange_);
 	Parameters::parse(parameters, Parameters::kOdomF2MBundleAdjustment(), bundleAdjustment_);
 	Parameters::parse(parameters, Parameters::kOdomF2MBundleAdjustmentMaxFrames(), bundleMaxFrames_);
 	UASSERT(bundleMaxFrames_ >= 0);
@@ -111,6 +119,13 @@ OdometryF2M::OdometryF2M(const ParametersMap & parameters) :
 	UASSERT(visKeyFrameThr_>=0);
 	UASSERT(scanKeyFrameThr_ >= 0.0f && scanKeyFrameThr_<=1.0f);
 	UASSERT(maxNewFeatures_ >= 0);
+	UASSERT(scanMapVoxelSize_ >= 0.0f);
+	UASSERT(scanMapRange_ >= 0.0f);
+	if(scanMapVoxelSize_ > 0.0f)
+	{
+		UASSERT(scanMaximumMapSize_ > 0);
+		scanVoxelMap_ = new VoxelHashMap(scanMapVoxelSize_, scanMaximumMapSize_);
+	}
 
 	int corType = Parameters::defaultVisCorType();
 	Parameters::parse(parameters, Parameters::kVisCorType(), corType);
@@ -124,6 +139,28 @@ OdometryF2M::OdometryF2M(const ParametersMap & parameters) :
 	uInsert(bundleParameters, ParametersPair(Parameters::kVisCorType(), uNumber2Str(corType)));
 
 	regPipeline_ = Registration::create(bundleParameters);
+	RegistrationVis * regVis = dynamic_cast<RegistrationVis*>(regPipeline_);
+	if(regVis)
+	{
+		// The local map words are indexed once and updated on key frames,
+		// instead of being indexed on each registration.
+		mapDictionary_ = regVis->createDictionary();
+		regVis->setFromDictionary(mapDictionary_);
+	}
+	if(scanVoxelMap_)
+	{
+		// The correspondences with the local scan map are searched in its
+		// voxels, instead of building a kd-tree on each new local map.
+		RegistrationIcp * regIcp = dynamic_cast<RegistrationIcp*>(regPipeline_);
+		if(!regIcp)
+		{
+			regIcp = dynamic_cast<RegistrationIcp*>(regPipeline_->childRegistration());
+		}
+		if(regIcp)
+		{
+			regIcp->setFromVoxelMap(scanVoxelMap_);
+		}
+	}
 	if(bundleAdjustment_>0 && regPipeline_->isScanRequired())
 	{
 		UWARN("%s=%d cannot be used with registration not done only with images (%s=%s), disabling bundle adjustment.",
@@ -140,6 +177,7 @@ OdometryF2M::OdometryF2M(const ParametersMap & parameters) :
 OdometryF2M::~OdometryF2M()
 {
 	delete map_;
+	delete mapDictionary_;
 	delete lastFrame_;
 	scansBuffer_.clear();
 	bundleWordReferences_.clear();
@@ -149,6 +187,7 @@ OdometryF2M::~OdometryF2M()
 	bundlePoseReferences_.clear();
 	delete sba_;
 	delete regPipeline_;
+	delete scanVoxelMap_;
 	UDEBUG("");
 }
 
@@ -158,7 +197,15 @@ void OdometryF2M::reset(const Transform & initialPose)
 	Odometry::reset(initialPose);
 	*lastFrame_ = Signature(1);
 	*map_ = Signature(-1);
+	if(mapDictionary_)
+	{
+		mapDictionary_->clear(false);
+	}
 	scansBuffer_.clear();
+	if(scanVoxelMap_)
+	{
+		scanVoxelMap_->clear();
+	}
 	bundleWordReferences_.clear();
 	bundlePoses_.clear();
 	bundleLinks_.clear();
@@ -168,6 +215,60 @@ void OdometryF2M::reset(const Transform & initialPose)
 	lastFrameOldestNewId_ = 0;
 }
 
+// Add/remove the words of the dictionary so that it contains the words of
+// the map (IDs are sorted in both). Words are never modified in the
+// map, so the words with the same ID are not updated.
+static void updateMapDictionary(const Signature & map, VWDictionary & dictionary)
+{
+	UTimer timer;
+	const std::vector<int> & ids = map.getWordIds();
+	const cv::Mat & descriptors = map.getWordDescriptorsMat();
+	if(descriptors.rows != (int)ids.size())
+	{
+		// words without descriptors, the dictionary cannot be used
+		dictionary.clear(false);
+		return;
+	}
+
+	std::vector<VisualWord*> removedWords;
+	int added = 0;
+	std::map<int, VisualWord*>::const_iterator iter = dictionary.getVisualWords().begin();
+	std::map<int, VisualWord*>::const_iterator end = dictionary.getVisualWords().end();
+	for(unsigned int i=0; i<ids.size(); ++i)
+	{
+		if(i>0 && ids[i] == ids[i-1])
+		{
+			continue; // duplicated IDs, the dictionary is not used in that case
+		}
+		for(; iter!=end && iter->first < ids[i]; ++iter)
+		{
+			removedWords.push_back(iter->second);
+		}
+		if(iter!=end && iter->first == ids[i])
+		{
+			++iter;
+		}
+		else
+		{
+			// the map descriptors can be moved or edited in place, copy it
+			dictionary.addWord(new VisualWord(ids[i], descriptors.row(i).clone(), 1));
+			++added;
+		}
+	}
+	for(; iter!=end; ++iter)
+	{
+		removedWords.push_back(iter->second);
+	}
+	dictionary.removeWords(removedWords);
+	for(unsigned int i=0; i<removedWords.size(); ++i)
+	{
+		delete removedWords[i];
+	}
+	dictionary.update();
+	UDEBUG("Local map dictionary updated (added=%d removed=%d size=%d) time=%fs",
+			added, (int)removedWords.size(), (int)dictionary.getVisualWords().size(), timer.ticks());
+}
+
 // return not null transform if odometry is correctly computed
 Transform OdometryF2M::computeTransform(
 		SensorData & data,
@@ -201,6 +302,7 @@ Transform OdometryF2M::computeTransform(
 	int totalBundleWordReferencesUsed = 0;
 	int totalBundleOutliers = 0;
 	float bundleTime = 0.0f;
+	float bundleSolverTime = 0.0f;
 
 	// Generate keypoints from the new data
 	if(lastFrame_->sensorData().isValid())
@@ -208,10 +310,33 @@ Transform OdometryF2M::computeTransform(
 		if((map_->getWords3().size() || !map_->sensorData().laserScanRaw().isEmpty()) &&
 			lastFrame_->sensorData().isValid())
 		{
-			Signature tmpMap;
 			Transform transform;
 			UDEBUG("guess=%s frames=%d image required=%d", guess.prettyPrint().c_str(), this->framesProcessed(), regPipeline_->isImageRequired()?1:0);
 
+			// The local map is registered in place (no copy) when visual registration
+			// would give back the same words, i.e., with unique IDs and valid 3D points.
+			// The local scan map is restored after each registration, as ICP may filter it.
+			bool inPlace = map_->getWords().size() == map_->getWords3().size() &&
+						   map_->getWords3().size() == map_->getWordsDescriptors().size();
+			int previousWordId = 0;
+			for(std::multimap<int, cv::Point3f>::const_iterator iter=map_->getWords3().begin(); inPlace && iter!=map_->getWords3().end(); ++iter)
+			{
+				if(!util3d::isFinite(iter->second) ||
+				   (iter!=map_->getWords3().begin() && iter->first == previousWordId))
+				{
+					inPlace = false;
+				}
+				previousWordId = iter->first;
+			}
+			UDEBUG("Register local map in place=%d", inPlace?1:0);
+			Signature tmpMap;
+			Signature * regMap = inPlace?map_:&tmpMap;
+			const LaserScan mapScanBackup = map_->sensorData().laserScanRaw();
+			LaserScan regScan;
+			int mapWordsSize = (int)map_->getWords().size();
+			int mapFirstWordId = mapWordsSize?map_->getWords().begin()->first:0;
+			int mapLastWordId = mapWordsSize?map_->getWords().rbegin()->first:0;
+
 			// bundle adjustment stuff if used
 			std::map<int, cv::Point3f> points3DMap;
 			std::map<int, Transform> bundlePoses;
@@ -223,7 +348,10 @@ Transform OdometryF2M::computeTransform(
 					guessIteration<(!guess.isNull()&&regPipeline_->isImageRequired()?2:1) && transform.isNull();
 					++guessIteration)
 			{
-				tmpMap = *map_;
+				if(!inPlace)
+				{
+					tmpMap = *map_;
+				}
 				// reset matches, but keep already extracted features in lastFrame_->sensorData()
 				lastFrame_->setWords(std::multimap<int, cv::KeyPoint>());
 				lastFrame_->setWords3(std::multimap<int, cv::Point3f>());
@@ -259,12 +387,20 @@ Transform OdometryF2M::computeTransform(
 				}
 
 				transform = regPipeline_->computeTransformationMod(
-						tmpMap,
+						*regMap,
 						*lastFrame_,
 						// special case for ICP-only odom, set guess to identity if we just started or reset
 						guessIteration==0 && !guess.isNull()?this->getPose()*guess:!regPipeline_->isImageRequired()&&this->framesProcessed()<2?this->getPose():Transform(),
 						&regInfo);
 
+				regScan = regMap->sensorData().laserScanRaw();
+				if(inPlace)
+				{
+					map_->sensorData().setLaserScanRaw(mapScanBackup);
+					// registration sets the features of the "from" signature, clear them to avoid growing the map
+					map_->sensorData().setFeatures(std::vector<cv::KeyPoint>(), std::vector<cv::Point3f>(), cv::Mat());
+				}
+
 				if(maxCorrespondenceDistance>0.0f)
 				{
 					// set it back
@@ -288,10 +424,10 @@ Transform OdometryF2M::computeTransform(
 						UDEBUG("Local Bundle Adjustment");
 
 						// make sure the IDs of words in the map are not modified (Optical Flow Registration issue)
-						UASSERT(map_->getWords().size() && tmpMap.getWords().size());
-						if(map_->getWords().size() != tmpMap.getWords().size() ||
-						   map_->getWords().begin()->first != tmpMap.getWords().begin()->first ||
-						   map_->getWords().rbegin()->first != tmpMap.getWords().rbegin()->first)
+						UASSERT(mapWordsSize && regMap->getWords().size());
+						if(mapWordsSize != (int)regMap->getWords().size() ||
+						   mapFirstWordId != regMap->getWords().begin()->first ||
+						   mapLastWordId != regMap->getWords().rbegin()->first)
 						{
 							UERROR("Bundle Adjustment cannot be used with a registration approach recomputing features from the \"from\" signature (e.g., Optical Flow).");
 							bundleAdjustment_ = 0;
@@ -344,8 +480,8 @@ Transform OdometryF2M::computeTransform(
 								int wordId =regInfo.inliersIDs[i];
 
 								// 3D point
-								std::multimap<int, cv::Point3f>::const_iterator iter3D = tmpMap.getWords3().find(wordId);
-								UASSERT(iter3D!=tmpMap.getWords3().end());
+								std::multimap<int, cv::Point3f>::const_iterator iter3D = regMap->getWords3().find(wordId);
+								UASSERT(iter3D!=regMap->getWords3().end());
 								points3DMap.insert(*iter3D);
 
 								std::multimap<int, cv::KeyPoint>::const_iterator iter2D = lastFrame_->getWords().find(wordId);
@@ -400,10 +536,11 @@ Transform OdometryF2M::computeTransform(
 							UTimer bundleTimer;
 							bundlePoses = sba_->optimizeBA(-lastFrame_->id(), bundlePoses, bundleLinks, bundleModels, points3DMap, wordReferences, &sbaOutliers);
 							bundleTime = bundleTimer.ticks();
+							bundleSolverTime = sba_->lastSolverTime();
 							UDEBUG("sba...end");
 							totalBundleOutliers = (int)sbaOutliers.size();
 
-							UDEBUG("bundleTime=%fs (poses=%d wordRef=%d outliers=%d)", bundleTime, (int)bundlePoses.size(), (int)bundleWordReferences_.size(), (int)sbaOutliers.size());
+							UDEBUG("bundleTime=%fs (solver=%fs poses=%d wordRef=%d outliers=%d)", bundleTime, bundleSolverTime, (int)bundlePoses.size(), (int)bundleWordReferences_.size(), (int)sbaOutliers.size());
 							if(info)
 							{
 								info->localBundlePoses = bundlePoses;
@@ -479,6 +616,18 @@ Transform OdometryF2M::computeTransform(
 				}
 			}
 
+			if(info)
+			{
+				// use the registered map before it is updated to make sure that correspondences with the new frame matches
+				info->localMapSize = (int)regMap->getWords3().size();
+				info->localScanMapSize = regScan.size();
+				if(this->isInfoDataFilled())
+				{
+					info->localMap = uMultimapToMap(regMap->getWords3());
+					info->localScanMap = regScan;
+				}
+			}
+
 			if(!transform.isNull())
 			{
 				output = transform;
@@ -486,11 +635,12 @@ Transform OdometryF2M::computeTransform(
 				bool modified = false;
 				Transform newFramePose = this->getPose()*output;
 
-				// fields to update
-				LaserScan mapScan = tmpMap.sensorData().laserScanRaw();
-				std::multimap<int, cv::KeyPoint> mapWords = tmpMap.getWords();
-				std::multimap<int, cv::Point3f> mapPoints = tmpMap.getWords3();
-				std::multimap<int, cv::Mat> mapDescriptors = tmpMap.getWordsDescriptors();
+				// fields to update, words are moved out of the registered map and updated in place
+				LaserScan mapScan = regScan;
+				std::multimap<int, cv::KeyPoint> mapWords;
+				std::multimap<int, cv::Point3f> mapPoints;
+				std::multimap<int, cv::Mat> mapDescriptors;
+				regMap->swapWords(mapWords, mapPoints, mapDescriptors);
 
 				bool addVisualKeyFrame = regPipeline_->isImageRequired() &&
 						 (keyFrameThr_ == 0.0f ||
@@ -534,6 +684,7 @@ Transform OdometryF2M::computeTransform(
 							UASSERT(mapPoints.count(iter->first) == 1);
 							//UDEBUG("Updated %d (%f,%f,%f) -> (%f,%f,%f)", iter->first, mapPoints.find(origin)->second.x, mapPoints.find(origin)->second.y, mapPoints.find(origin)->second.z, iter->second.x, iter->second.y, iter->second.z);
 							mapPoints.find(iter->first)->second = iter->second;
+							modified = true;
 						}
 					}
 
@@ -763,9 +914,40 @@ Transform OdometryF2M::computeTransform(
 					UDEBUG("scankeyframeThr=%f icpInliersRatio=%f", scanKeyFrameThr_, regInfo.icpInliersRatio);
 					UINFO("Update local scan map %d (ratio=%f < %f)", lastFrame_->id(), regInfo.icpInliersRatio, scanKeyFrameThr_);
 
-					if(lastFrame_->sensorData().laserScanRaw().size())
+					if(lastFrame_->sensorData().laserScanRaw().size() && scanVoxelMap_)
+					{
+						// Voxel map: far and old voxels are removed to make room for the new
+						// scan, then its points are inserted in the empty voxels.
+						pcl::PointCloud<pcl::PointNormal>::Ptr frameCloudNormals = util3d::laserScanToPointCloudNormal(lastFrame_->sensorData().laserScanRaw(), newFramePose * lastFrame_->sensorData().laserScanRaw().localTransform());
+						int removed = scanVoxelMap_->evict(
+								Eigen::Vector3f(newFramePose.x(), newFramePose.y(), newFramePose.z()),
+								scanMapRange_,
+								*frameCloudNormals);
+						int added = scanVoxelMap_->insert(*frameCloudNormals);
+						UDEBUG("voxelMap=%d added=%d removed=%d maxVoxels=%d",
+								scanVoxelMap_->size(),
+								added,
+								removed,
+								scanVoxelMap_->capacity());
+						if(added || removed)
+						{
+							pcl::PointCloud<pcl::PointNormal>::Ptr mapCloudNormals = scanVoxelMap_->getCloud();
+							if(mapScan.is2d())
+							{
+								Transform mapViewpoint(-newFramePose.x(), -newFramePose.y(),0,0,0,0);
+								mapScan = LaserScan(util3d::laserScan2dFromPointCloud(*mapCloudNormals, mapViewpoint), 0, 0.0f, LaserScan::kXYNormal);
+							}
+							else
+							{
+								Transform mapViewpoint(-newFramePose.x(), -newFramePose.y(), -newFramePose.z(),0,0,0);
+								mapScan = LaserScan(util3d::laserScanFromPointCloud(*mapCloudNormals, mapViewpoint), 0, 0.0f, LaserScan::kXYZNormal);
+							}
+							modified=true;
+						}
+					}
+					else if(lastFrame_->sensorData().laserScanRaw().size())
 					{
-						pcl::PointCloud<pcl::PointNormal>::Ptr mapCloudNormals = util3d::laserScanToPointCloudNormal(mapScan, tmpMap.sensorData().laserScanRaw().localTransform());
+						pcl::PointCloud<pcl::PointNormal>::Ptr mapCloudNormals = util3d::laserScanToPointCloudNormal(mapScan, regScan.localTransform());
 						pcl::PointCloud<pcl::PointNormal>::Ptr frameCloudNormals = util3d::laserScanToPointCloudNormal(lastFrame_->sensorData().laserScanRaw(), newFramePose * lastFrame_->sensorData().laserScanRaw().localTransform());
 
 						pcl::IndicesPtr frameCloudNormalsIndices(new std::vector<int>);
@@ -870,10 +1052,17 @@ Transform OdometryF2M::computeTransform(
 					UDEBUG("Update local scan map = %fs", tmpTimer.ticks());
 				}
 
-				if(modified)
+				if(modified || inPlace)
 				{
-					*map_ = tmpMap;
+					map_->swapWords(mapWords, mapPoints, mapDescriptors);
+				}
+				if(modified && mapDictionary_)
+				{
+					updateMapDictionary(*map_, *mapDictionary_);
+				}
 
+				if(modified)
+				{
 					if(mapScan.is2d())
 					{
 
@@ -895,22 +1084,6 @@ Transform OdometryF2M::computeTransform(
 										mapScan.format(),
 										newFramePose.translation()));
 					}
-
-					map_->setWords(mapWords);
-					map_->setWords3(mapPoints);
-				 	map_->setWordsDescriptors(mapDescriptors);
-				}
-			}
-
-			if(info)
-			{
-				// use tmpMap instead of map_ to make sure that correspondences with the new frame matches
-				info->localMapSize = (int)tmpMap.getWords3().size();
-				info->localScanMapSize = tmpMap.sensorData().laserScanRaw().size();
-				if(this->isInfoDataFilled())
-				{
-					info->localMap = uMultimapToMap(tmpMap.getWords3());
-					info->localScanMap = tmpMap.sensorData().laserScanRaw();
 				}
 			}
 		}
@@ -1029,6 +1202,10 @@ Transform OdometryF2M::computeTransform(
 					map_->setWords(words);
 					map_->setWords3(transformedPoints);
 					map_->setWordsDescriptors(descriptors);
+					if(mapDictionary_)
+					{
+						updateMapDictionary(*map_, *mapDictionary_);
+					}
 					addKeyFrame = true;
 				}
 				else
@@ -1042,7 +1219,16 @@ Transform OdometryF2M::computeTransform(
 				{
 					frameValid = true;
 					pcl::PointCloud<pcl::PointNormal>::Ptr mapCloudNormals = util3d::laserScanToPointCloudNormal(lastFrame_->sensorData().laserScanRaw(), newFramePose * lastFrame_->sensorData().laserScanRaw().localTransform());
-					scansBuffer_.push_back(std::make_pair(mapCloudNormals, pcl::IndicesPtr(new std::vector<int>)));
+					if(scanVoxelMap_)
+					{
+						scanVoxelMap_->clear();
+						scanVoxelMap_->insert(*mapCloudNormals);
+						mapCloudNormals = scanVoxelMap_->getCloud();
+					}
+					else
+					{
+						scansBuffer_.push_back(std::make_pair(mapCloudNormals, pcl::IndicesPtr(new std::vector<int>)));
+					}
 					if(lastFrame_->sensorData().laserScanRaw().is2d())
 					{
 						Transform mapViewpoint(-newFramePose.x(), -newFramePose.y(),0,0,0,0);
@@ -1112,6 +1298,7 @@ Transform OdometryF2M::computeTransform(
 		info->localBundleOutliers = totalBundleOutliers;
 		info->localBundleConstraints = totalBundleWordReferencesUsed;
 		info->localBundleTime = bundleTime;
+		info->localBundleSolverTime = bundleSolverTime;
 
 		if(this->isInfoDataFilled())
 		{
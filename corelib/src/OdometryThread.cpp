@@ -120,6 +120,8 @@ void OdometryThread::mainLoop()
 		{
 			UDEBUG("Odom pose = %s", pose.prettyPrint().c_str());
 			// a null pose notify that odometry could not be computed
+			// pyramids stay with odometry, they are not needed by the receivers of the event
+			data.clearImagePyramids();
 			this->post(new OdometryEvent(data, pose, info));
 		}
 	}
@@ -238,7 +238,8 @@ Optimizer::Optimizer(int iterations, bool slam2d, bool covarianceIgnored, double
 		covarianceIgnored_(covarianceIgnored),
 		epsilon_(epsilon),
 		robust_(robust),
-		priorsIgnored_(priorsIgnored)
+		priorsIgnored_(priorsIgnored),
+		lastSolverTime_(0.0)
 {
 }
 
@@ -248,7 +249,8 @@ Optimizer::Optimizer(const ParametersMap & parameters) :
 		covarianceIgnored_(Parameters::defaultOptimizerVarianceIgnored()),
 		epsilon_(Parameters::defaultOptimizerEpsilon()),
 		robust_(Parameters::defaultOptimizerRobust()),
-		priorsIgnored_(Parameters::defaultOptimizerPriorsIgnored())
+		priorsIgnored_(Parameters::defaultOptimizerPriorsIgnored()),
+		lastSolverTime_(0.0)
 {
 	parseParameters(parameters);
 }
@@ -359,6 +361,23 @@ std::map<int, Transform> Optimizer::optimize(
 	return std::map<int, Transform>();
 }
 
+std::map<int, Transform> Optimizer::optimizeSession(
+		int rootId,
+		const std::map<int, Transform> & poses,
+		const std::multimap<int, Link> & constraints,
+		cv::Mat & outputCovariance,
+		double * finalError,
+		int * iterationsDone)
+{
+	return optimize(rootId,
+			poses,
+			constraints,
+			outputCovariance,
+			0,
+			finalError,
+			iterationsDone);
+}
+
 std::map<int, Transform> Optimizer::optimizeBA(
 		int rootId,
 		const std::map<int, Transform> & poses,
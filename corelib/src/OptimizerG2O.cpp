@@ -75,7 +75,46 @@ enum {
 #include "g2o/solvers/linear_solver_eigen.h"
 #endif
 
-typedef g2o::BlockSolver< g2o::BlockSolverTraits<-1, -1> > SlamBlockSolver;
+/**
+ * Block solver measuring the time spent in solve(), i.e., solving the linear
+ * system of each iteration. g2o batch statistics are not used because they
+ * are global to the process, and graph optimization and odometry bundle
+ * adjustment can run at the same time.
+ */
+template <typename Traits>
+class TimedBlockSolver : public g2o::BlockSolver<Traits>
+{
+public:
+#if defined(RTABMAP_G2O_CPP11) and not defined(RTABMAP_ORB_SLAM2)
+	TimedBlockSolver(std::unique_ptr<typename g2o::BlockSolver<Traits>::LinearSolverType> linearSolver) :
+		g2o::BlockSolver<Traits>(std::move(linearSolver)),
+		time_(0.0)
+	{}
+#else
+	TimedBlockSolver(typename g2o::BlockSolver<Traits>::LinearSolverType * linearSolver) :
+		g2o::BlockSolver<Traits>(linearSolver),
+		time_(0.0)
+	{}
+#endif
+	virtual ~TimedBlockSolver() {}
+
+	virtual bool solve()
+	{
+		UTimer timer;
+		bool solved = g2o::BlockSolver<Traits>::solve();
+		time_ += timer.ticks();
+		return solved;
+	}
+
+	// Time (s) accumulated since the creation of the solver
+	double time() const {return time_;}
+
+private:
+	double time_;
+};
+
+typedef TimedBlockSolver< g2o::BlockSolverTraits<-1, -1> > SlamBlockSolver;
+typedef TimedBlockSolver< g2o::BlockSolverTraits<6, 3> > BABlockSolver;
 typedef g2o::LinearSolverEigen<SlamBlockSolver::PoseMatrixType> SlamLinearEigenSolver;
 #ifdef RTABMAP_G2O
 typedef g2o::LinearSolverPCG<SlamBlockSolver::PoseMatrixType> SlamLinearPCGSolver;
@@ -86,6 +125,218 @@ typedef g2o::LinearSolverCSparse<SlamBlockSolver::PoseMatrixType> SlamLinearCSpa
 typedef g2o::LinearSolverCholmod<SlamBlockSolver::PoseMatrixType> SlamLinearCholmodSolver;
 #endif
 
+/**
+ * Preconditioned conjugate gradient solver with a block-Jacobi
+ * preconditioner (like g2o::LinearSolverPCG), but the sparse
+ * matrix-vector products and the preconditioner are computed
+ * in parallel over the block rows with OpenMP. Only the upper
+ * triangular part of the matrix is expected, as filled by
+ * g2o::BlockSolver.
+ */
+template <typename MatrixType>
+class LinearSolverPCGOMP : public g2o::LinearSolver<MatrixType>
+{
+public:
+	LinearSolverPCGOMP() :
+		A_(0),
+		tolerance_(1e-6)
+	{}
+	virtual ~LinearSolverPCGOMP() {}
+
+	virtual bool init() {return true;}
+
+	virtual bool solve(const g2o::SparseBlockMatrix<MatrixType> & A, double * x, double * b)
+	{
+		setup(A);
+		return pcg(b, x);
+	}
+
+	// Covariance blocks are computed column by column from the
+	// solution of A*x=e_k, used for the marginals of the last pose.
+	virtual bool solvePattern(
+			g2o::SparseBlockMatrix<g2o::MatrixXD> & spinv,
+			const std::vector<std::pair<int, int> > & blockIndices,
+			const g2o::SparseBlockMatrix<MatrixType> & A)
+	{
+		setup(A);
+		spinv = g2o::SparseBlockMatrix<g2o::MatrixXD>(
+				&A.rowBlockIndices()[0],
+				&A.rowBlockIndices()[0],
+				A.rowBlockIndices().size(),
+				A.rowBlockIndices().size(),
+				true);
+
+		std::map<int, std::vector<int> > rowsPerCol;
+		for(unsigned int i=0; i<blockIndices.size(); ++i)
+		{
+			rowsPerCol[blockIndices[i].second].push_back(blockIndices[i].first);
+		}
+
+		Eigen::VectorXd e = Eigen::VectorXd::Zero(A.cols());
+		Eigen::VectorXd y(A.cols());
+		for(std::map<int, std::vector<int> >::iterator iter=rowsPerCol.begin(); iter!=rowsPerCol.end(); ++iter)
+		{
+			int c = iter->first;
+			for(int k=0; k<A.colsOfBlock(c); ++k)
+			{
+				e[A.colBaseOfBlock(c)+k] = 1.0;
+				bool ok = pcg(e.data(), y.data());
+				e[A.colBaseOfBlock(c)+k] = 0.0;
+				if(!ok)
+				{
+					return false;
+				}
+				for(unsigned int j=0; j<iter->second.size(); ++j)
+				{
+					int r = iter->second[j];
+					spinv.block(r, c, true)->col(k) = y.segment(A.rowBaseOfBlock(r), A.rowsOfBlock(r));
+				}
+			}
+		}
+		return true;
+	}
+
+private:
+	struct BlockRef
+	{
+		BlockRef(int col, const MatrixType * block, bool transposed) :
+			col(col), block(block), transposed(transposed) {}
+		int col;
+		const MatrixType * block;
+		bool transposed;
+	};
+
+	void setup(const g2o::SparseBlockMatrix<MatrixType> & A)
+	{
+		A_ = &A;
+		int n = (int)A.blockCols().size();
+		rows_.clear();
+		rows_.resize(n);
+		diagInverse_.resize(n);
+		std::vector<const MatrixType *> diag(n, (const MatrixType *)0);
+		for(int j=0; j<n; ++j)
+		{
+			for(typename g2o::SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator iter=A.blockCols()[j].begin();
+				iter!=A.blockCols()[j].end();
+				++iter)
+			{
+				int i = iter->first;
+				UASSERT_MSG(i <= j, "Only the upper triangular part of the matrix should be set");
+				rows_[i].push_back(BlockRef(j, iter->second, false));
+				if(i == j)
+				{
+					diag[j] = iter->second;
+				}
+				else
+				{
+					rows_[j].push_back(BlockRef(i, iter->second, true));
+				}
+			}
+		}
+
+		#pragma omp parallel for
+		for(int i=0; i<n; ++i)
+		{
+			if(diag[i])
+			{
+				diagInverse_[i] = diag[i]->inverse();
+			}
+			else
+			{
+				diagInverse_[i].setIdentity(A.rowsOfBlock(i), A.colsOfBlock(i));
+			}
+		}
+	}
+
+	// y = A*x
+	void multiply(const double * x, double * y) const
+	{
+		const g2o::SparseBlockMatrix<MatrixType> & A = *A_;
+		int n = (int)rows_.size();
+		#pragma omp parallel for schedule(dynamic, 64)
+		for(int i=0; i<n; ++i)
+		{
+			Eigen::Map<Eigen::VectorXd> yi(y + A.rowBaseOfBlock(i), A.rowsOfBlock(i));
+			yi.setZero();
+			for(unsigned int k=0; k<rows_[i].size(); ++k)
+			{
+				const BlockRef & ref = rows_[i][k];
+				Eigen::Map<const Eigen::VectorXd> xj(x + A.colBaseOfBlock(ref.col), A.colsOfBlock(ref.col));
+				if(ref.transposed)
+				{
+					yi.noalias() += ref.block->transpose() * xj;
+				}
+				else
+				{
+					yi.noalias() += (*ref.block) * xj;
+				}
+			}
+		}
+	}
+
+	// z = M^-1*r
+	void precondition(const double * r, double * z) const
+	{
+		const g2o::SparseBlockMatrix<MatrixType> & A = *A_;
+		int n = (int)diagInverse_.size();
+		#pragma omp parallel for
+		for(int i=0; i<n; ++i)
+		{
+			Eigen::Map<const Eigen::VectorXd> ri(r + A.rowBaseOfBlock(i), A.rowsOfBlock(i));
+			Eigen::Map<Eigen::VectorXd> zi(z + A.rowBaseOfBlock(i), A.rowsOfBlock(i));
+			zi.noalias() = diagInverse_[i] * ri;
+		}
+	}
+
+	bool pcg(const double * b, double * x) const
+	{
+		int n = A_->rows();
+		Eigen::Map<const Eigen::VectorXd> bv(b, n);
+		Eigen::Map<Eigen::VectorXd> xv(x, n);
+		Eigen::VectorXd r = bv;
+		Eigen::VectorXd z(n);
+		Eigen::VectorXd q(n);
+		xv.setZero();
+		precondition(r.data(), z.data());
+		Eigen::VectorXd p = z;
+		double rz = r.dot(z);
+		double threshold = tolerance_ * rz;
+		int it = 0;
+		while(it < n && rz > threshold)
+		{
+			multiply(p.data(), q.data());
+			double pq = p.dot(q);
+			if(pq <= 0.0)
+			{
+				UWARN("Matrix is not positive definite (p'Ap=%g) after %d iterations!", pq, it);
+				return false;
+			}
+			double alpha = rz / pq;
+			xv += alpha * p;
+			r -= alpha * q;
+			precondition(r.data(), z.data());
+			double rzNew = r.dot(z);
+			p = z + (rzNew/rz) * p;
+			rz = rzNew;
+			++it;
+		}
+		if(rz > threshold)
+		{
+			UWARN("PCG did not converge after %d iterations (size=%d, residual=%g, threshold=%g)!", it, n, rz, threshold);
+			return false;
+		}
+		UDEBUG("PCG: %d iterations (size=%d, residual=%g, threshold=%g)", it, n, rz, threshold);
+		return true;
+	}
+
+private:
+	const g2o::SparseBlockMatrix<MatrixType> * A_;
+	double tolerance_;
+	std::vector<std::vector<BlockRef> > rows_;
+	std::vector<MatrixType, Eigen::aligned_allocator<MatrixType> > diagInverse_;
+};
+typedef LinearSolverPCGOMP<SlamBlockSolver::PoseMatrixType> SlamLinearPCGOMPSolver;
+
 #if defined(RTABMAP_VERTIGO)
 #include "vertigo/g2o/edge_switchPrior.h"
 #include "vertigo/g2o/edge_se2Switchable.h"
@@ -173,6 +424,7 @@ std::map<int, Transform> OptimizerG2O::optimize(
 		int * iterationsDone)
 {
 	outputCovariance = cv::Mat::eye(6,6,CV_64FC1);
+	setLastSolverTime(0.0);
 	std::map<int, Transform> optimizedPoses;
 #ifdef RTABMAP_G2O
 	UDEBUG("Optimizing graph...");
@@ -226,12 +478,19 @@ std::map<int, Transform> OptimizerG2O::optimize(
 			blockSolver = g2o::make_unique<SlamBlockSolver>(std::move(linearSolver));
 		}
 #endif
+		else if(solver_ == 4)
+		{
+			//pcg multi-threaded
+			auto linearSolver = g2o::make_unique<SlamLinearPCGOMPSolver>();
+			blockSolver = g2o::make_unique<SlamBlockSolver>(std::move(linearSolver));
+		}
 		else
 		{
 			//pcg
 			auto linearSolver = g2o::make_unique<SlamLinearPCGSolver>();
 			blockSolver = g2o::make_unique<SlamBlockSolver>(std::move(linearSolver));
 		}
+		const SlamBlockSolver * timedSolver = blockSolver.get();
 
 		if(optimizer_ == 1)
 		{
@@ -272,12 +531,19 @@ std::map<int, Transform> OptimizerG2O::optimize(
 			blockSolver = new SlamBlockSolver(linearSolver);
 		}
 #endif
+		else if(solver_ == 4)
+		{
+			//pcg multi-threaded
+			SlamLinearPCGOMPSolver * linearSolver = new SlamLinearPCGOMPSolver();
+			blockSolver = new SlamBlockSolver(linearSolver);
+		}
 		else
 		{
 			//pcg
 			SlamLinearPCGSolver * linearSolver = new SlamLinearPCGSolver();
 			blockSolver = new SlamBlockSolver(linearSolver);
 		}
+		const SlamBlockSolver * timedSolver = blockSolver;
 
 		if(optimizer_ == 1)
 		{
@@ -598,6 +864,7 @@ std::map<int, Transform> OptimizerG2O::optimize(
 				}
 
 				it += optimizer.optimize(1);
+				setLastSolverTime(timedSolver->time());
 
 				// early stop condition
 				optimizer.computeActiveErrors();
@@ -634,6 +901,7 @@ std::map<int, Transform> OptimizerG2O::optimize(
 		else
 		{
 			it = optimizer.optimize(iterations());
+			setLastSolverTime(timedSolver->time());
 			optimizer.computeActiveErrors();
 			UDEBUG("%d nodes, %d edges, chi2: %f", (int)optimizer.vertices().size(), (int)optimizer.edges().size(), optimizer.activeRobustChi2());
 		}
@@ -645,7 +913,7 @@ std::map<int, Transform> OptimizerG2O::optimize(
 		{
 			*iterationsDone = it;
 		}
-		UINFO("g2o optimizing end (%d iterations done, error=%f, time = %f s)", it, optimizer.activeRobustChi2(), timer.ticks());
+		UINFO("g2o optimizing end (%d iterations done, error=%f, time = %f s, solver = %f s)", it, optimizer.activeRobustChi2(), timer.ticks(), lastSolverTime());
 
 		if(optimizer.activeRobustChi2() > 1000000000000.0)
 		{
@@ -857,6 +1125,7 @@ std::map<int, Transform> OptimizerG2O::optimizeBA(
 		const std::map<int, std::map<int, cv::Point3f> > & wordReferences,
 		std::set<int> * outliers)
 {
+	setLastSolverTime(0.0);
 	std::map<int, Transform> optimizedPoses;
 #if defined(RTABMAP_G2O) || defined(RTABMAP_ORB_SLAM2)
 	UDEBUG("Optimizing graph...");
@@ -906,6 +1175,15 @@ std::map<int, Transform> OptimizerG2O::optimizeBA(
 #endif
 		}
 #endif
+		else if(solver_ == 4)
+		{
+			//pcg multi-threaded
+#ifdef RTABMAP_G2O_CPP11
+			linearSolver = g2o::make_unique<LinearSolverPCGOMP<g2o::BlockSolver_6_3::PoseMatrixType> >();
+#else
+			linearSolver = new LinearSolverPCGOMP<g2o::BlockSolver_6_3::PoseMatrixType>();
+#endif
+		}
 		else
 		{
 			//pcg
@@ -917,24 +1195,30 @@ std::map<int, Transform> OptimizerG2O::optimizeBA(
 		}
 #endif // RTABMAP_ORB_SLAM2
 
+#if defined(RTABMAP_G2O_CPP11) and not defined(RTABMAP_ORB_SLAM2)
+		std::unique_ptr<BABlockSolver> blockSolver = g2o::make_unique<BABlockSolver>(std::move(linearSolver));
+		const BABlockSolver * timedSolver = blockSolver.get();
+#else
+		BABlockSolver * blockSolver = new BABlockSolver(linearSolver);
+		const BABlockSolver * timedSolver = blockSolver;
+#endif
+
 #ifndef RTABMAP_ORB_SLAM2
 		if(optimizer_ == 1)
 		{
 #ifdef RTABMAP_G2O_CPP11
-			optimizer.setAlgorithm(new g2o::OptimizationAlgorithmGaussNewton(
-					g2o::make_unique<g2o::BlockSolver_6_3>(std::move(linearSolver))));
+			optimizer.setAlgorithm(new g2o::OptimizationAlgorithmGaussNewton(std::move(blockSolver)));
 #else
-			optimizer.setAlgorithm(new g2o::OptimizationAlgorithmGaussNewton(new g2o::BlockSolver_6_3(linearSolver)));
+			optimizer.setAlgorithm(new g2o::OptimizationAlgorithmGaussNewton(blockSolver));
 #endif
 		}
 		else
 #endif
 		{
 #if defined(RTABMAP_G2O_CPP11) and not defined(RTABMAP_ORB_SLAM2)
-			optimizer.setAlgorithm(new g2o::OptimizationAlgorithmLevenberg(
-					g2o::make_unique<g2o::BlockSolver_6_3>(std::move(linearSolver))));
+			optimizer.setAlgorithm(new g2o::OptimizationAlgorithmLevenberg(std::move(blockSolver)));
 #else
-			optimizer.setAlgorithm(new g2o::OptimizationAlgorithmLevenberg(new g2o::BlockSolver_6_3(linearSolver)));
+			optimizer.setAlgorithm(new g2o::OptimizationAlgorithmLevenberg(blockSolver));
 #endif
 		}
 
@@ -1192,6 +1476,7 @@ std::map<int, Transform> OptimizerG2O::optimizeBA(
 		for(int i=0; i<(robustKernelDelta_>0.0?2:1); ++i)
 		{
 			it += optimizer.optimize(i==0&&robustKernelDelta_>0.0?5:iterations());
+			setLastSolverTime(timedSolver->time());
 
 			// early stop condition
 			optimizer.computeActiveErrors();
@@ -1261,6 +1546,7 @@ std::map<int, Transform> OptimizerG2O::optimizeBA(
 			}
 		}
 		UINFO("g2o optimizing end (%d iterations done, error=%f, outliers=%d/%d (delta=%f) time = %f s)", it, optimizer.activeRobustChi2(), outliersCount, (int)edges.size(), robustKernelDelta_, timer.ticks());
+		UDEBUG("g2o linear solver time = %f s", lastSolverTime());
 
 		if(optimizer.activeRobustChi2() > 1000000000000.0)
 		{
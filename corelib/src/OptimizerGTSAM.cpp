@@ -47,6 +47,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <gtsam/nonlinear/DoglegOptimizer.h>
 #include <gtsam/nonlinear/LevenbergMarquardtOptimizer.h>
 #include <gtsam/nonlinear/NonlinearOptimizer.h>
+#include <gtsam/nonlinear/ISAM2.h>
 #include <gtsam/nonlinear/Marginals.h>
 #include <gtsam/nonlinear/Values.h>
 
@@ -69,12 +70,105 @@ bool OptimizerGTSAM::available()
 #endif
 }
 
+OptimizerGTSAM::~OptimizerGTSAM()
+{
+	resetSession();
+}
+
 void OptimizerGTSAM::parseParameters(const ParametersMap & parameters)
 {
 	Optimizer::parseParameters(parameters);
 	Parameters::parse(parameters, Parameters::kGTSAMOptimizer(), optimizer_);
+	Parameters::parse(parameters, Parameters::kGTSAMIncremental(), incremental_);
+
+	// the factors of the session may not match the new parameters
+	resetSession();
+}
+
+void OptimizerGTSAM::resetSession()
+{
+#ifdef RTABMAP_GTSAM
+	delete isam2_;
+#endif
+	isam2_ = 0;
+	isam2Nodes_.clear();
+	isam2RemovedNodes_.clear();
+	isam2Links_.clear();
+	isam2RootId_ = 0;
+	isam2RootFactor_ = 0;
+}
+
+#ifdef RTABMAP_GTSAM
+static gtsam::SharedNoiseModel createNoiseModel(const Link & link, bool slam2d, bool covarianceIgnored)
+{
+	if(slam2d)
+	{
+		Eigen::Matrix<double, 3, 3> information = Eigen::Matrix<double, 3, 3>::Identity();
+		if(!covarianceIgnored)
+		{
+			information(0,0) = link.infMatrix().at<double>(0,0); // x-x
+			information(0,1) = link.infMatrix().at<double>(0,1); // x-y
+			information(0,2) = link.infMatrix().at<double>(0,5); // x-theta
+			information(1,0) = link.infMatrix().at<double>(1,0); // y-x
+			information(1,1) = link.infMatrix().at<double>(1,1); // y-y
+			information(1,2) = link.infMatrix().at<double>(1,5); // y-theta
+			information(2,0) = link.infMatrix().at<double>(5,0); // theta-x
+			information(2,1) = link.infMatrix().at<double>(5,1); // theta-y
+			information(2,2) = link.infMatrix().at<double>(5,5); // theta-theta
+		}
+		return gtsam::noiseModel::Gaussian::Information(information);
+	}
+
+	Eigen::Matrix<double, 6, 6> information = Eigen::Matrix<double, 6, 6>::Identity();
+	if(!covarianceIgnored)
+	{
+		memcpy(information.data(), link.infMatrix().data, link.infMatrix().total()*sizeof(double));
+	}
+
+	Eigen::Matrix<double, 6, 6> mgtsam = Eigen::Matrix<double, 6, 6>::Identity();
+	mgtsam.block(0,0,3,3) = information.block(3,3,3,3); // cov rotation
+	mgtsam.block(3,3,3,3) = information.block(0,0,3,3); // cov translation
+	mgtsam.block(0,3,3,3) = information.block(0,3,3,3); // off diagonal
+	mgtsam.block(3,0,3,3) = information.block(3,0,3,3); // off diagonal
+	return gtsam::noiseModel::Gaussian::Information(mgtsam);
+}
+
+static void addLinkFactor(gtsam::NonlinearFactorGraph & graph, const Link & link, bool slam2d, bool covarianceIgnored)
+{
+	gtsam::SharedNoiseModel model = createNoiseModel(link, slam2d, covarianceIgnored);
+	const Transform & t = link.transform();
+	if(link.from() == link.to())
+	{
+		if(slam2d)
+		{
+			graph.add(gtsam::PriorFactor<gtsam::Pose2>(link.from(), gtsam::Pose2(t.x(), t.y(), t.theta()), model));
+		}
+		else
+		{
+			graph.add(gtsam::PriorFactor<gtsam::Pose3>(link.from(), gtsam::Pose3(t.toEigen4d()), model));
+		}
+	}
+	else if(slam2d)
+	{
+		graph.add(gtsam::BetweenFactor<gtsam::Pose2>(link.from(), link.to(), gtsam::Pose2(t.x(), t.y(), t.theta()), model));
+	}
+	else
+	{
+		graph.add(gtsam::BetweenFactor<gtsam::Pose3>(link.from(), link.to(), gtsam::Pose3(t.toEigen4d()), model));
+	}
 }
 
+static bool isSameLink(const Link & a, const Link & b)
+{
+	return a.from() == b.from() &&
+		   a.to() == b.to() &&
+		   a.type() == b.type() &&
+		   a.transform() == b.transform() &&
+		   a.infMatrix().total() == b.infMatrix().total() &&
+		   memcmp(a.infMatrix().data, b.infMatrix().data, a.infMatrix().total()*a.infMatrix().elemSize()) == 0;
+}
+#endif
+
 std::map<int, Transform> OptimizerGTSAM::optimize(
 		int rootId,
 		const std::map<int, Transform> & poses,
@@ -451,4 +545,332 @@ std::map<int, Transform> OptimizerGTSAM::optimize(
 	return optimizedPoses;
 }
 
+std::map<int, Transform> OptimizerGTSAM::optimizeSession(
+		int rootId,
+		const std::map<int, Transform> & poses,
+		const std::multimap<int, Link> & edgeConstraints,
+		cv::Mat & outputCovariance,
+		double * finalError,
+		int * iterationsDone)
+{
+	if(!incremental_ || isRobust())
+	{
+		// switch variables of robust optimization are not handled in the session
+		return Optimizer::optimizeSession(rootId, poses, edgeConstraints, outputCovariance, finalError, iterationsDone);
+	}
+
+	outputCovariance = cv::Mat::eye(6,6,CV_64FC1);
+	std::map<int, Transform> optimizedPoses;
+#ifdef RTABMAP_GTSAM
+	if(edgeConstraints.size()>=1 && poses.size()>=2 && iterations() > 0)
+	{
+		UTimer timer;
+
+		// Same factors as optimize(): if there is a global pose prior set, remove rootId
+		std::multimap<int, Link> links; // <from, link>
+		for(std::multimap<int, Link>::const_iterator iter=edgeConstraints.begin(); iter!=edgeConstraints.end(); ++iter)
+		{
+			UASSERT(!iter->second.transform().isNull());
+			if(iter->second.from() == iter->second.to())
+			{
+				if(priorsIgnored())
+				{
+					continue;
+				}
+				rootId = 0;
+			}
+			links.insert(std::make_pair(iter->second.from(), iter->second));
+		}
+		UASSERT(rootId == 0 || uContains(poses, rootId));
+
+		// Variables cannot be removed from iSAM2. The factors of the nodes not in
+		// the graph anymore (e.g., transferred to long-term memory) are removed
+		// like the links to them, and the nodes are anchored by a prior on their
+		// current estimate so that they don't constrain the remaining graph, as
+		// if they were removed. A new session is started if one of them comes
+		// back in the graph, or if they outnumber the nodes of the graph.
+		std::vector<int> removedNodes;
+		if(isam2_)
+		{
+			for(std::set<int>::iterator iter=isam2RemovedNodes_.begin(); iter!=isam2RemovedNodes_.end(); ++iter)
+			{
+				if(poses.find(*iter) != poses.end())
+				{
+					UINFO("Node %d is back in the graph, starting a new iSAM2 session.", *iter);
+					resetSession();
+					break;
+				}
+			}
+		}
+		if(isam2_)
+		{
+			for(std::set<int>::iterator iter=isam2Nodes_.begin(); iter!=isam2Nodes_.end(); ++iter)
+			{
+				if(poses.find(*iter) == poses.end())
+				{
+					removedNodes.push_back(*iter);
+				}
+			}
+			if(isam2RemovedNodes_.size() + removedNodes.size() > poses.size())
+			{
+				UINFO("More nodes removed (%d) than in the graph (%d), starting a new iSAM2 session.",
+						(int)(isam2RemovedNodes_.size() + removedNodes.size()), (int)poses.size());
+				resetSession();
+				removedNodes.clear();
+			}
+		}
+		bool newSession = isam2_ == 0;
+		if(newSession)
+		{
+			gtsam::ISAM2Params parameters;
+			parameters.evaluateNonlinearError = true;
+			isam2_ = new gtsam::ISAM2(parameters);
+		}
+
+		// Links removed or changed since the last call
+		gtsam::FastVector<size_t> removedFactors;
+		std::multimap<int, Link> addedLinks = links;
+		for(std::multimap<int, std::pair<Link, size_t> >::iterator iter=isam2Links_.begin(); iter!=isam2Links_.end();)
+		{
+			std::multimap<int, Link>::iterator jter = addedLinks.find(iter->first);
+			for(; jter!=addedLinks.end() && jter->first == iter->first; ++jter)
+			{
+				if(isSameLink(iter->second.first, jter->second))
+				{
+					break;
+				}
+			}
+			if(jter!=addedLinks.end() && jter->first == iter->first)
+			{
+				// already in the session
+				addedLinks.erase(jter);
+				++iter;
+			}
+			else
+			{
+				removedFactors.push_back(iter->second.second);
+				isam2Links_.erase(iter++);
+			}
+		}
+
+		gtsam::NonlinearFactorGraph newFactors;
+		std::vector<const Link *> newFactorsLinks; // null for the root prior
+		if(rootId != isam2RootId_)
+		{
+			if(isam2RootId_ != 0)
+			{
+				removedFactors.push_back(isam2RootFactor_);
+			}
+			if(rootId != 0)
+			{
+				const Transform & initialPose = poses.at(rootId);
+				if(isSlam2d())
+				{
+					gtsam::noiseModel::Diagonal::shared_ptr priorNoise = gtsam::noiseModel::Diagonal::Variances(gtsam::Vector3(0.01, 0.01, 0.01));
+					newFactors.add(gtsam::PriorFactor<gtsam::Pose2>(rootId, gtsam::Pose2(initialPose.x(), initialPose.y(), initialPose.theta()), priorNoise));
+				}
+				else
+				{
+					gtsam::noiseModel::Diagonal::shared_ptr priorNoise = gtsam::noiseModel::Diagonal::Variances((gtsam::Vector(6) << 1e-6, 1e-6, 1e-6, 1e-4, 1e-4, 1e-4).finished());
+					newFactors.add(gtsam::PriorFactor<gtsam::Pose3>(rootId, gtsam::Pose3(initialPose.toEigen4d()), priorNoise));
+				}
+				newFactorsLinks.push_back(0);
+			}
+		}
+		for(std::multimap<int, Link>::iterator iter=addedLinks.begin(); iter!=addedLinks.end(); ++iter)
+		{
+			addLinkFactor(newFactors, iter->second, isSlam2d(), isCovarianceIgnored());
+			newFactorsLinks.push_back(&iter->second);
+		}
+		// anchors of the removed nodes, added after the links
+		for(unsigned int i=0; i<removedNodes.size(); ++i)
+		{
+			if(isSlam2d())
+			{
+				gtsam::noiseModel::Diagonal::shared_ptr priorNoise = gtsam::noiseModel::Diagonal::Variances(gtsam::Vector3(0.01, 0.01, 0.01));
+				newFactors.add(gtsam::PriorFactor<gtsam::Pose2>(removedNodes[i], isam2_->calculateEstimate<gtsam::Pose2>(removedNodes[i]), priorNoise));
+			}
+			else
+			{
+				gtsam::noiseModel::Diagonal::shared_ptr priorNoise = gtsam::noiseModel::Diagonal::Variances((gtsam::Vector(6) << 1e-6, 1e-6, 1e-6, 1e-4, 1e-4, 1e-4).finished());
+				newFactors.add(gtsam::PriorFactor<gtsam::Pose3>(removedNodes[i], isam2_->calculateEstimate<gtsam::Pose3>(removedNodes[i]), priorNoise));
+			}
+		}
+
+		// New nodes start from the current solution of a node linked to them,
+		// so that they are in the same frame as the optimized graph
+		std::map<int, Transform> newPoses;
+		for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
+		{
+			UASSERT(!iter->second.isNull());
+			if(isam2Nodes_.find(iter->first) != isam2Nodes_.end())
+			{
+				continue;
+			}
+			Transform pose = iter->second;
+			for(std::multimap<int, Link>::iterator jter=addedLinks.begin(); !newSession && jter!=addedLinks.end(); ++jter)
+			{
+				const Link & link = jter->second;
+				if(link.from() != link.to() && (link.from() == iter->first || link.to() == iter->first))
+				{
+					int otherId = link.from() == iter->first?link.to():link.from();
+					Transform otherPose;
+					if(isam2Nodes_.find(otherId) != isam2Nodes_.end())
+					{
+						if(isSlam2d())
+						{
+							gtsam::Pose2 p = isam2_->calculateEstimate<gtsam::Pose2>(otherId);
+							otherPose = Transform(p.x(), p.y(), p.theta());
+						}
+						else
+						{
+							otherPose = Transform::fromEigen4d(isam2_->calculateEstimate<gtsam::Pose3>(otherId).matrix());
+						}
+					}
+					else if(newPoses.find(otherId) != newPoses.end())
+					{
+						otherPose = newPoses.at(otherId);
+					}
+					if(!otherPose.isNull())
+					{
+						pose = link.from() == iter->first?otherPose * link.transform().inverse():otherPose * link.transform();
+						break;
+					}
+				}
+			}
+			newPoses.insert(std::make_pair(iter->first, pose));
+		}
+		gtsam::Values newValues;
+		for(std::map<int, Transform>::iterator iter = newPoses.begin(); iter!=newPoses.end(); ++iter)
+		{
+			if(isSlam2d())
+			{
+				newValues.insert(iter->first, gtsam::Pose2(iter->second.x(), iter->second.y(), iter->second.theta()));
+			}
+			else
+			{
+				newValues.insert(iter->first, gtsam::Pose3(iter->second.toEigen4d()));
+			}
+		}
+
+		UINFO("GTSAM iSAM2 update begin (new session=%d, new nodes=%d, removed nodes=%d, new factors=%d, removed factors=%d)",
+				newSession?1:0, (int)newValues.size(), (int)removedNodes.size(), (int)newFactors.size(), (int)removedFactors.size());
+		try
+		{
+			gtsam::ISAM2Result result = isam2_->update(newFactors, newValues, removedFactors);
+			UASSERT(result.newFactorsIndices.size() == newFactorsLinks.size() + removedNodes.size());
+			for(unsigned int i=0; i<newFactorsLinks.size(); ++i)
+			{
+				if(newFactorsLinks[i] == 0)
+				{
+					isam2RootFactor_ = result.newFactorsIndices[i];
+				}
+				else
+				{
+					isam2Links_.insert(std::make_pair(newFactorsLinks[i]->from(), std::make_pair(*newFactorsLinks[i], (size_t)result.newFactorsIndices[i])));
+				}
+			}
+			for(unsigned int i=0; i<removedNodes.size(); ++i)
+			{
+				isam2Nodes_.erase(removedNodes[i]);
+				isam2RemovedNodes_.insert(removedNodes[i]);
+			}
+			isam2RootId_ = rootId;
+			for(std::map<int, Transform>::iterator iter = newPoses.begin(); iter!=newPoses.end(); ++iter)
+			{
+				isam2Nodes_.insert(iter->first);
+			}
+
+			// Relinearize until the error doesn't improve anymore
+			int it = 1;
+			double lastError = *result.errorAfter;
+			while(it < iterations())
+			{
+				result = isam2_->update();
+				++it;
+				double errorDelta = lastError - *result.errorAfter;
+				lastError = *result.errorAfter;
+				UDEBUG("update %d error=%f", it, lastError);
+				if(errorDelta >= 0.0 && errorDelta < this->epsilon())
+				{
+					break;
+				}
+			}
+			if(finalError)
+			{
+				*finalError = lastError;
+			}
+			if(iterationsDone)
+			{
+				*iterationsDone = it;
+			}
+
+			gtsam::Values values = isam2_->calculateEstimate();
+			for(gtsam::Values::const_iterator iter=values.begin(); iter!=values.end(); ++iter)
+			{
+				if(isam2RemovedNodes_.find((int)iter->key) != isam2RemovedNodes_.end())
+				{
+					continue;
+				}
+				if(isSlam2d())
+				{
+					gtsam::Pose2 p = iter->value.cast<gtsam::Pose2>();
+					optimizedPoses.insert(std::make_pair((int)iter->key, Transform(p.x(), p.y(), p.theta())));
+				}
+				else
+				{
+					gtsam::Pose3 p = iter->value.cast<gtsam::Pose3>();
+					optimizedPoses.insert(std::make_pair((int)iter->key, Transform::fromEigen4d(p.matrix())));
+				}
+			}
+
+			gtsam::Matrix info = isam2_->marginalCovariance(*isam2Nodes_.rbegin());
+			if(isSlam2d())
+			{
+				UASSERT(info.cols() == 3 && info.cols() == 3);
+				outputCovariance.at<double>(0,0) = info(0,0); // x-x
+				outputCovariance.at<double>(0,1) = info(0,1); // x-y
+				outputCovariance.at<double>(0,5) = info(0,2); // x-theta
+				outputCovariance.at<double>(1,0) = info(1,0); // y-x
+				outputCovariance.at<double>(1,1) = info(1,1); // y-y
+				outputCovariance.at<double>(1,5) = info(1,2); // y-theta
+				outputCovariance.at<double>(5,0) = info(2,0); // theta-x
+				outputCovariance.at<double>(5,1) = info(2,1); // theta-y
+				outputCovariance.at<double>(5,5) = info(2,2); // theta-theta
+			}
+			else
+			{
+				UASSERT(info.cols() == 6 && info.cols() == 6);
+				Eigen::Matrix<double, 6, 6> mgtsam = Eigen::Matrix<double, 6, 6>::Identity();
+				mgtsam.block(3,3,3,3) = info.block(0,0,3,3); // cov rotation
+				mgtsam.block(0,0,3,3) = info.block(3,3,3,3); // cov translation
+				mgtsam.block(0,3,3,3) = info.block(0,3,3,3); // off diagonal
+				mgtsam.block(3,0,3,3) = info.block(3,0,3,3); // off diagonal
+				memcpy(outputCovariance.data, mgtsam.data(), outputCovariance.total()*sizeof(double));
+			}
+			UINFO("GTSAM iSAM2 update end (%d updates done, error=%f, nodes=%d, factors=%d, time=%f s)",
+					it, lastError, (int)isam2Nodes_.size(), (int)isam2Links_.size(), timer.ticks());
+		}
+		catch(std::exception & e)
+		{
+			UERROR("GTSAM exception caught: %s", e.what());
+			resetSession();
+			optimizedPoses.clear();
+			outputCovariance = cv::Mat::eye(6,6,CV_64FC1);
+		}
+	}
+	else if(poses.size() == 1 || iterations() <= 0)
+	{
+		optimizedPoses = poses;
+	}
+	else
+	{
+		UWARN("This method should be called at least with 1 pose!");
+	}
+#else
+	UERROR("Not built with GTSAM support!");
+#endif
+	return optimizedPoses;
+}
+
 } /* namespace rtabmap */
@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/util3d.h>
 #include <rtabmap/core/util3d_transforms.h>
 #include <rtabmap/core/util3d_filtering.h>
+#include <rtabmap/core/VoxelHashMap.h>
 #include <rtabmap/utilite/ULogger.h>
 #include <rtabmap/utilite/UConversion.h>
 #include <rtabmap/utilite/UMath.h>
@@ -362,6 +363,289 @@ typename PointMatcher<T>::TransformationParameters eigenMatrixToDim(const typena
 
 namespace rtabmap {
 
+// The raw scan is kept in the cache so that its data cannot be released,
+// the address of the data then identifies the scan.
+class RegistrationIcpCache
+{
+public:
+	RegistrationIcpCache() :
+		scanComplexity(-1.0),
+		maxPointsFiltered(0),
+		complexity(-1.0)
+	{}
+	bool isSameScan(const LaserScan & scan) const
+	{
+		return !raw.isEmpty() &&
+				raw.data().data == scan.data().data &&
+				raw.data().rows == scan.data().rows &&
+				raw.data().cols == scan.data().cols &&
+				raw.data().type() == scan.data().type() &&
+				raw.format() == scan.format() &&
+				raw.maxPoints() == scan.maxPoints() &&
+				raw.maxRange() == scan.maxRange() &&
+				raw.localTransform() == scan.localTransform();
+	}
+
+	LaserScan raw;
+	LaserScan downsampled;
+
+	// normals already in the scan
+	double scanComplexity;
+	cv::Mat scanComplexityVectors;
+	pcl::PointCloud<pcl::PointNormal>::Ptr scanCloudNormals;
+	pcl::search::KdTree<pcl::PointNormal>::Ptr scanCloudNormalsTree;
+
+	// filtered cloud and computed normals
+	pcl::PointCloud<pcl::PointXYZ>::Ptr cloudFiltered;
+	pcl::search::KdTree<pcl::PointXYZ>::Ptr cloudFilteredTree;
+	int maxPointsFiltered;
+	pcl::PointCloud<pcl::Normal>::Ptr normals;
+	double complexity;
+	cv::Mat complexityVectors;
+	pcl::PointCloud<pcl::PointNormal>::Ptr cloudNormals;
+	pcl::search::KdTree<pcl::PointNormal>::Ptr cloudNormalsTree;
+	LaserScan scanNormals;
+	LaserScan scanFiltered;
+};
+
+template<typename PointT>
+static void buildTree(
+		const typename pcl::PointCloud<PointT>::Ptr & cloud,
+		typename pcl::search::KdTree<PointT>::Ptr & tree)
+{
+	if(!tree.get())
+	{
+		tree.reset(new pcl::search::KdTree<PointT>);
+		tree->setInputCloud(cloud);
+	}
+}
+
+// Nearest neighbor search in the voxels of the VoxelHashMap the cloud has
+// been created from, used like a kd-tree by the correspondence estimation
+// without having to build one.
+class VoxelHashMapSearch : public pcl::search::KdTree<pcl::PointNormal>
+{
+public:
+	// remap: voxel index -> index in the cloud
+	VoxelHashMapSearch(const VoxelHashMap * voxelMap, const std::vector<int> & remap, float maxDistance) :
+		pcl::search::KdTree<pcl::PointNormal>(false),
+		voxelMap_(voxelMap),
+		remap_(remap),
+		maxDistance_(maxDistance)
+	{
+		UASSERT(voxelMap_ != 0);
+	}
+	using pcl::search::KdTree<pcl::PointNormal>::nearestKSearch;
+
+	virtual void setInputCloud(const PointCloudConstPtr & cloud, const IndicesConstPtr & indices = IndicesConstPtr())
+	{
+		// no tree to build
+		input_ = cloud;
+		indices_ = indices;
+	}
+
+	// Only the nearest neighbor is searched (k=1, as done by the
+	// correspondence estimation). Like a kd-tree, a neighbor is always
+	// returned: if there is none closer than the maximum distance, its
+	// distance is set over it to be rejected.
+	virtual int nearestKSearch(
+			const pcl::PointNormal & point,
+			int k,
+			std::vector<int> & k_indices,
+			std::vector<float> & k_sqr_distances) const
+	{
+		UASSERT(k == 1);
+		k_indices.resize(1);
+		k_sqr_distances.resize(1);
+		int i = voxelMap_->nearest(point, maxDistance_, 0, &remap_);
+		if(i < 0)
+		{
+			k_indices[0] = 0;
+			k_sqr_distances[0] = std::numeric_limits<float>::max();
+		}
+		else
+		{
+			const pcl::PointNormal & pt = input_->at(i);
+			k_indices[0] = i;
+			k_sqr_distances[0] = (pt.x-point.x)*(pt.x-point.x) + (pt.y-point.y)*(pt.y-point.y) + (pt.z-point.z)*(pt.z-point.z);
+		}
+		return 1;
+	}
+
+private:
+	const VoxelHashMap * voxelMap_;
+	std::vector<int> remap_;
+	float maxDistance_;
+};
+
+// Search in the voxels of "voxelMap" if all points of "cloud" are points of the
+// last cloud returned by voxelMap->getCloud() (the points with NaN normals may
+// have been removed), otherwise null.
+static pcl::search::KdTree<pcl::PointNormal>::Ptr createVoxelMapSearch(
+		const VoxelHashMap * voxelMap,
+		const pcl::PointCloud<pcl::PointNormal>::Ptr & cloud,
+		float maxDistance)
+{
+	pcl::search::KdTree<pcl::PointNormal>::Ptr search;
+	if(voxelMap && cloud->size() && (int)cloud->size() <= voxelMap->size() && maxDistance > 0.0f)
+	{
+		// tolerance for the rounding errors of the conversions to/from LaserScan
+		float tolerance = voxelMap->voxelSize()*0.01f;
+		std::vector<int> remap(voxelMap->size(), -1);
+		for(unsigned int i=0; i<cloud->size(); ++i)
+		{
+			int j = voxelMap->nearest(cloud->at(i), tolerance);
+			if(j < 0 || j >= (int)remap.size() || remap[j] >= 0)
+			{
+				UDEBUG("Cloud not created from the voxel map (point %d), a kd-tree is used.", i);
+				return search;
+			}
+			remap[j] = i;
+		}
+		search.reset(new VoxelHashMapSearch(voxelMap, remap, maxDistance));
+		search->setInputCloud(cloud);
+	}
+	return search;
+}
+
+// When "from" is the same scan than in the previous registration (e.g., the
+// local scan map of OdometryF2M between key frames) or has a search in its
+// voxel map, ICP is done with "from" as target, so that its cached search
+// tree is used by the correspondence estimation instead of being rebuilt at
+// each call. The transform is then inverted to move "from" in "to" frame.
+// Otherwise, "from" is the source as usual and no tree is kept for it.
+//
+// ICP is not symmetric: the correspondences are searched from the points of
+// "to" and, for point-to-plane, the normals of "from" are used instead of
+// the ones of "to". With the local scan map, these normals are computed on
+// the denser (accumulated) cloud. The estimated transform is the same up to
+// the correspondence noise, but not bit-exact with the usual direction.
+static Transform icpPointToPlaneFromTree(
+		const pcl::PointCloud<pcl::PointNormal>::Ptr & fromCloud,
+		pcl::search::KdTree<pcl::PointNormal>::Ptr & fromTree,
+		bool reuseFromTree,
+		const pcl::PointCloud<pcl::PointNormal>::Ptr & toCloud,
+		double maxCorrespondenceDistance,
+		int maximumIterations,
+		bool & hasConverged,
+		pcl::PointCloud<pcl::PointNormal>::Ptr & fromCloudRegistered,
+		float epsilon,
+		bool icp2D)
+{
+	if(!reuseFromTree)
+	{
+		return util3d::icpPointToPlane(
+				fromCloud,
+				toCloud,
+				maxCorrespondenceDistance,
+				maximumIterations,
+				hasConverged,
+				*fromCloudRegistered,
+				epsilon,
+				icp2D);
+	}
+	buildTree<pcl::PointNormal>(fromCloud, fromTree);
+	pcl::PointCloud<pcl::PointNormal> toCloudRegistered;
+	Transform t = util3d::icpPointToPlane(
+			toCloud,
+			fromCloud,
+			maxCorrespondenceDistance,
+			maximumIterations,
+			hasConverged,
+			toCloudRegistered,
+			epsilon,
+			icp2D,
+			fromTree);
+	if(!t.isNull())
+	{
+		t = t.inverse();
+		fromCloudRegistered = util3d::transformPointCloud(fromCloud, t);
+	}
+	return t;
+}
+
+// Same as above for point-to-point ICP
+static Transform icpFromTree(
+		const pcl::PointCloud<pcl::PointXYZ>::Ptr & fromCloud,
+		pcl::search::KdTree<pcl::PointXYZ>::Ptr & fromTree,
+		bool reuseFromTree,
+		const pcl::PointCloud<pcl::PointXYZ>::Ptr & toCloud,
+		double maxCorrespondenceDistance,
+		int maximumIterations,
+		bool & hasConverged,
+		pcl::PointCloud<pcl::PointXYZ>::Ptr & fromCloudRegistered,
+		float epsilon,
+		bool icp2D)
+{
+	if(!reuseFromTree)
+	{
+		return util3d::icp(
+				fromCloud,
+				toCloud,
+				maxCorrespondenceDistance,
+				maximumIterations,
+				hasConverged,
+				*fromCloudRegistered,
+				epsilon,
+				icp2D);
+	}
+	buildTree<pcl::PointXYZ>(fromCloud, fromTree);
+	pcl::PointCloud<pcl::PointXYZ> toCloudRegistered;
+	Transform t = util3d::icp(
+			toCloud,
+			fromCloud,
+			maxCorrespondenceDistance,
+			maximumIterations,
+			hasConverged,
+			toCloudRegistered,
+			epsilon,
+			icp2D,
+			fromTree);
+	if(!t.isNull())
+	{
+		t = t.inverse();
+		fromCloudRegistered = util3d::transformPointCloud(fromCloud, t);
+	}
+	return t;
+}
+
+// If "from" is the largest cloud, "to" is moved in "from" frame instead of
+// moving "from" in "to" frame, so that the search tree of "from" can be reused.
+static void computeVarianceAndCorrespondences(
+		const pcl::PointCloud<pcl::PointNormal>::Ptr & fromCloud,
+		pcl::search::KdTree<pcl::PointNormal>::Ptr & fromTree,
+		const pcl::PointCloud<pcl::PointNormal>::Ptr & fromCloudRegistered,
+		const pcl::PointCloud<pcl::PointNormal>::Ptr & toCloud,
+		const Transform & icpT,
+		double maxCorrespondenceDistance,
+		double maxCorrespondenceAngle,
+		double & variance,
+		int & correspondences)
+{
+	if(fromCloud->size() > toCloud->size())
+	{
+		buildTree<pcl::PointNormal>(fromCloud, fromTree);
+		util3d::computeVarianceAndCorrespondences(
+				fromCloud,
+				util3d::transformPointCloud(toCloud, icpT.inverse()),
+				maxCorrespondenceDistance,
+				maxCorrespondenceAngle,
+				variance,
+				correspondences,
+				fromTree);
+	}
+	else
+	{
+		util3d::computeVarianceAndCorrespondences(
+				fromCloudRegistered,
+				toCloud,
+				maxCorrespondenceDistance,
+				maxCorrespondenceAngle,
+				variance,
+				correspondences);
+	}
+}
+
 RegistrationIcp::RegistrationIcp(const ParametersMap & parameters, Registration * child) :
 	Registration(parameters, child),
 	_maxTranslation(Parameters::defaultIcpMaxTranslation()),
@@ -381,7 +665,9 @@ RegistrationIcp::RegistrationIcp(const ParametersMap & parameters, Registration
 	_libpointmatcherKnn(Parameters::defaultIcpPMMatcherKnn()),
 	_libpointmatcherEpsilon(Parameters::defaultIcpPMMatcherEpsilon()),
 	_libpointmatcherOutlierRatio(Parameters::defaultIcpPMOutlierRatio()),
-	_libpointmatcherICP(0)
+	_libpointmatcherICP(0),
+	_fromCache(new RegistrationIcpCache()),
+	_fromVoxelMap(0)
 {
 	this->parseParameters(parameters);
 }
@@ -391,6 +677,7 @@ RegistrationIcp::~RegistrationIcp()
 #ifdef RTABMAP_POINTMATCHER
 	delete (PM::ICP*)_libpointmatcherICP;
 #endif
+	delete _fromCache;
 }
 
 void RegistrationIcp::parseParameters(const ParametersMap & parameters)
@@ -417,6 +704,10 @@ void RegistrationIcp::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(parameters, Parameters::kIcpPMMatcherKnn(), _libpointmatcherKnn);
 	Parameters::parse(parameters, Parameters::kIcpPMMatcherEpsilon(), _libpointmatcherEpsilon);
 
+	_fromCacheMutex.lock();
+	*_fromCache = RegistrationIcpCache();
+	_fromCacheMutex.unlock();
+
 #ifndef RTABMAP_POINTMATCHER
 	if(_libpointmatcher)
 	{
@@ -557,9 +848,29 @@ Transform RegistrationIcp::computeTransformationImpl(
 		// ICP with guess transform
 		LaserScan fromScan = dataFrom.laserScanRaw();
 		LaserScan toScan = dataTo.laserScanRaw();
+
+		// reuse what has been computed for "from" if it is the same scan than in the last registration
+		RegistrationIcpCache fromCache;
+		_fromCacheMutex.lock();
+		bool fromCached = _fromCache->isSameScan(fromScan);
+		if(fromCached)
+		{
+			fromCache = *_fromCache;
+		}
+		_fromCacheMutex.unlock();
+		if(!fromCached)
+		{
+			fromCache.raw = fromScan;
+		}
+		UDEBUG("From scan cached=%d", fromCached?1:0);
+
 		if(_downsamplingStep>1)
 		{
-			fromScan = util3d::downsample(fromScan, _downsamplingStep);
+			if(fromCache.downsampled.isEmpty())
+			{
+				fromCache.downsampled = util3d::downsample(fromScan, _downsamplingStep);
+			}
+			fromScan = fromCache.downsampled;
 			toScan = util3d::downsample(toScan, _downsamplingStep);
 			UDEBUG("Downsampling time (step=%d) = %f s", _downsamplingStep, timer.ticks());
 		}
@@ -583,8 +894,13 @@ Transform RegistrationIcp::computeTransformationImpl(
 			{
 				//special case if we have already normals computed and there is no filtering
 
-				cv::Mat complexityVectorsFrom, complexityVectorsTo;
-				double fromComplexity = util3d::computeNormalsComplexity(fromScan, &complexityVectorsFrom);
+				if(fromCache.scanComplexity < 0.0)
+				{
+					fromCache.scanComplexity = util3d::computeNormalsComplexity(fromScan, &fromCache.scanComplexityVectors);
+				}
+				cv::Mat complexityVectorsFrom = fromCache.scanComplexityVectors;
+				cv::Mat complexityVectorsTo;
+				double fromComplexity = fromCache.scanComplexity;
 				double toComplexity = util3d::computeNormalsComplexity(toScan, &complexityVectorsTo);
 				float complexity = fromComplexity<toComplexity?fromComplexity:toComplexity;
 				info.icpStructuralComplexity = complexity;
@@ -596,10 +912,15 @@ Transform RegistrationIcp::computeTransformationImpl(
 				}
 				else
 				{
-					pcl::PointCloud<pcl::PointNormal>::Ptr fromCloudNormals = util3d::laserScanToPointCloudNormal(fromScan, fromScan.localTransform());
+					if(!fromCache.scanCloudNormals.get())
+					{
+						fromCache.scanCloudNormals = util3d::laserScanToPointCloudNormal(fromScan, fromScan.localTransform());
+						fromCache.scanCloudNormals = util3d::removeNaNNormalsFromPointCloud(fromCache.scanCloudNormals);
+						fromCache.scanCloudNormalsTree = createVoxelMapSearch(_fromVoxelMap, fromCache.scanCloudNormals, _maxCorrespondenceDistance);
+						UDEBUG("Voxel map search=%d", fromCache.scanCloudNormalsTree.get()?1:0);
+					}
+					pcl::PointCloud<pcl::PointNormal>::Ptr fromCloudNormals = fromCache.scanCloudNormals;
 					pcl::PointCloud<pcl::PointNormal>::Ptr toCloudNormals = util3d::laserScanToPointCloudNormal(toScan, guess * toScan.localTransform());
-
-					fromCloudNormals = util3d::removeNaNNormalsFromPointCloud(fromCloudNormals);
 					toCloudNormals = util3d::removeNaNNormalsFromPointCloud(toCloudNormals);
 
 
@@ -640,22 +961,27 @@ Transform RegistrationIcp::computeTransformationImpl(
 					else
 #endif
 					{
-						icpT = util3d::icpPointToPlane(
+						icpT = icpPointToPlaneFromTree(
 								fromCloudNormals,
+								fromCache.scanCloudNormalsTree,
+								fromCached || fromCache.scanCloudNormalsTree.get() != 0,
 								toCloudNormals,
 							   _maxCorrespondenceDistance,
 							   _maxIterations,
 							   hasConverged,
-							   *fromCloudNormalsRegistered,
+							   fromCloudNormalsRegistered,
 							   _epsilon,
 							   this->force3DoF());
 					}
 
 					if(!icpT.isNull() && hasConverged)
 					{
-						util3d::computeVarianceAndCorrespondences(
+						computeVarianceAndCorrespondences(
+								fromCloudNormals,
+								fromCache.scanCloudNormalsTree,
 								fromCloudNormalsRegistered,
 								toCloudNormals,
+								icpT,
 								_maxCorrespondenceDistance,
 								_maxRotation,
 								variance,
@@ -669,65 +995,77 @@ Transform RegistrationIcp::computeTransformationImpl(
 			int maxLaserScansTo = toScan.maxPoints();
 			if(!transformComputed)
 			{
-				pcl::PointCloud<pcl::PointXYZ>::Ptr fromCloud = util3d::laserScanToPointCloud(fromScan, fromScan.localTransform());
+				bool fromFilteredCached = fromCache.cloudFiltered.get() != 0;
+				if(!fromFilteredCached)
+				{
+					fromCache.cloudFiltered = util3d::laserScanToPointCloud(fromScan, fromScan.localTransform());
+					fromCache.maxPointsFiltered = maxLaserScansFrom;
+				}
 				pcl::PointCloud<pcl::PointXYZ>::Ptr toCloud = util3d::laserScanToPointCloud(toScan, guess * toScan.localTransform());
 				UDEBUG("Conversion time = %f s", timer.ticks());
 
-				pcl::PointCloud<pcl::PointXYZ>::Ptr fromCloudFiltered = fromCloud;
 				pcl::PointCloud<pcl::PointXYZ>::Ptr toCloudFiltered = toCloud;
 				if(_voxelSize > 0.0f)
 				{
-					float pointsBeforeFiltering = (float)fromCloudFiltered->size();
-					fromCloudFiltered = util3d::voxelize(fromCloudFiltered, _voxelSize);
-					float ratioFrom = float(fromCloudFiltered->size()) / pointsBeforeFiltering;
-					maxLaserScansFrom = int(float(maxLaserScansFrom) * ratioFrom);
+					if(!fromFilteredCached)
+					{
+						float pointsBeforeFiltering = (float)fromCache.cloudFiltered->size();
+						fromCache.cloudFiltered = util3d::voxelize(fromCache.cloudFiltered, _voxelSize);
+						float ratioFrom = float(fromCache.cloudFiltered->size()) / pointsBeforeFiltering;
+						fromCache.maxPointsFiltered = int(float(maxLaserScansFrom) * ratioFrom);
+					}
 
-					pointsBeforeFiltering = (float)toCloudFiltered->size();
+					float pointsBeforeFiltering = (float)toCloudFiltered->size();
 					toCloudFiltered = util3d::voxelize(toCloudFiltered, _voxelSize);
 					float ratioTo = float(toCloudFiltered->size()) / pointsBeforeFiltering;
 					maxLaserScansTo = int(float(maxLaserScansTo) * ratioTo);
 
-					UDEBUG("Voxel filtering time (voxel=%f m, ratioFrom=%f->%d/%d ratioTo=%f->%d/%d) = %f s",
+					UDEBUG("Voxel filtering time (voxel=%f m, from=%d/%d (cached=%d) ratioTo=%f->%d/%d) = %f s",
 							_voxelSize,
-							ratioFrom,
-							(int)fromCloudFiltered->size(),
-							maxLaserScansFrom,
+							(int)fromCache.cloudFiltered->size(),
+							fromCache.maxPointsFiltered,
+							fromFilteredCached?1:0,
 							ratioTo,
 							(int)toCloudFiltered->size(),
 							maxLaserScansTo,
 							timer.ticks());
 				}
+				pcl::PointCloud<pcl::PointXYZ>::Ptr fromCloudFiltered = fromCache.cloudFiltered;
+				maxLaserScansFrom = fromCache.maxPointsFiltered;
 
 				pcl::PointCloud<pcl::PointXYZ>::Ptr fromCloudRegistered(new pcl::PointCloud<pcl::PointXYZ>());
 				if(_pointToPlane && // ICP Point To Plane
 					!tooLowComplexityForPlaneToPlane && // if previously rejected above
 					!((fromScan.is2d()|| toScan.is2d()) && !_libpointmatcher)) // PCL crashes if 2D
 				{
-					Eigen::Vector3f viewpointFrom(fromScan.localTransform().x(), fromScan.localTransform().y(), fromScan.localTransform().z());
-					pcl::PointCloud<pcl::Normal>::Ptr normalsFrom;
-					if(fromScan.is2d())
+					if(!fromCache.normals.get())
 					{
-						if(_voxelSize > 0.0f)
+						Eigen::Vector3f viewpointFrom(fromScan.localTransform().x(), fromScan.localTransform().y(), fromScan.localTransform().z());
+						if(fromScan.is2d())
 						{
-							normalsFrom = util3d::computeNormals2D(
-									fromCloudFiltered,
-									_pointToPlaneK,
-									_pointToPlaneRadius,
-									viewpointFrom);
+							if(_voxelSize > 0.0f)
+							{
+								fromCache.normals = util3d::computeNormals2D(
+										fromCloudFiltered,
+										_pointToPlaneK,
+										_pointToPlaneRadius,
+										viewpointFrom);
+							}
+							else
+							{
+								fromCache.normals = util3d::computeFastOrganizedNormals2D(
+										fromCloudFiltered,
+										_pointToPlaneK,
+										_pointToPlaneRadius,
+										viewpointFrom);
+							}
 						}
 						else
 						{
-							normalsFrom = util3d::computeFastOrganizedNormals2D(
-									fromCloudFiltered,
-									_pointToPlaneK,
-									_pointToPlaneRadius,
-									viewpointFrom);
+							fromCache.normals = util3d::computeNormals(fromCloudFiltered, _pointToPlaneK, _pointToPlaneRadius, viewpointFrom);
 						}
 					}
-					else
-					{
-						normalsFrom = util3d::computeNormals(fromCloudFiltered, _pointToPlaneK, _pointToPlaneRadius, viewpointFrom);
-					}
+					pcl::PointCloud<pcl::Normal>::Ptr normalsFrom = fromCache.normals;
 
 					Transform toT = guess * toScan.localTransform();
 					Eigen::Vector3f viewpointTo(toT.x(), toT.y(), toT.z());
@@ -756,8 +1094,13 @@ Transform RegistrationIcp::computeTransformationImpl(
 						normalsTo = util3d::computeNormals(toCloudFiltered, _pointToPlaneK, _pointToPlaneRadius, viewpointTo);
 					}
 
-					cv::Mat complexityVectorsFrom, complexityVectorsTo;
-					double fromComplexity = util3d::computeNormalsComplexity(*normalsFrom, fromScan.is2d(), &complexityVectorsFrom);
+					if(fromCache.complexity < 0.0)
+					{
+						fromCache.complexity = util3d::computeNormalsComplexity(*normalsFrom, fromScan.is2d(), &fromCache.complexityVectors);
+					}
+					cv::Mat complexityVectorsFrom = fromCache.complexityVectors;
+					cv::Mat complexityVectorsTo;
+					double fromComplexity = fromCache.complexity;
 					double toComplexity = util3d::computeNormalsComplexity(*normalsTo, toScan.is2d(), &complexityVectorsTo);
 					float complexity = fromComplexity<toComplexity?fromComplexity:toComplexity;
 					info.icpStructuralComplexity = complexity;
@@ -769,37 +1112,43 @@ Transform RegistrationIcp::computeTransformationImpl(
 					}
 					else
 					{
-						pcl::PointCloud<pcl::PointNormal>::Ptr fromCloudNormals(new pcl::PointCloud<pcl::PointNormal>);
-						pcl::concatenateFields(*fromCloudFiltered, *normalsFrom, *fromCloudNormals);
+						if(!fromCache.cloudNormals.get())
+						{
+							fromCache.cloudNormals.reset(new pcl::PointCloud<pcl::PointNormal>);
+							pcl::concatenateFields(*fromCloudFiltered, *normalsFrom, *fromCache.cloudNormals);
+							fromCache.cloudNormals = util3d::removeNaNNormalsFromPointCloud(fromCache.cloudNormals);
+						}
+						pcl::PointCloud<pcl::PointNormal>::Ptr fromCloudNormals = fromCache.cloudNormals;
 
 						pcl::PointCloud<pcl::PointNormal>::Ptr toCloudNormals(new pcl::PointCloud<pcl::PointNormal>);
 						pcl::concatenateFields(*toCloudFiltered, *normalsTo, *toCloudNormals);
 
 						std::vector<int> indices;
 						toCloudNormals = util3d::removeNaNNormalsFromPointCloud(toCloudNormals);
-						fromCloudNormals = util3d::removeNaNNormalsFromPointCloud(fromCloudNormals);
 
 						// update output scans
-						if(fromScan.is2d())
-						{
-							fromSignature.sensorData().setLaserScanRaw(
-									LaserScan(
-											util3d::laserScan2dFromPointCloud(*fromCloudNormals, fromScan.localTransform().inverse()),
-											maxLaserScansFrom,
-											fromScan.maxRange(),
-											LaserScan::kXYNormal,
-											fromScan.localTransform()));
-						}
-						else
+						if(fromCache.scanNormals.isEmpty())
 						{
-							fromSignature.sensorData().setLaserScanRaw(
-									LaserScan(
-											util3d::laserScanFromPointCloud(*fromCloudNormals, fromScan.localTransform().inverse()),
-											maxLaserScansFrom,
-											fromScan.maxRange(),
-											LaserScan::kXYZNormal,
-											fromScan.localTransform()));
+							if(fromScan.is2d())
+							{
+								fromCache.scanNormals = LaserScan(
+										util3d::laserScan2dFromPointCloud(*fromCloudNormals, fromScan.localTransform().inverse()),
+										maxLaserScansFrom,
+										fromScan.maxRange(),
+										LaserScan::kXYNormal,
+										fromScan.localTransform());
+							}
+							else
+							{
+								fromCache.scanNormals = LaserScan(
+										util3d::laserScanFromPointCloud(*fromCloudNormals, fromScan.localTransform().inverse()),
+										maxLaserScansFrom,
+										fromScan.maxRange(),
+										LaserScan::kXYZNormal,
+										fromScan.localTransform());
+							}
 						}
+						fromSignature.sensorData().setLaserScanRaw(fromCache.scanNormals);
 						if(toScan.is2d())
 						{
 							toSignature.sensorData().setLaserScanRaw(
@@ -863,22 +1212,27 @@ Transform RegistrationIcp::computeTransformationImpl(
 							else
 #endif
 							{
-								icpT = util3d::icpPointToPlane(
+								icpT = icpPointToPlaneFromTree(
 										fromCloudNormals,
+										fromCache.cloudNormalsTree,
+										fromCached,
 										toCloudNormals,
 									   _maxCorrespondenceDistance,
 									   _maxIterations,
 									   hasConverged,
-									   *fromCloudNormalsRegistered,
+									   fromCloudNormalsRegistered,
 									   _epsilon,
 									   this->force3DoF());
 							}
 
 							if(!icpT.isNull() && hasConverged)
 							{
-								util3d::computeVarianceAndCorrespondences(
+								computeVarianceAndCorrespondences(
+										fromCloudNormals,
+										fromCache.cloudNormalsTree,
 										fromCloudNormalsRegistered,
 										toCloudNormals,
+										icpT,
 										_maxCorrespondenceDistance,
 										_maxRotation,
 										variance,
@@ -899,26 +1253,28 @@ Transform RegistrationIcp::computeTransformationImpl(
 					if(_voxelSize > 0.0f || !tooLowComplexityForPlaneToPlane)
 					{
 						// update output scans
-						if(fromScan.is2d())
+						if(fromCache.scanFiltered.isEmpty())
 						{
-							fromSignature.sensorData().setLaserScanRaw(
-									LaserScan(
-											util3d::laserScan2dFromPointCloud(*fromCloudFiltered, fromScan.localTransform().inverse()),
-											maxLaserScansFrom,
-											fromScan.maxRange(),
-											LaserScan::kXY,
-											fromScan.localTransform()));
-						}
-						else
-						{
-							fromSignature.sensorData().setLaserScanRaw(
-									LaserScan(
-											util3d::laserScanFromPointCloud(*fromCloudFiltered, fromScan.localTransform().inverse()),
-											maxLaserScansFrom,
-											fromScan.maxRange(),
-											LaserScan::kXYZ,
-											fromScan.localTransform()));
+							if(fromScan.is2d())
+							{
+								fromCache.scanFiltered = LaserScan(
+										util3d::laserScan2dFromPointCloud(*fromCloudFiltered, fromScan.localTransform().inverse()),
+										maxLaserScansFrom,
+										fromScan.maxRange(),
+										LaserScan::kXY,
+										fromScan.localTransform());
+							}
+							else
+							{
+								fromCache.scanFiltered = LaserScan(
+										util3d::laserScanFromPointCloud(*fromCloudFiltered, fromScan.localTransform().inverse()),
+										maxLaserScansFrom,
+										fromScan.maxRange(),
+										LaserScan::kXYZ,
+										fromScan.localTransform());
+							}
 						}
+						fromSignature.sensorData().setLaserScanRaw(fromCache.scanFiltered);
 						if(toScan.is2d())
 						{
 							toSignature.sensorData().setLaserScanRaw(
@@ -1001,13 +1357,15 @@ Transform RegistrationIcp::computeTransformationImpl(
 					else
 #endif
 					{
-						icpT = util3d::icp(
+						icpT = icpFromTree(
 								fromCloudFiltered,
+								fromCache.cloudFilteredTree,
+								fromCached,
 								toCloudFiltered,
 							   _maxCorrespondenceDistance,
 							   _maxIterations,
 							   hasConverged,
-							   *fromCloudRegistered,
+							   fromCloudRegistered,
 							   _epsilon,
 							   this->force3DoF()); // icp2D
 					}
@@ -1072,6 +1430,10 @@ Transform RegistrationIcp::computeTransformationImpl(
 			}
 			UDEBUG("ICP (iterations=%d) time = %f s", _maxIterations, timer.ticks());
 
+			_fromCacheMutex.lock();
+			*_fromCache = fromCache;
+			_fromCacheMutex.unlock();
+
 			if(!icpT.isNull() && hasConverged)
 			{
 				float ix,iy,iz, iroll,ipitch,iyaw;
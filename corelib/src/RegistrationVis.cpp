@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/util3d_features.h>
 #include <rtabmap/core/util3d.h>
 #include <rtabmap/core/VWDictionary.h>
+#include <rtabmap/core/HammingMatcher.h>
 #include <rtabmap/core/util2d.h>
 #include <rtabmap/core/Features2d.h>
 #include <rtabmap/core/VisualWord.h>
@@ -68,7 +69,8 @@ RegistrationVis::RegistrationVis(const ParametersMap & parameters, Registration
 		_guessWinSize(Parameters::defaultVisCorGuessWinSize()),
 		_guessMatchToProjection(Parameters::defaultVisCorGuessMatchToProjection()),
 		_bundleAdjustment(Parameters::defaultVisBundleAdjustment()),
-		_depthAsMask(Parameters::defaultVisDepthAsMask())
+		_depthAsMask(Parameters::defaultVisDepthAsMask()),
+		_fromDictionary(0)
 {
 	_featureParameters = Parameters::getDefaultParameters();
 	uInsert(_featureParameters, ParametersPair(Parameters::kKpNNStrategy(), _featureParameters.at(Parameters::kVisCorNNType())));
@@ -83,6 +85,7 @@ RegistrationVis::RegistrationVis(const ParametersMap & parameters, Registration
 	uInsert(_featureParameters, ParametersPair(Parameters::kKpSubPixWinSize(), _featureParameters.at(Parameters::kVisSubPixEps())));
 	uInsert(_featureParameters, ParametersPair(Parameters::kKpGridRows(), _featureParameters.at(Parameters::kVisGridRows())));
 	uInsert(_featureParameters, ParametersPair(Parameters::kKpGridCols(), _featureParameters.at(Parameters::kVisGridCols())));
+	uInsert(_featureParameters, ParametersPair(Parameters::kKpThreads(), _featureParameters.at(Parameters::kVisFeatureThreads())));
 	uInsert(_featureParameters, ParametersPair(Parameters::kKpNewWordsComparedTogether(), "false"));
 
 	this->parseParameters(parameters);
@@ -176,6 +179,10 @@ void RegistrationVis::parseParameters(const ParametersMap & parameters)
 	{
 		uInsert(_featureParameters, ParametersPair(Parameters::kKpGridCols(), parameters.at(Parameters::kVisGridCols())));
 	}
+	if(uContains(parameters, Parameters::kVisFeatureThreads()))
+	{
+		uInsert(_featureParameters, ParametersPair(Parameters::kKpThreads(), parameters.at(Parameters::kVisFeatureThreads())));
+	}
 }
 
 RegistrationVis::~RegistrationVis()
@@ -187,6 +194,11 @@ Feature2D * RegistrationVis::createFeatureDetector() const
 	return Feature2D::create(_featureParameters);
 }
 
+VWDictionary * RegistrationVis::createDictionary() const
+{
+	return new VWDictionary(_featureParameters);
+}
+
 Transform RegistrationVis::computeTransformationImpl(
 			Signature & fromSignature,
 			Signature & toSignature,
@@ -283,12 +295,7 @@ Transform RegistrationVis::computeTransformationImpl(
 			{
 				if(!imageFrom.empty())
 				{
-					if(imageFrom.channels() > 1)
-					{
-						cv::Mat tmp;
-						cv::cvtColor(imageFrom, tmp, cv::COLOR_BGR2GRAY);
-						imageFrom = tmp;
-					}
+					imageFrom = fromSignature.sensorData().imageRawGray();
 
 					cv::Mat depthMask;
 					if(!fromSignature.sensorData().depthRaw().empty() && _depthAsMask)
@@ -344,18 +351,8 @@ Transform RegistrationVis::computeTransformationImpl(
 		{
 			UDEBUG("");
 			// convert to grayscale
-			if(imageFrom.channels() > 1)
-			{
-				cv::Mat tmp;
-				cv::cvtColor(imageFrom, tmp, cv::COLOR_BGR2GRAY);
-				imageFrom = tmp;
-			}
-			if(imageTo.channels() > 1)
-			{
-				cv::Mat tmp;
-				cv::cvtColor(imageTo, tmp, cv::COLOR_BGR2GRAY);
-				imageTo = tmp;
-			}
+			imageFrom = fromSignature.sensorData().imageRawGray();
+			imageTo = toSignature.sensorData().imageRawGray();
 
 			std::vector<cv::Point3f> kptsFrom3D;
 			if(kptsFrom.size() == fromSignature.getWords3().size())
@@ -397,14 +394,16 @@ Transform RegistrationVis::computeTransformationImpl(
 				std::vector<unsigned char> status;
 				std::vector<float> err;
 				UDEBUG("cv::calcOpticalFlowPyrLK() begin");
+				// Pyramids are cached in the data, the new frame will be the reference of the next one
+				cv::Size winSize(_flowWinSize, _flowWinSize);
 				cv::calcOpticalFlowPyrLK(
-						imageFrom,
-						imageTo,
+						fromSignature.sensorData().imageRawPyramid(winSize, _flowMaxLevel),
+						toSignature.sensorData().imageRawPyramid(winSize, _flowMaxLevel),
 						cornersFrom,
 						cornersTo,
 						status,
 						err,
-						cv::Size(_flowWinSize, _flowWinSize),
+						winSize,
 						guessSet?0:_flowMaxLevel,
 						cv::TermCriteria(cv::TermCriteria::COUNT+cv::TermCriteria::EPS, _flowIterations, _flowEps),
 						cv::OPTFLOW_LK_GET_MIN_EIGENVALS | (guessSet?cv::OPTFLOW_USE_INITIAL_FLOW:0), 1e-4);
@@ -491,12 +490,7 @@ Transform RegistrationVis::computeTransformationImpl(
 				if(toSignature.sensorData().keypoints().empty() &&
 				   !imageTo.empty())
 				{
-					if(imageTo.channels() > 1)
-					{
-						cv::Mat tmp;
-						cv::cvtColor(imageTo, tmp, cv::COLOR_BGR2GRAY);
-						imageTo = tmp;
-					}
+					imageTo = toSignature.sensorData().imageRawGray();
 
 					cv::Mat depthMask;
 					if(!toSignature.sensorData().depthRaw().empty() && _depthAsMask)
@@ -548,12 +542,7 @@ Transform RegistrationVis::computeTransformationImpl(
 			}
 			else if(!imageFrom.empty())
 			{
-				if(imageFrom.channels() > 1)
-				{
-					cv::Mat tmp;
-					cv::cvtColor(imageFrom, tmp, cv::COLOR_BGR2GRAY);
-					imageFrom = tmp;
-				}
+				imageFrom = fromSignature.sensorData().imageRawGray();
 				orignalWordsFromIds.clear();
 				descriptorsFrom = detector->generateDescriptors(imageFrom, kptsFrom);
 			}
@@ -580,12 +569,7 @@ Transform RegistrationVis::computeTransformationImpl(
 				}
 				else if(!imageTo.empty())
 				{
-					if(imageTo.channels() > 1)
-					{
-						cv::Mat tmp;
-						cv::cvtColor(imageTo, tmp, cv::COLOR_BGR2GRAY);
-						imageTo = tmp;
-					}
+					imageTo = toSignature.sensorData().imageRawGray();
 
 					descriptorsTo = detector->generateDescriptors(imageTo, kptsTo);
 				}
@@ -847,8 +831,15 @@ Transform RegistrationVis::computeTransformationImpl(
 										if(oi >=2)
 										{
 											std::vector<std::vector<cv::DMatch> > matches;
-											cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
-											matcher.knnMatch(descriptorsTo.row(i), cv::Mat(descriptors, cv::Range(0, oi)), matches, 2);
+											if(descriptors.type()==CV_8U)
+											{
+												HammingMatcher::knnMatch(descriptorsTo.row(i), cv::Mat(descriptors, cv::Range(0, oi)), matches, 2);
+											}
+											else
+											{
+												cv::BFMatcher matcher(cv::NORM_L2SQR);
+												matcher.knnMatch(descriptorsTo.row(i), cv::Mat(descriptors, cv::Range(0, oi)), matches, 2);
+											}
 											UASSERT(matches.size() == 1);
 											UASSERT(matches[0].size() == 2);
 											if(matches[0].at(0).distance < _nndr * matches[0].at(1).distance)
@@ -998,8 +989,15 @@ Transform RegistrationVis::computeTransformationImpl(
 										if(oi >=2)
 										{
 											std::vector<std::vector<cv::DMatch> > matches;
-											cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
-											matcher.knnMatch(descriptorsFrom.row(matchedIndexFrom), cv::Mat(descriptors, cv::Range(0, oi)), matches, 2);
+											if(descriptors.type()==CV_8U)
+											{
+												HammingMatcher::knnMatch(descriptorsFrom.row(matchedIndexFrom), cv::Mat(descriptors, cv::Range(0, oi)), matches, 2);
+											}
+											else
+											{
+												cv::BFMatcher matcher(cv::NORM_L2SQR);
+												matcher.knnMatch(descriptorsFrom.row(matchedIndexFrom), cv::Mat(descriptors, cv::Range(0, oi)), matches, 2);
+											}
 											UASSERT(matches.size() == 1);
 											UASSERT(matches[0].size() == 2);
 											bruteForceTotalTime+=bruteForceTimer.elapsed();
@@ -1106,22 +1104,58 @@ Transform RegistrationVis::computeTransformationImpl(
 
 					UDEBUG("");
 					// match between all descriptors
-					VWDictionary dictionary(_featureParameters);
-					std::list<int> fromWordIds;
-					for (int i = 0; i < descriptorsFrom.rows; ++i)
+					bool fromDictionaryValid =
+							_fromDictionary &&
+							orignalWordsFromIds.size() &&
+							(int)orignalWordsFromIds.size() == descriptorsFrom.rows &&
+							_fromDictionary->getVisualWords().size() == orignalWordsFromIds.size();
+					if(fromDictionaryValid)
 					{
-						int id = orignalWordsFromIds.size() ? orignalWordsFromIds[i] : i;
-						dictionary.addWord(new VisualWord(id, descriptorsFrom.row(i), 1));
-						fromWordIds.push_back(id);
+						// IDs of the "from" words are unique and sorted
+						std::map<int, VisualWord*>::const_iterator iter=_fromDictionary->getVisualWords().begin();
+						for(unsigned int i=0; fromDictionaryValid && i<orignalWordsFromIds.size(); ++i, ++iter)
+						{
+							fromDictionaryValid = iter->first == orignalWordsFromIds[i];
+						}
+						if(!fromDictionaryValid)
+						{
+							UDEBUG("The dictionary doesn't contain the words of the \"from\" signature, a temporary one is used.");
+						}
 					}
 
+					std::list<int> fromWordIds;
 					std::list<int> toWordIds;
-					if(descriptorsTo.rows)
+					if(fromDictionaryValid)
 					{
-						dictionary.update();
-						toWordIds = dictionary.addNewWords(descriptorsTo, 2);
+						fromWordIds.insert(fromWordIds.end(), orignalWordsFromIds.begin(), orignalWordsFromIds.end());
+						if(descriptorsTo.rows)
+						{
+							// Words not matched get new IDs, like they would be added to the dictionary
+							std::vector<int> matchedIds = _fromDictionary->findNN(descriptorsTo);
+							int newId = orignalWordsFromIds.back()+1;
+							for(unsigned int i=0; i<matchedIds.size(); ++i)
+							{
+								toWordIds.push_back(matchedIds[i]>0?matchedIds[i]:newId++);
+							}
+						}
+					}
+					else
+					{
+						VWDictionary dictionary(_featureParameters);
+						for (int i = 0; i < descriptorsFrom.rows; ++i)
+						{
+							int id = orignalWordsFromIds.size() ? orignalWordsFromIds[i] : i;
+							dictionary.addWord(new VisualWord(id, descriptorsFrom.row(i), 1));
+							fromWordIds.push_back(id);
+						}
+
+						if(descriptorsTo.rows)
+						{
+							dictionary.update();
+							toWordIds = dictionary.addNewWords(descriptorsTo, 2);
+						}
+						dictionary.clear(false);
 					}
-					dictionary.clear(false);
 
 					std::multiset<int> fromWordIdsSet(fromWordIds.begin(), fromWordIds.end());
 					std::multiset<int> toWordIdsSet(toWordIds.begin(), toWordIds.end());
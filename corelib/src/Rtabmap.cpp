@@ -89,6 +89,7 @@ Rtabmap::Rtabmap() :
 	_loopRatio(Parameters::defaultRtabmapLoopRatio()),
 	_verifyLoopClosureHypothesis(Parameters::defaultVhEpEnabled()),
 	_maxRetrieved(Parameters::defaultRtabmapMaxRetrieved()),
+	_maxPrefetched(Parameters::defaultRtabmapMaxPrefetched()),
 	_maxLocalRetrieved(Parameters::defaultRGBDMaxLocalRetrieved()),
 	_rawDataKept(Parameters::defaultMemImageKept()),
 	_statisticLogsBufferedInRAM(Parameters::defaultRtabmapStatisticLogsBufferedInRAM()),
@@ -431,6 +432,7 @@ void Rtabmap::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(parameters, Parameters::kRtabmapLoopRatio(), _loopRatio);
 	Parameters::parse(parameters, Parameters::kVhEpEnabled(), _verifyLoopClosureHypothesis);
 	Parameters::parse(parameters, Parameters::kRtabmapMaxRetrieved(), _maxRetrieved);
+	Parameters::parse(parameters, Parameters::kRtabmapMaxPrefetched(), _maxPrefetched);
 	Parameters::parse(parameters, Parameters::kRGBDMaxLocalRetrieved(), _maxLocalRetrieved);
 	Parameters::parse(parameters, Parameters::kMemImageKept(), _rawDataKept);
 	Parameters::parse(parameters, Parameters::kRGBDEnabled(), _rgbdSlamMode);
@@ -692,6 +694,10 @@ int Rtabmap::triggerNewMap()
 		UINFO("New map triggered, new map = %d", mapId);
 		_optimizedPoses.clear();
 		_constraints.clear();
+		if(_graphOptimizer)
+		{
+			_graphOptimizer->resetSession();
+		}
 		_lastLocalizationNodeId = 0;
 
 		if(_bayesFilter)
@@ -842,6 +848,11 @@ void Rtabmap::resetMemory()
 	_distanceTravelled = 0.0f;
 	this->clearPath(0);
 
+	if(_graphOptimizer)
+	{
+		_graphOptimizer->resetSession();
+	}
+
 	if(_memory)
 	{
 		_memory->init(_databasePath, true, _parameters, true);
@@ -2246,6 +2257,7 @@ bool Rtabmap::process(
 	float maxLinearErrorRatio = 0.0f;
 	double optimizationError = 0.0;
 	int optimizationIterations = 0;
+	double timeMapOptimizationSolver = 0.0;
 	cv::Mat localizationCovariance;
 	if(_rgbdSlamMode &&
 		(_loopClosureHypothesis.first>0 ||
@@ -2322,6 +2334,7 @@ bool Rtabmap::process(
 			std::multimap<int, Link> constraints;
 			cv::Mat covariance;
 			optimizeCurrentMap(signature->id(), false, poses, covariance, &constraints, &optimizationError, &optimizationIterations);
+			timeMapOptimizationSolver = _graphOptimizer->lastSolverTime();
 
 			// Check added loop closures have broken the graph
 			// (in case of wrong loop closures).
@@ -2509,6 +2522,7 @@ bool Rtabmap::process(
 			statistics_.addStatistic(Statistics::kTimingReactivation(), timeReactivations*1000);
 			statistics_.addStatistic(Statistics::kTimingAdd_loop_closure_link(), timeAddLoopClosureLink*1000);
 			statistics_.addStatistic(Statistics::kTimingMap_optimization(), timeMapOptimization*1000);
+			statistics_.addStatistic(Statistics::kTimingMap_optimization_solver(), timeMapOptimizationSolver*1000);
 			statistics_.addStatistic(Statistics::kTimingLikelihood_computation(), timeLikelihoodCalculation*1000);
 			statistics_.addStatistic(Statistics::kTimingPosterior_computation(), timePosteriorCalculation*1000);
 			statistics_.addStatistic(Statistics::kTimingHypotheses_creation(), timeHypothesesCreation*1000);
@@ -2738,6 +2752,41 @@ bool Rtabmap::process(
 	timeRealTimeLimitReachedProcess = timer.ticks();
 	ULOGGER_INFO("Time limit reached processing = %f...", timeRealTimeLimitReachedProcess);
 
+	//Locations around the highest hypothesis will likely be retrieved on
+	//next update, look for them before the trash thread is started as
+	//links of nodes in LTM may be loaded from the database. The search
+	//accesses the memory, so it cannot be done in the prefetch thread.
+	std::list<int> idsToPrefetch;
+	double timePrefetchSearch = 0;
+	if(_maxPrefetched > 0)
+	{
+		if(_highestHypothesis.first > 0 && _memory->getSignature(_highestHypothesis.first))
+		{
+			int neighborhoodSize = (int)_bayesFilter->getPredictionLC().size()-1;
+			std::map<int, int> neighbors = _memory->getNeighborsId(_highestHypothesis.first,
+					neighborhoodSize,
+					_maxPrefetched,
+					true);
+			std::multimap<int, int> ltmNeighborsByMargin;
+			for(std::map<int, int>::iterator iter=neighbors.begin(); iter!=neighbors.end(); ++iter)
+			{
+				if(_memory->getSignature(iter->first) == 0)
+				{
+					ltmNeighborsByMargin.insert(std::make_pair(iter->second, iter->first));
+				}
+			}
+			for(std::multimap<int, int>::iterator iter=ltmNeighborsByMargin.begin();
+				iter!=ltmNeighborsByMargin.end() && idsToPrefetch.size() < _maxPrefetched;
+				++iter)
+			{
+				idsToPrefetch.push_back(iter->second);
+			}
+			UDEBUG("Prefetching %d locations around %d", (int)idsToPrefetch.size(), _highestHypothesis.first);
+		}
+		timePrefetchSearch = timer.ticks();
+		ULOGGER_INFO("Time searching locations to prefetch = %f...", timePrefetchSearch);
+	}
+
 	//==============================================================
 	// Finalize statistics and log files
 	//==============================================================
@@ -2750,6 +2799,10 @@ bool Rtabmap::process(
 		statistics_.addStatistic(Statistics::kTimingJoining_trash(), timeJoiningTrash*1000);
 		statistics_.addStatistic(Statistics::kTimingEmptying_trash(), timeEmptyingTrash*1000);
 		statistics_.addStatistic(Statistics::kTimingMemory_cleanup(), timeMemoryCleanup*1000);
+		if(_maxPrefetched > 0)
+		{
+			statistics_.addStatistic(Statistics::kTimingPrefetch_search(), timePrefetchSearch*1000);
+		}
 
 		// Transfer
 		statistics_.addStatistic(Statistics::kMemorySignatures_removed(), signaturesRemoved.size());
@@ -2896,6 +2949,12 @@ bool Rtabmap::process(
 	UDEBUG("Empty trash...");
 	_memory->emptyTrash();
 
+	//Start prefetching, previously prefetched locations not in this list are released
+	if(_maxPrefetched > 0)
+	{
+		_memory->prefetchSignatures(idsToPrefetch);
+	}
+
 	// Log info...
 	// TODO : use a specific class which will handle the RtabmapEvent
 	if(_foutFloat && _foutInt)
@@ -3348,7 +3407,9 @@ void Rtabmap::optimizeCurrentMap(
 		}
 		UINFO("get %d ids time %f s", (int)ids.size(), timer.ticks());
 
-		std::map<int, Transform> poses = Rtabmap::optimizeGraph(id, uKeysSet(ids), optimizedPoses, lookInDatabase, covariance, constraints, error, iterationsDone);
+		// Only the graph of the working memory is optimized incrementally, the
+		// optimizer session is not used for the whole graph in database
+		std::map<int, Transform> poses = Rtabmap::optimizeGraph(id, uKeysSet(ids), optimizedPoses, lookInDatabase, covariance, constraints, error, iterationsDone, !lookInDatabase);
 		UINFO("optimize time %f s", timer.ticks());
 
 		if(poses.size())
@@ -3381,7 +3442,8 @@ std::map<int, Transform> Rtabmap::optimizeGraph(
 		cv::Mat & covariance,
 		std::multimap<int, Link> * constraints,
 		double * error,
-		int * iterationsDone) const
+		int * iterationsDone,
+		bool optimizerSession) const
 {
 	UTimer timer;
 	std::map<int, Transform> optimizedPoses;
@@ -3460,7 +3522,14 @@ std::map<int, Transform> Rtabmap::optimizeGraph(
 	}
 	else
 	{
-		optimizedPoses = _graphOptimizer->optimize(fromId, poses, edgeConstraints, covariance, 0, error, iterationsDone);
+		if(optimizerSession)
+		{
+			optimizedPoses = _graphOptimizer->optimizeSession(fromId, poses, edgeConstraints, covariance, error, iterationsDone);
+		}
+		else
+		{
+			optimizedPoses = _graphOptimizer->optimize(fromId, poses, edgeConstraints, covariance, 0, error, iterationsDone);
+		}
 
 		if(!poses.empty() && optimizedPoses.empty() && guessPoses.empty())
 		{
@@ -29,9 +29,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/SensorData.h"
 #include "rtabmap/core/Compression.h"
 #include "rtabmap/core/util3d_transforms.h"
+#include "rtabmap/core/util2d.h"
 #include "rtabmap/utilite/ULogger.h"
 #include <rtabmap/utilite/UMath.h>
 #include <rtabmap/utilite/UConversion.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
 
 namespace rtabmap
 {
@@ -40,6 +43,8 @@ namespace rtabmap
 SensorData::SensorData() :
 		_id(0),
 		_stamp(0.0),
+		_imageRawCache(new ImageCache),
+		_depthOrRightRawCache(new ImageCache),
 		_cellSize(0.0f)
 {
 }
@@ -52,6 +57,8 @@ SensorData::SensorData(
 		const cv::Mat & userData) :
 		_id(id),
 		_stamp(stamp),
+		_imageRawCache(new ImageCache),
+		_depthOrRightRawCache(new ImageCache),
 		_cellSize(0.0f)
 {
 	if(image.rows == 1)
@@ -85,6 +92,8 @@ SensorData::SensorData(
 		const cv::Mat & userData) :
 		_id(id),
 		_stamp(stamp),
+		_imageRawCache(new ImageCache),
+		_depthOrRightRawCache(new ImageCache),
 		_cameraModels(std::vector<CameraModel>(1, cameraModel)),
 		_cellSize(0.0f)
 {
@@ -120,6 +129,8 @@ SensorData::SensorData(
 		const cv::Mat & userData) :
 		_id(id),
 		_stamp(stamp),
+		_imageRawCache(new ImageCache),
+		_depthOrRightRawCache(new ImageCache),
 		_cameraModels(std::vector<CameraModel>(1, cameraModel)),
 		_cellSize(0.0f)
 {
@@ -168,6 +179,8 @@ SensorData::SensorData(
 		const cv::Mat & userData) :
 		_id(id),
 		_stamp(stamp),
+		_imageRawCache(new ImageCache),
+		_depthOrRightRawCache(new ImageCache),
 		_cameraModels(std::vector<CameraModel>(1, cameraModel)),
 		_cellSize(0.0f)
 {
@@ -223,6 +236,8 @@ SensorData::SensorData(
 		const cv::Mat & userData) :
 		_id(id),
 		_stamp(stamp),
+		_imageRawCache(new ImageCache),
+		_depthOrRightRawCache(new ImageCache),
 		_cameraModels(cameraModels),
 		_cellSize(0.0f)
 {
@@ -270,6 +285,8 @@ SensorData::SensorData(
 		const cv::Mat & userData) :
 		_id(id),
 		_stamp(stamp),
+		_imageRawCache(new ImageCache),
+		_depthOrRightRawCache(new ImageCache),
 		_cameraModels(cameraModels),
 		_cellSize(0.0f)
 {
@@ -325,6 +342,8 @@ SensorData::SensorData(
 		const cv::Mat & userData):
 		_id(id),
 		_stamp(stamp),
+		_imageRawCache(new ImageCache),
+		_depthOrRightRawCache(new ImageCache),
 		_stereoCameraModel(cameraModel),
 		_cellSize(0.0f)
 {
@@ -374,6 +393,8 @@ SensorData::SensorData(
 		const cv::Mat & userData) :
 		_id(id),
 		_stamp(stamp),
+		_imageRawCache(new ImageCache),
+		_depthOrRightRawCache(new ImageCache),
 		_stereoCameraModel(cameraModel),
 		_cellSize(0.0f)
 {
@@ -424,6 +445,8 @@ SensorData::SensorData(
 	double stamp) :
 		_id(id),
 		_stamp(stamp),
+		_imageRawCache(new ImageCache),
+		_depthOrRightRawCache(new ImageCache),
 		_cellSize(0.0f)
 {
 	imu_ = imu;
@@ -502,9 +525,9 @@ void SensorData::setOccupancyGrid(
 	_emptyCellsRaw = cv::Mat();
 	_emptyCellsCompressed = cv::Mat();
 
-	CompressionThread ctGround(ground);
-	CompressionThread ctObstacles(obstacles);
-	CompressionThread ctEmpty(empty);
+	CompressionJob ctGround(ground);
+	CompressionJob ctObstacles(obstacles);
+	CompressionJob ctEmpty(empty);
 
 	if(!ground.empty())
 	{
@@ -610,6 +633,7 @@ void SensorData::uncompressData(
 	if(imageRaw && !imageRaw->empty() && _imageRaw.empty())
 	{
 		_imageRaw = *imageRaw;
+		_imageRawCache = cv::Ptr<ImageCache>(new ImageCache);
 		//backward compatibility, set image size in camera model if not set
 		if(!_imageRaw.empty() && _cameraModels.size())
 		{
@@ -626,6 +650,7 @@ void SensorData::uncompressData(
 	if(depthRaw && !depthRaw->empty() && _depthOrRightRaw.empty())
 	{
 		_depthOrRightRaw = *depthRaw;
+		_depthOrRightRawCache = cv::Ptr<ImageCache>(new ImageCache);
 	}
 	if(laserScanRaw && !laserScanRaw->isEmpty() && _laserScanRaw.isEmpty())
 	{
@@ -698,13 +723,13 @@ void SensorData::uncompressDataConst(
 		(obstacleCellsRaw && obstacleCellsRaw->empty()) ||
 		(emptyCellsRaw && emptyCellsRaw->empty()))
 	{
-		rtabmap::CompressionThread ctImage(_imageCompressed, true);
-		rtabmap::CompressionThread ctDepth(_depthOrRightCompressed, true);
-		rtabmap::CompressionThread ctLaserScan(_laserScanCompressed.data(), false);
-		rtabmap::CompressionThread ctUserData(_userDataCompressed, false);
-		rtabmap::CompressionThread ctGroundCells(_groundCellsCompressed, false);
-		rtabmap::CompressionThread ctObstacleCells(_obstacleCellsCompressed, false);
-		rtabmap::CompressionThread ctEmptyCells(_emptyCellsCompressed, false);
+		rtabmap::CompressionJob ctImage(_imageCompressed, true);
+		rtabmap::CompressionJob ctDepth(_depthOrRightCompressed, true);
+		rtabmap::CompressionJob ctLaserScan(_laserScanCompressed.data(), false);
+		rtabmap::CompressionJob ctUserData(_userDataCompressed, false);
+		rtabmap::CompressionJob ctGroundCells(_groundCellsCompressed, false);
+		rtabmap::CompressionJob ctObstacleCells(_obstacleCellsCompressed, false);
+		rtabmap::CompressionJob ctEmptyCells(_emptyCellsCompressed, false);
 		if(imageRaw && imageRaw->empty() && !_imageCompressed.empty())
 		{
 			UASSERT(_imageCompressed.type() == CV_8UC1);
@@ -825,6 +850,154 @@ void SensorData::uncompressDataConst(
 	}
 }
 
+static bool isSameImage(const cv::Mat & a, const cv::Mat & b)
+{
+	return a.data == b.data && a.size() == b.size() && a.type() == b.type() && a.step[0] == b.step[0];
+}
+
+void SensorData::setImageRaw(const cv::Mat & imageRaw)
+{
+	if(!isSameImage(imageRaw, _imageRaw))
+	{
+		// Reuse the derived images if imageRaw comes from imageRawDecimated()
+		cv::Ptr<ImageCache> cache = _imageRawCache->cacheOf(imageRaw);
+		_imageRawCache = cache.empty()?cv::Ptr<ImageCache>(new ImageCache):cache;
+	}
+	_imageRaw = imageRaw;
+}
+
+void SensorData::setDepthOrRightRaw(const cv::Mat & depthOrImageRaw)
+{
+	if(!isSameImage(depthOrImageRaw, _depthOrRightRaw))
+	{
+		// Reuse the derived images if depthOrImageRaw comes from depthOrRightRawDecimated()
+		cv::Ptr<ImageCache> cache = _depthOrRightRawCache->cacheOf(depthOrImageRaw);
+		_depthOrRightRawCache = cache.empty()?cv::Ptr<ImageCache>(new ImageCache):cache;
+	}
+	_depthOrRightRaw = depthOrImageRaw;
+}
+
+cv::Mat SensorData::imageRawGray() const
+{
+	return _imageRawCache->gray(_imageRaw);
+}
+
+cv::Mat SensorData::imageRawDecimated(int decimation) const
+{
+	return _imageRawCache->decimated(_imageRaw, decimation);
+}
+
+cv::Mat SensorData::depthOrRightRawDecimated(int decimation) const
+{
+	return _depthOrRightRawCache->decimated(_depthOrRightRaw, decimation);
+}
+
+std::vector<cv::Mat> SensorData::imageRawPyramid(const cv::Size & winSize, int maxLevel) const
+{
+	return _imageRawCache->pyramid(_imageRaw, winSize, maxLevel, true);
+}
+
+std::vector<cv::Mat> SensorData::rightRawPyramid(const cv::Size & winSize, int maxLevel) const
+{
+	return _depthOrRightRawCache->pyramid(rightRaw(), winSize, maxLevel, false);
+}
+
+void SensorData::clearImageCache()
+{
+	_imageRawCache = cv::Ptr<ImageCache>(new ImageCache);
+	_depthOrRightRawCache = cv::Ptr<ImageCache>(new ImageCache);
+}
+
+void SensorData::clearImagePyramids()
+{
+	_imageRawCache = _imageRawCache->withoutPyramids();
+	_depthOrRightRawCache = _depthOrRightRawCache->withoutPyramids();
+}
+
+cv::Mat SensorData::ImageCache::gray(const cv::Mat & image)
+{
+	if(image.empty() || image.channels() == 1)
+	{
+		return image;
+	}
+	UScopeMutex lock(mutex_);
+	if(gray_.empty())
+	{
+		UASSERT_MSG(image.type() == CV_8UC3 || image.type() == CV_8UC4, uFormat("type=%d", image.type()).c_str());
+		cv::cvtColor(image, gray_, image.type() == CV_8UC4?CV_BGRA2GRAY:CV_BGR2GRAY);
+	}
+	return gray_;
+}
+
+cv::Mat SensorData::ImageCache::decimated(const cv::Mat & image, int decimation)
+{
+	if(image.empty() || decimation <= 1)
+	{
+		return image;
+	}
+	UScopeMutex lock(mutex_);
+	std::map<int, std::pair<cv::Mat, cv::Ptr<ImageCache> > >::iterator iter = decimated_.find(decimation);
+	if(iter == decimated_.end())
+	{
+		iter = decimated_.insert(std::make_pair(decimation, std::make_pair(
+				util2d::decimate(image, decimation),
+				cv::Ptr<ImageCache>(new ImageCache)))).first;
+	}
+	return iter->second.first;
+}
+
+std::vector<cv::Mat> SensorData::ImageCache::pyramid(const cv::Mat & image, const cv::Size & winSize, int maxLevel, bool withDerivatives)
+{
+	if(image.empty())
+	{
+		return std::vector<cv::Mat>();
+	}
+	UScopeMutex lock(mutex_);
+	// A pyramid with larger borders, more levels or with derivatives can be used instead
+	for(unsigned int i=0; i<pyramids_.size(); ++i)
+	{
+		if(pyramids_[i].winSize.width >= winSize.width &&
+		   pyramids_[i].winSize.height >= winSize.height &&
+		   pyramids_[i].maxLevel >= maxLevel &&
+		   (pyramids_[i].withDerivatives || !withDerivatives))
+		{
+			return pyramids_[i].levels;
+		}
+	}
+	Pyramid pyramid;
+	pyramid.winSize = winSize;
+	pyramid.maxLevel = maxLevel;
+	pyramid.withDerivatives = withDerivatives;
+	cv::buildOpticalFlowPyramid(gray(image), pyramid.levels, winSize, maxLevel, withDerivatives);
+	pyramids_.push_back(pyramid);
+	return pyramid.levels;
+}
+
+cv::Ptr<SensorData::ImageCache> SensorData::ImageCache::cacheOf(const cv::Mat & image)
+{
+	UScopeMutex lock(mutex_);
+	for(std::map<int, std::pair<cv::Mat, cv::Ptr<ImageCache> > >::iterator iter=decimated_.begin(); iter!=decimated_.end(); ++iter)
+	{
+		if(!image.empty() && isSameImage(image, iter->second.first))
+		{
+			return iter->second.second;
+		}
+	}
+	return cv::Ptr<ImageCache>();
+}
+
+cv::Ptr<SensorData::ImageCache> SensorData::ImageCache::withoutPyramids()
+{
+	UScopeMutex lock(mutex_);
+	cv::Ptr<ImageCache> cache(new ImageCache);
+	cache->gray_ = gray_;
+	for(std::map<int, std::pair<cv::Mat, cv::Ptr<ImageCache> > >::iterator iter=decimated_.begin(); iter!=decimated_.end(); ++iter)
+	{
+		cache->decimated_.insert(std::make_pair(iter->first, std::make_pair(iter->second.first, iter->second.second->withoutPyramids())));
+	}
+	return cache;
+}
+
 void SensorData::setFeatures(const std::vector<cv::KeyPoint> & keypoints, const std::vector<cv::Point3f> & keypoints3D, const cv::Mat & descriptors)
 {
 	UASSERT_MSG(keypoints3D.empty() || keypoints.size() == keypoints3D.size(), uFormat("keypoints=%d keypoints3D=%d", (int)keypoints.size(), (int)keypoints3D.size()).c_str());
@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/Memory.h"
 #include "rtabmap/core/Compression.h"
 #include <opencv2/highgui/highgui.hpp>
+#include <algorithm>
 
 #include <rtabmap/utilite/UtiLite.h>
 
@@ -180,95 +181,403 @@ void Signature::removeVirtualLinks()
 float Signature::compareTo(const Signature & s) const
 {
 	float similarity = 0.0f;
-	const std::multimap<int, cv::KeyPoint> & words = s.getWords();
 
 	if(!s.isBadSignature() && !this->isBadSignature())
 	{
-		std::list<std::pair<int, std::pair<cv::KeyPoint, cv::KeyPoint> > > pairs;
-		int totalWords = ((int)_words.size()-_invalidWordsCount)>((int)words.size()-s.getInvalidWordsCount())?((int)_words.size()-_invalidWordsCount):((int)words.size()-s.getInvalidWordsCount());
+		int totalWords = ((int)_wordsKpts.size()-_invalidWordsCount)>((int)s.getWordKeypoints().size()-s.getInvalidWordsCount())?((int)_wordsKpts.size()-_invalidWordsCount):((int)s.getWordKeypoints().size()-s.getInvalidWordsCount());
 		UASSERT(totalWords > 0);
-		EpipolarGeometry::findPairs(words, _words, pairs);
+		int pairs = EpipolarGeometry::countPairs(s.getWordIds(), _wordIds);
 
-		similarity = float(pairs.size()) / float(totalWords);
+		similarity = float(pairs) / float(totalWords);
 	}
 	return similarity;
 }
 
 void Signature::changeWordsRef(int oldWordId, int activeWordId)
 {
-	std::list<cv::KeyPoint> kps = uValues(_words, oldWordId);
-	if(kps.size())
+	std::map<int, int> refsToChange;
+	refsToChange.insert(std::make_pair(oldWordId, activeWordId));
+	changeWordsRef(refsToChange);
+}
+
+void Signature::changeWordsRef(const std::map<int, int> & refsToChange)
+{
+	bool changed = false;
+	for(unsigned int i=0; i<_wordIds.size(); ++i)
 	{
-		std::list<cv::Point3f> pts = uValues(_words3, oldWordId);
-		std::list<cv::Mat> descriptors = uValues(_wordsDescriptors, oldWordId);
-		if(oldWordId<=0)
+		std::map<int, int>::const_iterator iter = refsToChange.find(_wordIds[i]);
+		if(iter != refsToChange.end())
 		{
-			_invalidWordsCount-=(int)_words.erase(oldWordId);
-			UASSERT(_invalidWordsCount>=0);
-		}
-		else
-		{
-			_words.erase(oldWordId);
+			_wordsChanged.insert(*iter);
+			if(iter->first != iter->second)
+			{
+				_wordIds[i] = iter->second;
+				changed = true;
+			}
 		}
-		_words3.erase(oldWordId);
-		_wordsDescriptors.erase(oldWordId);
-		_wordsChanged.insert(std::make_pair(oldWordId, activeWordId));
-		for(std::list<cv::KeyPoint>::const_iterator iter=kps.begin(); iter!=kps.end(); ++iter)
+	}
+	if(changed)
+	{
+		sortWords();
+		updateInvalidWordsCount();
+		updateViews();
+	}
+}
+
+namespace {
+
+// Keys of the multimap are the same than the ids (with duplicates)
+template<typename V>
+bool hasSameIds(const std::multimap<int, V> & words, const std::vector<int> & ids)
+{
+	if(words.size() != ids.size())
+	{
+		return false;
+	}
+	int i=0;
+	for(typename std::multimap<int, V>::const_iterator iter=words.begin(); iter!=words.end(); ++iter)
+	{
+		if(iter->first != ids[i++])
 		{
-			_words.insert(std::pair<int, cv::KeyPoint>(activeWordId, (*iter)));
+			return false;
 		}
-		for(std::list<cv::Point3f>::const_iterator iter=pts.begin(); iter!=pts.end(); ++iter)
+	}
+	return true;
+}
+
+template<typename V>
+std::vector<int> multimapKeys(const std::multimap<int, V> & words)
+{
+	std::vector<int> ids(words.size());
+	int i=0;
+	for(typename std::multimap<int, V>::const_iterator iter=words.begin(); iter!=words.end(); ++iter)
+	{
+		ids[i++] = iter->first;
+	}
+	return ids;
+}
+
+template<typename V>
+std::vector<V> multimapValues(const std::multimap<int, V> & words)
+{
+	std::vector<V> v(words.size());
+	int i=0;
+	for(typename std::multimap<int, V>::const_iterator iter=words.begin(); iter!=words.end(); ++iter)
+	{
+		v[i++] = iter->second;
+	}
+	return v;
+}
+
+cv::Mat descriptorsMat(const std::multimap<int, cv::Mat> & descriptors)
+{
+	cv::Mat mat;
+	if(!descriptors.empty())
+	{
+		const cv::Mat & first = descriptors.begin()->second;
+		mat = cv::Mat((int)descriptors.size(), first.cols, first.type());
+		int i=0;
+		for(std::multimap<int, cv::Mat>::const_iterator iter=descriptors.begin(); iter!=descriptors.end(); ++iter)
 		{
-			_words3.insert(std::pair<int, cv::Point3f>(activeWordId, (*iter)));
+			UASSERT_MSG(iter->second.rows == 1 && iter->second.cols == mat.cols && iter->second.type() == mat.type(),
+					uFormat("Descriptor of word %d is %dx%d (type=%d), expected 1x%d (type=%d)",
+							iter->first, iter->second.rows, iter->second.cols, iter->second.type(), mat.cols, mat.type()).c_str());
+			iter->second.copyTo(mat.row(i++));
 		}
-		for(std::list<cv::Mat>::const_iterator iter=descriptors.begin(); iter!=descriptors.end(); ++iter)
+	}
+	return mat;
+}
+
+template<typename V>
+void fillView(std::multimap<int, V> & view, const std::vector<int> & ids, const std::vector<V> & v)
+{
+	view.clear();
+	for(unsigned int i=0; i<v.size(); ++i)
+	{
+		view.insert(view.end(), std::make_pair(ids[i], v[i]));
+	}
+}
+
+struct IdLess
+{
+	IdLess(const std::vector<int> & ids) : ids_(ids) {}
+	bool operator()(int a, int b) const {return ids_[a] < ids_[b];}
+	const std::vector<int> & ids_;
+};
+
+template<typename V>
+void permute(std::vector<V> & v, const std::vector<int> & order)
+{
+	if(!v.empty())
+	{
+		std::vector<V> sorted(v.size());
+		for(unsigned int i=0; i<order.size(); ++i)
 		{
-			_wordsDescriptors.insert(std::pair<int, cv::Mat>(activeWordId, (*iter)));
+			sorted[i] = v[order[i]];
 		}
+		v.swap(sorted);
 	}
 }
 
+} // namespace
+
 void Signature::setWords(const std::multimap<int, cv::KeyPoint> & words)
 {
 	_enabled = false;
-	_words = words;
+	if(!words.empty() && !hasSameIds(words, _wordIds))
+	{
+		resetWordIds(multimapKeys(words));
+	}
+	_wordsKpts = multimapValues(words);
+	clearWordIdsIfUnused();
+	updateInvalidWordsCount();
+	updateViews();
+}
+
+void Signature::setWords3(const std::multimap<int, cv::Point3f> & words3)
+{
+	if(!words3.empty() && !hasSameIds(words3, _wordIds))
+	{
+		resetWordIds(multimapKeys(words3));
+	}
+	_words3 = multimapValues(words3);
+	clearWordIdsIfUnused();
+	updateInvalidWordsCount();
+	updateViews();
+}
+
+void Signature::setWordsDescriptors(const std::multimap<int, cv::Mat> & descriptors)
+{
+	if(!descriptors.empty() && !hasSameIds(descriptors, _wordIds))
+	{
+		resetWordIds(multimapKeys(descriptors));
+	}
+	_wordsDescriptors = descriptorsMat(descriptors);
+	clearWordIdsIfUnused();
+	updateInvalidWordsCount();
+	updateViews();
+}
+
+void Signature::setWords(
+		const std::vector<int> & ids,
+		const std::vector<cv::KeyPoint> & keypoints,
+		const std::vector<cv::Point3f> & points,
+		const cv::Mat & descriptors)
+{
+	UASSERT(keypoints.empty() || keypoints.size() == ids.size());
+	UASSERT(points.empty() || points.size() == ids.size());
+	UASSERT(descriptors.empty() || descriptors.rows == (int)ids.size());
+	_enabled = false;
+	_wordIds = ids;
+	_wordsKpts = keypoints;
+	_words3 = points;
+	_wordsDescriptors = descriptors;
+	sortWords();
+	clearWordIdsIfUnused();
+	updateInvalidWordsCount();
+	updateViews();
+}
+
+void Signature::swapWords(
+		std::multimap<int, cv::KeyPoint> & words,
+		std::multimap<int, cv::Point3f> & words3,
+		std::multimap<int, cv::Mat> & descriptors)
+{
+	std::multimap<int, cv::KeyPoint> previousWords;
+	std::multimap<int, cv::Point3f> previousWords3;
+	std::multimap<int, cv::Mat> previousDescriptors;
+	fillView(previousWords, _wordIds, _wordsKpts);
+	fillView(previousWords3, _wordIds, _words3);
+	for(int i=0; i<_wordsDescriptors.rows; ++i)
+	{
+		previousDescriptors.insert(previousDescriptors.end(), std::make_pair(_wordIds[i], _wordsDescriptors.row(i)));
+	}
+	setWords(words);
+	setWords3(words3);
+	setWordsDescriptors(descriptors);
+	words.swap(previousWords);
+	words3.swap(previousWords3);
+	descriptors.swap(previousDescriptors);
+}
+
+// Ids of a component set with different ids than the current ones, the
+// other components don't match anymore and are cleared
+void Signature::resetWordIds(const std::vector<int> & ids)
+{
+	_wordIds = ids;
+	_wordsKpts.clear();
+	_words3.clear();
+	_wordsDescriptors = cv::Mat();
+}
+
+void Signature::clearWordIdsIfUnused()
+{
+	if(_wordsKpts.empty() && _words3.empty() && _wordsDescriptors.empty())
+	{
+		_wordIds.clear();
+	}
+}
+
+// Sort the words by id, keeping the order of the duplicated ids
+void Signature::sortWords()
+{
+	bool sorted = true;
+	for(unsigned int i=1; i<_wordIds.size() && sorted; ++i)
+	{
+		sorted = _wordIds[i-1] <= _wordIds[i];
+	}
+	if(sorted)
+	{
+		return;
+	}
+
+	std::vector<int> order(_wordIds.size());
+	for(unsigned int i=0; i<order.size(); ++i)
+	{
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), IdLess(_wordIds));
+
+	permute(_wordIds, order);
+	permute(_wordsKpts, order);
+	permute(_words3, order);
+	if(!_wordsDescriptors.empty())
+	{
+		cv::Mat sortedDescriptors(_wordsDescriptors.size(), _wordsDescriptors.type());
+		for(unsigned int i=0; i<order.size(); ++i)
+		{
+			_wordsDescriptors.row(order[i]).copyTo(sortedDescriptors.row(i));
+		}
+		_wordsDescriptors = sortedDescriptors;
+	}
+}
+
+void Signature::updateInvalidWordsCount()
+{
 	_invalidWordsCount = 0;
-	for(std::multimap<int, cv::KeyPoint>::iterator iter=_words.begin(); iter!=_words.end(); ++iter)
+	if(!_wordsKpts.empty())
 	{
-		if(iter->first>0)
+		for(unsigned int i=0; i<_wordIds.size() && _wordIds[i]<=0; ++i)
 		{
-			break;
+			++_invalidWordsCount;
+		}
+	}
+}
+
+// Rebuild the multimaps already returned by the compatibility
+// accessors, references on them stay valid
+void Signature::updateViews()
+{
+	if(_wordsView.valid)
+	{
+		_wordsView.valid = false;
+		buildWordsView();
+	}
+	if(_words3View.valid)
+	{
+		_words3View.valid = false;
+		buildWords3View();
+	}
+	if(_wordsDescriptorsView.valid)
+	{
+		_wordsDescriptorsView.valid = false;
+		buildWordsDescriptorsView();
+	}
+}
+
+void Signature::buildWordsView() const
+{
+	#pragma omp critical(rtabmap_signature_view)
+	{
+		if(!_wordsView.valid)
+		{
+			fillView(_wordsView.map, _wordIds, _wordsKpts);
+			#pragma omp flush
+			_wordsView.valid = true;
+		}
+	}
+}
+
+void Signature::buildWords3View() const
+{
+	#pragma omp critical(rtabmap_signature_view)
+	{
+		if(!_words3View.valid)
+		{
+			fillView(_words3View.map, _wordIds, _words3);
+			#pragma omp flush
+			_words3View.valid = true;
+		}
+	}
+}
+
+void Signature::buildWordsDescriptorsView() const
+{
+	#pragma omp critical(rtabmap_signature_view)
+	{
+		if(!_wordsDescriptorsView.valid)
+		{
+			// rows share the data of the descriptors matrix
+			_wordsDescriptorsView.map.clear();
+			for(int i=0; i<_wordsDescriptors.rows; ++i)
+			{
+				_wordsDescriptorsView.map.insert(_wordsDescriptorsView.map.end(), std::make_pair(_wordIds[i], _wordsDescriptors.row(i)));
+			}
+			#pragma omp flush
+			_wordsDescriptorsView.valid = true;
 		}
-		++_invalidWordsCount;
 	}
 }
 
 bool Signature::isBadSignature() const
 {
-	return _words.size()-_invalidWordsCount <= 0;
+	return _wordsKpts.size()-_invalidWordsCount <= 0;
 }
 
 void Signature::removeAllWords()
 {
-	_words.clear();
+	_wordIds.clear();
+	_wordsKpts.clear();
 	_words3.clear();
-	_wordsDescriptors.clear();
+	_wordsDescriptors = cv::Mat();
 	_invalidWordsCount = 0;
+	updateViews();
 }
 
 void Signature::removeWord(int wordId)
 {
-	if(wordId<=0)
+	std::pair<std::vector<int>::iterator, std::vector<int>::iterator> range = std::equal_range(_wordIds.begin(), _wordIds.end(), wordId);
+	int first = int(range.first - _wordIds.begin());
+	int last = int(range.second - _wordIds.begin());
+	if(first == last)
 	{
-		_invalidWordsCount-=(int)_words.erase(wordId);
-		UASSERT(_invalidWordsCount>=0);
+		return;
 	}
-	else
+	_wordIds.erase(_wordIds.begin()+first, _wordIds.begin()+last);
+	if(!_wordsKpts.empty())
 	{
-		_words.erase(wordId);
+		_wordsKpts.erase(_wordsKpts.begin()+first, _wordsKpts.begin()+last);
 	}
-	_words3.erase(wordId);
-	_wordsDescriptors.clear();
+	if(!_words3.empty())
+	{
+		_words3.erase(_words3.begin()+first, _words3.begin()+last);
+	}
+	if(!_wordsDescriptors.empty())
+	{
+		cv::Mat descriptors(_wordsDescriptors.rows-(last-first), _wordsDescriptors.cols, _wordsDescriptors.type());
+		if(first > 0)
+		{
+			_wordsDescriptors.rowRange(0, first).copyTo(descriptors.rowRange(0, first));
+		}
+		if(last < _wordsDescriptors.rows)
+		{
+			_wordsDescriptors.rowRange(last, _wordsDescriptors.rows).copyTo(descriptors.rowRange(first, descriptors.rows));
+		}
+		_wordsDescriptors = descriptors;
+	}
+	clearWordIdsIfUnused();
+	updateInvalidWordsCount();
+	updateViews();
 }
 
 cv::Mat Signature::getPoseCovariance() const
@@ -294,13 +603,10 @@ cv::Mat Signature::getPoseCovariance() const
 
 long Signature::getMemoryUsed(bool withSensorData) const // Return memory usage in Bytes
 {
-	long total =  _words.size() * sizeof(float) * 8 +
-				  _words3.size() * sizeof(float) * 4;
-	if(!_wordsDescriptors.empty())
-	{
-		total += _wordsDescriptors.size() * sizeof(int);
-		total += _wordsDescriptors.size() * _wordsDescriptors.begin()->second.total() * _wordsDescriptors.begin()->second.elemSize();
-	}
+	long total =  _wordIds.size() * sizeof(int) +
+				  _wordsKpts.size() * sizeof(cv::KeyPoint) +
+				  _words3.size() * sizeof(cv::Point3f) +
+				  _wordsDescriptors.total() * _wordsDescriptors.elemSize();
 	if(withSensorData)
 	{
 		total+=_sensorData.getMemoryUsed();
@@ -26,6 +26,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <rtabmap/core/Stereo.h>
+#include <rtabmap/core/SensorData.h>
 #include <rtabmap/core/util2d.h>
 #include <rtabmap/utilite/ULogger.h>
 #include <opencv2/video/tracking.hpp>
@@ -106,11 +107,40 @@ void StereoOpticalFlow::parseParameters(const ParametersMap & parameters)
 }
 
 
+std::vector<cv::Point2f> Stereo::computeCorrespondences(
+		const SensorData & data,
+		const std::vector<cv::Point2f> & leftCorners,
+		std::vector<unsigned char> & status) const
+{
+	return computeCorrespondences(data.imageRawGray(), data.rightRaw(), leftCorners, status);
+}
+
 std::vector<cv::Point2f> StereoOpticalFlow::computeCorrespondences(
 		const cv::Mat & leftImage,
 		const cv::Mat & rightImage,
 		const std::vector<cv::Point2f> & leftCorners,
 		std::vector<unsigned char> & status) const
+{
+	return computeCorrespondencesImpl(leftImage, rightImage, leftCorners, status);
+}
+
+std::vector<cv::Point2f> StereoOpticalFlow::computeCorrespondences(
+		const SensorData & data,
+		const std::vector<cv::Point2f> & leftCorners,
+		std::vector<unsigned char> & status) const
+{
+	return computeCorrespondencesImpl(
+			data.imageRawPyramid(this->winSize(), this->maxLevel()),
+			data.rightRawPyramid(this->winSize(), this->maxLevel()),
+			leftCorners,
+			status);
+}
+
+std::vector<cv::Point2f> StereoOpticalFlow::computeCorrespondencesImpl(
+		cv::InputArray leftImage,
+		cv::InputArray rightImage,
+		const std::vector<cv::Point2f> & leftCorners,
+		std::vector<unsigned char> & status) const
 {
 	std::vector<cv::Point2f> rightCorners;
 	UDEBUG("util2d::calcOpticalFlowPyrLKStereo() begin");
@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/DBDriver.h"
 #include "rtabmap/core/Parameters.h"
 #include "rtabmap/core/FlannIndex.h"
+#include "rtabmap/core/HammingMatcher.h"
 
 #include "rtabmap/utilite/UtiLite.h"
 
@@ -50,6 +51,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <fstream>
 #include <string>
+#include <algorithm>
 
 #define KDTREE_SIZE 4
 #define KNN_CHECKS 32
@@ -60,17 +62,99 @@ namespace rtabmap
 const int VWDictionary::ID_START = 1;
 const int VWDictionary::ID_INVALID = 0;
 
+// Build the FLANN index from a snapshot of the descriptors. The snapshot
+// only shares the word descriptors (the data is not copied on the calling
+// thread), the data matrix is created here.
+class FlannIndexThread : public UThread
+{
+public:
+	FlannIndexThread(const std::vector<cv::Mat> & descriptors, const std::vector<int> & ids, int type, VWDictionary::NNStrategy strategy, bool useDistanceL1, bool serializable) :
+		_descriptors(descriptors),
+		_ids(ids),
+		_type(type),
+		_strategy(strategy),
+		_useDistanceL1(useDistanceL1),
+		_index(new FlannIndex())
+	{
+		UASSERT(_descriptors.size() == _ids.size() && _descriptors.size());
+		_index->setSerializable(serializable);
+	}
+	virtual ~FlannIndexThread()
+	{
+		delete _index;
+	}
+	const cv::Mat & data() const {return _data;}
+	const std::map<int, int> & mapIndexId() const {return _mapIndexId;}
+	FlannIndex * takeIndex() {FlannIndex * index = _index; _index = 0; return index;}
+
+private:
+	void mainLoop()
+	{
+		UTimer timer;
+		_data = cv::Mat((int)_descriptors.size(), _descriptors[0].cols, _type);
+		for(int i=0; i<_data.rows; ++i)
+		{
+			if(_descriptors[i].type() != _type)
+			{
+				_descriptors[i].convertTo(_data.row(i), _type);
+			}
+			else
+			{
+				_descriptors[i].copyTo(_data.row(i));
+			}
+			_mapIndexId.insert(_mapIndexId.end(), std::make_pair(i, _ids[i]));
+		}
+		_descriptors.clear();
+		_ids.clear();
+
+		// Rebalancing is done by the dictionary with another background
+		// rebuild, so it is disabled in the index (factor=0).
+		switch(_strategy)
+		{
+		case VWDictionary::kNNFlannNaive:
+			_index->buildLinearIndex(_data, _useDistanceL1, 0.0f);
+			break;
+		case VWDictionary::kNNFlannKdTree:
+			_index->buildKDTreeIndex(_data, KDTREE_SIZE, _useDistanceL1, 0.0f);
+			break;
+		case VWDictionary::kNNFlannLSH:
+			_index->buildLSHIndex(_data, 12, 20, 2, 0.0f);
+			break;
+		default:
+			UFATAL("Not supposed to be here!");
+			break;
+		}
+		UDEBUG("Time to create FLANN index in background (%d words) = %f s", _data.rows, timer.ticks());
+		this->kill();
+	}
+
+private:
+	std::vector<cv::Mat> _descriptors;
+	std::vector<int> _ids;
+	int _type;
+	cv::Mat _data;
+	std::map<int, int> _mapIndexId;
+	VWDictionary::NNStrategy _strategy;
+	bool _useDistanceL1;
+	FlannIndex * _index;
+};
+
 VWDictionary::VWDictionary(const ParametersMap & parameters) :
 	_totalActiveReferences(0),
 	_incrementalDictionary(Parameters::defaultKpIncrementalDictionary()),
 	_incrementalFlann(Parameters::defaultKpIncrementalFlann()),
 	_rebalancingFactor(Parameters::defaultKpFlannRebalancingFactor()),
+	_backgroundRebuild(Parameters::defaultKpFlannBackgroundRebuild()),
+	_indexSerializable(false),
 	_nndrRatio(Parameters::defaultKpNndrRatio()),
 	_dictionaryPath(Parameters::defaultKpDictionaryPath()),
 	_newWordsComparedTogether(Parameters::defaultKpNewWordsComparedTogether()),
 	_lastWordId(0),
 	useDistanceL1_(false),
 	_flannIndex(new FlannIndex()),
+	_flannIndexThread(0),
+	_indexSizeAtBuild(0),
+	_indexAddedSinceBuild(0),
 	_strategy(kNNBruteForce)
 {
 	this->setNNStrategy((NNStrategy)Parameters::defaultKpNNStrategy());
@@ -90,6 +174,7 @@ void VWDictionary::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(parameters, Parameters::kKpNewWordsComparedTogether(), _newWordsComparedTogether);
 	Parameters::parse(parameters, Parameters::kKpIncrementalFlann(), _incrementalFlann);
 	Parameters::parse(parameters, Parameters::kKpFlannRebalancingFactor(), _rebalancingFactor);
+	Parameters::parse(parameters, Parameters::kKpFlannBackgroundRebuild(), _backgroundRebuild);
 
 	UASSERT_MSG(_nndrRatio > 0.0f, uFormat("String=%s value=%f", uContains(parameters, Parameters::kKpNndrRatio())?parameters.at(Parameters::kKpNndrRatio()).c_str():"", _nndrRatio).c_str());
 
@@ -311,10 +396,16 @@ void VWDictionary::setNNStrategy(NNStrategy strategy)
 #endif
 #endif
 
+		if(strategy == kNNBruteForceHamming)
+		{
+			UDEBUG("Hamming brute force implementation: %s", HammingMatcher::implementationName().c_str());
+		}
+
 		bool update = _strategy != strategy;
 		_strategy = strategy;
 		if(update)
 		{
+			this->releaseBackgroundRebuild();
 			_dataTree = cv::Mat();
 			_notIndexedWords = uKeysSet(_visualWords);
 			_removedIndexedWords.clear();
@@ -356,6 +447,15 @@ void VWDictionary::update()
 		return;
 	}
 
+	if(_backgroundRebuild && _incrementalDictionary && _strategy < kNNBruteForce)
+	{
+		this->updateInBackground();
+		return;
+	}
+	// Background rebuild has been disabled, the words not in
+	// the current index are still in _notIndexedWords and _removedIndexedWords
+	this->releaseBackgroundRebuild();
+
 	if(_notIndexedWords.size() || _visualWords.size() == 0 || _removedIndexedWords.size())
 	{
 		if(_incrementalFlann &&
@@ -558,6 +658,315 @@ void VWDictionary::update()
 	UDEBUG("");
 }
 
+// With background rebuild, the index is updated incrementally (words added
+// and removed without rebuilding it). When it has grown by the rebalancing
+// factor since it was built, a new index is built in background from a
+// snapshot of the dictionary and swapped in on a next update. Until then,
+// the previous index is still updated incrementally and the words not yet
+// in an index are searched by brute force.
+void VWDictionary::updateInBackground()
+{
+	if(_flannIndexThread && _flannIndexThread->isKilled())
+	{
+		// The new index is ready, swap it with the current one
+		UTimer timer;
+		_flannIndexThread->join();
+		delete _flannIndex;
+		_flannIndex = _flannIndexThread->takeIndex();
+		_dataTree = _flannIndexThread->data();
+		_mapIndexId = _flannIndexThread->mapIndexId();
+		_mapIdIndex.clear();
+		for(std::map<int, int>::iterator iter=_mapIndexId.begin(); iter!=_mapIndexId.end(); ++iter)
+		{
+			_mapIdIndex.insert(_mapIdIndex.end(), std::make_pair(iter->second, iter->first));
+		}
+		_indexSizeAtBuild = (unsigned int)_mapIndexId.size();
+		_indexAddedSinceBuild = 0;
+		delete _flannIndexThread;
+		_flannIndexThread = 0;
+
+		// Only the changes done since the snapshot have to be applied to the
+		// new index: words removed since are still indexed, words added
+		// since (in the previous index or not) are not indexed.
+		std::set<int> removedIndexedWords;
+		_removedDuringRebuild.insert(_removedDuringRebuild.end(), _removedIndexedWords.begin(), _removedIndexedWords.end());
+		for(unsigned int i=0; i<_removedDuringRebuild.size(); ++i)
+		{
+			if(_mapIdIndex.find(_removedDuringRebuild[i]) != _mapIdIndex.end())
+			{
+				removedIndexedWords.insert(_removedDuringRebuild[i]);
+			}
+		}
+		std::set<int> notIndexedWords;
+		_addedDuringRebuild.insert(_addedDuringRebuild.end(), _notIndexedWords.begin(), _notIndexedWords.end());
+		for(unsigned int i=0; i<_addedDuringRebuild.size(); ++i)
+		{
+			int id = _addedDuringRebuild[i];
+			if(_visualWords.find(id) != _visualWords.end() &&
+			   (_mapIdIndex.find(id) == _mapIdIndex.end() || removedIndexedWords.find(id) != removedIndexedWords.end()))
+			{
+				notIndexedWords.insert(id);
+			}
+		}
+		_removedIndexedWords = removedIndexedWords;
+		_notIndexedWords = notIndexedWords;
+		_addedDuringRebuild.clear();
+		_removedDuringRebuild.clear();
+		UDEBUG("Swapped FLANN index (size=%d, not indexed=%d, removed=%d) time=%fs",
+				(int)_mapIndexId.size(), (int)_notIndexedWords.size(), (int)_removedIndexedWords.size(), timer.ticks());
+	}
+
+	if(_visualWords.empty() && _flannIndexThread == 0)
+	{
+		_mapIndexId.clear();
+		_mapIdIndex.clear();
+		_dataTree = cv::Mat();
+		_flannIndex->release();
+		_notIndexedWords.clear();
+		_removedIndexedWords.clear();
+		_indexSizeAtBuild = 0;
+		_indexAddedSinceBuild = 0;
+		return;
+	}
+
+	if(_flannIndex->isBuilt() && (_notIndexedWords.size() || _removedIndexedWords.size()))
+	{
+		UTimer timer;
+		for(std::set<int>::iterator iter=_removedIndexedWords.begin(); iter!=_removedIndexedWords.end(); ++iter)
+		{
+			UASSERT(uContains(_mapIdIndex, *iter));
+			_flannIndex->removePoint(_mapIdIndex.at(*iter));
+			_mapIndexId.erase(_mapIdIndex.at(*iter));
+			_mapIdIndex.erase(*iter);
+		}
+
+		if(_notIndexedWords.size())
+		{
+			// all new words are added at once
+			cv::Mat descriptors((int)_notIndexedWords.size(), _flannIndex->featuresDim(), _flannIndex->featuresType());
+			int row = 0;
+			for(std::set<int>::iterator iter=_notIndexedWords.begin(); iter!=_notIndexedWords.end(); ++iter, ++row)
+			{
+				const cv::Mat & descriptor = _visualWords.at(*iter)->getDescriptor();
+				UASSERT(descriptor.cols == descriptors.cols);
+				if(descriptor.type() != descriptors.type())
+				{
+					descriptor.convertTo(descriptors.row(row), descriptors.type());
+				}
+				else
+				{
+					descriptor.copyTo(descriptors.row(row));
+				}
+			}
+			int index = _flannIndex->addPoints(descriptors);
+			for(std::set<int>::iterator iter=_notIndexedWords.begin(); iter!=_notIndexedWords.end(); ++iter, ++index)
+			{
+				_mapIndexId.insert(_mapIndexId.end(), std::make_pair(index, *iter));
+				std::pair<std::map<int, int>::iterator, bool> inserted = _mapIdIndex.insert(std::make_pair(*iter, index));
+				UASSERT(inserted.second);
+			}
+			_indexAddedSinceBuild += descriptors.rows;
+		}
+
+		if(_flannIndexThread)
+		{
+			// these words are not in the snapshot of the index being built
+			_addedDuringRebuild.insert(_addedDuringRebuild.end(), _notIndexedWords.begin(), _notIndexedWords.end());
+		}
+		UDEBUG("Incremental FLANN: added %d words, removed %d words (size=%d) time=%fs",
+				(int)_notIndexedWords.size(), (int)_removedIndexedWords.size(), (int)_mapIndexId.size(), timer.ticks());
+		_notIndexedWords.clear();
+		_removedIndexedWords.clear();
+	}
+
+	if(_flannIndexThread == 0 &&
+	   (!_flannIndex->isBuilt() ||
+		(_rebalancingFactor > 1.0f && float(_indexSizeAtBuild + _indexAddedSinceBuild) > float(_indexSizeAtBuild) * _rebalancingFactor)))
+	{
+		UTimer timer;
+		int type = _visualWords.begin()->second->getDescriptor().type();
+		if(type == CV_8U)
+		{
+			useDistanceL1_ = true;
+			if(_strategy == kNNFlannKdTree || _strategy == kNNFlannNaive)
+			{
+				type = CV_32F;
+			}
+		}
+		UASSERT(type == CV_32F || type == CV_8U);
+		UASSERT(_visualWords.begin()->second->getDescriptor().cols > 0);
+		UASSERT_MSG(_strategy != kNNFlannKdTree || type == CV_32F, "To use KdTree dictionary, float descriptors are required!");
+		UASSERT_MSG(_strategy != kNNFlannLSH || type == CV_8U, "To use LSH dictionary, binary descriptors are required!");
+
+		// Only the descriptor headers are copied here: the descriptors of the
+		// words are never modified, they stay valid in the thread even if the
+		// words are deleted while the index is built.
+		std::vector<cv::Mat> descriptors(_visualWords.size());
+		std::vector<int> ids(_visualWords.size());
+		std::map<int, VisualWord*>::const_iterator iter = _visualWords.begin();
+		for(unsigned int i=0; i < descriptors.size(); ++i, ++iter)
+		{
+			descriptors[i] = iter->second->getDescriptor();
+			ids[i] = iter->first;
+		}
+
+		_flannIndexThread = new FlannIndexThread(descriptors, ids, type, _strategy, useDistanceL1_, _indexSerializable);
+		_flannIndexThread->start();
+		UDEBUG("Started FLANN index rebuild in background (%d words, indexed=%d, added since build=%d) time=%fs",
+				(int)descriptors.size(), (int)_indexSizeAtBuild, (int)_indexAddedSinceBuild, timer.ticks());
+	}
+}
+
+// FNV-1a hash of the word ids
+static unsigned long long hashWordIds(const std::map<int, VisualWord *> & words)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	for(std::map<int, VisualWord *>::const_iterator iter=words.begin(); iter!=words.end(); ++iter)
+	{
+		const unsigned char * bytes = (const unsigned char *)&iter->first;
+		for(unsigned int i=0; i<sizeof(int); ++i)
+		{
+			hash = (hash ^ bytes[i]) * 1099511628211ULL;
+		}
+	}
+	return hash;
+}
+
+#define INDEX_SERIALIZATION_VERSION 1
+
+void VWDictionary::setIndexSerializable(bool enabled)
+{
+	_indexSerializable = enabled;
+	_flannIndex->setSerializable(enabled);
+}
+
+cv::Mat VWDictionary::serializeIndex() const
+{
+	cv::Mat output;
+	if(_strategy >= kNNBruteForce ||
+	   !_flannIndex->isBuilt() ||
+	   _notIndexedWords.size() ||
+	   _removedIndexedWords.size() ||
+	   _mapIndexId.size() != _visualWords.size())
+	{
+		UDEBUG("Index doesn't contain all words of the dictionary (not indexed=%d removed=%d), it is not serialized.",
+				(int)_notIndexedWords.size(), (int)_removedIndexedWords.size());
+		return output;
+	}
+
+	UTimer timer;
+	cv::Mat flannData = _flannIndex->serialize();
+	if(flannData.empty())
+	{
+		return output;
+	}
+
+	// header: version, strategy, words, hash, then <index, id> pairs and the FLANN index
+	int header[3] = {INDEX_SERIALIZATION_VERSION, (int)_strategy, (int)_mapIndexId.size()};
+	unsigned long long hash = hashWordIds(_visualWords);
+	size_t mapSize = _mapIndexId.size()*2*sizeof(int);
+	output = cv::Mat(1, int(sizeof(header) + sizeof(hash) + mapSize + flannData.total()), CV_8UC1);
+	unsigned char * ptr = output.data;
+	memcpy(ptr, header, sizeof(header));
+	ptr += sizeof(header);
+	memcpy(ptr, &hash, sizeof(hash));
+	ptr += sizeof(hash);
+	for(std::map<int, int>::const_iterator iter=_mapIndexId.begin(); iter!=_mapIndexId.end(); ++iter)
+	{
+		int pair[2] = {iter->first, iter->second};
+		memcpy(ptr, pair, sizeof(pair));
+		ptr += sizeof(pair);
+	}
+	memcpy(ptr, flannData.data, flannData.total());
+	UDEBUG("Serialized index of %d words (%d bytes) in %fs", (int)_mapIndexId.size(), output.cols, timer.ticks());
+	return output;
+}
+
+bool VWDictionary::deserializeIndex(const cv::Mat & data)
+{
+	int header[3];
+	unsigned long long hash = 0;
+	if(data.empty() || data.total() < sizeof(header) + sizeof(hash))
+	{
+		return false;
+	}
+	UASSERT(data.type() == CV_8UC1 && data.isContinuous());
+	const unsigned char * ptr = data.data;
+	memcpy(header, ptr, sizeof(header));
+	ptr += sizeof(header);
+	memcpy(&hash, ptr, sizeof(hash));
+	ptr += sizeof(hash);
+
+	if(header[0] != INDEX_SERIALIZATION_VERSION ||
+	   header[1] != (int)_strategy ||
+	   header[2] != (int)_visualWords.size() ||
+	   hash != hashWordIds(_visualWords) ||
+	   data.total() < sizeof(header) + sizeof(hash) + header[2]*2*sizeof(int))
+	{
+		UINFO("Saved index doesn't match the dictionary (version=%d/%d strategy=%d/%d words=%d/%d), it will be rebuilt.",
+				header[0], INDEX_SERIALIZATION_VERSION, header[1], (int)_strategy, header[2], (int)_visualWords.size());
+		return false;
+	}
+
+	UTimer timer;
+	std::map<int, int> mapIndexId;
+	std::map<int, int> mapIdIndex;
+	for(int i=0; i<header[2]; ++i)
+	{
+		int pair[2];
+		memcpy(pair, ptr, sizeof(pair));
+		ptr += sizeof(pair);
+		mapIndexId.insert(mapIndexId.end(), std::make_pair(pair[0], pair[1]));
+		mapIdIndex.insert(std::make_pair(pair[1], pair[0]));
+	}
+
+	FlannIndex * index = new FlannIndex();
+	index->setSerializable(_indexSerializable);
+	const cv::Mat & descriptor = _visualWords.begin()->second->getDescriptor();
+	int type = descriptor.type()==CV_8U && (_strategy == kNNFlannKdTree || _strategy == kNNFlannNaive)?CV_32F:descriptor.type();
+	if(!index->deserialize(cv::Mat(1, int(data.total() - (ptr - data.data)), CV_8UC1, (void*)ptr)) ||
+	   index->featuresDim() != descriptor.cols ||
+	   index->featuresType() != type ||
+	   index->indexedFeatures() != mapIndexId.size())
+	{
+		UWARN("Failed to restore saved index, it will be rebuilt.");
+		delete index;
+		return false;
+	}
+
+	this->releaseBackgroundRebuild();
+	delete _flannIndex;
+	_flannIndex = index;
+	_dataTree = cv::Mat();
+	_mapIndexId = mapIndexId;
+	_mapIdIndex = mapIdIndex;
+	_indexSizeAtBuild = (unsigned int)_mapIndexId.size();
+	_indexAddedSinceBuild = 0;
+	_notIndexedWords.clear();
+	_removedIndexedWords.clear();
+	if(descriptor.type() == CV_8U)
+	{
+		useDistanceL1_ = true;
+	}
+	UINFO("Restored saved index of %d words in %fs", (int)_mapIndexId.size(), timer.ticks());
+	return true;
+}
+
+void VWDictionary::releaseBackgroundRebuild()
+{
+	if(_flannIndexThread)
+	{
+		// wait the thread, the index is dropped
+		_flannIndexThread->join();
+		delete _flannIndexThread;
+		_flannIndexThread = 0;
+	}
+	_addedDuringRebuild.clear();
+	_removedDuringRebuild.clear();
+	_notIndexedData = cv::Mat();
+	_notIndexedDataIds.clear();
+}
+
 void VWDictionary::clear(bool printWarningsIfNotEmpty)
 {
 	ULOGGER_DEBUG("");
@@ -576,6 +985,7 @@ void VWDictionary::clear(bool printWarningsIfNotEmpty)
 	{
 		delete (*i).second;
 	}
+	this->releaseBackgroundRebuild();
 	_visualWords.clear();
 	_notIndexedWords.clear();
 	_removedIndexedWords.clear();
@@ -585,7 +995,10 @@ void VWDictionary::clear(bool printWarningsIfNotEmpty)
 	_mapIndexId.clear();
 	_mapIdIndex.clear();
 	_unusedWords.clear();
+	_invertedIndex.clear();
 	_flannIndex->release();
+	_indexSizeAtBuild = 0;
+	_indexAddedSinceBuild = 0;
 	useDistanceL1_ = false;
 
 	if(!_incrementalDictionary)
@@ -608,6 +1021,7 @@ void VWDictionary::addWordRef(int wordId, int signatureId)
 	{
 		vw->addRef(signatureId);
 		_totalActiveReferences += 1;
+		this->addPosting(wordId, signatureId);
 
 		_unusedWords.erase(vw->id());
 	}
@@ -624,6 +1038,7 @@ void VWDictionary::removeAllWordRef(int wordId, int signatureId)
 	if(vw)
 	{
 		_totalActiveReferences -= vw->removeAllRef(signatureId);
+		this->removePostings(wordId, signatureId);
 		if(vw->getReferences().size() == 0)
 		{
 			_unusedWords.insert(std::pair<int, VisualWord*>(vw->id(), vw));
@@ -631,6 +1046,157 @@ void VWDictionary::removeAllWordRef(int wordId, int signatureId)
 	}
 }
 
+void VWDictionary::addPosting(int wordId, int signatureId)
+{
+	std::vector<std::pair<int, int> > & postings = _invertedIndex[wordId];
+	if(postings.empty() || postings.back().first < signatureId)
+	{
+		// most of the time, references are added for the most recent signature
+		postings.push_back(std::make_pair(signatureId, 1));
+	}
+	else
+	{
+		std::vector<std::pair<int, int> >::iterator iter = std::lower_bound(postings.begin(), postings.end(), std::make_pair(signatureId, 0));
+		if(iter != postings.end() && iter->first == signatureId)
+		{
+			++iter->second;
+		}
+		else
+		{
+			postings.insert(iter, std::make_pair(signatureId, 1));
+		}
+	}
+}
+
+void VWDictionary::removePostings(int wordId, int signatureId)
+{
+	std::map<int, std::vector<std::pair<int, int> > >::iterator iter = _invertedIndex.find(wordId);
+	if(iter != _invertedIndex.end())
+	{
+		std::vector<std::pair<int, int> >::iterator jter = std::lower_bound(iter->second.begin(), iter->second.end(), std::make_pair(signatureId, 0));
+		if(jter != iter->second.end() && jter->first == signatureId)
+		{
+			iter->second.erase(jter);
+		}
+		if(iter->second.empty())
+		{
+			_invertedIndex.erase(iter);
+		}
+	}
+}
+
+const std::vector<std::pair<int, int> > & VWDictionary::getPostings(int wordId) const
+{
+	static const std::vector<std::pair<int, int> > empty;
+	std::map<int, std::vector<std::pair<int, int> > >::const_iterator iter = _invertedIndex.find(wordId);
+	if(iter != _invertedIndex.end())
+	{
+		return iter->second;
+	}
+	return empty;
+}
+
+// First posting of the range covered by the sorted signature ids, so
+// that a block of ids only walks its own part of the posting list
+static std::vector<std::pair<int, int> >::const_iterator postingsBegin(
+		const std::vector<std::pair<int, int> > & postings,
+		const std::vector<int> & signatureIds)
+{
+	return std::lower_bound(postings.begin(), postings.end(), std::make_pair(signatureIds.front(), 0));
+}
+
+void VWDictionary::computeTfIdfScores(
+		const std::list<int> & wordIds,
+		const std::vector<int> & signatureIds,
+		const std::vector<float> & signatureWordsCount,
+		float totalSignatures,
+		std::vector<float> & scores) const
+{
+	UASSERT(signatureIds.size() == signatureWordsCount.size());
+	scores.resize(signatureIds.size(), 0.0f);
+	if(totalSignatures <= 0 || signatureIds.empty())
+	{
+		return;
+	}
+
+	float nwi; // nwi is the number of a specific word referenced by a place
+	float ni; // ni is the total of words referenced by a place
+	float nw; // nw is the number of places referenced by a specific word
+	float N = totalSignatures; // N is the total number of places
+	float logNnw;
+	for(std::list<int>::const_iterator iter=wordIds.begin(); iter!=wordIds.end(); ++iter)
+	{
+		if(*iter>0)
+		{
+			std::map<int, std::vector<std::pair<int, int> > >::const_iterator jter = _invertedIndex.find(*iter);
+			UASSERT_MSG(jter != _invertedIndex.end() || uContains(_visualWords, *iter), uFormat("Word %d not found in dictionary!?", *iter).c_str());
+			if(jter == _invertedIndex.end())
+			{
+				continue;
+			}
+			const std::vector<std::pair<int, int> > & postings = jter->second;
+			nw = postings.size();
+			logNnw = log10(N/nw);
+			if(logNnw)
+			{
+				// Both lists are sorted, search only in the remaining signatures
+				std::vector<int>::const_iterator begin = signatureIds.begin();
+				for(std::vector<std::pair<int, int> >::const_iterator kter=postingsBegin(postings, signatureIds);
+					kter!=postings.end() && kter->first <= signatureIds.back() && begin!=signatureIds.end();
+					++kter)
+				{
+					begin = std::lower_bound(begin, signatureIds.end(), kter->first);
+					if(begin != signatureIds.end() && *begin == kter->first)
+					{
+						int index = begin - signatureIds.begin();
+						nwi = kter->second;
+						ni = signatureWordsCount[index];
+						if(ni != 0)
+						{
+							scores[index] += ( nwi  * logNnw ) / ni;
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void VWDictionary::computeSharedWords(
+		const std::map<int, int> & wordsCount,
+		const std::vector<int> & signatureIds,
+		std::vector<int> & sharedWords) const
+{
+	sharedWords.resize(signatureIds.size(), 0);
+	if(signatureIds.empty())
+	{
+		return;
+	}
+	for(std::map<int, int>::const_iterator iter=wordsCount.begin(); iter!=wordsCount.end(); ++iter)
+	{
+		if(iter->first>0)
+		{
+			std::map<int, std::vector<std::pair<int, int> > >::const_iterator jter = _invertedIndex.find(iter->first);
+			if(jter != _invertedIndex.end())
+			{
+				const std::vector<std::pair<int, int> > & postings = jter->second;
+				std::vector<int>::const_iterator begin = signatureIds.begin();
+				for(std::vector<std::pair<int, int> >::const_iterator kter=postingsBegin(postings, signatureIds);
+					kter!=postings.end() && kter->first <= signatureIds.back() && begin!=signatureIds.end();
+					++kter)
+				{
+					begin = std::lower_bound(begin, signatureIds.end(), kter->first);
+					if(begin != signatureIds.end() && *begin == kter->first)
+					{
+						// same number of pairs than EpipolarGeometry::findPairs()
+						sharedWords[begin - signatureIds.begin()] += kter->second<iter->second?kter->second:iter->second;
+					}
+				}
+			}
+		}
+	}
+}
+
 std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 							   int signatureId)
 {
@@ -739,6 +1305,19 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 			cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
 			matcher.knnMatch(descriptors, _dataTree, matches, k);
 		}
+		else if(_strategy == kNNBruteForceHamming)
+		{
+			bruteForce = true;
+			if(descriptors.type()==CV_8U)
+			{
+				HammingMatcher::knnMatch(descriptors, _dataTree, matches, k);
+			}
+			else
+			{
+				cv::BFMatcher matcher(cv::NORM_L2SQR);
+				matcher.knnMatch(descriptors, _dataTree, matches, k);
+			}
+		}
 		else if(_strategy == kNNBruteForceGPU)
 		{
 			bruteForce = true;
@@ -795,6 +1374,25 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 		UDEBUG("Time to find nn = %f s", timerLocal.ticks());
 	}
 
+	// When the index is rebuilt in background, words added since the
+	// last swap are not in the index yet, search them by brute force.
+	std::vector<std::vector<cv::DMatch> > matchesNotIndexed;
+	if(_backgroundRebuild && _notIndexedWords.size())
+	{
+		updateNotIndexedData(descriptors.type(), descriptors.cols);
+		const cv::Mat & dataNotIndexed = _notIndexedData;
+		if(_strategy == kNNBruteForceHamming && descriptors.type()==CV_8U)
+		{
+			HammingMatcher::knnMatch(descriptors, dataNotIndexed, matchesNotIndexed, dataNotIndexed.rows>1?2:1);
+		}
+		else
+		{
+			cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:useDistanceL1_?cv::NORM_L1:cv::NORM_L2SQR);
+			matcher.knnMatch(descriptors, dataNotIndexed, matchesNotIndexed, dataNotIndexed.rows>1?2:1);
+		}
+		UDEBUG("Time to search %d not indexed words = %f s", dataNotIndexed.rows, timerLocal.ticks());
+	}
+
 	// Process results
 	for(int i = 0; i < descriptors.rows; ++i)
 	{
@@ -816,6 +1414,10 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 				int id = uValue(_mapIndexId, index);
 				if(d >= 0.0f && id != 0)
 				{
+					if(_removedIndexedWords.find(id) != _removedIndexedWords.end())
+					{
+						continue; // removed but still in the index
+					}
 					fullResults.insert(std::pair<float, int>(d, id));
 				}
 				else
@@ -841,13 +1443,37 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 			}
 		}
 
+		if(matchesNotIndexed.size())
+		{
+			for(unsigned int j=0; j<matchesNotIndexed.at(i).size(); ++j)
+			{
+				float d = matchesNotIndexed.at(i).at(j).distance;
+				int id = _notIndexedDataIds[matchesNotIndexed.at(i).at(j).trainIdx];
+				if(d >= 0.0f && id != 0)
+				{
+					fullResults.insert(std::pair<float, int>(d, id));
+				}
+				else
+				{
+					break;
+				}
+			}
+		}
+
 		// Check if this descriptor matches with a word from the last signature (a word not already added to the tree)
 		if(_newWordsComparedTogether && newWords.rows)
 		{
 			std::vector<std::vector<cv::DMatch> > matchesNewWords;
-			cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:useDistanceL1_?cv::NORM_L1:cv::NORM_L2SQR);
 			UASSERT(descriptors.cols == newWords.cols && descriptors.type() == newWords.type());
-			matcher.knnMatch(descriptors.row(i), newWords, matchesNewWords, newWords.rows>1?2:1);
+			if(_strategy == kNNBruteForceHamming && descriptors.type()==CV_8U)
+			{
+				HammingMatcher::knnMatch(descriptors.row(i), newWords, matchesNewWords, newWords.rows>1?2:1);
+			}
+			else
+			{
+				cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:useDistanceL1_?cv::NORM_L1:cv::NORM_L2SQR);
+				matcher.knnMatch(descriptors.row(i), newWords, matchesNewWords, newWords.rows>1?2:1);
+			}
 			UASSERT(matchesNewWords.size() == 1);
 			for(unsigned int j=0; j<matchesNewWords.at(0).size(); ++j)
 			{
@@ -892,6 +1518,10 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 				// use original descriptor
 				VisualWord * vw = new VisualWord(getNextId(), descriptorsIn.row(i), signatureId);
 				_visualWords.insert(_visualWords.end(), std::pair<int, VisualWord *>(vw->id(), vw));
+				if(signatureId)
+				{
+					this->addPosting(vw->id(), signatureId);
+				}
 				_notIndexedWords.insert(_notIndexedWords.end(), vw->id());
 				newWords.push_back(descriptors.row(i));
 				newWordsId.push_back(vw->id());
@@ -924,15 +1554,57 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 	}
 	ULOGGER_DEBUG("naive search and add ref/words time = %f s", timerLocal.ticks());
 
-	ULOGGER_DEBUG("%d new words added...", _notIndexedWords.size());
+	ULOGGER_DEBUG("%d new words added...", (int)newWordsId.size());
 	ULOGGER_DEBUG("%d duplicated words added (from current image = %d)...",
 			dupWordsCountFromDict+dupWordsCountFromLast, dupWordsCountFromLast);
 	UDEBUG("total time %fs", timer.ticks());
 
-	_totalActiveReferences += _notIndexedWords.size();
+	_totalActiveReferences += newWordsId.size();
 	return wordIds;
 }
 
+// Keep the descriptors of the not indexed words in sync with
+// _notIndexedWords. New words have the largest ids, so they are appended
+// at the end of the set: only their rows are copied. The matrix is
+// rebuilt when words are removed from the set (e.g., after a swap).
+void VWDictionary::updateNotIndexedData(int type, int cols)
+{
+	bool rebuild = _notIndexedData.type() != type ||
+				   _notIndexedData.cols != cols ||
+				   _notIndexedDataIds.size() > _notIndexedWords.size();
+	std::set<int>::iterator iter = _notIndexedWords.begin();
+	for(unsigned int i=0; !rebuild && i<_notIndexedDataIds.size(); ++i, ++iter)
+	{
+		rebuild = *iter != _notIndexedDataIds[i];
+	}
+	if(rebuild)
+	{
+		_notIndexedData = cv::Mat(0, cols, type);
+		_notIndexedDataIds.clear();
+		iter = _notIndexedWords.begin();
+	}
+	if(iter != _notIndexedWords.end())
+	{
+		cv::Mat rows(std::distance(iter, _notIndexedWords.end()), cols, type);
+		_notIndexedDataIds.reserve(_notIndexedWords.size());
+		for(int index=0; iter != _notIndexedWords.end(); ++iter, ++index)
+		{
+			const cv::Mat & descriptor = _visualWords.at(*iter)->getDescriptor();
+			UASSERT(descriptor.cols == cols);
+			if(descriptor.type() != type)
+			{
+				descriptor.convertTo(rows.row(index), type);
+			}
+			else
+			{
+				descriptor.copyTo(rows.row(index));
+			}
+			_notIndexedDataIds.push_back(*iter);
+		}
+		_notIndexedData.push_back(rows);
+	}
+}
+
 std::vector<int> VWDictionary::findNN(const std::list<VisualWord *> & vws) const
 {
 	UTimer timer;
@@ -1058,6 +1730,19 @@ std::vector<int> VWDictionary::findNN(const cv::Mat & queryIn) const
 				cv::BFMatcher matcher(query.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
 				matcher.knnMatch(query, _dataTree, matches, k);
 			}
+			else if(_strategy == kNNBruteForceHamming)
+			{
+				bruteForce = true;
+				if(query.type()==CV_8U)
+				{
+					HammingMatcher::knnMatch(query, _dataTree, matches, k);
+				}
+				else
+				{
+					cv::BFMatcher matcher(cv::NORM_L2SQR);
+					matcher.knnMatch(query, _dataTree, matches, k);
+				}
+			}
 			else if(_strategy == kNNBruteForceGPU)
 			{
 				bruteForce = true;
@@ -1148,8 +1833,15 @@ std::vector<int> VWDictionary::findNN(const cv::Mat & queryIn) const
 
 			// Find nearest neighbor
 			ULOGGER_DEBUG("Searching in words not indexed...");
-			cv::BFMatcher matcher(query.type()==CV_8U?cv::NORM_HAMMING:useDistanceL1_?cv::NORM_L1:cv::NORM_L2SQR);
-			matcher.knnMatch(query, dataNotIndexed, matchesNotIndexed, dataNotIndexed.rows>1?2:1);
+			if(_strategy == kNNBruteForceHamming && query.type()==CV_8U)
+			{
+				HammingMatcher::knnMatch(query, dataNotIndexed, matchesNotIndexed, dataNotIndexed.rows>1?2:1);
+			}
+			else
+			{
+				cv::BFMatcher matcher(query.type()==CV_8U?cv::NORM_HAMMING:useDistanceL1_?cv::NORM_L1:cv::NORM_L2SQR);
+				matcher.knnMatch(query, dataNotIndexed, matchesNotIndexed, dataNotIndexed.rows>1?2:1);
+			}
 		}
 		ULOGGER_DEBUG("Search not yet indexed words time = %fs", timer.ticks());
 
@@ -1172,7 +1864,7 @@ std::vector<int> VWDictionary::findNN(const cv::Mat & queryIn) const
 						index = *((size_t*)&results.at<int>(i, j));
 					}
 					int id = uValue(_mapIndexId, index);
-					if(d >= 0.0f && id != 0)
+					if(d >= 0.0f && id != 0 && _removedIndexedWords.find(id) == _removedIndexedWords.end())
 					{
 						fullResults.insert(std::pair<float, int>(d, id));
 					}
@@ -1257,6 +1949,9 @@ void VWDictionary::addWord(VisualWord * vw)
 		if(vw->getReferences().size())
 		{
 			_totalActiveReferences += uSum(uValues(vw->getReferences()));
+			std::vector<std::pair<int, int> > & postings = _invertedIndex[vw->id()];
+			postings.clear();
+			postings.insert(postings.end(), vw->getReferences().begin(), vw->getReferences().end());
 		}
 		else
 		{
@@ -1296,10 +1991,16 @@ void VWDictionary::removeWords(const std::vector<VisualWord*> & words)
 	{
 		_visualWords.erase(words[i]->id());
 		_unusedWords.erase(words[i]->id());
+		_invertedIndex.erase(words[i]->id());
 		if(_notIndexedWords.erase(words[i]->id()) == 0)
 		{
 			_removedIndexedWords.insert(words[i]->id());
 		}
+		if(_flannIndexThread)
+		{
+			// the word may be in the snapshot of the index being built
+			_removedDuringRebuild.push_back(words[i]->id());
+		}
 	}
 }
 
@@ -0,0 +1,402 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <rtabmap/core/VoxelHashMap.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UMath.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace rtabmap {
+
+VoxelHashMap::VoxelHashMap(float voxelSize, int capacity) :
+		voxelSize_(voxelSize),
+		capacity_(capacity),
+		size_(0),
+		stamp_(0)
+{
+	UASSERT(voxelSize_ > 0.0f);
+	UASSERT(capacity_ > 0);
+	// keep the load factor under 0.5 so that probing stays short
+	unsigned int tableSize = 1;
+	while(tableSize < (unsigned int)capacity_*2)
+	{
+		tableSize <<= 1;
+	}
+	table_.resize(tableSize);
+}
+
+void VoxelHashMap::clear()
+{
+	table_.assign(table_.size(), Voxel());
+	size_ = 0;
+	stamp_ = 0;
+}
+
+int VoxelHashMap::insert(const pcl::PointCloud<pcl::PointNormal> & cloud)
+{
+	++stamp_;
+	int added = 0;
+	for(unsigned int i=0; i<cloud.size() && size_ < capacity_; ++i)
+	{
+		const pcl::PointNormal & pt = cloud.at(i);
+		if(uIsFinite(pt.x) && uIsFinite(pt.y) && uIsFinite(pt.z) &&
+		   add(key(pt), pt, stamp_))
+		{
+			++added;
+		}
+	}
+	return added;
+}
+
+static bool inRange(const pcl::PointNormal & pt, const Eigen::Vector3f & center, float range)
+{
+	return range <= 0.0f ||
+		(pt.x-center[0])*(pt.x-center[0]) + (pt.y-center[1])*(pt.y-center[1]) + (pt.z-center[2])*(pt.z-center[2]) <= range*range;
+}
+
+int VoxelHashMap::evict(const Eigen::Vector3f & center, float range, const pcl::PointCloud<pcl::PointNormal> & incoming)
+{
+	// Voxels to remove are marked with stamp 0 (inserted voxels have a stamp >= 1)
+	int kept = 0;
+	for(unsigned int i=0; i<table_.size(); ++i)
+	{
+		if(table_[i].used)
+		{
+			if(inRange(table_[i].point, center, range))
+			{
+				++kept;
+			}
+			else
+			{
+				table_[i].stamp = 0;
+			}
+		}
+	}
+
+	// empty voxels (after the range filtering) that the incoming points would fill
+	incomingKeys_.clear();
+	for(unsigned int i=0; i<incoming.size(); ++i)
+	{
+		const pcl::PointNormal & pt = incoming.at(i);
+		if(uIsFinite(pt.x) && uIsFinite(pt.y) && uIsFinite(pt.z))
+		{
+			unsigned long long k = key(pt);
+			int j = find(k);
+			if(j < 0 || table_[j].stamp == 0)
+			{
+				incomingKeys_.push_back(k);
+			}
+		}
+	}
+	std::sort(incomingKeys_.begin(), incomingKeys_.end());
+	int reserve = int(std::unique(incomingKeys_.begin(), incomingKeys_.end()) - incomingKeys_.begin());
+
+	int maxKept = capacity_ - reserve;
+	if(maxKept < 0)
+	{
+		maxKept = 0;
+	}
+	if(kept > maxKept)
+	{
+		// keep the newest voxels, ties on the oldest stamp kept are removed in table order
+		unsigned int minStamp = 0;
+		int keptWithMinStamp = 0;
+		if(maxKept > 0)
+		{
+			stamps_.clear();
+			for(unsigned int i=0; i<table_.size(); ++i)
+			{
+				if(table_[i].used && table_[i].stamp > 0)
+				{
+					stamps_.push_back(table_[i].stamp);
+				}
+			}
+			std::nth_element(stamps_.begin(), stamps_.begin()+(maxKept-1), stamps_.end(), std::greater<unsigned int>());
+			minStamp = stamps_[maxKept-1];
+			keptWithMinStamp = maxKept;
+			for(unsigned int i=0; i<stamps_.size(); ++i)
+			{
+				if(stamps_[i] > minStamp)
+				{
+					--keptWithMinStamp;
+				}
+			}
+		}
+		for(unsigned int i=0; i<table_.size(); ++i)
+		{
+			if(table_[i].used && table_[i].stamp > 0)
+			{
+				if(table_[i].stamp < minStamp || maxKept == 0)
+				{
+					table_[i].stamp = 0;
+				}
+				else if(table_[i].stamp == minStamp)
+				{
+					if(keptWithMinStamp > 0)
+					{
+						--keptWithMinStamp;
+					}
+					else
+					{
+						table_[i].stamp = 0;
+					}
+				}
+			}
+		}
+	}
+
+	int sizeBefore = size_;
+	for(unsigned int i=0; i<table_.size(); ++i)
+	{
+		// erase() may move a following voxel in this slot
+		while(table_[i].used && table_[i].stamp == 0)
+		{
+			erase(i);
+		}
+	}
+	return sizeBefore - size_;
+}
+
+pcl::PointCloud<pcl::PointNormal>::Ptr VoxelHashMap::getCloud()
+{
+	pcl::PointCloud<pcl::PointNormal>::Ptr cloud(new pcl::PointCloud<pcl::PointNormal>);
+	cloud->resize(size_);
+	int oi = 0;
+	for(unsigned int i=0; i<table_.size(); ++i)
+	{
+		if(table_[i].used)
+		{
+			table_[i].index = oi;
+			cloud->at(oi++) = table_[i].point;
+		}
+	}
+	UASSERT(oi == size_);
+	return cloud;
+}
+
+// Distance along an axis between "value" and the voxel "c" (0 if inside)
+static float axisDistance(float value, long long c, float voxelSize)
+{
+	float low = float(c)*voxelSize;
+	if(value < low)
+	{
+		return low - value;
+	}
+	if(value > low + voxelSize)
+	{
+		return value - low - voxelSize;
+	}
+	return 0.0f;
+}
+
+int VoxelHashMap::nearest(
+		const pcl::PointNormal & point,
+		float maxDistance,
+		float * distanceSqr,
+		const std::vector<int> * remap) const
+{
+	UASSERT(maxDistance > 0.0f);
+	int best = -1;
+	float bestSqr = maxDistance*maxDistance;
+	if(!(uIsFinite(point.x) && uIsFinite(point.y) && uIsFinite(point.z)))
+	{
+		return best;
+	}
+	const float p[3] = {point.x, point.y, point.z};
+	const long long c[3] = {coordinate(point.x), coordinate(point.y), coordinate(point.z)};
+
+	// The voxels are visited by rings (voxels at k voxels of the voxel of
+	// "point"), the points of ring k being at least at (k-1) voxels plus the
+	// distance between "point" and the closest border of its voxel.
+	float border = voxelSize_;
+	for(int a=0; a<3; ++a)
+	{
+		float low = p[a] - float(c[a])*voxelSize_;
+		border = std::min(border, std::min(low, voxelSize_-low));
+	}
+	border = std::max(border, 0.0f);
+	int maxRing = (int)std::ceil(maxDistance/voxelSize_);
+	for(int k=0; k<=maxRing; ++k)
+	{
+		if(k>0)
+		{
+			float ringDistance = float(k-1)*voxelSize_ + border;
+			if(ringDistance*ringDistance > bestSqr)
+			{
+				break;
+			}
+		}
+		for(int dx=-k; dx<=k; ++dx)
+		{
+			float ddx = axisDistance(p[0], c[0]+dx, voxelSize_);
+			ddx *= ddx;
+			if(ddx > bestSqr)
+			{
+				continue;
+			}
+			for(int dy=-k; dy<=k; ++dy)
+			{
+				float ddy = axisDistance(p[1], c[1]+dy, voxelSize_);
+				float ddxy = ddx + ddy*ddy;
+				if(ddxy > bestSqr)
+				{
+					continue;
+				}
+				// inside the ring, only the first and last voxels along z are on it
+				int stepZ = dx==-k || dx==k || dy==-k || dy==k?1:2*k;
+				for(int dz=-k; dz<=k; dz+=stepZ)
+				{
+					float ddz = axisDistance(p[2], c[2]+dz, voxelSize_);
+					if(ddxy + ddz*ddz > bestSqr)
+					{
+						continue;
+					}
+					int i = find(key(c[0]+dx, c[1]+dy, c[2]+dz));
+					if(i < 0 || table_[i].index < 0)
+					{
+						continue;
+					}
+					int index = table_[i].index;
+					if(remap)
+					{
+						index = index < (int)remap->size()?remap->at(index):-1;
+						if(index < 0)
+						{
+							continue;
+						}
+					}
+					const pcl::PointNormal & pt = table_[i].point;
+					float d = (pt.x-p[0])*(pt.x-p[0]) + (pt.y-p[1])*(pt.y-p[1]) + (pt.z-p[2])*(pt.z-p[2]);
+					if(d < bestSqr || (best < 0 && d == bestSqr))
+					{
+						best = index;
+						bestSqr = d;
+					}
+				}
+			}
+		}
+	}
+	if(distanceSqr && best >= 0)
+	{
+		*distanceSqr = bestSqr;
+	}
+	return best;
+}
+
+long long VoxelHashMap::coordinate(float value) const
+{
+	return (long long)std::floor(value/voxelSize_);
+}
+
+unsigned long long VoxelHashMap::key(long long x, long long y, long long z) const
+{
+	// 21 bits per axis, centered on 0
+	return ((((unsigned long long)(x + (1<<20))) & 0x1FFFFF) << 42) |
+			((((unsigned long long)(y + (1<<20))) & 0x1FFFFF) << 21) |
+			(((unsigned long long)(z + (1<<20))) & 0x1FFFFF);
+}
+
+unsigned long long VoxelHashMap::key(const pcl::PointNormal & point) const
+{
+	return key(coordinate(point.x), coordinate(point.y), coordinate(point.z));
+}
+
+unsigned int VoxelHashMap::slot(unsigned long long key) const
+{
+	return (unsigned int)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (table_.size()-1);
+}
+
+int VoxelHashMap::find(unsigned long long key) const
+{
+	unsigned int mask = table_.size()-1;
+	unsigned int i = slot(key);
+	while(table_[i].used)
+	{
+		if(table_[i].key == key)
+		{
+			return i;
+		}
+		i = (i+1) & mask;
+	}
+	return -1;
+}
+
+bool VoxelHashMap::add(unsigned long long key, const pcl::PointNormal & point, unsigned int stamp)
+{
+	if(size_ >= capacity_)
+	{
+		return false;
+	}
+	unsigned int mask = table_.size()-1;
+	unsigned int i = slot(key);
+	while(table_[i].used)
+	{
+		if(table_[i].key == key)
+		{
+			return false;
+		}
+		i = (i+1) & mask;
+	}
+	table_[i].key = key;
+	table_[i].stamp = stamp;
+	table_[i].point = point;
+	table_[i].used = true;
+	++size_;
+	return true;
+}
+
+// Backward shift deletion: the following voxels of the probing sequence are
+// moved back so that they can still be found without tombstones.
+void VoxelHashMap::erase(unsigned int i)
+{
+	UASSERT(i < table_.size() && table_[i].used);
+	unsigned int mask = table_.size()-1;
+	unsigned int hole = i;
+	unsigned int j = i;
+	while(true)
+	{
+		j = (j+1) & mask;
+		if(!table_[j].used)
+		{
+			break;
+		}
+		unsigned int home = slot(table_[j].key);
+		// the voxel can be moved in the hole if its home slot is not in (hole, j]
+		bool homeBetween = hole <= j ? (home > hole && home <= j) : (home > hole || home <= j);
+		if(!homeBetween)
+		{
+			table_[hole] = table_[j];
+			hole = j;
+		}
+	}
+	table_[hole] = Voxel();
+	--size_;
+}
+
+} /* namespace rtabmap */
@@ -184,6 +184,26 @@ public:
         fclose(fout);
     }
 
+    /**
+     * Save index to an opened stream
+     * @param stream
+     */
+    void saveIndex(FILE* stream)
+    {
+        nnIndex_->saveIndex(stream);
+    }
+
+    /**
+     * Load index from an opened stream. Contrary to SavedIndexParams,
+     * the index can still be rebuilt afterwards (e.g., on addPoints()).
+     * The index should have been created with the same algorithm.
+     * @param stream
+     */
+    void loadIndex(FILE* stream)
+    {
+        nnIndex_->loadIndex(stream);
+    }
+
     /**
      * \returns number of features in this index.
      */
@@ -2324,110 +2324,131 @@ pcl::PCLPointCloud2::Ptr laserScanToPointCloud2(const LaserScan & laserScan, con
 	return cloud;
 }
 
-pcl::PointCloud<pcl::PointXYZ>::Ptr laserScanToPointCloud(const LaserScan & laserScan, const Transform & transform)
+template<typename PointT> inline void laserScanRotateNormal(PointT &, const Eigen::Affine3f &) {}
+template<typename PointT> inline void laserScanRotateNormalImpl(PointT & pt, const Eigen::Affine3f & t)
 {
-	pcl::PointCloud<pcl::PointXYZ>::Ptr output(new pcl::PointCloud<pcl::PointXYZ>);
-	output->resize(laserScan.size());
-	output->is_dense = true;
-	bool nullTransform = transform.isNull();
-	Eigen::Affine3f transform3f = transform.toEigen3f();
-	for(int i=0; i<laserScan.size(); ++i)
+	Eigen::Vector3f n = t.linear() * Eigen::Vector3f(pt.normal_x, pt.normal_y, pt.normal_z);
+	pt.normal_x = n[0]; pt.normal_y = n[1]; pt.normal_z = n[2];
+}
+inline void laserScanRotateNormal(pcl::PointNormal & pt, const Eigen::Affine3f & t) {laserScanRotateNormalImpl(pt, t);}
+inline void laserScanRotateNormal(pcl::PointXYZRGBNormal & pt, const Eigen::Affine3f & t) {laserScanRotateNormalImpl(pt, t);}
+inline void laserScanRotateNormal(pcl::PointXYZINormal & pt, const Eigen::Affine3f & t) {laserScanRotateNormalImpl(pt, t);}
+
+// Points are read through a LaserScanPointView and appended to output,
+// transformed in the same pass.
+template<typename PointT>
+void laserScanToPointCloudImpl(
+		const LaserScan & laserScan,
+		const Transform & transform,
+		const PointT & defaultPoint,
+		pcl::PointCloud<PointT> & output)
+{
+	if(laserScan.isEmpty())
+	{
+		return;
+	}
+	UASSERT(!laserScan.isCompressed());
+	const int size = laserScan.size();
+	const int offset = (int)output.size();
+	if(offset == 0)
+	{
+		output.is_dense = true;
+	}
+	output.resize(offset + size);
+
+	const LaserScanPointView<PointT> points(laserScan, defaultPoint);
+	const bool nullTransform = transform.isNull() || transform.isIdentity();
+	const Eigen::Affine3f transform3f = nullTransform?Eigen::Affine3f::Identity():transform.toEigen3f();
+	#pragma omp parallel for
+	for(int i=0; i<size; ++i)
 	{
-		output->at(i) = util3d::laserScanToPoint(laserScan, i);
+		PointT & pt = output.points[offset+i];
+		pt = points.at(i);
 		if(!nullTransform)
 		{
-			output->at(i) = pcl::transformPoint(output->at(i), transform3f);
+			pt.getVector3fMap() = transform3f * pt.getVector3fMap();
+			laserScanRotateNormal(pt, transform3f);
 		}
 	}
+}
+
+pcl::PointCloud<pcl::PointXYZ>::Ptr laserScanToPointCloud(const LaserScan & laserScan, const Transform & transform)
+{
+	pcl::PointCloud<pcl::PointXYZ>::Ptr output(new pcl::PointCloud<pcl::PointXYZ>);
+	laserScanToPointCloud(laserScan, *output, transform);
 	return output;
 }
+void laserScanToPointCloud(const LaserScan & laserScan, pcl::PointCloud<pcl::PointXYZ> & output, const Transform & transform)
+{
+	laserScanToPointCloudImpl(laserScan, transform, pcl::PointXYZ(), output);
+}
 
 pcl::PointCloud<pcl::PointNormal>::Ptr laserScanToPointCloudNormal(const LaserScan & laserScan, const Transform & transform)
 {
 	pcl::PointCloud<pcl::PointNormal>::Ptr output(new pcl::PointCloud<pcl::PointNormal>);
-	output->resize(laserScan.size());
-	output->is_dense = true;
-	bool nullTransform = transform.isNull();
-	for(int i=0; i<laserScan.size(); ++i)
-	{
-		output->at(i) = laserScanToPointNormal(laserScan, i);
-		if(!nullTransform)
-		{
-			output->at(i) = util3d::transformPoint(output->at(i), transform);
-		}
-	}
+	laserScanToPointCloudNormal(laserScan, *output, transform);
 	return output;
 }
+void laserScanToPointCloudNormal(const LaserScan & laserScan, pcl::PointCloud<pcl::PointNormal> & output, const Transform & transform)
+{
+	laserScanToPointCloudImpl(laserScan, transform, pcl::PointNormal(), output);
+}
 
 pcl::PointCloud<pcl::PointXYZRGB>::Ptr laserScanToPointCloudRGB(const LaserScan & laserScan, const Transform & transform,  unsigned char r, unsigned char g, unsigned char b)
 {
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr output(new pcl::PointCloud<pcl::PointXYZRGB>);
-	output->resize(laserScan.size());
-	output->is_dense = true;
-	bool nullTransform = transform.isNull() || transform.isIdentity();
-	Eigen::Affine3f transform3f = transform.toEigen3f();
-	for(int i=0; i<laserScan.size(); ++i)
-	{
-		output->at(i) = util3d::laserScanToPointRGB(laserScan, i, r, g, b);
-		if(!nullTransform)
-		{
-			output->at(i) = pcl::transformPoint(output->at(i), transform3f);
-		}
-	}
+	laserScanToPointCloudRGB(laserScan, *output, transform, r, g, b);
 	return output;
 }
+void laserScanToPointCloudRGB(const LaserScan & laserScan, pcl::PointCloud<pcl::PointXYZRGB> & output, const Transform & transform,  unsigned char r, unsigned char g, unsigned char b)
+{
+	pcl::PointXYZRGB defaultPoint;
+	defaultPoint.r = r;
+	defaultPoint.g = g;
+	defaultPoint.b = b;
+	laserScanToPointCloudImpl(laserScan, transform, defaultPoint, output);
+}
 
 pcl::PointCloud<pcl::PointXYZI>::Ptr laserScanToPointCloudI(const LaserScan & laserScan, const Transform & transform,  float intensity)
 {
 	pcl::PointCloud<pcl::PointXYZI>::Ptr output(new pcl::PointCloud<pcl::PointXYZI>);
-	output->resize(laserScan.size());
-	output->is_dense = true;
-	bool nullTransform = transform.isNull() || transform.isIdentity();
-	Eigen::Affine3f transform3f = transform.toEigen3f();
-	for(int i=0; i<laserScan.size(); ++i)
-	{
-		output->at(i) = util3d::laserScanToPointI(laserScan, i, intensity);
-		if(!nullTransform)
-		{
-			output->at(i) = pcl::transformPoint(output->at(i), transform3f);
-		}
-	}
+	laserScanToPointCloudI(laserScan, *output, transform, intensity);
 	return output;
 }
+void laserScanToPointCloudI(const LaserScan & laserScan, pcl::PointCloud<pcl::PointXYZI> & output, const Transform & transform,  float intensity)
+{
+	pcl::PointXYZI defaultPoint;
+	defaultPoint.intensity = intensity;
+	laserScanToPointCloudImpl(laserScan, transform, defaultPoint, output);
+}
 
 pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr laserScanToPointCloudRGBNormal(const LaserScan & laserScan, const Transform & transform,  unsigned char r, unsigned char g, unsigned char b)
 {
 	pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr output(new pcl::PointCloud<pcl::PointXYZRGBNormal>);
-	output->resize(laserScan.size());
-	output->is_dense = true;
-	bool nullTransform = transform.isNull() || transform.isIdentity();
-	for(int i=0; i<laserScan.size(); ++i)
-	{
-		output->at(i) = util3d::laserScanToPointRGBNormal(laserScan, i, r, g, b);
-		if(!nullTransform)
-		{
-			output->at(i) = util3d::transformPoint(output->at(i), transform);
-		}
-	}
+	laserScanToPointCloudRGBNormal(laserScan, *output, transform, r, g, b);
 	return output;
 }
+void laserScanToPointCloudRGBNormal(const LaserScan & laserScan, pcl::PointCloud<pcl::PointXYZRGBNormal> & output, const Transform & transform,  unsigned char r, unsigned char g, unsigned char b)
+{
+	pcl::PointXYZRGBNormal defaultPoint;
+	defaultPoint.r = r;
+	defaultPoint.g = g;
+	defaultPoint.b = b;
+	laserScanToPointCloudImpl(laserScan, transform, defaultPoint, output);
+}
 
 pcl::PointCloud<pcl::PointXYZINormal>::Ptr laserScanToPointCloudINormal(const LaserScan & laserScan, const Transform & transform,  float intensity)
 {
 	pcl::PointCloud<pcl::PointXYZINormal>::Ptr output(new pcl::PointCloud<pcl::PointXYZINormal>);
-	output->resize(laserScan.size());
-	output->is_dense = true;
-	bool nullTransform = transform.isNull() || transform.isIdentity();
-	for(int i=0; i<laserScan.size(); ++i)
-	{
-		output->at(i) = util3d::laserScanToPointINormal(laserScan, i, intensity);
-		if(!nullTransform)
-		{
-			output->at(i) = util3d::transformPoint(output->at(i), transform);
-		}
-	}
+	laserScanToPointCloudINormal(laserScan, *output, transform, intensity);
 	return output;
 }
+void laserScanToPointCloudINormal(const LaserScan & laserScan, pcl::PointCloud<pcl::PointXYZINormal> & output, const Transform & transform,  float intensity)
+{
+	pcl::PointXYZINormal defaultPoint;
+	defaultPoint.intensity = intensity;
+	laserScanToPointCloudImpl(laserScan, transform, defaultPoint, output);
+}
 
 pcl::PointXYZ laserScanToPoint(const LaserScan & laserScan, int index)
 {
@@ -50,6 +50,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/UMath.h>
 #include <rtabmap/utilite/UConversion.h>
 
+#include <limits>
+
 #if PCL_VERSION_COMPARE(>=, 1, 8, 0)
 #include <pcl/impl/instantiate.hpp>
 #include <pcl/point_types.h>
@@ -125,8 +127,7 @@ LaserScan commonFiltering(
 					}
 				}
 
-				cv::Mat(scan.data(), cv::Range::all(), cv::Range(i,i+1)).copyTo(cv::Mat(tmp, cv::Range::all(), cv::Range(oi,oi+1)));
-				++oi;
+				memcpy(tmp.ptr<float>(0, oi++), ptr, scan.data().elemSize());
 			}
 			int previousSize = scan.size();
 			int scanMaxPtsTmp = scan.maxPoints();
@@ -134,37 +135,26 @@ LaserScan commonFiltering(
 			UDEBUG("Downsampling scan (step=%d): %d -> %d (scanMaxPts=%d->%d)", downsamplingStep, previousSize, scan.size(), scanMaxPtsTmp, scan.maxPoints());
 		}
 
-		if(scan.size() && (voxelSize > 0.0f || ((normalK > 0 || normalRadius>0.0f) && !scan.hasNormals())))
+		if(scan.size() && voxelSize > 0.0f)
+		{
+			// done directly on the scan data, normals (if any) are averaged per voxel
+			int previousSize = scan.size();
+			int scanMaxPtsTmp = scan.maxPoints();
+			scan = voxelize(scan, voxelSize);
+			UDEBUG("Voxel filtering scan (voxel=%f m): %d -> %d (scanMaxPts=%d->%d)", voxelSize, previousSize, scan.size(), scanMaxPtsTmp, scan.maxPoints());
+		}
+
+		if(scan.size() && (normalK > 0 || normalRadius>0.0f) && (voxelSize > 0.0f || !scan.hasNormals()))
 		{
-			// convert to compatible PCL format and filter it
+			// convert to compatible PCL format and compute normals
 			if(scan.hasRGB())
 			{
 				UASSERT(!scan.is2d());
 				pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = laserScanToPointCloudRGB(scan);
 				if(cloud->size())
 				{
-					int scanMaxPts = scan.maxPoints();
-					if(voxelSize > 0.0f)
-					{
-						cloud = voxelize(cloud, voxelSize);
-						float ratio = float(cloud->size()) / scan.size();
-						scanMaxPts = int(float(scanMaxPts) * ratio);
-						UDEBUG("Voxel filtering scan (voxel=%f m): %d -> %d (scanMaxPts=%d->%d)", voxelSize, scan.size(), cloud->size(), scan.maxPoints(), scanMaxPts);
-					}
-					if(cloud->size() && (normalK > 0 || normalRadius>0.0f))
-					{
-						pcl::PointCloud<pcl::Normal>::Ptr normals = util3d::computeNormals(cloud, normalK, normalRadius);
-						scan = LaserScan(laserScanFromPointCloud(*cloud, *normals), scanMaxPts, scan.maxRange(), LaserScan::kXYZRGBNormal, scan.localTransform());
-						UDEBUG("Normals computed (k=%d radius=%f)", normalK, normalRadius);
-					}
-					else
-					{
-						if(scan.hasNormals())
-						{
-							UWARN("Voxel filter i applied, but normal parameters are not set and input scan has normals. The returned scan has no normals.");
-						}
-						scan = LaserScan(laserScanFromPointCloud(*cloud), scanMaxPts, scan.maxRange(), LaserScan::kXYZRGB, scan.localTransform());
-					}
+					pcl::PointCloud<pcl::Normal>::Ptr normals = util3d::computeNormals(cloud, normalK, normalRadius);
+					scan = LaserScan(laserScanFromPointCloud(*cloud, *normals), scan.maxPoints(), scan.maxRange(), LaserScan::kXYZRGBNormal, scan.localTransform());
 				}
 			}
 			else if(scan.hasIntensity())
@@ -172,43 +162,16 @@ LaserScan commonFiltering(
 				pcl::PointCloud<pcl::PointXYZI>::Ptr cloud = laserScanToPointCloudI(scan);
 				if(cloud->size())
 				{
-					int scanMaxPts = scan.maxPoints();
-					if(voxelSize > 0.0f)
+					pcl::PointCloud<pcl::Normal>::Ptr normals;
+					if(scan.is2d())
 					{
-						cloud = voxelize(cloud, voxelSize);
-						float ratio = float(cloud->size()) / scan.size();
-						scanMaxPts = int(float(scanMaxPts) * ratio);
-						UDEBUG("Voxel filtering scan (voxel=%f m): %d -> %d (scanMaxPts=%d->%d)", voxelSize, scan.size(), cloud->size(), scan.maxPoints(), scanMaxPts);
-					}
-					if(cloud->size() && (normalK > 0 || normalRadius>0.0f))
-					{
-						pcl::PointCloud<pcl::Normal>::Ptr normals;
-						if(scan.is2d())
-						{
-							normals = util3d::computeNormals2D(cloud, normalK, normalRadius);
-							scan = LaserScan(laserScan2dFromPointCloud(*cloud, *normals), scanMaxPts, scan.maxRange(), LaserScan::kXYINormal, scan.localTransform());
-						}
-						else
-						{
-							normals = util3d::computeNormals(cloud, normalK, normalRadius);
-							scan = LaserScan(laserScanFromPointCloud(*cloud, *normals), scanMaxPts, scan.maxRange(), LaserScan::kXYZINormal, scan.localTransform());
-						}
-						UDEBUG("Normals computed (k=%d radius=%f)", normalK, normalRadius);
+						normals = util3d::computeNormals2D(cloud, normalK, normalRadius);
+						scan = LaserScan(laserScan2dFromPointCloud(*cloud, *normals), scan.maxPoints(), scan.maxRange(), LaserScan::kXYINormal, scan.localTransform());
 					}
 					else
 					{
-						if(scan.hasNormals())
-						{
-							UWARN("Voxel filter i applied, but normal parameters are not set and input scan has normals. The returned scan has no normals.");
-						}
-						if(scan.is2d())
-						{
-							scan = LaserScan(laserScan2dFromPointCloud(*cloud), scanMaxPts, scan.maxRange(), LaserScan::kXYI, scan.localTransform());
-						}
-						else
-						{
-							scan = LaserScan(laserScanFromPointCloud(*cloud), scanMaxPts, scan.maxRange(), LaserScan::kXYZI, scan.localTransform());
-						}
+						normals = util3d::computeNormals(cloud, normalK, normalRadius);
+						scan = LaserScan(laserScanFromPointCloud(*cloud, *normals), scan.maxPoints(), scan.maxRange(), LaserScan::kXYZINormal, scan.localTransform());
 					}
 				}
 			}
@@ -217,46 +180,20 @@ LaserScan commonFiltering(
 				pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = laserScanToPointCloud(scan);
 				if(cloud->size())
 				{
-					int scanMaxPts = scan.maxPoints();
-					if(voxelSize > 0.0f)
+					pcl::PointCloud<pcl::Normal>::Ptr normals;
+					if(scan.is2d())
 					{
-						cloud = voxelize(cloud, voxelSize);
-						float ratio = float(cloud->size()) / scan.size();
-						scanMaxPts = int(float(scanMaxPts) * ratio);
-						UDEBUG("Voxel filtering scan (voxel=%f m): %d -> %d (scanMaxPts=%d->%d)", voxelSize, scan.size(), cloud->size(), scan.maxPoints(), scanMaxPts);
-					}
-					if(cloud->size() && (normalK > 0 || normalRadius>0.0f))
-					{
-						pcl::PointCloud<pcl::Normal>::Ptr normals;
-						if(scan.is2d())
-						{
-							normals = util3d::computeNormals2D(cloud, normalK, normalRadius);
-							scan = LaserScan(laserScan2dFromPointCloud(*cloud, *normals), scanMaxPts, scan.maxRange(), LaserScan::kXYNormal, scan.localTransform());
-						}
-						else
-						{
-							normals = util3d::computeNormals(cloud, normalK, normalRadius);
-							scan = LaserScan(laserScanFromPointCloud(*cloud, *normals), scanMaxPts, scan.maxRange(), LaserScan::kXYZNormal, scan.localTransform());
-						}
-						UDEBUG("Normals computed (k=%d radius=%f)", normalK, normalRadius);
+						normals = util3d::computeNormals2D(cloud, normalK, normalRadius);
+						scan = LaserScan(laserScan2dFromPointCloud(*cloud, *normals), scan.maxPoints(), scan.maxRange(), LaserScan::kXYNormal, scan.localTransform());
 					}
 					else
 					{
-						if(scan.hasNormals())
-						{
-							UWARN("Voxel filter i applied, but normal parameters are not set and input scan has normals. The returned scan has no normals.");
-						}
-						if(scan.is2d())
-						{
-							scan = LaserScan(laserScan2dFromPointCloud(*cloud), scanMaxPts, scan.maxRange(), LaserScan::kXY, scan.localTransform());
-						}
-						else
-						{
-							scan = LaserScan(laserScanFromPointCloud(*cloud), scanMaxPts, scan.maxRange(), LaserScan::kXYZ, scan.localTransform());
-						}
+						normals = util3d::computeNormals(cloud, normalK, normalRadius);
+						scan = LaserScan(laserScanFromPointCloud(*cloud, *normals), scan.maxPoints(), scan.maxRange(), LaserScan::kXYZNormal, scan.localTransform());
 					}
 				}
 			}
+			UDEBUG("Normals computed (k=%d radius=%f)", normalK, normalRadius);
 		}
 
 		if(scan.size() && !scan.is2d() && scan.hasNormals() && forceGroundNormalsUp)
@@ -304,8 +241,7 @@ LaserScan rangeFiltering(
 					continue;
 				}
 
-				cv::Mat(scan.data(), cv::Range::all(), cv::Range(i,i+1)).copyTo(cv::Mat(output, cv::Range::all(), cv::Range(oi,oi+1)));
-				++oi;
+				memcpy(output.ptr<float>(0, oi++), ptr, scan.data().elemSize());
 			}
 			return LaserScan(cv::Mat(output, cv::Range::all(), cv::Range(0, oi)), scan.maxPoints(), scan.maxRange(), scan.format(), scan.localTransform());
 		}
@@ -331,8 +267,7 @@ LaserScan downsample(
 		int oi = 0;
 		for(int i=0; i<scan.size()-step+1; i+=step)
 		{
-			cv::Mat(scan.data(), cv::Range::all(), cv::Range(i,i+1)).copyTo(cv::Mat(output, cv::Range::all(), cv::Range(oi,oi+1)));
-			++oi;
+			memcpy(output.ptr<float>(0, oi++), scan.data().ptr<float>(0, i), scan.data().elemSize());
 		}
 		return LaserScan(output, scan.maxPoints()/step, scan.maxRange(), scan.format(), scan.localTransform());
 	}
@@ -460,6 +395,185 @@ pcl::PointCloud<pcl::PointXYZINormal>::Ptr voxelize(const pcl::PointCloud<pcl::P
 	return voxelize(cloud, indices, voxelSize);
 }
 
+static bool voxelKeyCompare(const std::pair<unsigned long long, int> & a, const std::pair<unsigned long long, int> & b)
+{
+	return a.first < b.first;
+}
+
+LaserScan voxelize(const LaserScan & scan, float voxelSize)
+{
+	UASSERT(voxelSize > 0.0f);
+	if(scan.isEmpty())
+	{
+		return scan;
+	}
+	UASSERT(scan.data().type() == CV_32FC(scan.data().channels()) && scan.data().channels() <= 7);
+
+	const int size = scan.size();
+	const int channels = scan.data().channels();
+	const int dims = scan.is2d()?2:3;
+	const int rgbOffset = scan.getRGBOffset();
+	const int normalsOffset = scan.getNormalsOffset();
+	const float inverseVoxelSize = 1.0f/voxelSize;
+	const unsigned long long invalidKey = (unsigned long long)-1;
+
+	// bounds of the finite points
+	float minPt[3] = {0,0,0};
+	float maxPt[3] = {0,0,0};
+	bool first = true;
+	for(int i=0; i<size; ++i)
+	{
+		const float * ptr = scan.data().ptr<float>(0, i);
+		if(uIsFinite(ptr[0]) && uIsFinite(ptr[1]) && (dims==2 || uIsFinite(ptr[2])))
+		{
+			for(int j=0; j<dims; ++j)
+			{
+				if(first || ptr[j] < minPt[j]) minPt[j] = ptr[j];
+				if(first || ptr[j] > maxPt[j]) maxPt[j] = ptr[j];
+			}
+			first = false;
+		}
+	}
+	if(first)
+	{
+		UWARN("Scan doesn't have any valid points, returning empty scan!");
+		return LaserScan(cv::Mat(), 0, scan.maxRange(), scan.format(), scan.localTransform());
+	}
+	// voxels are aligned on floor(p/voxelSize) like pcl::VoxelGrid, keys are relative to the first voxel
+	long long minVoxel[3] = {0,0,0};
+	for(int j=0; j<dims; ++j)
+	{
+		minVoxel[j] = (long long)std::floor(minPt[j]*inverseVoxelSize);
+		if((long long)std::floor(maxPt[j]*inverseVoxelSize) - minVoxel[j] >= (1<<21))
+		{
+			UWARN("Voxel size (%f) is too small for the scan's extent (%f m), voxel keys would overflow. Returning the scan without voxel filtering.",
+					voxelSize, maxPt[j]-minPt[j]);
+			return scan;
+		}
+	}
+
+	// voxel keys (z, y then x ordered like pcl::VoxelGrid) of each point
+	std::vector<std::pair<unsigned long long, int> > keys(size);
+	#pragma omp parallel for
+	for(int i=0; i<size; ++i)
+	{
+		const float * ptr = scan.data().ptr<float>(0, i);
+		if(uIsFinite(ptr[0]) && uIsFinite(ptr[1]) && (dims==2 || uIsFinite(ptr[2])))
+		{
+			unsigned long long x = (unsigned long long)((long long)std::floor(ptr[0]*inverseVoxelSize) - minVoxel[0]);
+			unsigned long long y = (unsigned long long)((long long)std::floor(ptr[1]*inverseVoxelSize) - minVoxel[1]);
+			unsigned long long z = dims==3?(unsigned long long)((long long)std::floor(ptr[2]*inverseVoxelSize) - minVoxel[2]):0;
+			keys[i].first = (z << 42) | (y << 21) | x;
+		}
+		else
+		{
+			keys[i].first = invalidKey;
+		}
+		keys[i].second = i;
+	}
+	std::sort(keys.begin(), keys.end(), voxelKeyCompare);
+
+	// first sorted index of each voxel
+	std::vector<int> voxelStarts;
+	voxelStarts.reserve(size);
+	for(int i=0; i<size && keys[i].first != invalidKey; ++i)
+	{
+		if(i==0 || keys[i].first != keys[i-1].first)
+		{
+			voxelStarts.push_back(i);
+		}
+	}
+	int end = (int)voxelStarts.size()?voxelStarts.back():0;
+	while(end < size && keys[end].first != invalidKey)
+	{
+		++end;
+	}
+	voxelStarts.push_back(end);
+
+	// average the points of each voxel
+	const int voxels = (int)voxelStarts.size()-1;
+	cv::Mat output(1, voxels, scan.data().type());
+	#pragma omp parallel for
+	for(int v=0; v<voxels; ++v)
+	{
+		double sum[7] = {0,0,0,0,0,0,0};
+		double rgbSum[4] = {0,0,0,0}; // b, g, r, a
+		const int count = voxelStarts[v+1] - voxelStarts[v];
+		int normalsCount = 0;
+		for(int k=voxelStarts[v]; k<voxelStarts[v+1]; ++k)
+		{
+			const float * ptr = scan.data().ptr<float>(0, keys[k].second);
+			// invalid normals are not averaged
+			bool validNormal = normalsOffset >= 0 &&
+					uIsFinite(ptr[normalsOffset]) && uIsFinite(ptr[normalsOffset+1]) && uIsFinite(ptr[normalsOffset+2]);
+			if(validNormal)
+			{
+				++normalsCount;
+			}
+			for(int c=0; c<channels; ++c)
+			{
+				if(normalsOffset >= 0 && c >= normalsOffset && c < normalsOffset+3)
+				{
+					if(validNormal)
+					{
+						sum[c] += ptr[c];
+					}
+				}
+				else if(c == rgbOffset)
+				{
+					int rgb = *(const int*)(ptr+c);
+					rgbSum[0] += rgb & 0xFF;
+					rgbSum[1] += (rgb >> 8) & 0xFF;
+					rgbSum[2] += (rgb >> 16) & 0xFF;
+					rgbSum[3] += (rgb >> 24) & 0xFF;
+				}
+				else
+				{
+					sum[c] += ptr[c];
+				}
+			}
+		}
+
+		float * outPtr = output.ptr<float>(0, v);
+		for(int c=0; c<channels; ++c)
+		{
+			if(c == rgbOffset)
+			{
+				unsigned int * outPtrInt = (unsigned int*)(outPtr+c);
+				*outPtrInt = (unsigned int)(rgbSum[0]/count+0.5) |
+						((unsigned int)(rgbSum[1]/count+0.5) << 8) |
+						((unsigned int)(rgbSum[2]/count+0.5) << 16) |
+						((unsigned int)(rgbSum[3]/count+0.5) << 24);
+			}
+			else
+			{
+				outPtr[c] = float(sum[c]/count);
+			}
+		}
+		if(normalsOffset >= 0)
+		{
+			// the average of unit normals is shorter than 1, it is renormalized
+			float * n = outPtr + normalsOffset;
+			double norm = sqrt(sum[normalsOffset]*sum[normalsOffset] +
+					sum[normalsOffset+1]*sum[normalsOffset+1] +
+					sum[normalsOffset+2]*sum[normalsOffset+2]);
+			if(normalsCount > 0 && norm > 0.0)
+			{
+				n[0] = float(sum[normalsOffset]/norm);
+				n[1] = float(sum[normalsOffset+1]/norm);
+				n[2] = float(sum[normalsOffset+2]/norm);
+			}
+			else
+			{
+				n[0] = n[1] = n[2] = std::numeric_limits<float>::quiet_NaN();
+			}
+		}
+	}
+
+	int maxPoints = int(float(scan.maxPoints()) * float(voxels) / float(size));
+	return LaserScan(output, maxPoints, scan.maxRange(), scan.format(), scan.localTransform());
+}
+
 template<typename PointT>
 typename pcl::PointCloud<PointT>::Ptr randomSamplingImpl(
 		const typename pcl::PointCloud<PointT>::Ptr & cloud, int samples)
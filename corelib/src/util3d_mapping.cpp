@@ -548,6 +548,243 @@ cv::Mat create2DMap(const std::map<int, Transform> & poses,
 			scanMaxRange);
 }
 
+namespace {
+
+// Visits the cells of the ray start->end exactly like rayTrace() does (same
+// column-wise traversal and same rounding), but walks raw offsets in the grid
+// buffer instead of branching on the swapped case for every cell. The visitor
+// receives the byte offset of each free cell. Stops before the first obstacle
+// if stopOnObstacle is true.
+template<typename Visitor>
+void traceRay(const cv::Point2i & start, const cv::Point2i & end, const cv::Mat & grid, bool stopOnObstacle, Visitor & visitor)
+{
+	cv::Point2i ptA = start;
+	cv::Point2i ptB = end;
+
+	float slope = float(ptB.y - ptA.y)/float(ptB.x - ptA.x);
+
+	size_t majorStep = 1;
+	size_t minorStep = grid.step[0];
+	int minorSize = grid.rows;
+	if(slope<-1.0f || slope>1.0f)
+	{
+		// swap x and y
+		slope = 1.0f/slope;
+		std::swap(ptA.x, ptA.y);
+		std::swap(ptB.x, ptB.y);
+		majorStep = grid.step[0];
+		minorStep = 1;
+		minorSize = grid.cols;
+	}
+
+	const char * data = (const char *)grid.data;
+	float b = ptA.y - slope*ptA.x;
+	int dx = ptA.x<ptB.x?1:-1;
+	for(int x=ptA.x; x!=ptB.x; x+=dx)
+	{
+		int upperbound = float(x)*slope + b;
+		int lowerbound = upperbound;
+		if(x != ptA.x)
+		{
+			lowerbound = (x+dx)*slope + b;
+		}
+		if(lowerbound > upperbound)
+		{
+			std::swap(lowerbound, upperbound);
+		}
+		UASSERT_MSG(lowerbound >= 0 && upperbound < minorSize, uFormat("lowerbound=%d upperbound=%d size=%d x=%d slope=%f b=%f", lowerbound, upperbound, minorSize, x, slope, b).c_str());
+
+		size_t i = size_t(x)*majorStep + size_t(lowerbound)*minorStep;
+		for(int y = lowerbound; y<=upperbound; ++y, i+=minorStep)
+		{
+			if(stopOnObstacle && data[i] == 100)
+			{
+				return;
+			}
+			visitor(i);
+		}
+	}
+}
+
+struct RayFreeSpaceWriter
+{
+	RayFreeSpaceWriter(char * data) : data_(data) {}
+	void operator()(size_t i) {data_[i] = 0;}
+	char * data_;
+};
+
+// Converts a byte offset in the grid to an offset in a mask covering only roi.
+struct RayGridRoi
+{
+	RayGridRoi(const cv::Rect & roi, size_t step) : roi_(roi), step_(step) {}
+	size_t operator()(size_t i) const
+	{
+		int y = int(i/step_);
+		int x = int(i - size_t(y)*step_);
+		return size_t((y-roi_.y)*roi_.width + x-roi_.x);
+	}
+	cv::Rect roi_;
+	size_t step_;
+};
+
+struct RayMaskWriter
+{
+	RayMaskWriter(unsigned char * data, const RayGridRoi & roi) : data_(data), roi_(roi) {}
+	void operator()(size_t i) {data_[roi_(i)] = 1;}
+	unsigned char * data_;
+	RayGridRoi roi_;
+};
+
+struct RayEndsCollector
+{
+	RayEndsCollector(const unsigned char * endMask, const RayGridRoi & roi, std::vector<size_t> & ends) : endMask_(endMask), roi_(roi), ends_(ends) {}
+	void operator()(size_t i) {size_t j = roi_(i); if(endMask_[j]) ends_.push_back(j);}
+	const unsigned char * endMask_;
+	RayGridRoi roi_;
+	std::vector<size_t> & ends_;
+};
+
+/**
+ * Trace free space of all rays from start to ends, in parallel. The result is the same
+ * as calling rayTrace(start, ends[k], map, true) sequentially in order of the rays:
+ * rays only clear cells and stop on obstacles, so the free cells are the union
+ * of the rays' cells (obstacle > free > unknown), whatever the order.
+ * @param setEnds if not empty, end cells flagged are set to empty after tracing if still unknown
+ * @param skipTracedEnds skip rays whose end cell is already empty when the ray
+ *        would have been traced sequentially (end cleared before the scan or by a previous ray)
+ */
+void rayTraceParallel(
+		const cv::Point2i & start,
+		const std::vector<cv::Point2i> & ends,
+		const std::vector<bool> & setEnds,
+		bool skipTracedEnds,
+		cv::Mat & map)
+{
+	UASSERT(map.type() == CV_8SC1 && map.isContinuous());
+	UASSERT(setEnds.empty() || setEnds.size() == ends.size());
+	UASSERT_MSG(start.x >= 0 && start.x < map.cols && start.y >= 0 && start.y < map.rows,
+			uFormat("start=(%d,%d) grid=%dx%d", start.x, start.y, map.cols, map.rows).c_str());
+	const int n = (int)ends.size();
+	if(n == 0)
+	{
+		return;
+	}
+	char * data = map.ptr<char>();
+	const size_t step = map.step[0];
+
+	// The masks below only cover the bounding box of the rays (with one
+	// cell of margin for the rounding in traceRay()), not the whole map.
+	cv::Point2i minPt = start;
+	cv::Point2i maxPt = start;
+	for(int k=0; k<n; ++k)
+	{
+		minPt.x = std::min(minPt.x, ends[k].x);
+		minPt.y = std::min(minPt.y, ends[k].y);
+		maxPt.x = std::max(maxPt.x, ends[k].x);
+		maxPt.y = std::max(maxPt.y, ends[k].y);
+	}
+	minPt.x = std::max(minPt.x-1, 0);
+	minPt.y = std::max(minPt.y-1, 0);
+	maxPt.x = std::min(maxPt.x+1, map.cols-1);
+	maxPt.y = std::min(maxPt.y+1, map.rows-1);
+	const cv::Rect roiRect(minPt.x, minPt.y, maxPt.x-minPt.x+1, maxPt.y-minPt.y+1);
+	const RayGridRoi roi(roiRect, step);
+
+	std::vector<unsigned char> traced(n, 1);
+	if(skipTracedEnds)
+	{
+		// Find which end cells would be crossed by each ray, then replay the
+		// sequential end checks in ray order to know which rays are skipped.
+		cv::Mat endMask = cv::Mat::zeros(roiRect.size(), CV_8UC1);
+		for(int k=0; k<n; ++k)
+		{
+			endMask.data[roi(ends[k].y*step + ends[k].x)] = 1;
+		}
+		std::vector<std::vector<size_t> > endsOnPath(n);
+		#pragma omp parallel for schedule(dynamic, 64)
+		for(int k=0; k<n; ++k)
+		{
+			RayEndsCollector collector(endMask.data, roi, endsOnPath[k]);
+			traceRay(start, ends[k], map, true, collector);
+		}
+		cv::Mat freeEnds = cv::Mat::zeros(roiRect.size(), CV_8UC1);
+		for(int k=0; k<n; ++k)
+		{
+			size_t e = ends[k].y*step + ends[k].x;
+			size_t eRoi = roi(e);
+			if(data[e] == 0 || freeEnds.data[eRoi])
+			{
+				traced[k] = 0;
+				continue;
+			}
+			for(size_t j=0; j<endsOnPath[k].size(); ++j)
+			{
+				freeEnds.data[endsOnPath[k][j]] = 1;
+			}
+			if(!setEnds.empty() && setEnds[k] && data[e] != 100)
+			{
+				freeEnds.data[eRoi] = 1;
+			}
+		}
+	}
+
+	// Rays are split in contiguous blocks (angular sectors for a scan),
+	// each one writing in its own mask, then merged.
+	const int raysPerSector = 1024;
+	const int maxSectors = 8;
+	const int sectors = std::min(maxSectors, (n+raysPerSector-1)/raysPerSector);
+	if(sectors <= 1)
+	{
+		RayFreeSpaceWriter writer(data);
+		for(int k=0; k<n; ++k)
+		{
+			if(traced[k])
+			{
+				traceRay(start, ends[k], map, true, writer);
+			}
+		}
+	}
+	else
+	{
+		std::vector<cv::Mat> masks(sectors);
+		#pragma omp parallel for schedule(dynamic, 1)
+		for(int s=0; s<sectors; ++s)
+		{
+			cv::Mat mask = cv::Mat::zeros(roiRect.size(), CV_8UC1);
+			RayMaskWriter writer(mask.data, roi);
+			int first = int((long long)s*n/sectors);
+			int last = int((long long)(s+1)*n/sectors);
+			for(int k=first; k<last; ++k)
+			{
+				if(traced[k])
+				{
+					traceRay(start, ends[k], map, true, writer);
+				}
+			}
+			masks[s] = mask;
+		}
+		for(int s=1; s<sectors; ++s)
+		{
+			cv::bitwise_or(masks[0], masks[s], masks[0]);
+		}
+		map(roiRect).setTo(0, masks[0]);
+	}
+
+	if(!setEnds.empty())
+	{
+		for(int k=0; k<n; ++k)
+		{
+			size_t e = ends[k].y*step + ends[k].x;
+			if(traced[k] && setEnds[k] && data[e] == -1)
+			{
+				data[e] = 0; // empty
+			}
+		}
+	}
+}
+
+} // namespace
+
 /**
  * Create 2d Occupancy grid (CV_8S)
  * -1 = unknown
@@ -668,6 +905,10 @@ cv::Mat create2DMap(const std::map<int, Transform> & poses,
 			}
 
 			// ray tracing for hits
+			std::vector<cv::Point2i> ends;
+			std::vector<bool> setEnds;
+			ends.reserve(iter->second.first.cols + iter->second.second.cols);
+			setEnds.reserve(iter->second.first.cols + iter->second.second.cols);
 			for(int i=0; i<iter->second.first.cols; ++i)
 			{
 				const float * ptr = iter->second.first.ptr<float>(0, i);
@@ -688,10 +929,8 @@ cv::Mat create2DMap(const std::map<int, Transform> & poses,
 				cv::Point2i end((pt[0]-xMin)/cellSize, (pt[1]-yMin)/cellSize);
 				if(end!=start)
 				{
-					if(localScans.size() > 1 || map.at<char>(end.y, end.x) != 0)
-					{
-						rayTrace(start, end, map, true); // trace free space
-					}
+					ends.push_back(end);
+					setEnds.push_back(false);
 				}
 			}
 			// ray tracing for no hits
@@ -715,16 +954,13 @@ cv::Mat create2DMap(const std::map<int, Transform> & poses,
 				cv::Point2i end((pt[0]-xMin)/cellSize, (pt[1]-yMin)/cellSize);
 				if(end!=start)
 				{
-					if(localScans.size() > 1 || map.at<char>(end.y, end.x) != 0)
-					{
-						rayTrace(start, end, map, true); // trace free space
-						if(map.at<char>(end.y, end.x) == -1)
-						{
-							map.at<char>(end.y, end.x) = 0; // empty
-						}
-					}
+					ends.push_back(end);
+					setEnds.push_back(true);
 				}
 			}
+
+			// trace free space, a ray is not traced if its end is already known as empty (single scan only)
+			rayTraceParallel(start, ends, setEnds, localScans.size() <= 1, map);
 			++j;
 		}
 		UDEBUG("Ray trace known space=%fs", timer.ticks());
@@ -778,6 +1014,7 @@ cv::Mat create2DMap(const std::map<int, Transform> & poses,
 						endLastVector = endLastVector / cv::norm(endLastVector);
 						float angle = (endRotatedVector/normEndRotatedVector).dot(endLastVector);
 						angle = angle<-1.0f?-1.0f:angle>1.0f?1.0f:angle;
+						std::vector<cv::Point2i> ends;
 						while(acos(angle) > M_PI_4 || endRotatedVector.cross(endLastVector).at<float>(2) > 0.0f)
 						{
 							cv::Point2i end((endRotated.at<float>(0)-xMin)/cellSize, (endRotated.at<float>(1)-yMin)/cellSize);
@@ -786,7 +1023,7 @@ cv::Mat create2DMap(const std::map<int, Transform> & poses,
 							end.x = end.x >= map.cols?map.cols-1:end.x;
 							end.y = end.y < 0?0:end.y;
 							end.y = end.y >= map.rows?map.rows-1:end.y;
-							rayTrace(start, end, map, true); // trace free space
+							ends.push_back(end);
 							// next point
 							endRotated = rotation*(endRotated - origin) + origin;
 							endRotatedVector.at<float>(0) = endRotated.at<float>(0) - origin.at<float>(0);
@@ -800,6 +1037,7 @@ cv::Mat create2DMap(const std::map<int, Transform> & poses,
 							//		angle,
 							//		endRotatedVector.cross(endLastVector).at<float>(2));
 						}
+						rayTraceParallel(start, ends, std::vector<bool>(), false, map); // trace free space
 					}
 				}
 				++j;
@@ -818,79 +1056,10 @@ void rayTrace(const cv::Point2i & start, const cv::Point2i & end, cv::Mat & grid
 	UASSERT_MSG(start.y >= 0 && start.y < grid.rows, uFormat("start.y=%d grid.rows=%d", start.y, grid.rows).c_str());
 	UASSERT_MSG(end.x >= 0 && end.x < grid.cols, uFormat("end.x=%d grid.cols=%d", end.x, grid.cols).c_str());
 	UASSERT_MSG(end.y >= 0 && end.y < grid.rows, uFormat("end.x=%d grid.cols=%d", end.y, grid.rows).c_str());
+	UASSERT(grid.elemSize() == 1);
 
-	cv::Point2i ptA, ptB;
-	ptA = start;
-	ptB = end;
-
-	float slope = float(ptB.y - ptA.y)/float(ptB.x - ptA.x);
-
-	bool swapped = false;
-	if(slope<-1.0f || slope>1.0f)
-	{
-		// swap x and y
-		slope = 1.0f/slope;
-
-		int tmp = ptA.x;
-		ptA.x = ptA.y;
-		ptA.y = tmp;
-
-		tmp = ptB.x;
-		ptB.x = ptB.y;
-		ptB.y = tmp;
-
-		swapped = true;
-	}
-
-	float b = ptA.y - slope*ptA.x;
-	for(int x=ptA.x; ptA.x<ptB.x?x<ptB.x:x>ptB.x; ptA.x<ptB.x?++x:--x)
-	{
-		int upperbound = float(x)*slope + b;
-		int lowerbound = upperbound;
-		if(x != ptA.x)
-		{
-			lowerbound = (ptA.x<ptB.x?x+1:x-1)*slope + b;
-		}
-
-		if(lowerbound > upperbound)
-		{
-			int tmp = upperbound;
-			upperbound = lowerbound;
-			lowerbound = tmp;
-		}
-
-		if(!swapped)
-		{
-			UASSERT_MSG(lowerbound >= 0 && lowerbound < grid.rows, uFormat("lowerbound=%f grid.rows=%d x=%d slope=%f b=%f x=%f", lowerbound, grid.rows, x, slope, b, x).c_str());
-			UASSERT_MSG(upperbound >= 0 && upperbound < grid.rows, uFormat("upperbound=%f grid.rows=%d x+1=%d slope=%f b=%f x=%f", upperbound, grid.rows, x+1, slope, b, x).c_str());
-		}
-		else
-		{
-			UASSERT_MSG(lowerbound >= 0 && lowerbound < grid.cols, uFormat("lowerbound=%f grid.cols=%d x=%d slope=%f b=%f x=%f", lowerbound, grid.cols, x, slope, b, x).c_str());
-			UASSERT_MSG(upperbound >= 0 && upperbound < grid.cols, uFormat("upperbound=%f grid.cols=%d x+1=%d slope=%f b=%f x=%f", upperbound, grid.cols, x+1, slope, b, x).c_str());
-		}
-
-		for(int y = lowerbound; y<=(int)upperbound; ++y)
-		{
-			char * v;
-			if(swapped)
-			{
-				v = &grid.at<char>(x, y);
-			}
-			else
-			{
-				v = &grid.at<char>(y, x);
-			}
-			if(*v == 100 && stopOnObstacle)
-			{
-				return;
-			}
-			else
-			{
-				*v = 0; // free space
-			}
-		}
-	}
+	RayFreeSpaceWriter writer(grid.ptr<char>());
+	traceRay(start, end, grid, stopOnObstacle, writer);
 }
 
 //convert to gray scaled map
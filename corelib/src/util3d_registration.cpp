@@ -32,7 +32,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/util3d.h"
 
 #include <pcl/registration/icp.h>
+#include <pcl/registration/correspondence_estimation.h>
 #include <pcl/registration/transformation_estimation_2D.h>
+#include <pcl/registration/transformation_estimation_point_to_plane_lls.h>
 #include <pcl/registration/transformation_estimation_svd.h>
 #include <pcl/sample_consensus/sac_model_registration.h>
 #include <pcl/sample_consensus/ransac.h>
@@ -40,12 +42,152 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/ULogger.h>
 #include <rtabmap/utilite/UMath.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace rtabmap
 {
 
 namespace util3d
 {
 
+// Same correspondences (and same order) than pcl::registration::CorrespondenceEstimation,
+// but the nearest neighbor searches are split between threads (OpenMP).
+template <typename PointT>
+class CorrespondenceEstimationOMP : public pcl::registration::CorrespondenceEstimation<PointT, PointT, float>
+{
+public:
+	typedef boost::shared_ptr<CorrespondenceEstimationOMP<PointT> > Ptr;
+	typedef typename pcl::registration::CorrespondenceEstimationBase<PointT, PointT, float>::Ptr BasePtr;
+
+	virtual void determineCorrespondences(
+			pcl::Correspondences & correspondences,
+			double max_distance = std::numeric_limits<double>::max())
+	{
+		if(!this->initCompute())
+		{
+			return;
+		}
+
+		const double maxDistanceSqr = max_distance * max_distance;
+		const int size = (int)this->indices_->size();
+		std::vector<pcl::Correspondence> all(size);
+		std::vector<unsigned char> valid(size, 0);
+		#pragma omp parallel for
+		for(int i=0; i<size; ++i)
+		{
+			std::vector<int> index(1);
+			std::vector<float> distance(1);
+			int idx = this->indices_->at(i);
+			if(this->tree_->nearestKSearch(this->input_->points[idx], 1, index, distance) > 0 &&
+			   distance[0] <= maxDistanceSqr)
+			{
+				all[i].index_query = idx;
+				all[i].index_match = index[0];
+				all[i].distance = distance[0];
+				valid[i] = 1;
+			}
+		}
+
+		correspondences.resize(size);
+		unsigned int oi = 0;
+		for(int i=0; i<size; ++i)
+		{
+			if(valid[i])
+			{
+				correspondences[oi++] = all[i];
+			}
+		}
+		correspondences.resize(oi);
+
+		this->deinitCompute();
+	}
+
+	virtual BasePtr clone() const
+	{
+		Ptr copy(new CorrespondenceEstimationOMP<PointT>(*this));
+		return copy;
+	}
+};
+
+// Same linear system than pcl::registration::TransformationEstimationPointToPlaneLLS,
+// but the A^T*A and A^T*b terms are accumulated per thread (OpenMP) then summed
+// in thread order, so that the result doesn't depend on which thread finishes first.
+template <typename PointT>
+class TransformationEstimationPointToPlaneLLSOMP : public pcl::registration::TransformationEstimationPointToPlaneLLS<PointT, PointT, float>
+{
+public:
+	typedef boost::shared_ptr<TransformationEstimationPointToPlaneLLSOMP<PointT> > Ptr;
+	using pcl::registration::TransformationEstimationPointToPlaneLLS<PointT, PointT, float>::estimateRigidTransformation;
+
+	virtual void estimateRigidTransformation(
+			const pcl::PointCloud<PointT> & cloud_src,
+			const pcl::PointCloud<PointT> & cloud_tgt,
+			const pcl::Correspondences & correspondences,
+			Eigen::Matrix4f & transformation_matrix) const
+	{
+		typedef Eigen::Matrix<double, 6, 1> Vector6d;
+		typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+
+#ifdef _OPENMP
+		const int threads = omp_get_max_threads();
+#else
+		const int threads = 1;
+#endif
+		std::vector<Matrix6d, Eigen::aligned_allocator<Matrix6d> > partialATA(threads, Matrix6d::Zero());
+		std::vector<Vector6d, Eigen::aligned_allocator<Vector6d> > partialATb(threads, Vector6d::Zero());
+		const int size = (int)correspondences.size();
+		#pragma omp parallel num_threads(threads)
+		{
+			Matrix6d localATA = Matrix6d::Zero();
+			Vector6d localATb = Vector6d::Zero();
+			#pragma omp for schedule(static)
+			for(int i=0; i<size; ++i)
+			{
+				const PointT & src = cloud_src.points[correspondences[i].index_query];
+				const PointT & tgt = cloud_tgt.points[correspondences[i].index_match];
+				if(!uIsFinite(src.x) || !uIsFinite(src.y) || !uIsFinite(src.z) ||
+				   !uIsFinite(tgt.x) || !uIsFinite(tgt.y) || !uIsFinite(tgt.z) ||
+				   !uIsFinite(tgt.normal_x) || !uIsFinite(tgt.normal_y) || !uIsFinite(tgt.normal_z))
+				{
+					continue;
+				}
+
+				Vector6d row;
+				row[0] = tgt.normal_z*src.y - tgt.normal_y*src.z;
+				row[1] = tgt.normal_x*src.z - tgt.normal_z*src.x;
+				row[2] = tgt.normal_y*src.x - tgt.normal_x*src.y;
+				row[3] = tgt.normal_x;
+				row[4] = tgt.normal_y;
+				row[5] = tgt.normal_z;
+				double d = tgt.normal_x*(tgt.x-src.x) + tgt.normal_y*(tgt.y-src.y) + tgt.normal_z*(tgt.z-src.z);
+
+				localATA += row * row.transpose();
+				localATb += row * d;
+			}
+#ifdef _OPENMP
+			const int thread = omp_get_thread_num();
+#else
+			const int thread = 0;
+#endif
+			partialATA[thread] = localATA;
+			partialATb[thread] = localATb;
+		}
+
+		Matrix6d ATA = Matrix6d::Zero();
+		Vector6d ATb = Vector6d::Zero();
+		for(int i=0; i<threads; ++i)
+		{
+			ATA += partialATA[i];
+			ATb += partialATb[i];
+		}
+
+		Vector6d x = static_cast<Vector6d>(ATA.inverse() * ATb);
+		this->constructTransformationMatrix(x(0), x(1), x(2), x(3), x(4), x(5), transformation_matrix);
+	}
+};
+
 // Get transform from cloud2 to cloud1
 Transform transformFromXYZCorrespondencesSVD(
 	const pcl::PointCloud<pcl::PointXYZ> & cloud1,
@@ -243,16 +385,22 @@ void computeVarianceAndCorrespondences(
 		double maxCorrespondenceDistance,
 		double maxCorrespondenceAngle,
 		double & variance,
-		int & correspondencesOut)
+		int & correspondencesOut,
+		const pcl::search::KdTree<pcl::PointNormal>::Ptr & treeA)
 {
 	variance = 1;
 	correspondencesOut = 0;
-	pcl::registration::CorrespondenceEstimation<pcl::PointNormal, pcl::PointNormal>::Ptr est;
-	est.reset(new pcl::registration::CorrespondenceEstimation<pcl::PointNormal, pcl::PointNormal>);
+	CorrespondenceEstimationOMP<pcl::PointNormal>::Ptr est;
+	est.reset(new CorrespondenceEstimationOMP<pcl::PointNormal>);
 	const pcl::PointCloud<pcl::PointNormal>::ConstPtr & target = cloudA->size()>cloudB->size()?cloudA:cloudB;
 	const pcl::PointCloud<pcl::PointNormal>::ConstPtr & source = cloudA->size()>cloudB->size()?cloudB:cloudA;
 	est->setInputTarget(target);
 	est->setInputSource(source);
+	if(treeA.get() && cloudA->size()>cloudB->size())
+	{
+		UASSERT(treeA->getInputCloud().get() == cloudA.get());
+		est->setSearchMethodTarget(treeA, true);
+	}
 	pcl::Correspondences correspondences;
 	est->determineCorrespondences(correspondences, maxCorrespondenceDistance);
 
@@ -307,8 +455,8 @@ void computeVarianceAndCorrespondences(
 {
 	variance = 1;
 	correspondencesOut = 0;
-	pcl::registration::CorrespondenceEstimation<pcl::PointXYZ, pcl::PointXYZ>::Ptr est;
-	est.reset(new pcl::registration::CorrespondenceEstimation<pcl::PointXYZ, pcl::PointXYZ>);
+	CorrespondenceEstimationOMP<pcl::PointXYZ>::Ptr est;
+	est.reset(new CorrespondenceEstimationOMP<pcl::PointXYZ>);
 	est->setInputTarget(cloudA->size()>cloudB->size()?cloudA:cloudB);
 	est->setInputSource(cloudA->size()>cloudB->size()?cloudB:cloudA);
 	pcl::Correspondences correspondences;
@@ -339,12 +487,23 @@ Transform icp(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr & cloud_source,
 			  bool & hasConverged,
 			  pcl::PointCloud<pcl::PointXYZ> & cloud_source_registered,
 			  float epsilon,
-			  bool icp2D)
+			  bool icp2D,
+			  const pcl::search::KdTree<pcl::PointXYZ>::Ptr & treeTarget)
 {
 	pcl::IterativeClosestPoint<pcl::PointXYZ, pcl::PointXYZ> icp;
 	// Set the input source and target
 	icp.setInputTarget (cloud_target);
 	icp.setInputSource (cloud_source);
+	if(treeTarget.get())
+	{
+		// must be set after the target, which would force the tree to be rebuilt
+		UASSERT(treeTarget->getInputCloud().get() == cloud_target.get());
+		icp.setSearchMethodTarget(treeTarget, true);
+	}
+
+	// Nearest neighbor searches of each iteration are done in parallel
+	CorrespondenceEstimationOMP<pcl::PointXYZ>::Ptr ce(new CorrespondenceEstimationOMP<pcl::PointXYZ>);
+	icp.setCorrespondenceEstimation(ce);
 
 	if(icp2D)
 	{
@@ -378,15 +537,25 @@ Transform icpPointToPlane(
 		bool & hasConverged,
 		pcl::PointCloud<pcl::PointNormal> & cloud_source_registered,
 		float epsilon,
-		bool icp2D)
+		bool icp2D,
+		const pcl::search::KdTree<pcl::PointNormal>::Ptr & treeTarget)
 {
 	pcl::IterativeClosestPoint<pcl::PointNormal, pcl::PointNormal> icp;
 	// Set the input source and target
 	icp.setInputTarget (cloud_target);
 	icp.setInputSource (cloud_source);
+	if(treeTarget.get())
+	{
+		// must be set after the target, which would force the tree to be rebuilt
+		UASSERT(treeTarget->getInputCloud().get() == cloud_target.get());
+		icp.setSearchMethodTarget(treeTarget, true);
+	}
 
-	pcl::registration::TransformationEstimationPointToPlaneLLS<pcl::PointNormal, pcl::PointNormal>::Ptr est;
-	est.reset(new pcl::registration::TransformationEstimationPointToPlaneLLS<pcl::PointNormal, pcl::PointNormal>);
+	// Nearest neighbor searches and linear system accumulation of each iteration are done in parallel
+	CorrespondenceEstimationOMP<pcl::PointNormal>::Ptr ce(new CorrespondenceEstimationOMP<pcl::PointNormal>);
+	icp.setCorrespondenceEstimation(ce);
+	TransformationEstimationPointToPlaneLLSOMP<pcl::PointNormal>::Ptr est;
+	est.reset(new TransformationEstimationPointToPlaneLLSOMP<pcl::PointNormal>);
 	icp.setTransformationEstimation(est);
 
 	// Set the max correspondence distance to 5cm (e.g., correspondences with higher distances will be ignored)
@@ -0,0 +1,155 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <rtabmap/core/util3d_mapping.h>
+#include <rtabmap/core/util3d_transforms.h>
+#include <rtabmap/core/LaserScan.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <cmath>
+#include <cstdio>
+
+using namespace rtabmap;
+
+// Hits on an irregular wall around the sensor, and no hits in between (CV_32FC2).
+void createScan(int rays, int seed, cv::Mat & hits, cv::Mat & noHits)
+{
+	cv::RNG rng(seed);
+	hits = cv::Mat(1, rays, CV_32FC2);
+	noHits = cv::Mat(1, rays/4, CV_32FC2);
+	for(int i=0; i<rays; ++i)
+	{
+		float a = float(i)*2.0f*float(CV_PI)/float(rays);
+		float r = 3.0f + 0.8f*std::sin(5.0f*a) + rng.uniform(-0.2f, 0.2f);
+		hits.at<cv::Vec2f>(i) = cv::Vec2f(r*std::cos(a), r*std::sin(a));
+	}
+	for(int i=0; i<noHits.cols; ++i)
+	{
+		float a = rng.uniform(0.0f, 2.0f*float(CV_PI));
+		float r = rng.uniform(1.0f, 4.0f);
+		noHits.at<cv::Vec2f>(i) = cv::Vec2f(r*std::cos(a), r*std::sin(a));
+	}
+}
+
+// Same grid as create2DMap() (no unknown space filling and no max range),
+// tracing the rays one by one with rayTrace().
+cv::Mat create2DMapSequential(
+		const std::map<int, Transform> & poses,
+		const std::map<int, std::pair<cv::Mat, cv::Mat> > & scans,
+		float cellSize,
+		float xMin,
+		float yMin,
+		const cv::Size & size)
+{
+	cv::Mat map = cv::Mat::ones(size, CV_8S)*-1;
+	std::map<int, std::pair<cv::Mat, cv::Mat> > localScans;
+	for(std::map<int, Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+	{
+		const std::pair<cv::Mat, cv::Mat> & scan = scans.at(iter->first);
+		localScans.insert(std::make_pair(iter->first, std::make_pair(
+				util3d::transformLaserScan(LaserScan::backwardCompatibility(scan.first), iter->second).data(),
+				util3d::transformLaserScan(LaserScan::backwardCompatibility(scan.second), iter->second).data())));
+	}
+	for(std::map<int, std::pair<cv::Mat, cv::Mat> >::iterator iter=localScans.begin(); iter!=localScans.end(); ++iter)
+	{
+		const Transform & pose = poses.at(iter->first);
+		cv::Point2i start((pose.x()-xMin)/cellSize, (pose.y()-yMin)/cellSize);
+		for(int i=0; i<iter->second.first.cols; ++i)
+		{
+			const float * ptr = iter->second.first.ptr<float>(0, i);
+			cv::Point2i end((ptr[0]-xMin)/cellSize, (ptr[1]-yMin)/cellSize);
+			if(end!=start)
+			{
+				map.at<char>(end.y, end.x) = 100; // obstacle
+			}
+		}
+		for(int i=0; i<iter->second.first.cols; ++i)
+		{
+			const float * ptr = iter->second.first.ptr<float>(0, i);
+			cv::Point2i end((ptr[0]-xMin)/cellSize, (ptr[1]-yMin)/cellSize);
+			if(end!=start && (localScans.size() > 1 || map.at<char>(end.y, end.x) != 0))
+			{
+				util3d::rayTrace(start, end, map, true);
+			}
+		}
+		for(int i=0; i<iter->second.second.cols; ++i)
+		{
+			const float * ptr = iter->second.second.ptr<float>(0, i);
+			cv::Point2i end((ptr[0]-xMin)/cellSize, (ptr[1]-yMin)/cellSize);
+			if(end!=start && (localScans.size() > 1 || map.at<char>(end.y, end.x) != 0))
+			{
+				util3d::rayTrace(start, end, map, true);
+				if(map.at<char>(end.y, end.x) == -1)
+				{
+					map.at<char>(end.y, end.x) = 0; // empty
+				}
+			}
+		}
+	}
+	return map;
+}
+
+int compareMaps(const std::map<int, Transform> & poses, const std::map<int, std::pair<cv::Mat, cv::Mat> > & scans)
+{
+	const float cellSize = 0.05f;
+	float xMin, yMin;
+	cv::Mat map = util3d::create2DMap(poses, scans, std::map<int, cv::Point3f>(), cellSize, false, xMin, yMin);
+	cv::Mat expected = create2DMapSequential(poses, scans, cellSize, xMin, yMin, map.size());
+	cv::Mat diff;
+	cv::compare(map, expected, diff, cv::CMP_NE);
+	int differences = cv::countNonZero(diff);
+	printf("%d scan(s), grid %dx%d, free=%d, different cells=%d\n",
+			(int)scans.size(), map.cols, map.rows, cv::countNonZero(map==0), differences);
+	return differences;
+}
+
+// Rays traced in parallel (more than 1024 rays per scan) should give
+// the same grid than tracing them sequentially.
+int main(int argc, char * argv[])
+{
+	ULogger::setType(ULogger::kTypeConsole);
+	ULogger::setLevel(ULogger::kWarning);
+
+	int errors = 0;
+
+	std::map<int, Transform> poses;
+	std::map<int, std::pair<cv::Mat, cv::Mat> > scans;
+	cv::Mat hits, noHits;
+
+	// single scan, rays with an end already free are skipped
+	createScan(4000, 1, hits, noHits);
+	poses.insert(std::make_pair(1, Transform::getIdentity()));
+	scans.insert(std::make_pair(1, std::make_pair(hits, noHits)));
+	errors += compareMaps(poses, scans);
+
+	// multiple scans
+	createScan(3000, 2, hits, noHits);
+	poses.insert(std::make_pair(2, Transform(1.0f, 0.5f, 0.0f, 0.0f, 0.0f, 0.3f)));
+	scans.insert(std::make_pair(2, std::make_pair(hits, noHits)));
+	errors += compareMaps(poses, scans);
+
+	return errors == 0?0:1;
+}
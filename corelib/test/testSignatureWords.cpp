@@ -0,0 +1,206 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <rtabmap/core/Signature.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <cstdio>
+
+using namespace rtabmap;
+
+std::multimap<int, cv::KeyPoint> createWords(const int * ids, int size)
+{
+	std::multimap<int, cv::KeyPoint> words;
+	for(int i=0; i<size; ++i)
+	{
+		words.insert(std::make_pair(ids[i], cv::KeyPoint(float(i), 0.0f, 1.0f)));
+	}
+	return words;
+}
+
+std::multimap<int, cv::Point3f> createWords3(const int * ids, int size)
+{
+	std::multimap<int, cv::Point3f> words3;
+	for(int i=0; i<size; ++i)
+	{
+		words3.insert(std::make_pair(ids[i], cv::Point3f(float(i), 0.0f, 0.0f)));
+	}
+	return words3;
+}
+
+std::multimap<int, cv::Mat> createDescriptors(const int * ids, int size)
+{
+	std::multimap<int, cv::Mat> descriptors;
+	for(int i=0; i<size; ++i)
+	{
+		cv::Mat d(1, 32, CV_8UC1);
+		for(int j=0; j<d.cols; ++j)
+		{
+			d.at<unsigned char>(0, j) = (unsigned char)i;
+		}
+		descriptors.insert(std::make_pair(ids[i], d));
+	}
+	return descriptors;
+}
+
+// Keypoint, point and descriptor of each word are still at the same index
+bool isConsistent(const Signature & s)
+{
+	const std::vector<int> & ids = s.getWordIds();
+	for(unsigned int i=0; i<ids.size(); ++i)
+	{
+		if(i>0 && ids[i-1] > ids[i])
+		{
+			return false;
+		}
+		float x = s.getWordKeypoints()[i].pt.x;
+		if(!s.getWordPoints3().empty() && s.getWordPoints3()[i].x != x)
+		{
+			return false;
+		}
+		if(!s.getWordDescriptorsMat().empty() && s.getWordDescriptorsMat().at<unsigned char>(i, 31) != (unsigned char)x)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+#define CHECK(cond) \
+	if(!(cond)) \
+	{ \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		++errors; \
+	}
+
+// Words of a signature stored as parallel arrays sorted by id, and
+// the multimaps returned by the compatibility accessors.
+int main(int argc, char * argv[])
+{
+	ULogger::setType(ULogger::kTypeConsole);
+	ULogger::setLevel(ULogger::kWarning);
+
+	int errors = 0;
+	const int ids[] = {5, 2, 7, 2, 0, 9};
+	const int size = 6;
+
+	// set from multimaps
+	{
+		Signature s(1);
+		s.setWords(createWords(ids, size));
+		s.setWords3(createWords3(ids, size));
+		s.setWordsDescriptors(createDescriptors(ids, size));
+		CHECK(s.getWordIds().size() == 6 && s.getWordIds()[0] == 0 && s.getWordIds()[5] == 9);
+		CHECK(s.getWordPoints3().size() == 6 && s.getWordDescriptorsMat().rows == 6);
+		CHECK(isConsistent(s));
+		CHECK(s.getInvalidWordsCount() == 1);
+		CHECK(s.getWords().size() == 6 && s.getWords().count(2) == 2);
+		CHECK(s.getWords3().size() == 6 && s.getWordsDescriptors().size() == 6);
+		CHECK(s.getWords().find(7)->second.pt.x == s.getWords3().find(7)->second.x);
+
+		// a component with other ids replaces the words
+		const int otherIds[] = {3, 4};
+		s.setWords3(createWords3(otherIds, 2));
+		CHECK(s.getWordIds().size() == 2 && s.getWordKeypoints().empty() && s.getWordDescriptorsMat().empty());
+		CHECK(s.isBadSignature());
+		s.setWords3(std::multimap<int, cv::Point3f>());
+		CHECK(s.getWordIds().empty());
+	}
+
+	// set from arrays, not sorted
+	{
+		Signature s(1);
+		std::vector<int> wordIds(ids, ids+size);
+		std::vector<cv::KeyPoint> kpts;
+		cv::Mat descriptors(size, 32, CV_8UC1);
+		for(int i=0; i<size; ++i)
+		{
+			kpts.push_back(cv::KeyPoint(float(i), 0.0f, 1.0f));
+			for(int j=0; j<descriptors.cols; ++j)
+			{
+				descriptors.at<unsigned char>(i, j) = (unsigned char)i;
+			}
+		}
+		s.setWords(wordIds, kpts, std::vector<cv::Point3f>(), descriptors);
+		CHECK(s.getWordIds().size() == 6 && s.getWordPoints3().empty());
+		CHECK(isConsistent(s));
+		CHECK(s.getWords3().empty());
+	}
+
+	// views are kept up to date and are not shared by copies
+	{
+		Signature s(1);
+		s.setWords(createWords(ids, size));
+		const std::multimap<int, cv::KeyPoint> & words = s.getWords();
+		CHECK(words.size() == 6);
+		s.removeWord(2);
+		CHECK(words.size() == 4 && words.count(2) == 0);
+		CHECK(s.getWordIds().size() == 4);
+
+		Signature copy = s;
+		s.removeAllWords();
+		CHECK(words.empty());
+		CHECK(copy.getWords().size() == 4);
+	}
+
+	// change references
+	{
+		Signature s(1);
+		s.setWords(createWords(ids, size));
+		s.setWords3(createWords3(ids, size));
+		s.setWordsDescriptors(createDescriptors(ids, size));
+		const std::multimap<int, cv::Mat> & descriptors = s.getWordsDescriptors();
+		std::map<int, int> refs;
+		refs.insert(std::make_pair(0, 8));
+		refs.insert(std::make_pair(9, 1));
+		refs.insert(std::make_pair(4, 6)); // not in the signature
+		s.changeWordsRef(refs);
+		CHECK(s.getWordIds()[0] == 1 && s.getWordIds()[5] == 8);
+		CHECK(isConsistent(s));
+		CHECK(s.getInvalidWordsCount() == 0);
+		CHECK(s.getWordsChanged().size() == 2);
+		CHECK(descriptors.count(9) == 0 && descriptors.count(1) == 1);
+		s.changeWordsRef(7, 2);
+		CHECK(s.getWords().count(2) == 3 && s.getWords().count(7) == 0);
+		CHECK(isConsistent(s));
+	}
+
+	// similarity
+	{
+		const int idsA[] = {1, 2, 3, 4, 6, 6};
+		const int idsB[] = {1, 1, 2, 4, 5, 6, 6};
+		Signature a(1);
+		Signature b(2);
+		a.setWords(createWords(idsA, 6));
+		b.setWords(createWords(idsB, 7));
+		CHECK(a.compareTo(b) == 5.0f/7.0f);
+		CHECK(b.compareTo(a) == 5.0f/7.0f);
+		CHECK(a.compareTo(Signature(3)) == 0.0f);
+	}
+
+	printf("%d errors\n", errors);
+	return errors == 0?0:1;
+}
@@ -0,0 +1,121 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <rtabmap/core/Rtabmap.h>
+#include <rtabmap/core/Parameters.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UStl.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <cmath>
+#include <cstdio>
+
+using namespace rtabmap;
+
+// Textured synthetic image, the same place always gives the same image
+cv::Mat createPlaceImage(int place)
+{
+	cv::RNG rng(place+1);
+	cv::Mat image(480, 640, CV_8UC1, cv::Scalar(rng.uniform(0, 255)));
+	for(int i=0; i<80; ++i)
+	{
+		cv::Point pt(rng.uniform(0, image.cols), rng.uniform(0, image.rows));
+		cv::Scalar color(rng.uniform(0, 255));
+		if(i%2==0)
+		{
+			cv::rectangle(image, pt, pt+cv::Point(rng.uniform(5, 60), rng.uniform(5, 60)), color, -1);
+		}
+		else
+		{
+			cv::circle(image, pt, rng.uniform(3, 30), color, -1);
+		}
+	}
+	return image;
+}
+
+// Sparse and dense prediction models should give the same posterior.
+int main(int argc, char * argv[])
+{
+	ULogger::setType(ULogger::kTypeConsole);
+	ULogger::setLevel(ULogger::kWarning);
+
+	ParametersMap parameters;
+	parameters.insert(ParametersPair(Parameters::kKpDetectorStrategy(), "2")); // ORB
+	parameters.insert(ParametersPair(Parameters::kMemSTMSize(), "3"));
+
+	Rtabmap dense;
+	Rtabmap sparse;
+	uInsert(parameters, ParametersPair(Parameters::kBayesSparsePrediction(), "false"));
+	dense.init(parameters);
+	uInsert(parameters, ParametersPair(Parameters::kBayesSparsePrediction(), "true"));
+	sparse.init(parameters);
+
+	// go forward, then revisit some places
+	std::vector<int> places;
+	for(int i=0; i<20; ++i)
+	{
+		places.push_back(i);
+	}
+	for(int i=3; i<13; ++i)
+	{
+		places.push_back(i);
+	}
+
+	int errors = 0;
+	int compared = 0;
+	for(unsigned int i=0; i<places.size(); ++i)
+	{
+		cv::Mat image = createPlaceImage(places[i]);
+		dense.process(image);
+		sparse.process(image);
+
+		const std::map<int, float> & posteriorDense = dense.getStatistics().posterior();
+		const std::map<int, float> & posteriorSparse = sparse.getStatistics().posterior();
+		if(posteriorDense.size() != posteriorSparse.size())
+		{
+			printf("Iteration %d: posterior sizes differ (dense=%d sparse=%d)\n",
+					i, (int)posteriorDense.size(), (int)posteriorSparse.size());
+			++errors;
+			continue;
+		}
+		for(std::map<int, float>::const_iterator iter=posteriorDense.begin(); iter!=posteriorDense.end(); ++iter)
+		{
+			std::map<int, float>::const_iterator jter = posteriorSparse.find(iter->first);
+			if(jter == posteriorSparse.end() || std::fabs(jter->second - iter->second) > 1e-4f)
+			{
+				printf("Iteration %d: posterior of %d differs (dense=%f sparse=%f)\n",
+						i, iter->first, iter->second, jter == posteriorSparse.end()?-1.0f:jter->second);
+				++errors;
+			}
+			++compared;
+		}
+	}
+	dense.close(false);
+	sparse.close(false);
+
+	printf("Compared %d posterior values, %d errors\n", compared, errors);
+	return errors == 0 && compared > 0?0:1;
+}
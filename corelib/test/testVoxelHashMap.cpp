@@ -0,0 +1,224 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <rtabmap/core/VoxelHashMap.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace rtabmap;
+
+pcl::PointNormal createPoint(float x, float y, float z)
+{
+	pcl::PointNormal pt;
+	pt.x = x;
+	pt.y = y;
+	pt.z = z;
+	pt.normal_x = 0.0f;
+	pt.normal_y = 0.0f;
+	pt.normal_z = 1.0f;
+	return pt;
+}
+
+// Points of a line along x, one every "step" meters.
+pcl::PointCloud<pcl::PointNormal> createLine(float start, float step, int size)
+{
+	pcl::PointCloud<pcl::PointNormal> cloud;
+	for(int i=0; i<size; ++i)
+	{
+		cloud.push_back(createPoint(start+float(i)*step, 0.0f, 0.0f));
+	}
+	return cloud;
+}
+
+bool contains(const pcl::PointCloud<pcl::PointNormal> & cloud, float x)
+{
+	for(unsigned int i=0; i<cloud.size(); ++i)
+	{
+		if(std::fabs(cloud.at(i).x - x) < 0.0001f)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+#define CHECK(cond) \
+	if(!(cond)) \
+	{ \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		++errors; \
+	}
+
+// Index of the nearest point not farther than maxDistance (brute force)
+int bruteForceNearest(const pcl::PointCloud<pcl::PointNormal> & cloud, const pcl::PointNormal & pt, float maxDistance)
+{
+	int best = -1;
+	float bestSqr = maxDistance*maxDistance;
+	for(unsigned int i=0; i<cloud.size(); ++i)
+	{
+		const pcl::PointNormal & p = cloud.at(i);
+		float d = (p.x-pt.x)*(p.x-pt.x) + (p.y-pt.y)*(p.y-pt.y) + (p.z-pt.z)*(p.z-pt.z);
+		if(d < bestSqr || (best < 0 && d == bestSqr))
+		{
+			best = i;
+			bestSqr = d;
+		}
+	}
+	return best;
+}
+
+float randomCoordinate()
+{
+	return float(rand()%2000)/1000.0f - 1.0f;
+}
+
+// Insertion, eviction and nearest neighbor search of the voxel hash map.
+int main(int argc, char * argv[])
+{
+	ULogger::setType(ULogger::kTypeConsole);
+	ULogger::setLevel(ULogger::kWarning);
+
+	int errors = 0;
+
+	// insert: one point per voxel, the first point added stays in the voxel
+	{
+		VoxelHashMap map(0.1f, 100);
+		CHECK(map.insert(createLine(0.01f, 0.02f, 5)) == 1); // 0.01 to 0.09
+		CHECK(map.insert(createLine(0.05f, 0.1f, 3)) == 2); // 0.05 (same voxel), 0.15, 0.25
+		CHECK(map.size() == 3);
+		pcl::PointCloud<pcl::PointNormal>::Ptr cloud = map.getCloud();
+		CHECK((int)cloud->size() == map.size());
+		CHECK(contains(*cloud, 0.01f) && !contains(*cloud, 0.05f));
+
+		// points on each side of a voxel border
+		CHECK(map.insert(createLine(-0.001f, 0.002f, 2)) == 1); // -0.001 (new voxel), 0.001 (first voxel)
+		CHECK(map.size() == 4);
+
+		// the map is full
+		VoxelHashMap small(0.1f, 10);
+		CHECK(small.insert(createLine(0.05f, 0.1f, 20)) == 10);
+		CHECK(small.size() == 10);
+		small.clear();
+		CHECK(small.size() == 0 && small.getCloud()->empty());
+	}
+
+	// evict: far voxels are removed, then the oldest to make room
+	{
+		VoxelHashMap map(0.1f, 10);
+		map.insert(createLine(0.05f, 0.1f, 3)); // 0.05 to 0.25, older
+		map.insert(createLine(0.35f, 0.1f, 7)); // 0.35 to 0.95
+		CHECK(map.size() == 10);
+
+		// 3 new voxels, 1 already in the map
+		CHECK(map.evict(Eigen::Vector3f(0,0,0), 0.0f, createLine(0.95f, 0.1f, 4)) == 3);
+		CHECK(map.size() == 7);
+		pcl::PointCloud<pcl::PointNormal>::Ptr cloud = map.getCloud();
+		CHECK(!contains(*cloud, 0.05f) && !contains(*cloud, 0.25f));
+		CHECK(contains(*cloud, 0.35f) && contains(*cloud, 0.95f));
+		// remaining voxels can still be found
+		CHECK(map.insert(*cloud) == 0);
+		CHECK(map.insert(createLine(0.95f, 0.1f, 4)) == 3);
+		CHECK(map.size() == 10);
+
+		// range only
+		CHECK(map.evict(Eigen::Vector3f(0,0,0), 0.5f) == 8);
+		CHECK(map.size() == 2);
+		cloud = map.getCloud();
+		CHECK(contains(*cloud, 0.35f) && contains(*cloud, 0.45f));
+
+		// more incoming voxels than the capacity
+		CHECK(map.evict(Eigen::Vector3f(0,0,0), 0.0f, createLine(10.05f, 0.1f, 20)) == 2);
+		CHECK(map.size() == 0);
+	}
+
+	// evict many voxels colliding in the table, all remaining voxels must be found
+	{
+		VoxelHashMap map(0.01f, 1000);
+		pcl::PointCloud<pcl::PointNormal> cloud;
+		for(int i=0; i<1000; ++i)
+		{
+			cloud.push_back(createPoint(float(i%10)*0.01f+0.005f, float((i/10)%10)*0.01f+0.005f, float(i/100)*0.01f+0.005f));
+		}
+		CHECK(map.insert(cloud) == 1000);
+		CHECK(map.evict(Eigen::Vector3f(0.05f,0.05f,0.05f), 0.03f) > 0);
+		CHECK(map.size() > 0);
+		CHECK(map.insert(*map.getCloud()) == 0);
+		int remaining = map.size();
+		CHECK(map.insert(cloud) == 1000-remaining);
+		CHECK(map.size() == 1000);
+	}
+
+	// nearest: same point than a brute force search in the last cloud returned
+	{
+		srand(42);
+		VoxelHashMap map(0.05f, 5000);
+		pcl::PointCloud<pcl::PointNormal> points;
+		for(int i=0; i<3000; ++i)
+		{
+			points.push_back(createPoint(randomCoordinate(), randomCoordinate(), randomCoordinate()*0.1f));
+		}
+		map.insert(points);
+		pcl::PointCloud<pcl::PointNormal>::Ptr cloud = map.getCloud();
+		CHECK(map.nearest(cloud->at(10), 0.001f) == 10);
+		int mismatches = 0;
+		for(int i=0; i<1000; ++i)
+		{
+			pcl::PointNormal pt = createPoint(randomCoordinate(), randomCoordinate(), randomCoordinate()*0.1f);
+			float maxDistance = i%2==0?0.03f:0.12f;
+			float d = -1.0f;
+			int j = map.nearest(pt, maxDistance, &d);
+			if(j != bruteForceNearest(*cloud, pt, maxDistance))
+			{
+				++mismatches;
+			}
+			else if(j >= 0)
+			{
+				const pcl::PointNormal & p = cloud->at(j);
+				CHECK(std::fabs(d - ((p.x-pt.x)*(p.x-pt.x) + (p.y-pt.y)*(p.y-pt.y) + (p.z-pt.z)*(p.z-pt.z))) < 1e-6f);
+			}
+		}
+		CHECK(mismatches == 0);
+		CHECK(map.nearest(createPoint(5.0f, 5.0f, 5.0f), 0.1f) == -1);
+
+		// voxels added after getCloud() are ignored
+		pcl::PointCloud<pcl::PointNormal> far;
+		far.push_back(createPoint(3.0f, 3.0f, 3.0f));
+		CHECK(map.insert(far) == 1);
+		CHECK(map.nearest(far.at(0), 0.1f) == -1);
+
+		// remapped indices, voxels remapped to -1 are ignored
+		std::vector<int> remap(cloud->size(), -1);
+		remap[10] = 0;
+		CHECK(map.nearest(cloud->at(10), 0.01f, 0, &remap) == 0);
+		CHECK(map.nearest(cloud->at(11), 0.01f, 0, &remap) == -1);
+	}
+
+	printf("%d errors\n", errors);
+	return errors == 0?0:1;
+}
@@ -146,9 +146,9 @@ PreferencesDialog::PreferencesDialog(QWidget * parent) :
 		_ui->checkBox_ORBGpu->setEnabled(false);
 		_ui->label_orbGpu->setEnabled(false);
 
-		// remove BruteForceGPU option
-		_ui->comboBox_dictionary_strategy->removeItem(4);
-		_ui->reextract_nn->removeItem(4);
+		// disable BruteForceGPU option (items after it keep their index)
+		qobject_cast<QStandardItemModel*>(_ui->comboBox_dictionary_strategy->model())->item(4)->setEnabled(false);
+		qobject_cast<QStandardItemModel*>(_ui->reextract_nn->model())->item(4)->setEnabled(false);
 	}
 
 #ifndef RTABMAP_OCTOMAP